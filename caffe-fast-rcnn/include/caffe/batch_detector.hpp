@@ -0,0 +1,114 @@
+#ifndef CAFFE_BATCH_DETECTOR_HPP_
+#define CAFFE_BATCH_DETECTOR_HPP_
+
+#include <string>
+#include <vector>
+
+#include "caffe/blob.hpp"
+#include "caffe/common.hpp"
+#include "caffe/net.hpp"
+
+namespace caffe {
+
+/**
+ * @brief Runs a Fast or Faster R-CNN test net on many images at a time, as
+ *        lib/fast_rcnn/test.py::im_detect does on one.
+ *
+ * The images are grouped into buckets by their size rounded up to a
+ * multiple of bucket_step, and up to max_batch images of a bucket are padded
+ * into one "data" blob and go through a single forward pass. The net tells
+ * the images apart by the batch index of the rois: a Faster R-CNN net gets
+ * a row of "im_info" per image, which the Proposal layer carries into its
+ * rois, and a Fast R-CNN net gets its "rois" input built from the proposals
+ * of each image. The outputs are then split back by that batch index.
+ *
+ * Buckets run from the largest to the smallest, so the blobs of the net
+ * are sized by the first forward pass and later ones do not reallocate.
+ */
+template <typename Dtype>
+class BatchDetector {
+ public:
+  /// @brief One image to detect objects in.
+  struct Image {
+    Image() : data(NULL), height(0), width(0), scale(1), im_height(0),
+        im_width(0), boxes(NULL), num_boxes(0) {}
+
+    /// height x width x channels pixels, interleaved as OpenCV stores them,
+    /// mean subtracted and resized by scale.
+    const Dtype* data;
+    int height;
+    int width;
+    Dtype scale;
+    /// The size of the original image, which the boxes are clipped to.
+    int im_height;
+    int im_width;
+    /// num_boxes x 4 proposals in the original image, for the nets without
+    /// an RPN.
+    const Dtype* boxes;
+    int num_boxes;
+  };
+
+  /// @brief The detections of one image, as im_detect returns them.
+  struct Detections {
+    /// R x K class scores.
+    Blob<Dtype> scores;
+    /// R x 4K boxes of each class, in the original image.
+    Blob<Dtype> boxes;
+  };
+
+  BatchDetector(const shared_ptr<Net<Dtype> >& net, int max_batch,
+      int bucket_step);
+
+  /// @brief Use the raw scores of the named blob, e.g. "cls_score" for the
+  ///        nets trained as linear SVMs, instead of "cls_prob".
+  void set_score_blob(const string& name) { score_blob_ = name; }
+  /// @brief Whether to apply the "bbox_pred" deltas to the boxes (default);
+  ///        without, each class gets the roi itself.
+  void set_bbox_reg(bool bbox_reg) { bbox_reg_ = bbox_reg; }
+  int channels() const { return data_->channels(); }
+  int max_batch() const { return max_batch_; }
+  int bucket_step() const { return bucket_step_; }
+  /// @brief The forward passes run so far.
+  int num_forwards() const { return num_forwards_; }
+
+  /// @brief Detect objects in all the images; detections gets one entry per
+  ///        image, in order.
+  void Detect(const vector<Image>& images,
+      vector<shared_ptr<Detections> >* detections);
+
+  /**
+   * @brief Keeps the detections of each class scoring above thresh, applies
+   *        NMS to each class, and then keeps the max_per_image (0: all) best
+   *        over all the classes, as test_net does.
+   *
+   * @param class_dets receives for each class but the background one, i.e.
+   *        for classes 1 to K - 1, its detections as rows of (x1, y1, x2,
+   *        y2, score) by decreasing score
+   */
+  static void Suppress(const Detections& detections, Dtype thresh,
+      Dtype nms_thresh, int max_per_image,
+      vector<vector<Dtype> >* class_dets);
+
+ protected:
+  /// Run one forward pass on images[batch[i]], padded to height x width.
+  void DetectBatch(const vector<Image>& images, const vector<int>& batch,
+      int height, int width, vector<shared_ptr<Detections> >* detections);
+
+  shared_ptr<Net<Dtype> > net_;
+  int max_batch_;
+  int bucket_step_;
+  string score_blob_;
+  bool bbox_reg_;
+  int num_forwards_;
+  Blob<Dtype>* data_;
+  /// NULL for the nets without an RPN.
+  Blob<Dtype>* im_info_;
+  /// The input rois; NULL for the nets with an RPN.
+  Blob<Dtype>* rois_;
+
+  DISABLE_COPY_AND_ASSIGN(BatchDetector);
+};
+
+}  // namespace caffe
+
+#endif  // CAFFE_BATCH_DETECTOR_HPP_
@@ -24,7 +24,7 @@ template <typename Dtype>
 class Blob {
  public:
   Blob()
-       : data_(), diff_(), count_(0), capacity_(0) {}
+       : data_(), diff_(), count_(0), capacity_(0), zero_fill_(true) {}
 
   /// @brief Deprecated; use <code>Blob(const vector<int>& shape)</code>.
   explicit Blob(const int num, const int channels, const int height,
@@ -42,7 +42,10 @@ class Blob {
    * of memory, and to adjust the dimensions of a top blob during Layer::Reshape
    * or Layer::Forward. When changing the size of blob, memory will only be
    * reallocated if sufficient memory does not already exist, and excess memory
-   * will never be freed.
+   * will never be freed. The first allocation fits the blob exactly; when a
+   * blob outgrows it, the new memory has a quarter more room than the old,
+   * so that blobs whose size changes with every input (e.g. with the image
+   * size or the number of rois) soon stop reallocating.
    *
    * Note that reshaping an input blob and immediately calling Net::Backward is
    * an error; either Net::Forward or Net::Reshape need to be called to
@@ -73,6 +76,8 @@ class Blob {
   }
   inline int num_axes() const { return shape_.size(); }
   inline int count() const { return count_; }
+  /// @brief The number of elements the memory of the blob can hold.
+  inline int capacity() const { return capacity_; }
 
   /**
    * @brief Compute the volume of a slice; i.e., the product of dimensions
@@ -262,6 +267,24 @@ class Blob {
    * shared_ptr calls its destructor when reset with the "=" operator.
    */
   void ShareDiff(const Blob& other);
+  /**
+   * @brief Set the data_ shared_ptr to point to memory, which may be larger
+   *        than this Blob -- used by Net to pack Blob%s that are not in use
+   *        at the same time into one buffer.
+   *
+   * The Blob keeps memory as long as it is reshaped to fit in it. Its diff
+   * is reallocated to the new capacity, and its data is left as it is.
+   */
+  void ShareDataMemory(const shared_ptr<SyncedMemory>& memory);
+  /**
+   * @brief Whether new data memory is zeroed when first used (the default).
+   *
+   * Turn it off for blobs that are always written before they are read,
+   * such as layer tops, to save a memset of every (re)allocation; their
+   * data then holds garbage until written. The diff is always zeroed.
+   */
+  void set_zero_fill(bool zero_fill);
+  bool zero_fill() const { return zero_fill_; }
 
   bool ShapeEquals(const BlobProto& other);
 
@@ -272,6 +295,7 @@ class Blob {
   vector<int> shape_;
   int count_;
   int capacity_;
+  bool zero_fill_;
 
   DISABLE_COPY_AND_ASSIGN(Blob);
 };  // class Blob
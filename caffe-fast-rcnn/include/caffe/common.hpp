@@ -158,6 +158,24 @@ class Caffe {
   inline static void set_solver_count(int val) { Get().solver_count_ = val; }
   inline static bool root_solver() { return Get().root_solver_; }
   inline static void set_root_solver(bool val) { Get().root_solver_ = val; }
+  // The bytes of host and device memory SyncedMemory allocated on this
+  // thread, which a ProfileScope reads at its start and end.
+  inline static size_t allocated_bytes() { return Get().allocated_bytes_; }
+  inline static void count_allocation(size_t size) {
+    Get().allocated_bytes_ += size;
+  }
+  // The bytes SyncedMemory zeroed on first use, and the times a Blob
+  // outgrew its memory and replaced it, on this thread.
+  inline static size_t zeroed_bytes() { return Get().zeroed_bytes_; }
+  inline static void count_zeroed(size_t size) {
+    Get().zeroed_bytes_ += size;
+  }
+  inline static size_t blob_reallocations() {
+    return Get().blob_reallocations_;
+  }
+  inline static void count_blob_reallocation() {
+    ++Get().blob_reallocations_;
+  }
 
  protected:
 #ifndef CPU_ONLY
@@ -169,6 +187,9 @@ class Caffe {
   Brew mode_;
   int solver_count_;
   bool root_solver_;
+  size_t allocated_bytes_;
+  size_t zeroed_bytes_;
+  size_t blob_reallocations_;
 
  private:
   // The private constructor to avoid duplicate instantiation.
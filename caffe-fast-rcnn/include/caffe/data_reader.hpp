@@ -8,6 +8,7 @@
 #include "caffe/common.hpp"
 #include "caffe/internal_thread.hpp"
 #include "caffe/util/blocking_queue.hpp"
+#include "caffe/util/lock_free_queue.hpp"
 #include "caffe/util/db.hpp"
 
 namespace caffe {
@@ -19,16 +20,21 @@ namespace caffe {
  * databases are read sequentially, and that each solver accesses a different
  * subset of the database. Data is distributed to solvers in a round-robin
  * way to keep parallel training deterministic.
+ *
+ * With data_param.reader_threads > 1, the source is read by that many shard
+ * threads, each parsing every reader_threads-th record through its own cursor.
+ * Records are then taken from the shards in turn, which gives the same order
+ * as a single reader, unless data_param.deterministic is false.
  */
 class DataReader {
  public:
   explicit DataReader(const LayerParameter& param);
   ~DataReader();
 
-  inline BlockingQueue<Datum*>& free() const {
+  inline LockFreeQueue<Datum*>& free() const {
     return queue_pair_->free_;
   }
-  inline BlockingQueue<Datum*>& full() const {
+  inline LockFreeQueue<Datum*>& full() const {
     return queue_pair_->full_;
   }
 
@@ -39,12 +45,32 @@ class DataReader {
     explicit QueuePair(int size);
     ~QueuePair();
 
-    BlockingQueue<Datum*> free_;
-    BlockingQueue<Datum*> full_;
+    LockFreeQueue<Datum*> free_;
+    LockFreeQueue<Datum*> full_;
 
   DISABLE_COPY_AND_ASSIGN(QueuePair);
   };
 
+  // Reads records index, index + count, ... of a source, wrapping around
+  class Shard : public InternalThread {
+   public:
+    Shard(db::Cursor* cursor, int index, int count, int size);
+    virtual ~Shard();
+
+    QueuePair queue_pair_;
+
+   protected:
+    void InternalThreadEntry();
+    // Move the cursor count records ahead
+    void skip(int count);
+
+    shared_ptr<db::Cursor> cursor_;
+    const int index_;
+    const int count_;
+
+  DISABLE_COPY_AND_ASSIGN(Shard);
+  };
+
   // A single body is created per source
   class Body : public InternalThread {
    public:
@@ -54,9 +80,13 @@ class DataReader {
    protected:
     void InternalThreadEntry();
     void read_one(db::Cursor* cursor, QueuePair* qp);
+    // Take the next parsed datum from the shards
+    void read_one_sharded(QueuePair* qp);
 
     const LayerParameter param_;
     BlockingQueue<shared_ptr<QueuePair> > new_queue_pairs_;
+    vector<shared_ptr<Shard> > shards_;
+    int next_shard_;
 
     friend class DataReader;
 
@@ -46,6 +46,10 @@ class DataTransformer {
    * @param transformed_blob
    *    This is destination blob. It can be part of top blob's data if
    *    set_cpu_data() is used. See memory_layer.cpp for an example.
+   *
+   * The random crops and mirrors are drawn in order, as for a sequence of
+   * single transforms, and the items are then transformed in parallel with
+   * OpenMP.
    */
   void Transform(const vector<Datum> & datum_vector,
                 Blob<Dtype>* transformed_blob);
@@ -60,6 +64,8 @@ class DataTransformer {
    * @param transformed_blob
    *    This is destination blob. It can be part of top blob's data if
    *    set_cpu_data() is used. See memory_layer.cpp for an example.
+   *
+   * As for a vector of Datum, the items are transformed in parallel.
    */
   void Transform(const vector<cv::Mat> & mat_vector,
                 Blob<Dtype>* transformed_blob);
@@ -75,6 +81,15 @@ class DataTransformer {
    *    set_cpu_data() is used. See image_data_layer.cpp for an example.
    */
   void Transform(const cv::Mat& cv_img, Blob<Dtype>* transformed_blob);
+
+  /**
+   * @brief Decodes an encoded Datum to a cv::Mat, in color or gray as
+   *    set by force_color and force_gray, as Transform does for it.
+   *
+   * @param datum
+   *    Datum containing the encoded image.
+   */
+  cv::Mat DecodeDatum(const Datum& datum);
 #endif  // USE_OPENCV
 
   /**
@@ -138,7 +153,27 @@ class DataTransformer {
    */
   virtual int Rand(int n);
 
+  // The random choices of a transform, drawn before the data is transformed
+  // so that the items of a batch can be transformed in parallel.
+  struct CropMirror {
+    int h_off;
+    int w_off;
+    bool mirror;
+  };
+  CropMirror RandCropMirror(int height, int width);
+  // Check the mean against the input shape, and replicate a single
+  // mean_value over the channels.
+  void CheckMean(int channels, int height, int width);
+
   void Transform(const Datum& datum, Dtype* transformed_data);
+  // Transform without drawing random numbers or changing the mean; safe to
+  // call from several threads.
+  void Transform(const Datum& datum, const CropMirror& crop_mirror,
+      Dtype* transformed_data);
+#ifdef USE_OPENCV
+  void Transform(const cv::Mat& cv_img, const CropMirror& crop_mirror,
+      Dtype* transformed_data);
+#endif  // USE_OPENCV
   // Tranformation parameters
   TransformationParameter param_;
 
@@ -55,6 +55,9 @@ class ROIPoolingLayer : public Layer<Dtype> {
   int pooled_width_;
   Dtype spatial_scale_;
   Blob<int> max_idx_;
+  /// bottom[0] transposed to N x H x W x C, so that Forward_cpu can take
+  /// the max of all the channels of a bin at once.
+  Blob<Dtype> bottom_hwc_;
 };
 
 template <typename Dtype>
@@ -99,6 +102,130 @@ class SmoothL1LossLayer : public LossLayer<Dtype> {
   Dtype sigma2_;
 };
 
+/* ProposalLayer - Outputs object detection proposals by applying estimated
+   bounding-box transformations to a set of regular boxes (called "anchors").
+   A native port of lib/rpn/proposal_layer.py, which also takes batches of
+   images padded to one size: each image gets its own proposals, clipped to
+   its own height and width, and the rois of image n carry batch index n.
+
+   bottom[0]: N x 2A x H x W rpn_cls_prob_reshape (bg scores, then fg scores)
+   bottom[1]: N x 4A x H x W rpn_bbox_pred
+   bottom[2]: N x 3 im_info (height, width, scale) of each image
+   top[0]: R x 5 rois (batch index, x1, y1, x2, y2), ordered by image
+   top[1]: R x 1 scores (optional)
+*/
+template <typename Dtype>
+class ProposalLayer : public Layer<Dtype> {
+ public:
+  explicit ProposalLayer(const LayerParameter& param)
+      : Layer<Dtype>(param) {}
+  virtual void LayerSetUp(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top);
+  virtual void Reshape(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top);
+
+  virtual inline const char* type() const { return "Proposal"; }
+
+  virtual inline int ExactNumBottomBlobs() const { return 3; }
+  virtual inline int MinTopBlobs() const { return 1; }
+  virtual inline int MaxTopBlobs() const { return 2; }
+
+ protected:
+  virtual void Forward_cpu(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top);
+  virtual void Backward_cpu(const vector<Blob<Dtype>*>& top,
+      const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom) {}
+
+  int feat_stride_;
+  int pre_nms_topn_;
+  int post_nms_topn_;
+  Dtype nms_thresh_;
+  int min_size_;
+  /// num_anchors x 4 anchors of the cell at (0, 0)
+  vector<Dtype> anchors_;
+  /// H x W x A x 4 decoded and clipped boxes
+  Blob<Dtype> proposals_;
+};
+
+/* AnchorTargetLayer - Assigns anchors to ground-truth targets. Produces
+   anchor classification labels and bounding-box regression targets.
+   A native port of lib/rpn/anchor_target_layer.py.
+
+   bottom[0]: 1 x 2A x H x W rpn_cls_score (only its shape is used)
+   bottom[1]: G x 5 gt_boxes (x1, y1, x2, y2, label)
+   bottom[2]: 1 x 3 im_info (height, width, scale)
+   bottom[3]: data (optional, unused)
+   top[0]: 1 x 1 x AH x W labels (1 fg, 0 bg, -1 ignored)
+   top[1-3]: 1 x 4A x H x W bbox targets, inside and outside weights
+*/
+template <typename Dtype>
+class AnchorTargetLayer : public Layer<Dtype> {
+ public:
+  explicit AnchorTargetLayer(const LayerParameter& param)
+      : Layer<Dtype>(param) {}
+  virtual void LayerSetUp(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top);
+  virtual void Reshape(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top);
+
+  virtual inline const char* type() const { return "AnchorTarget"; }
+
+  virtual inline int MinBottomBlobs() const { return 3; }
+  virtual inline int MaxBottomBlobs() const { return 4; }
+  virtual inline int ExactNumTopBlobs() const { return 4; }
+
+ protected:
+  virtual void Forward_cpu(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top);
+  virtual void Backward_cpu(const vector<Blob<Dtype>*>& top,
+      const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom) {}
+
+  int feat_stride_;
+  /// num_anchors x 4 anchors of the cell at (0, 0)
+  vector<Dtype> anchors_;
+  /// H x W x A x 4 anchors of every cell, rebuilt when the map size changes
+  vector<Dtype> all_anchors_;
+  int height_;
+  int width_;
+};
+
+/* ProposalTargetLayer - Assigns object detection proposals to ground-truth
+   targets. Samples a minibatch of rois and produces their classification
+   labels and bounding-box regression targets.
+   A native port of lib/rpn/proposal_target_layer.py.
+
+   bottom[0]: R x 5 rpn_rois (batch index, x1, y1, x2, y2)
+   bottom[1]: G x 5 gt_boxes (x1, y1, x2, y2, label)
+   top[0]: N x 5 rois
+   top[1]: N labels
+   top[2-4]: N x 4K bbox targets, inside and outside weights
+*/
+template <typename Dtype>
+class ProposalTargetLayer : public Layer<Dtype> {
+ public:
+  explicit ProposalTargetLayer(const LayerParameter& param)
+      : Layer<Dtype>(param) {}
+  virtual void LayerSetUp(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top);
+  virtual void Reshape(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top);
+
+  virtual inline const char* type() const { return "ProposalTarget"; }
+
+  virtual inline int ExactNumBottomBlobs() const { return 2; }
+  virtual inline int ExactNumTopBlobs() const { return 5; }
+
+ protected:
+  virtual void Forward_cpu(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top);
+  virtual void Backward_cpu(const vector<Blob<Dtype>*>& top,
+      const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom) {}
+
+  int num_classes_;
+  vector<Dtype> target_mean_;
+  vector<Dtype> target_std_;
+};
+
 }  // namespace caffe
 
 #endif  // CAFFE_FAST_RCNN_LAYERS_HPP_
@@ -10,6 +10,7 @@
 #include "caffe/layer_factory.hpp"
 #include "caffe/proto/caffe.pb.h"
 #include "caffe/util/math_functions.hpp"
+#include "caffe/util/profiler.hpp"
 
 /**
  Forward declare boost::thread instead of including boost/thread.hpp
@@ -38,7 +39,7 @@ class Layer {
    * layer.
    */
   explicit Layer(const LayerParameter& param)
-    : layer_param_(param), is_shared_(false) {
+    : layer_param_(param), profile_(NULL), is_shared_(false) {
       // Set phase and copy blobs (if there are any).
       phase_ = param.phase();
       if (layer_param_.blobs_size() > 0) {
@@ -358,6 +359,13 @@ class Layer {
 
   inline Phase phase() { return phase_; }
 
+  /**
+   * @brief Sets where Forward and Backward record their time, or stops the
+   *        recording with NULL.
+   */
+  void set_profile(LayerProfile* profile) { profile_ = profile; }
+  LayerProfile* profile() const { return profile_; }
+
  protected:
   /** The protobuf that stores the layer parameters */
   LayerParameter layer_param_;
@@ -378,6 +386,8 @@ class Layer {
   /** The vector that indicates whether each top blob has a non-zero weight in
    *  the objective function. */
   vector<Dtype> loss_;
+  /** Where to record the time of the layer, if anywhere. */
+  LayerProfile* profile_;
 
   /** @brief Using the CPU device, compute the layer output. */
   virtual void Forward_cpu(const vector<Blob<Dtype>*>& bottom,
@@ -501,7 +511,11 @@ inline Dtype Layer<Dtype>::Forward(const vector<Blob<Dtype>*>& bottom,
   // Lock during forward to ensure sequential forward
   Lock();
   Dtype loss = 0;
-  Reshape(bottom, top);
+  {
+    ProfileScope scope(profile_, LayerProfile::RESHAPE);
+    Reshape(bottom, top);
+  }
+  ProfileScope scope(profile_, LayerProfile::FORWARD);
   switch (Caffe::mode()) {
   case Caffe::CPU:
     Forward_cpu(bottom, top);
@@ -538,6 +552,7 @@ template <typename Dtype>
 inline void Layer<Dtype>::Backward(const vector<Blob<Dtype>*>& top,
     const vector<bool>& propagate_down,
     const vector<Blob<Dtype>*>& bottom) {
+  ProfileScope scope(profile_, LayerProfile::BACKWARD);
   switch (Caffe::mode()) {
   case Caffe::CPU:
     Backward_cpu(top, propagate_down, bottom);
@@ -7,6 +7,7 @@
 #include "caffe/layer.hpp"
 #include "caffe/proto/caffe.pb.h"
 #include "caffe/util/im2col.hpp"
+#include "caffe/util/thread_pool.hpp"
 
 namespace caffe {
 
@@ -30,16 +31,35 @@ class BaseConvolutionLayer : public Layer<Dtype> {
 
  protected:
   // Helper functions that abstract away the column buffer and gemm arguments.
-  // The last argument in forward_cpu_gemm is so that we can skip the im2col if
-  // we just called weight_cpu_gemm with the same input.
+  // The skip_im2col argument in forward_cpu_gemm is so that we can skip the
+  // im2col if we just called weight_cpu_gemm with the same input. thread_id
+  // selects the column buffer of one of the batch threads.
   void forward_cpu_gemm(const Dtype* input, const Dtype* weights,
-      Dtype* output, bool skip_im2col = false);
+      Dtype* output, bool skip_im2col = false, int thread_id = 0);
   void forward_cpu_bias(Dtype* output, const Dtype* bias);
   void backward_cpu_gemm(const Dtype* input, const Dtype* weights,
-      Dtype* output);
+      Dtype* output, int thread_id = 0);
   void weight_cpu_gemm(const Dtype* input, const Dtype* output, Dtype*
-      weights);
+      weights, int thread_id = 0);
   void backward_cpu_bias(Dtype* bias, const Dtype* input);
+  /// @brief Run task(thread_id) on each of the batch threads.
+  void run_batch(const boost::function<void(int)>& task);
+  /// @brief The first image of the share of the batch of a thread; the share
+  ///        ends at the first image of the next one.
+  inline int batch_begin(int thread_id) const {
+    return static_cast<int64_t>(num_) * thread_id / num_batch_threads();
+  }
+  inline int num_batch_threads() const { return batch_threads_.size() + 1; }
+  /// @brief The parameter gradients of a batch thread: the layer's own for
+  ///        thread 0, else zeroed accumulators for reduce_batch_diffs().
+  Dtype* batch_weight_diff(int thread_id);
+  Dtype* batch_bias_diff(int thread_id);
+  /// @brief Add the gradients of the batch threads to the layer's, in order.
+  void reduce_batch_diffs();
+  // Rebuilds the per-group lists of live (not pruned) im2col rows and packs
+  // the matching weight columns. Once some column is dead, the cpu gemm
+  // helpers above build, multiply and scatter back the live rows only.
+  void update_live_cols();
 
 #ifndef CPU_ONLY
   void forward_gpu_gemm(const Dtype* col_input, const Dtype* weights,
@@ -92,8 +112,33 @@ class BaseConvolutionLayer : public Layer<Dtype> {
   bool bias_term_;
   bool is_1x1_;
   bool force_nd_im2col_;
+  /// @brief Whether the cpu gemm helpers skip the pruned columns.
+  bool use_live_cols_;
+  /// @brief Per group, the im2col rows whose weight columns are live.
+  vector<vector<int> > live_cols_;
+  /// @brief The live weight columns, packed group after group; its diff
+  ///        receives their gradient in weight_cpu_gemm.
+  Blob<Dtype> live_weight_;
+  /// @brief The output rows per im2col tile in forward_cpu_gemm, or 0 to
+  ///        build the whole column buffer.
+  int col_tile_rows_;
+
+  /// @brief The scratch of a batch thread other than the first one, which
+  ///        uses col_buffer_, live_weight_ and the parameter diffs.
+  struct BatchThread {
+    Blob<Dtype> col_buffer;
+    Blob<Dtype> live_weight_diff;
+    Blob<Dtype> weight_diff;
+    Blob<Dtype> bias_diff;
+  };
+  vector<shared_ptr<BatchThread> > batch_threads_;
+  shared_ptr<ThreadPool> batch_pool_;
 
  private:
+  inline Blob<Dtype>* col_buffer(int thread_id) {
+    return thread_id == 0 ? &col_buffer_ :
+        &batch_threads_[thread_id - 1]->col_buffer;
+  }
   // wrap im2col/col2im so we don't have to remember the (long) argument lists
   inline void conv_im2col_cpu(const Dtype* data, Dtype* col_buff) {
     if (!force_nd_im2col_ && num_spatial_axes_ == 2) {
@@ -123,6 +168,38 @@ class BaseConvolutionLayer : public Layer<Dtype> {
           pad_.cpu_data(), stride_.cpu_data(), dilation_.cpu_data(), data);
     }
   }
+  // the same for the live rows of one group only (2D, not reversed)
+  inline void conv_im2col_rows_cpu(const Dtype* data, const vector<int>& rows,
+      Dtype* col_buff) {
+    im2col_rows_cpu(data,
+        conv_input_shape_.cpu_data()[1], conv_input_shape_.cpu_data()[2],
+        kernel_shape_.cpu_data()[0], kernel_shape_.cpu_data()[1],
+        pad_.cpu_data()[0], pad_.cpu_data()[1],
+        stride_.cpu_data()[0], stride_.cpu_data()[1],
+        dilation_.cpu_data()[0], dilation_.cpu_data()[1],
+        rows.data(), rows.size(), col_buff);
+  }
+  inline void conv_col2im_rows_cpu(const Dtype* col_buff,
+      const vector<int>& rows, Dtype* data) {
+    col2im_rows_cpu(col_buff, conv_in_channels_ / group_,
+        conv_input_shape_.cpu_data()[1], conv_input_shape_.cpu_data()[2],
+        kernel_shape_.cpu_data()[0], kernel_shape_.cpu_data()[1],
+        pad_.cpu_data()[0], pad_.cpu_data()[1],
+        stride_.cpu_data()[0], stride_.cpu_data()[1],
+        dilation_.cpu_data()[0], dilation_.cpu_data()[1],
+        rows.data(), rows.size(), data);
+  }
+  // the same for the output rows [row_begin, row_end) only (2D)
+  inline void conv_im2col_tile_cpu(const Dtype* data, const vector<int>& rows,
+      const int row_begin, const int row_end, Dtype* col_buff) {
+    im2col_tile_cpu(data,
+        conv_input_shape_.cpu_data()[1], conv_input_shape_.cpu_data()[2],
+        kernel_shape_.cpu_data()[0], kernel_shape_.cpu_data()[1],
+        pad_.cpu_data()[0], pad_.cpu_data()[1],
+        stride_.cpu_data()[0], stride_.cpu_data()[1],
+        dilation_.cpu_data()[0], dilation_.cpu_data()[1],
+        rows.data(), rows.size(), row_begin, row_end, col_buff);
+  }
 #ifndef CPU_ONLY
   inline void conv_im2col_gpu(const Dtype* data, Dtype* col_buff) {
     if (!force_nd_im2col_ && num_spatial_axes_ == 2) {
@@ -167,6 +244,8 @@ class BaseConvolutionLayer : public Layer<Dtype> {
 
   Blob<Dtype> col_buffer_;
   Blob<Dtype> bias_multiplier_;
+  // the im2col rows of one group, for the tiles without pruned columns
+  vector<int> all_cols_;
 };
 
 }  // namespace caffe
@@ -8,7 +8,7 @@
 #include "caffe/internal_thread.hpp"
 #include "caffe/layer.hpp"
 #include "caffe/proto/caffe.pb.h"
-#include "caffe/util/blocking_queue.hpp"
+#include "caffe/util/lock_free_queue.hpp"
 
 namespace caffe {
 
@@ -75,8 +75,8 @@ class BasePrefetchingDataLayer :
   virtual void load_batch(Batch<Dtype>* batch) = 0;
 
   Batch<Dtype> prefetch_[PREFETCH_COUNT];
-  BlockingQueue<Batch<Dtype>*> prefetch_free_;
-  BlockingQueue<Batch<Dtype>*> prefetch_full_;
+  LockFreeQueue<Batch<Dtype>*> prefetch_free_;
+  LockFreeQueue<Batch<Dtype>*> prefetch_full_;
 
   Blob<Dtype> transformed_data_;
 };
@@ -77,6 +77,13 @@ class ConvolutionLayer : public BaseConvolutionLayer<Dtype> {
       const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom);
   virtual inline bool reverse_dimensions() { return false; }
   virtual void compute_output_shape();
+
+  // The share of batch thread thread_id of the cpu passes of one bottom.
+  void forward_cpu_batch(const Dtype* bottom_data, const Dtype* weight,
+      const Dtype* bias, Dtype* top_data, int thread_id);
+  void backward_cpu_batch(const Dtype* top_diff, const Dtype* weight,
+      const Dtype* bottom_data, Dtype* bottom_diff, bool propagate_down,
+      int thread_id);
 };
 
 }  // namespace caffe
@@ -11,6 +11,7 @@
 #include "caffe/layers/base_data_layer.hpp"
 #include "caffe/proto/caffe.pb.h"
 #include "caffe/util/db.hpp"
+#include "caffe/util/thread_pool.hpp"
 
 namespace caffe {
 
@@ -28,10 +29,37 @@ class DataLayer : public BasePrefetchingDataLayer<Dtype> {
   virtual inline int MinTopBlobs() const { return 1; }
   virtual inline int MaxTopBlobs() const { return 2; }
 
+  // Total time in ms spent waiting for datums from the reader, decoding
+  // encoded images, and transforming them. With decode_threads > 1, the
+  // decode and transform times add up the time of all threads. Safe to call
+  // while the prefetch thread runs.
+  double read_time() const;
+  double decode_time() const;
+  double transform_time() const;
+
  protected:
   virtual void load_batch(Batch<Dtype>* batch);
+  // Decode and transform the items thread_id, thread_id + decode_threads,
+  // ... of batch_datums_ into the batch data and labels
+  void TransformItems(int thread_id, int item_size, Dtype* top_data,
+      Dtype* top_label);
 
   DataReader reader_;
+
+  // The datums of the batch being loaded
+  vector<Datum*> batch_datums_;
+  // A transformer and item view per decode thread, thread 0 using
+  // data_transformer_
+  vector<shared_ptr<DataTransformer<Dtype> > > transformers_;
+  vector<shared_ptr<Blob<Dtype> > > transformed_items_;
+  shared_ptr<ThreadPool> decode_pool_;
+  vector<double> decode_times_;
+  vector<double> transform_times_;
+  // The totals, added to by the prefetch thread under time_mutex_
+  double read_time_;
+  double decode_time_;
+  double transform_time_;
+  shared_ptr<boost::mutex> time_mutex_;
 };
 
 }  // namespace caffe
@@ -0,0 +1,67 @@
+#ifndef CAFFE_DIRECT_CONV_LAYER_HPP_
+#define CAFFE_DIRECT_CONV_LAYER_HPP_
+
+#include <vector>
+
+#include "caffe/blob.hpp"
+#include "caffe/layer.hpp"
+#include "caffe/proto/caffe.pb.h"
+
+#include "caffe/layers/conv_layer.hpp"
+
+namespace caffe {
+
+/**
+ * @brief CPU implementation of ConvolutionLayer::Forward_cpu that does not
+ *        expand the input into the im2col buffer, for the WINOGRAD and
+ *        DIRECT engines. Backward and GPU mode fall back to ConvolutionLayer.
+ *
+ * With the WINOGRAD engine, 3x3 kernels of stride and dilation 1 are computed
+ * with Winograd's F(2x2, 3x3): each 4x4 input tile and 3x3 filter is
+ * transformed to a 4x4 tile, and the 16 elementwise products summed over the
+ * input channels become 16 GEMMs over a block of tiles. This takes 16 instead
+ * of 36 multiplications per 2x2 output tile. Other kernels, and the DIRECT
+ * engine, go through a direct convolution blocked over output channels.
+ *
+ * Both keep to the GEMM path up to rounding. Pruned weights are handled like
+ * there: the input channels whose columns are all dead are left out of the
+ * Winograd GEMMs, and the direct convolution skips every zero weight.
+ * Inputs that are not 2D go through the im2col GEMM path.
+ */
+template <typename Dtype>
+class DirectConvolutionLayer : public ConvolutionLayer<Dtype> {
+ public:
+  explicit DirectConvolutionLayer(const LayerParameter& param)
+      : ConvolutionLayer<Dtype>(param) {}
+  virtual void LayerSetUp(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top);
+
+ protected:
+  virtual void Forward_cpu(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top);
+
+  void forward_cpu_direct(const Dtype* input, const Dtype* weights,
+      Dtype* output);
+  // Transform the filters of the live input channels into winograd_weight_
+  void winograd_transform_weights(const Dtype* weights);
+  void forward_cpu_winograd(const Dtype* input, Dtype* output);
+  // Collect the input channels with a live column, per group
+  void update_live_channels();
+
+  /// @brief Whether the forward pass avoids im2col at all (2D only).
+  bool use_direct_;
+  /// @brief Whether 3x3 kernels go through Winograd F(2x2, 3x3).
+  bool use_winograd_;
+  /// @brief Per group, the input channels that are not pruned entirely.
+  vector<vector<int> > live_channels_;
+  /// @brief The transformed filters, per group 16 matrices of num_output /
+  ///        group x live input channels.
+  Blob<Dtype> winograd_weight_;
+  /// @brief The transformed input and output of a block of tiles.
+  Blob<Dtype> winograd_input_;
+  Blob<Dtype> winograd_output_;
+};
+
+}  // namespace caffe
+
+#endif  // CAFFE_DIRECT_CONV_LAYER_HPP_
@@ -6,6 +6,7 @@
 #include "caffe/blob.hpp"
 #include "caffe/layer.hpp"
 #include "caffe/proto/caffe.pb.h"
+#include "caffe/util/thread_pool.hpp"
 
 namespace caffe {
 
@@ -39,12 +40,28 @@ class InnerProductLayer : public Layer<Dtype> {
   virtual void Backward_gpu(const vector<Blob<Dtype>*>& top,
       const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom);
 
+  // The share of batch thread thread_id of the cpu passes: the rows
+  // [M_ * thread_id / batch_threads, M_ * (thread_id + 1) / batch_threads).
+  void forward_cpu_rows(const Dtype* bottom_data, const Dtype* weight,
+      const Dtype* bias, Dtype* top_data, int thread_id);
+  void backward_cpu_rows(const Dtype* top_diff, const Dtype* weight,
+      const Dtype* bottom_data, Dtype* bottom_diff, bool propagate_down,
+      int thread_id);
+  inline int batch_begin(int thread_id) const {
+    return static_cast<int64_t>(M_) * thread_id /
+        (batch_weight_diffs_.size() + 1);
+  }
+
   int M_;
   int K_;
   int N_;
   bool bias_term_;
   Blob<Dtype> bias_multiplier_;
   bool transpose_;          /// @lixang, if true, assume transposed weights
+  /// @brief The parameter gradients of the batch threads but the first.
+  vector<shared_ptr<Blob<Dtype> > > batch_weight_diffs_;
+  vector<shared_ptr<Blob<Dtype> > > batch_bias_diffs_;
+  shared_ptr<ThreadPool> batch_pool_;
 };
 
 }  // namespace caffe
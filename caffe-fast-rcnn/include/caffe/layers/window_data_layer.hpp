@@ -11,6 +11,8 @@
 #include "caffe/layer.hpp"
 #include "caffe/layers/base_data_layer.hpp"
 #include "caffe/proto/caffe.pb.h"
+#include "caffe/util/image_cache.hpp"
+#include "caffe/util/thread_pool.hpp"
 
 namespace caffe {
 
@@ -18,6 +20,11 @@ namespace caffe {
  * @brief Provides data to the Net from windows of images files, specified
  *        by a window data file.
  *
+ * Each image is decoded once per batch for all of its windows, and with
+ * decoded_cache_mb > 0 kept decoded in a cache shared by the layers reading
+ * the same source. With decode_threads > 1, the images are decoded and the
+ * windows cropped, warped and mean subtracted by that many threads.
+ *
  * TODO(dox): thorough documentation for Forward and proto params.
  */
 template <typename Dtype>
@@ -36,6 +43,12 @@ class WindowDataLayer : public BasePrefetchingDataLayer<Dtype> {
  protected:
   virtual unsigned int PrefetchRand();
   virtual void load_batch(Batch<Dtype>* batch);
+  // Decode the images thread_id, thread_id + decode_threads, ... of
+  // batch_images_
+  void DecodeImages(int thread_id);
+  // Crop the windows thread_id, thread_id + decode_threads, ... of
+  // batch_windows_ into the batch data and labels
+  void CropWindows(int thread_id, Dtype* top_data, Dtype* top_label);
 
   shared_ptr<Caffe::RNG> prefetch_rng_;
   vector<std::pair<std::string, vector<int> > > image_database_;
@@ -48,6 +61,21 @@ class WindowDataLayer : public BasePrefetchingDataLayer<Dtype> {
   bool has_mean_values_;
   bool cache_images_;
   vector<std::pair<std::string, Datum > > image_database_cache_;
+
+  // The windows of the batch being loaded, whether to mirror each, and the
+  // entry of batch_images_ each is cropped from
+  vector<const vector<float>*> batch_windows_;
+  vector<bool> batch_mirror_;
+  vector<int> batch_image_slots_;
+  // The distinct images of the batch, by index in image_database_
+  vector<int> batch_images_;
+#ifdef USE_OPENCV
+  vector<cv::Mat> batch_mats_;
+  shared_ptr<ImageCache> decoded_cache_;
+#endif  // USE_OPENCV
+  shared_ptr<ThreadPool> decode_pool_;
+  vector<double> decode_times_;
+  vector<double> transform_times_;
 };
 
 }  // namespace caffe
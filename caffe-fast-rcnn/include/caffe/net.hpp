@@ -14,6 +14,9 @@
 
 namespace caffe {
 
+class MappedWeights;
+class ThreadPool;
+
 /**
  * @brief Connects Layer%s together into a directed acyclic graph (DAG)
  *        specified by a NetParameter.
@@ -45,6 +48,9 @@ class Net {
    * extra computation on unrelated branches, and (2) computation starting in
    * the middle may be incorrect if all of the layers of a fan-in are not
    * included.
+   *
+   * With forward_threads > 1, layers that do not depend on each other through
+   * their bottom and top blobs run concurrently; see ForwardFromToParallel.
    */
   Dtype ForwardFromTo(int start, int end);
   Dtype ForwardFrom(int start);
@@ -114,6 +120,12 @@ class Net {
   void CopyTrainedLayersFrom(const string trained_filename);
   void CopyTrainedLayersFromBinaryProto(const string trained_filename);
   void CopyTrainedLayersFromHDF5(const string trained_filename);
+  /**
+   * @brief Point the layers at the weights of a .caffemap file (see
+   *        WriteMappedWeights) without copying them. The net keeps the file
+   *        mapped for as long as it lives.
+   */
+  void CopyTrainedLayersFromMapped(const string trained_filename);
   /// @brief Writes the net to a proto.
   void ToProto(NetParameter* param, bool write_diff = false) const;
   /// @brief Writes the net to an HDF5 file.
@@ -222,6 +234,23 @@ class Net {
 
   void set_debug_info(const bool value) { debug_info_ = value; }
 
+  /**
+   * @brief Start or stop recording the time of each layer, and of Forward and
+   *        Backward, into profiler(). Enabling it again adds to the totals.
+   *
+   * A layer shared with another net records into the net that enabled
+   * profiling last.
+   */
+  void set_profiling(const bool value);
+  bool profiling() const { return profiling_; }
+  /// @brief NULL until profiling is first enabled.
+  Profiler* profiler() const { return profiler_.get(); }
+  /**
+   * @brief Write the profile as JSON and the trace, skipping an empty file
+   *        name, with the current FLOPs of the layers APP prunes.
+   */
+  void WriteProfile(const string& json_file, const string& trace_file);
+
   // Helpers for Init.
   /**
    * @brief Remove layers that the user specified should be excluded given the current
@@ -247,6 +276,34 @@ class Net {
   void AppendParam(const NetParameter& param, const int layer_id,
                    const int param_id);
 
+  /**
+   * @brief Set alias[i] to the first of the blobs sharing their data with
+   *        blob i: in-place tops, and the tops of split, flatten, reshape
+   *        and single slice or concat layers, are one piece of memory with
+   *        their bottom.
+   */
+  void BlobAliases(vector<int>* alias) const;
+  /**
+   * @brief Assign the intermediate blobs to activation_buffers_ by their
+   *        lifetimes, for share_activations.
+   */
+  void InitActivationSharing(const NetParameter& param);
+  /**
+   * @brief Point the blobs of each activation buffer to it, growing the
+   *        buffers that some of their blobs outgrew.
+   */
+  void ShareActivationBuffers();
+  /// @brief Compute layer_forward_deps_ for a parallel Forward.
+  void InitForwardDependencies();
+  /**
+   * @brief Run the layers in [start, end] on forward_threads_ threads, each
+   *        layer as soon as the earlier layers it depends on are done.
+   */
+  Dtype ForwardFromToParallel(int start, int end);
+  /// The scheduling state shared by the threads of ForwardFromToParallel.
+  struct ForwardState;
+  void ForwardWorker(ForwardState* state, int thread_id);
+
   /// @brief Helper for displaying debug info in Forward about input Blobs.
   void InputDebugInfo(const int layer_id);
   /// @brief Helper for displaying debug info in Forward.
@@ -313,6 +370,25 @@ class Net {
   size_t memory_used_;
   /// Whether to compute and display debug info for the net.
   bool debug_info_;
+  /// The number of threads running the layers in ForwardFromTo (1 when the
+  /// net cannot be forwarded in parallel).
+  int forward_threads_;
+  /// The earlier layers each layer reads the output of, or overwrites the
+  /// input or output of, and so has to wait for in a parallel Forward.
+  vector<vector<int> > layer_forward_deps_;
+  /// Created by the first parallel Forward.
+  shared_ptr<ThreadPool> forward_pool_;
+  /// With share_activations, the buffers holding the intermediate blobs, and
+  /// the blobs of each buffer, which are in use at disjoint times.
+  vector<shared_ptr<SyncedMemory> > activation_buffers_;
+  vector<vector<int> > activation_buffer_blobs_;
+  /// Whether new memory of the blobs and activation buffers is zeroed.
+  bool zero_fill_activations_;
+  /// Set by set_profiling, with a LayerProfile per layer.
+  shared_ptr<Profiler> profiler_;
+  bool profiling_;
+  /// The weight files the layer blobs point into.
+  vector<shared_ptr<MappedWeights> > mapped_weights_;
   /// The root net that actually holds the shared layers in data parallelism
   const Net* const root_net_;
   DISABLE_COPY_AND_ASSIGN(Net);
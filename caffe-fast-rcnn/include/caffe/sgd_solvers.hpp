@@ -33,6 +33,7 @@ class SGDSolver : public Solver<Dtype> {
   virtual void ApplyUpdate();
   virtual void Normalize(int param_id);
   virtual void Regularize(int param_id);
+  bool UpdateColPunish(int param_id);                                                     ///@lixiang
   virtual void ComputeUpdateValue(int param_id, Dtype rate);
   virtual void ClipGradients();
   virtual void SnapshotSolverState(const string& model_filename);                         ///@lixiang
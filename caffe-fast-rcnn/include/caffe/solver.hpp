@@ -9,6 +9,8 @@
 
 namespace caffe {
 
+class AsyncProtoWriter;
+
 /**
   * @brief Enumeration of actions that a client of the Solver may request by
   * implementing the Solver's action request function, which a
@@ -66,6 +68,8 @@ class Solver {
   // function that produces a SolverState protocol buffer that needs to be
   // written to disk together with the learned net.
   void Snapshot();
+  // With snapshot_async, wait until the snapshots taken so far are written.
+  void FlushSnapshots();
   
   /// @lixiang
   void PrintFinalPrunedRatio();
@@ -88,6 +92,10 @@ class Solver {
     return test_nets_;
   }
   int iter() { return iter_; }
+  /// @brief The mean outputs of the last Test() of each test net.
+  inline const vector<vector<Dtype> >& test_scores() const {
+    return test_scores_;
+  }
 
   // Invoked at specific points during an iteration
   class Callback {
@@ -115,9 +123,21 @@ class Solver {
   string SnapshotFilename(const string extension);
   string SnapshotToBinaryProto();
   string SnapshotToHDF5();
+  // Write a snapshot file, on snapshot_writer_ with snapshot_async.
+  void WriteSnapshotProto(const shared_ptr<google::protobuf::Message>& proto,
+      const string& filename);
   // The test routine
   void TestAll();
   void Test(const int test_net_id = 0);
+  // With test_threads, create the replicas of a test net that Test forwards
+  // in parallel; they take the outputs of its data layers as inputs.
+  void InitTestNetReplicas(const int test_net_id,
+      const NetParameter& net_param);
+  // Forward the data layers of a test net once per replica, then forward the
+  // first num_batches replicas in parallel.
+  void ForwardTestNetReplicas(const int test_net_id, const int num_batches);
+  void TestReplicaWorker(const int test_net_id, const int num_batches,
+      const int thread_id);
   virtual void SnapshotSolverState(const string& model_filename) = 0;    /// @
   virtual void RestoreSolverStateFromHDF5(const string& state_file) = 0;
   virtual void RestoreSolverStateFromBinaryProto(const string& state_file, const bool& restore_prune_state) = 0;  /// @lixiang
@@ -130,6 +150,13 @@ class Solver {
   int current_step_;
   shared_ptr<Net<Dtype> > net_;
   vector<shared_ptr<Net<Dtype> > > test_nets_;
+  vector<vector<Dtype> > test_scores_;
+  // With test_threads, the replicas of each test net, the number of data
+  // layers of the test net they follow, and the losses of their last Forward.
+  vector<vector<shared_ptr<Net<Dtype> > > > test_net_replicas_;
+  vector<int> test_net_num_data_layers_;
+  vector<Dtype> test_replica_losses_;
+  shared_ptr<ThreadPool> test_pool_;
   vector<Callback*> callbacks_;
   vector<Dtype> losses_;
   Dtype smoothed_loss_;
@@ -173,6 +200,9 @@ class Solver {
   // True iff a request to stop early was received.
   bool requested_early_exit_;
 
+  // Writes the snapshots in the background with snapshot_async.
+  shared_ptr<AsyncProtoWriter> snapshot_writer_;
+
   DISABLE_COPY_AND_ASSIGN(Solver);
 };
 
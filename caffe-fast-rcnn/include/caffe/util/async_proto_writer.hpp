@@ -0,0 +1,55 @@
+#ifndef CAFFE_UTIL_ASYNC_PROTO_WRITER_HPP_
+#define CAFFE_UTIL_ASYNC_PROTO_WRITER_HPP_
+
+#include <google/protobuf/message.h>
+
+#include <string>
+
+#include "caffe/common.hpp"
+
+namespace boost { class thread; }
+
+namespace caffe {
+
+/**
+ * @brief Writes protos to binary files on a background thread, in the order
+ *        they are queued, e.g. to snapshot without stalling training.
+ *
+ * The files are written with WriteProtoToBinaryFile, which renames them into
+ * place once complete.
+ */
+class AsyncProtoWriter {
+ public:
+  AsyncProtoWriter();
+  /// Waits for the queued files to be written.
+  ~AsyncProtoWriter();
+
+  /**
+   * @brief Queue proto to be written to filename. The writer holds on to
+   *        proto until then, so it must not be changed any more.
+   */
+  void Write(const shared_ptr<google::protobuf::Message>& proto,
+      const string& filename);
+  /// @brief Queue the removal of filename, after the writes queued before.
+  void Remove(const string& filename);
+  /// @brief Wait until everything queued so far is done.
+  void Flush();
+
+ protected:
+  void WriterLoop();
+
+  /**
+   Move synchronization fields out instead of including boost/thread.hpp,
+   as in BlockingQueue.
+   */
+  class sync;
+
+  shared_ptr<sync> sync_;
+  shared_ptr<boost::thread> thread_;
+
+  DISABLE_COPY_AND_ASSIGN(AsyncProtoWriter);
+};
+
+}  // namespace caffe
+
+#endif  // CAFFE_UTIL_ASYNC_PROTO_WRITER_HPP_
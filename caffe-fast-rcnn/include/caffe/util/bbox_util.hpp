@@ -0,0 +1,95 @@
+#ifndef CAFFE_UTIL_BBOX_UTIL_HPP_
+#define CAFFE_UTIL_BBOX_UTIL_HPP_
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+namespace caffe {
+
+// Box helpers of the RPN layers, ported from lib/rpn/generate_anchors.py and
+// lib/fast_rcnn/bbox_transform.py. Boxes are (x1, y1, x2, y2) with inclusive
+// corners, so a box is x2 - x1 + 1 wide.
+
+/**
+ * @brief Enumerates the anchors of a base_size x base_size reference window
+ *        at (0, 0) over the aspect ratios, then the scales, as
+ *        generate_anchors.py does: anchors gets ratios.size() * scales.size()
+ *        boxes, ratio-major.
+ */
+template <typename Dtype>
+void generate_anchors(const int base_size, const std::vector<Dtype>& ratios,
+    const std::vector<Dtype>& scales, std::vector<Dtype>* anchors);
+
+/// @brief Computes the regression deltas (dx, dy, dw, dh) from box to gt_box.
+template <typename Dtype>
+inline void bbox_transform(const Dtype* box, const Dtype* gt_box,
+    Dtype* deltas) {
+  const Dtype width = box[2] - box[0] + Dtype(1);
+  const Dtype height = box[3] - box[1] + Dtype(1);
+  const Dtype gt_width = gt_box[2] - gt_box[0] + Dtype(1);
+  const Dtype gt_height = gt_box[3] - gt_box[1] + Dtype(1);
+  deltas[0] = (gt_box[0] + Dtype(0.5) * gt_width - box[0]
+      - Dtype(0.5) * width) / width;
+  deltas[1] = (gt_box[1] + Dtype(0.5) * gt_height - box[1]
+      - Dtype(0.5) * height) / height;
+  deltas[2] = std::log(gt_width / width);
+  deltas[3] = std::log(gt_height / height);
+}
+
+/// @brief Applies the regression deltas (dx, dy, dw, dh) to box.
+template <typename Dtype>
+inline void bbox_transform_inv(const Dtype* box, const Dtype dx,
+    const Dtype dy, const Dtype dw, const Dtype dh, Dtype* pred_box) {
+  const Dtype width = box[2] - box[0] + Dtype(1);
+  const Dtype height = box[3] - box[1] + Dtype(1);
+  const Dtype ctr_x = box[0] + Dtype(0.5) * width;
+  const Dtype ctr_y = box[1] + Dtype(0.5) * height;
+  const Dtype pred_ctr_x = dx * width + ctr_x;
+  const Dtype pred_ctr_y = dy * height + ctr_y;
+  const Dtype pred_w = std::exp(dw) * width;
+  const Dtype pred_h = std::exp(dh) * height;
+  pred_box[0] = pred_ctr_x - Dtype(0.5) * pred_w;
+  pred_box[1] = pred_ctr_y - Dtype(0.5) * pred_h;
+  pred_box[2] = pred_ctr_x + Dtype(0.5) * pred_w;
+  pred_box[3] = pred_ctr_y + Dtype(0.5) * pred_h;
+}
+
+/// @brief Clips box to an image of im_height x im_width pixels.
+template <typename Dtype>
+inline void clip_box(const Dtype im_height, const Dtype im_width,
+    Dtype* box) {
+  box[0] = std::max(std::min(box[0], im_width - Dtype(1)), Dtype(0));
+  box[1] = std::max(std::min(box[1], im_height - Dtype(1)), Dtype(0));
+  box[2] = std::max(std::min(box[2], im_width - Dtype(1)), Dtype(0));
+  box[3] = std::max(std::min(box[3], im_height - Dtype(1)), Dtype(0));
+}
+
+/// @brief Returns the intersection over union of two boxes, as
+///        lib/utils/bbox.pyx.
+template <typename Dtype>
+inline Dtype bbox_overlap(const Dtype* a, const Dtype* b) {
+  const Dtype iw = std::min(a[2], b[2]) - std::max(a[0], b[0]) + Dtype(1);
+  if (iw <= 0) {
+    return 0;
+  }
+  const Dtype ih = std::min(a[3], b[3]) - std::max(a[1], b[1]) + Dtype(1);
+  if (ih <= 0) {
+    return 0;
+  }
+  const Dtype area_a = (a[2] - a[0] + Dtype(1)) * (a[3] - a[1] + Dtype(1));
+  const Dtype area_b = (b[2] - b[0] + Dtype(1)) * (b[3] - b[1] + Dtype(1));
+  return iw * ih / (area_a + area_b - iw * ih);
+}
+
+/**
+ * @brief Moves a uniformly random subset of num_samples items, drawn with
+ *        Caffe's RNG, to the front of items, as np.random.choice(items,
+ *        num_samples, replace=False) would return them.
+ */
+template <typename T>
+void sample_without_replacement(const int num_samples, std::vector<T>* items);
+
+}  // namespace caffe
+
+#endif  // CAFFE_UTIL_BBOX_UTIL_HPP_
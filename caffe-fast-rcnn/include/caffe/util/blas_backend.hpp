@@ -0,0 +1,68 @@
+#ifndef CAFFE_UTIL_BLAS_BACKEND_HPP_
+#define CAFFE_UTIL_BLAS_BACKEND_HPP_
+
+#include <string>
+
+#include "caffe/common.hpp"
+#include "caffe/util/mkl_alternate.hpp"
+
+namespace caffe {
+
+/**
+ * @brief The BLAS routines caffe_cpu_gemm, caffe_cpu_gemv and caffe_axpy run
+ *        on, chosen at runtime instead of by Makefile.config.
+ *
+ * All matrices are row major. The backends are:
+ *   - "cblas": the BLAS library Caffe is linked against (the default);
+ *   - "builtin": a blocked GEMM with packed panels, with fast paths for the
+ *     skinny products Caffe makes, e.g. inner product layers with M = 1;
+ *   - the path of a shared library exporting the CBLAS interface, such as
+ *     libopenblas.so or libmkl_rt.so, which is loaded with dlopen.
+ */
+class BlasBackend {
+ public:
+  explicit BlasBackend(const string& name) : name_(name) {}
+  virtual ~BlasBackend() {}
+
+  const string& name() const { return name_; }
+
+  virtual void sgemm(const CBLAS_TRANSPOSE TransA,
+      const CBLAS_TRANSPOSE TransB, const int M, const int N, const int K,
+      const float alpha, const float* A, const int lda, const float* B,
+      const int ldb, const float beta, float* C, const int ldc) = 0;
+  virtual void dgemm(const CBLAS_TRANSPOSE TransA,
+      const CBLAS_TRANSPOSE TransB, const int M, const int N, const int K,
+      const double alpha, const double* A, const int lda, const double* B,
+      const int ldb, const double beta, double* C, const int ldc) = 0;
+  // y = alpha * op(A) * x + beta * y, with A an M x N matrix.
+  virtual void sgemv(const CBLAS_TRANSPOSE TransA, const int M, const int N,
+      const float alpha, const float* A, const float* x, const float beta,
+      float* y) = 0;
+  virtual void dgemv(const CBLAS_TRANSPOSE TransA, const int M, const int N,
+      const double alpha, const double* A, const double* x,
+      const double beta, double* y) = 0;
+  virtual void saxpy(const int N, const float alpha, const float* X,
+      float* Y) = 0;
+  virtual void daxpy(const int N, const double alpha, const double* X,
+      double* Y) = 0;
+
+ protected:
+  string name_;
+
+  DISABLE_COPY_AND_ASSIGN(BlasBackend);
+};
+
+// Create the backend "cblas", "builtin" or one loaded from a shared library.
+shared_ptr<BlasBackend> CreateBlasBackend(const string& name);
+
+// The backend of the process. Unless SetBlasBackend was called, it is the one
+// named by the environment variable CAFFE_BLAS, or "cblas".
+BlasBackend* GetBlasBackend();
+
+// Replace the backend of the process. It is not synchronized with running
+// BLAS calls, so set it before any net runs.
+void SetBlasBackend(shared_ptr<BlasBackend> backend);
+
+}  // namespace caffe
+
+#endif  // CAFFE_UTIL_BLAS_BACKEND_HPP_
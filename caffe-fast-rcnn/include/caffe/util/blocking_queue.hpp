@@ -4,6 +4,8 @@
 #include <queue>
 #include <string>
 
+#include "caffe/common.hpp"
+
 namespace caffe {
 
 template<typename T>
@@ -29,6 +29,35 @@ void col2im_cpu(const Dtype* data_col, const int channels,
     const int stride_w, const int dilation_h, const int dilation_w,
     Dtype* data_im);
 
+// im2col_cpu / col2im_cpu restricted to the given rows of the column
+// buffer (row = (channel * kernel_h + kernel_row) * kernel_w + kernel_col),
+// packed one after the other in data_col. col2im_rows_cpu still zeroes all
+// of data_im.
+template <typename Dtype>
+void im2col_rows_cpu(const Dtype* data_im, const int height, const int width,
+    const int kernel_h, const int kernel_w,
+    const int pad_h, const int pad_w, const int stride_h,
+    const int stride_w, const int dilation_h, const int dilation_w,
+    const int* rows, const int num_rows, Dtype* data_col);
+
+// im2col_rows_cpu restricted further to the output rows
+// [output_row_begin, output_row_end): data_col holds num_rows rows of
+// (output_row_end - output_row_begin) * output_w columns.
+template <typename Dtype>
+void im2col_tile_cpu(const Dtype* data_im, const int height, const int width,
+    const int kernel_h, const int kernel_w,
+    const int pad_h, const int pad_w, const int stride_h,
+    const int stride_w, const int dilation_h, const int dilation_w,
+    const int* rows, const int num_rows,
+    const int output_row_begin, const int output_row_end, Dtype* data_col);
+
+template <typename Dtype>
+void col2im_rows_cpu(const Dtype* data_col, const int channels,
+    const int height, const int width, const int kernel_h, const int kernel_w,
+    const int pad_h, const int pad_w, const int stride_h,
+    const int stride_w, const int dilation_h, const int dilation_w,
+    const int* rows, const int num_rows, Dtype* data_im);
+
 template <typename Dtype>
 void im2col_nd_gpu(const Dtype* data_im, const int num_spatial_axes,
     const int col_size, const int* im_shape, const int* col_shape,
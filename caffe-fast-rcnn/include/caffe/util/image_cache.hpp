@@ -0,0 +1,63 @@
+#ifndef CAFFE_UTIL_IMAGE_CACHE_HPP_
+#define CAFFE_UTIL_IMAGE_CACHE_HPP_
+
+#ifdef USE_OPENCV
+#include <opencv2/core/core.hpp>
+
+#include <list>
+#include <map>
+#include <utility>
+
+#include "caffe/common.hpp"
+
+namespace caffe {
+
+/**
+ * @brief A bounded LRU cache of decoded images by index, which threads and
+ *        layers can share.
+ *
+ * cv::Mat shares its pixels between copies, so an image evicted while a
+ * thread still uses it stays valid for that thread.
+ */
+class ImageCache {
+ public:
+  // capacity is the number of bytes of pixels to keep.
+  explicit ImageCache(size_t capacity);
+
+  /// @brief Find the image and make it the most recently used.
+  bool Get(int index, cv::Mat* image);
+  /// @brief Add the image, evicting the least recently used ones to stay
+  ///        within capacity. An image larger than the capacity is not kept.
+  void Put(int index, const cv::Mat& image);
+
+  size_t capacity() const { return capacity_; }
+  size_t size() const;
+  int count() const;
+  int hits() const;
+  int misses() const;
+
+ protected:
+  typedef std::list<std::pair<int, cv::Mat> > Images;
+
+  /**
+   Move synchronization fields out instead of including boost/thread.hpp,
+   as in BlockingQueue.
+   */
+  class sync;
+
+  const size_t capacity_;
+  shared_ptr<sync> sync_;
+  // The most recently used first.
+  Images images_;
+  map<int, Images::iterator> positions_;
+  size_t size_;
+  int hits_;
+  int misses_;
+
+  DISABLE_COPY_AND_ASSIGN(ImageCache);
+};
+
+}  // namespace caffe
+
+#endif  // USE_OPENCV
+#endif  // CAFFE_UTIL_IMAGE_CACHE_HPP_
@@ -0,0 +1,68 @@
+#ifndef CAFFE_UTIL_LOCK_FREE_QUEUE_HPP_
+#define CAFFE_UTIL_LOCK_FREE_QUEUE_HPP_
+
+#include <string>
+
+#include "caffe/common.hpp"
+
+namespace caffe {
+
+/**
+ * @brief A bounded multi-producer multi-consumer queue with the interface of
+ *        BlockingQueue, for handing off items that circulate between a fixed
+ *        number of slots (e.g. prefetch batches and their free list).
+ *
+ * push, try_push, try_pop and try_peek are lock-free: they claim a slot of a
+ * ring buffer with a compare-and-swap. Only a thread that has to wait, in pop
+ * or in push when the queue is full, first spins for spin_count tries and then
+ * parks on a condition variable until another thread makes progress.
+ */
+template<typename T>
+class LockFreeQueue {
+ public:
+  /// capacity is rounded up to a power of two.
+  explicit LockFreeQueue(size_t capacity, int spin_count = 1000);
+
+  // Waits while the queue is full
+  void push(const T& t);
+
+  bool try_push(const T& t);
+
+  bool try_pop(T* t);
+
+  // This logs a message if the threads needs to be blocked
+  // useful for detecting e.g. when data feeding is too slow
+  T pop(const string& log_on_wait = "");
+
+  // Only reliable with a single consumer, which the item cannot be taken from
+  bool try_peek(T* t);
+
+  // Return element without removing it
+  T peek();
+
+  size_t size() const;
+  size_t capacity() const { return capacity_; }
+
+ protected:
+  // try_push and try_pop without waking up the parked threads
+  bool TryPush(const T& t);
+  bool TryPop(T* t);
+  // Wake up the parked threads, if any, after a push or pop
+  void Notify();
+
+  /**
+   Move the ring buffer and the atomics out instead of including
+   boost/atomic.hpp, as BlockingQueue does for boost/thread.hpp.
+   */
+  class sync;
+
+  size_t capacity_;
+  int spin_count_;
+  shared_ptr<sync> sync_;
+
+DISABLE_COPY_AND_ASSIGN(LockFreeQueue);
+};
+
+}  // namespace caffe
+
+#endif  // CAFFE_UTIL_LOCK_FREE_QUEUE_HPP_
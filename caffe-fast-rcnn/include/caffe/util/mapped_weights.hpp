@@ -0,0 +1,50 @@
+#ifndef CAFFE_UTIL_MAPPED_WEIGHTS_HPP_
+#define CAFFE_UTIL_MAPPED_WEIGHTS_HPP_
+
+#include <string>
+
+#include "caffe/blob.hpp"
+#include "caffe/common.hpp"
+#include "caffe/proto/caffe.pb.h"
+
+namespace caffe {
+
+/**
+ * @brief A read-only memory mapping of a .caffemap weights file.
+ *
+ * The file holds an 8-byte magic, a uint32 version and a uint32 index size,
+ * the serialized MappedWeightsIndex, and then a 64-byte aligned data section
+ * with the raw float data of each blob. Float blobs can point straight into the mapped
+ * pages, so processes loading the same file share one page-cache copy. The
+ * mapping is private: writing to a weight only copies the touched pages.
+ */
+class MappedWeights {
+ public:
+  explicit MappedWeights(const string& filename);
+  ~MappedWeights();
+
+  const MappedWeightsIndex& index() const { return index_; }
+  /// @brief The mapped data of blob, which must come from index().
+  const float* data(const MappedBlob& blob) const;
+  /**
+   * @brief Make target use the mapped data of blob without a copy, or copy
+   *        the data in for a double blob. The mapping must outlive target.
+   */
+  void ShareInto(const MappedBlob& blob, Blob<float>* target) const;
+  void ShareInto(const MappedBlob& blob, Blob<double>* target) const;
+
+ protected:
+  void* addr_;
+  size_t size_;
+  size_t data_start_;
+  MappedWeightsIndex index_;
+
+  DISABLE_COPY_AND_ASSIGN(MappedWeights);
+};
+
+/// @brief Write the blobs of param (e.g. a caffemodel) as a .caffemap file.
+void WriteMappedWeights(const NetParameter& param, const string& filename);
+
+}  // namespace caffe
+
+#endif  // CAFFE_UTIL_MAPPED_WEIGHTS_HPP_
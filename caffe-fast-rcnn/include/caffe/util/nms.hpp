@@ -0,0 +1,47 @@
+#ifndef CAFFE_UTIL_NMS_HPP_
+#define CAFFE_UTIL_NMS_HPP_
+
+#include <vector>
+
+namespace caffe {
+
+/**
+ * @brief Greedy non-maximum suppression on the CPU, as lib/nms/cpu_nms.pyx:
+ *        a box is dropped when its IoU with a kept, higher scoring box is
+ *        >= thresh.
+ *
+ * Follows the block-mask scheme of lib/nms/nms_kernel.cu: the overlaps of
+ * a block of 64 boxes with all the lower scoring boxes are packed into
+ * 64-bit masks, computed in parallel across column blocks, and the greedy
+ * sweep just ORs the masks of the kept boxes together. Row blocks are only
+ * evaluated once the sweep reaches them, so boxes already suppressed cost
+ * nothing and the sweep stops as soon as max_keep boxes are kept.
+ *
+ * @param num_boxes the number of boxes
+ * @param boxes num_boxes x 4 (x1, y1, x2, y2), sorted by decreasing score
+ * @param thresh the IoU threshold
+ * @param keep receives the indices of the kept boxes, in order
+ * @param max_keep stop once that many boxes are kept (0: no limit)
+ */
+template <typename Dtype>
+void nms_cpu(const int num_boxes, const Dtype* boxes, const Dtype thresh,
+    std::vector<int>* keep, const int max_keep = 0);
+
+/**
+ * @brief Runs nms_cpu independently on groups of boxes, e.g. the detections
+ *        of each class, with the groups spread over threads.
+ *
+ * @param offsets num_groups + 1 offsets: group g is the boxes
+ *        [offsets[g], offsets[g + 1]), each group sorted by decreasing score
+ * @param boxes offsets.back() x 4 boxes
+ * @param keep receives, for each group, the indices of its kept boxes
+ *        relative to the start of the group
+ */
+template <typename Dtype>
+void nms_cpu_batched(const std::vector<int>& offsets, const Dtype* boxes,
+    const Dtype thresh, std::vector<std::vector<int> >* keep,
+    const int max_keep = 0);
+
+}  // namespace caffe
+
+#endif  // CAFFE_UTIL_NMS_HPP_
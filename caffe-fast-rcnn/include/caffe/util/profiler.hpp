@@ -0,0 +1,173 @@
+#ifndef CAFFE_UTIL_PROFILER_HPP_
+#define CAFFE_UTIL_PROFILER_HPP_
+
+#include <map>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include "caffe/common.hpp"
+
+namespace caffe {
+
+class Profiler;
+
+/// @brief The calls, time and allocations of one part of the work, summed.
+struct ProfileStat {
+  ProfileStat()
+      : calls(0), microseconds(0), bytes_allocated(0), bytes_zeroed(0),
+        reallocations(0) {}
+
+  int calls;
+  double microseconds;
+  /// Bytes of SyncedMemory allocated by the thread during the calls.
+  size_t bytes_allocated;
+  /// Bytes of SyncedMemory zeroed on first use, and Blobs that outgrew
+  /// their memory, on the thread during the calls.
+  size_t bytes_zeroed;
+  size_t reallocations;
+};
+
+/// @brief What a Profiler records of one layer.
+struct LayerProfile {
+  /// Forward includes the data wait of a data layer, but not the reshape.
+  enum Phase { FORWARD, BACKWARD, RESHAPE, DATA_WAIT, NUM_PHASES };
+
+  LayerProfile(Profiler* profiler, const string& name, const string& type)
+      : profiler(profiler), name(name), type(type), flops(0), flops_left(0) {}
+
+  Profiler* profiler;
+  string name;
+  string type;
+  ProfileStat phases[NUM_PHASES];
+  /// The multiply-adds of one forward pass per image as APP::GFLOPs counts
+  /// them, before and after pruning; 0 for the layers APP does not count.
+  double flops;
+  double flops_left;
+};
+
+/**
+ * @brief Records per layer and phase time of a Net, and the time of named
+ *        sections such as the steps of a Solver, and writes them as a JSON
+ *        summary or a Chrome trace (chrome://tracing).
+ *
+ * A ProfileScope does the recording. Layers run by several threads at once
+ * each update their own LayerProfile, so only the trace takes a lock.
+ */
+class Profiler {
+ public:
+  Profiler();
+
+  /// @brief Add a layer, whose profile lives as long as the profiler.
+  LayerProfile* AddLayer(const string& name, const string& type);
+  int num_layers() const { return layers_.size(); }
+  LayerProfile* layer(int i) { return layers_[i].get(); }
+  const LayerProfile* layer(int i) const { return layers_[i].get(); }
+  /// @brief The totals of a section, created by its first ProfileScope.
+  const map<string, ProfileStat>& sections() const { return sections_; }
+
+  /// @brief Keep up to max trace events; 0, the default, keeps no trace.
+  void set_max_trace_events(int max) { max_trace_events_ = max; }
+  int max_trace_events() const { return max_trace_events_; }
+  int num_trace_events() const;
+  /// @brief The events past max_trace_events that were not kept.
+  int dropped_trace_events() const;
+
+  /// @brief Microseconds since the profiler was made or last reset.
+  double Now() const;
+  /// @brief Clear the totals and the trace, keeping the layers.
+  void Reset();
+
+  /// @brief Write the totals, with the time per call in milliseconds.
+  void ToJSON(std::ostream* out) const;
+  /// @brief Write the trace in the Chrome trace event format.
+  void ToTrace(std::ostream* out) const;
+  void WriteJSON(const string& filename) const;
+  void WriteTrace(const string& filename) const;
+
+ protected:
+  friend class ProfileScope;
+
+  struct TraceEvent {
+    const string* name;
+    const char* category;
+    double start;
+    double duration;
+    int thread;
+  };
+
+  ProfileStat* Section(const string& name, const string** key);
+  void AddTraceEvent(const string* name, const char* category, double start,
+      double duration);
+
+  /**
+   Move synchronization fields out instead of including boost/thread.hpp,
+   as in BlockingQueue.
+   */
+  class sync;
+
+  shared_ptr<sync> sync_;
+  vector<shared_ptr<LayerProfile> > layers_;
+  map<string, ProfileStat> sections_;
+  vector<TraceEvent> events_;
+  int max_trace_events_;
+  int dropped_trace_events_;
+
+  DISABLE_COPY_AND_ASSIGN(Profiler);
+};
+
+/**
+ * @brief Times its scope into a phase of a layer or a section of a
+ *        Profiler, and does nothing when given NULL, so that code can profile
+ *        unconditionally.
+ *
+ * In GPU mode it synchronizes the device at both ends, so that the time is
+ * that of the scope's own kernels.
+ */
+class ProfileScope {
+ public:
+  ProfileScope(LayerProfile* layer, LayerProfile::Phase phase)
+      : profiler_(NULL) {
+    if (layer) {
+      profiler_ = layer->profiler;
+      stat_ = &layer->phases[phase];
+      name_ = &layer->name;
+      category_ = PhaseName(phase);
+      Start();
+    }
+  }
+  ProfileScope(Profiler* profiler, const string& section)
+      : profiler_(profiler) {
+    if (profiler) {
+      stat_ = profiler->Section(section, &name_);
+      category_ = "section";
+      Start();
+    }
+  }
+  ~ProfileScope() {
+    if (profiler_) {
+      Stop();
+    }
+  }
+
+  static const char* PhaseName(LayerProfile::Phase phase);
+
+ protected:
+  void Start();
+  void Stop();
+
+  Profiler* profiler_;
+  ProfileStat* stat_;
+  const string* name_;
+  const char* category_;
+  double start_;
+  size_t start_bytes_;
+  size_t start_zeroed_;
+  size_t start_reallocations_;
+
+  DISABLE_COPY_AND_ASSIGN(ProfileScope);
+};
+
+}  // namespace caffe
+
+#endif  // CAFFE_UTIL_PROFILER_HPP_
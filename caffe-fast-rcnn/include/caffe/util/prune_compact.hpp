@@ -0,0 +1,40 @@
+#ifndef CAFFE_UTIL_PRUNE_COMPACT_HPP_
+#define CAFFE_UTIL_PRUNE_COMPACT_HPP_
+
+#include "caffe/proto/caffe.pb.h"
+
+namespace caffe {
+
+/**
+ * @brief Physically removes the output channels that structured pruning
+ *        (APP "Row"/"Col" pruning) has zeroed, so a pruned net runs smaller
+ *        dense GEMMs instead of multiplying by zeros.
+ *
+ * The pruning state is recovered from the weights the same way
+ * Layer::RestoreMasks rebuilds IF_row_pruned / IF_col_pruned: an output
+ * channel of a Convolution or InnerProduct layer is dead when
+ *   - its weight row is all zero (a pruned row) and the constant it emits,
+ *     its bias after the in-place activations that follow, is either zero
+ *     or can be folded exactly into the biases of the next layers, or
+ *   - every next layer has all of its columns for that channel zeroed
+ *     (pruned columns covering a whole input channel).
+ * A dead channel is dropped from the producer (weights, bias, num_output)
+ * and the matching input channel (im2col columns) from every consumer.
+ *
+ * Only channels whose every path leads, through channel-wise layers
+ * (ReLU, Dropout, Pooling, ROIPooling), into ungrouped Convolution or
+ * InnerProduct layers are touched; anything else (Concat, Eltwise, net
+ * outputs, grouped convolutions, ...) keeps the channel as is.
+ *
+ * @param net_param the network definition, e.g. the test prototxt
+ * @param weights the trained (pruned) weights, e.g. a caffemodel
+ * @param compact_net_param the network definition with shrunk num_output
+ * @param compact_weights the weights with the dead channels removed
+ * @return the total number of output channels removed
+ */
+int CompactPrunedNet(const NetParameter& net_param, const NetParameter& weights,
+    NetParameter* compact_net_param, NetParameter* compact_weights);
+
+}  // namespace caffe
+
+#endif  // CAFFE_UTIL_PRUNE_COMPACT_HPP_
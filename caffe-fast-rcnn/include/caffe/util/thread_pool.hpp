@@ -0,0 +1,52 @@
+#ifndef CAFFE_UTIL_THREAD_POOL_HPP_
+#define CAFFE_UTIL_THREAD_POOL_HPP_
+
+#include <boost/function.hpp>
+#include <vector>
+
+#include "caffe/common.hpp"
+
+namespace boost { class thread; }
+
+namespace caffe {
+
+/**
+ * @brief A fixed set of threads that all run the same task, for work that
+ *        the threads share out among themselves (e.g. from a ready queue).
+ *
+ * The calling thread takes part as thread 0, so a pool of num_threads
+ * starts num_threads - 1 workers.
+ */
+class ThreadPool {
+ public:
+  explicit ThreadPool(int num_threads);
+  ~ThreadPool();
+
+  int num_threads() const { return threads_.size() + 1; }
+
+  /// @brief Run task(thread_id) on every thread and wait until all return.
+  void Run(const boost::function<void(int)>& task);
+
+ protected:
+  void WorkerLoop(int thread_id);
+
+  /**
+   Move synchronization fields out instead of including boost/thread.hpp,
+   as in BlockingQueue.
+   */
+  class sync;
+
+  vector<shared_ptr<boost::thread> > threads_;
+  shared_ptr<sync> sync_;
+  boost::function<void(int)> task_;
+  // Incremented by each Run, to wake the workers up once per task.
+  int generation_;
+  int num_running_;
+  bool stop_;
+
+  DISABLE_COPY_AND_ASSIGN(ThreadPool);
+};
+
+}  // namespace caffe
+
+#endif  // CAFFE_UTIL_THREAD_POOL_HPP_
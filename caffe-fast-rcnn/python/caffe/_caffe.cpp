@@ -15,6 +15,7 @@
 #include <vector>  // NOLINT(build/include_order)
 #include <fstream>  // NOLINT
 
+#include "caffe/batch_detector.hpp"
 #include "caffe/caffe.hpp"
 #include "caffe/layers/memory_data_layer.hpp"
 #include "caffe/layers/python_layer.hpp"
@@ -208,6 +209,126 @@ bp::object BlobVec_add_blob(bp::tuple args, bp::dict kwargs) {
   return bp::object();
 }
 
+// A new ndarray holding a copy of the blob.
+static bp::object Blob_ToArray(const Blob<Dtype>& blob) {
+  vector<npy_intp> dims(blob.shape().begin(), blob.shape().end());
+  PyObject* arr = PyArray_SimpleNew(dims.size(), dims.data(), NPY_DTYPE);
+  if (blob.count() > 0) {
+    memcpy(PyArray_DATA(reinterpret_cast<PyArrayObject*>(arr)),
+        blob.cpu_data(), blob.count() * sizeof(Dtype));
+  }
+  return bp::object(bp::handle<>(arr));
+}
+
+// Check that obj is a C contiguous float32 ndarray of num_axes axes, the
+// last of which has size last_dim, and return it.
+static PyArrayObject* CheckDetectorArray(bp::object obj, const string& name,
+    int num_axes, int last_dim) {
+  if (!PyArray_Check(obj.ptr())) {
+    throw std::runtime_error(name + " must be an ndarray");
+  }
+  PyArrayObject* arr = reinterpret_cast<PyArrayObject*>(obj.ptr());
+  if (!(PyArray_FLAGS(arr) & NPY_ARRAY_C_CONTIGUOUS)) {
+    throw std::runtime_error(name + " must be C contiguous");
+  }
+  if (PyArray_TYPE(arr) != NPY_FLOAT32) {
+    throw std::runtime_error(name + " must be float32");
+  }
+  if (PyArray_NDIM(arr) != num_axes ||
+      PyArray_DIMS(arr)[num_axes - 1] != last_dim) {
+    throw std::runtime_error(name + " has the wrong shape");
+  }
+  return arr;
+}
+
+// Detect objects in a list of H x W x C images, each resized by its scale
+// from an image of the given (height, width, ...) shape, and return a list
+// of the (scores, boxes) arrays of each image. boxes is None for the nets
+// with an RPN, or else the list of the R x 4 proposals of each image.
+bp::list BatchDetector_Detect(BatchDetector<Dtype>* detector,
+    bp::list images, bp::list scales, bp::list im_shapes, bp::object boxes) {
+  const int num = bp::len(images);
+  if (bp::len(scales) != num || bp::len(im_shapes) != num ||
+      (!boxes.is_none() && bp::len(boxes) != num)) {
+    throw std::runtime_error("detect needs a scale, a shape and proposals"
+        " for each image");
+  }
+  vector<BatchDetector<Dtype>::Image> inputs(num);
+  for (int i = 0; i < num; ++i) {
+    BatchDetector<Dtype>::Image& input = inputs[i];
+    PyArrayObject* image = CheckDetectorArray(images[i], "image", 3,
+        detector->channels());
+    input.data = static_cast<const Dtype*>(PyArray_DATA(image));
+    input.height = PyArray_DIMS(image)[0];
+    input.width = PyArray_DIMS(image)[1];
+    input.scale = bp::extract<Dtype>(scales[i]);
+    const bp::object im_shape = im_shapes[i];
+    input.im_height = bp::extract<int>(im_shape[0]);
+    input.im_width = bp::extract<int>(im_shape[1]);
+    if (!boxes.is_none()) {
+      PyArrayObject* image_boxes = CheckDetectorArray(boxes[i], "boxes", 2,
+          4);
+      input.boxes = static_cast<const Dtype*>(PyArray_DATA(image_boxes));
+      input.num_boxes = PyArray_DIMS(image_boxes)[0];
+    }
+  }
+  vector<shared_ptr<BatchDetector<Dtype>::Detections> > detections;
+  detector->Detect(inputs, &detections);
+  bp::list result;
+  for (int i = 0; i < num; ++i) {
+    result.append(bp::make_tuple(Blob_ToArray(detections[i]->scores),
+        Blob_ToArray(detections[i]->boxes)));
+  }
+  return result;
+}
+
+// Threshold, NMS and cap the R x K scores and R x 4K boxes of one image,
+// and return the N x 5 (x1, y1, x2, y2, score) detections of classes 1 to
+// K - 1.
+bp::list BatchDetector_Suppress(bp::object scores_obj, bp::object boxes_obj,
+    Dtype thresh, Dtype nms_thresh, int max_per_image) {
+  if (!PyArray_Check(scores_obj.ptr()) ||
+      PyArray_NDIM(reinterpret_cast<PyArrayObject*>(scores_obj.ptr())) != 2) {
+    throw std::runtime_error("scores must be a 2-d ndarray");
+  }
+  const int num_classes =
+      PyArray_DIMS(reinterpret_cast<PyArrayObject*>(scores_obj.ptr()))[1];
+  PyArrayObject* scores = CheckDetectorArray(scores_obj, "scores", 2,
+      num_classes);
+  PyArrayObject* boxes = CheckDetectorArray(boxes_obj, "boxes", 2,
+      4 * num_classes);
+  const int num_rois = PyArray_DIMS(scores)[0];
+  if (PyArray_DIMS(boxes)[0] != num_rois) {
+    throw std::runtime_error("scores and boxes must have the same rows");
+  }
+  BatchDetector<Dtype>::Detections detections;
+  detections.scores.Reshape(num_rois, num_classes, 1, 1);
+  detections.boxes.Reshape(num_rois, 4 * num_classes, 1, 1);
+  if (num_rois > 0) {
+    caffe_copy(detections.scores.count(),
+        static_cast<const Dtype*>(PyArray_DATA(scores)),
+        detections.scores.mutable_cpu_data());
+    caffe_copy(detections.boxes.count(),
+        static_cast<const Dtype*>(PyArray_DATA(boxes)),
+        detections.boxes.mutable_cpu_data());
+  }
+  vector<vector<Dtype> > class_dets;
+  BatchDetector<Dtype>::Suppress(detections, thresh, nms_thresh,
+      max_per_image, &class_dets);
+  bp::list result;
+  for (int j = 0; j < class_dets.size(); ++j) {
+    vector<int> shape(2, class_dets[j].size() / 5);
+    shape[1] = 5;
+    Blob<Dtype> dets(shape);
+    if (dets.count() > 0) {
+      std::copy(class_dets[j].begin(), class_dets[j].end(),
+          dets.mutable_cpu_data());
+    }
+    result.append(Blob_ToArray(dets));
+  }
+  return result;
+}
+
 BOOST_PYTHON_MEMBER_FUNCTION_OVERLOADS(SolveOverloads, Solve, 0, 1);
 
 BOOST_PYTHON_MODULE(_caffe) {
@@ -263,6 +384,18 @@ BOOST_PYTHON_MODULE(_caffe) {
         bp::with_custodian_and_ward<1, 2, bp::with_custodian_and_ward<1, 3> >())
     .def("save", &Net_Save);
 
+  bp::class_<BatchDetector<Dtype>, shared_ptr<BatchDetector<Dtype> >,
+    boost::noncopyable>("BatchDetector",
+        bp::init<shared_ptr<Net<Dtype> >, int, int>())
+    .def("detect", &BatchDetector_Detect)
+    .def("set_score_blob", &BatchDetector<Dtype>::set_score_blob)
+    .def("set_bbox_reg", &BatchDetector<Dtype>::set_bbox_reg)
+    .add_property("max_batch", &BatchDetector<Dtype>::max_batch)
+    .add_property("bucket_step", &BatchDetector<Dtype>::bucket_step)
+    .add_property("num_forwards", &BatchDetector<Dtype>::num_forwards)
+    .def("suppress", &BatchDetector_Suppress)
+    .staticmethod("suppress");
+
   bp::class_<Blob<Dtype>, shared_ptr<Blob<Dtype> >, boost::noncopyable>(
     "Blob", bp::no_init)
     .add_property("shape",
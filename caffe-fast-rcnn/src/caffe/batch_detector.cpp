@@ -0,0 +1,309 @@
+#include <algorithm>
+#include <cfloat>
+#include <functional>
+#include <map>
+#include <utility>
+#include <vector>
+
+#include "caffe/batch_detector.hpp"
+#include "caffe/util/bbox_util.hpp"
+#include "caffe/util/math_functions.hpp"
+#include "caffe/util/nms.hpp"
+
+namespace caffe {
+
+// The input blob of the net with the name, or NULL.
+template <typename Dtype>
+static Blob<Dtype>* Input(Net<Dtype>* net, const string& name) {
+  for (int i = 0; i < net->num_inputs(); ++i) {
+    if (net->blob_names()[net->input_blob_indices()[i]] == name) {
+      return net->input_blobs()[i];
+    }
+  }
+  return NULL;
+}
+
+template <typename Dtype>
+BatchDetector<Dtype>::BatchDetector(const shared_ptr<Net<Dtype> >& net,
+    int max_batch, int bucket_step)
+    : net_(net), max_batch_(max_batch), bucket_step_(bucket_step),
+      score_blob_("cls_prob"), bbox_reg_(true), num_forwards_(0) {
+  CHECK_GT(max_batch, 0) << "max_batch must be > 0";
+  CHECK_GT(bucket_step, 0) << "bucket_step must be > 0";
+  data_ = Input(net_.get(), "data");
+  im_info_ = Input(net_.get(), "im_info");
+  rois_ = Input(net_.get(), "rois");
+  CHECK(data_) << "The net has no \"data\" input";
+  CHECK(im_info_ || rois_)
+      << "The net needs an \"im_info\" input (RPN) or a \"rois\" input";
+  CHECK(net_->has_blob("rois")) << "The net has no \"rois\" blob";
+}
+
+template <typename Dtype>
+void BatchDetector<Dtype>::Detect(const vector<Image>& images,
+    vector<shared_ptr<Detections> >* detections) {
+  // Group the images by their padded size.
+  typedef std::pair<int, int> Size;
+  std::map<Size, vector<int> > buckets;
+  for (int i = 0; i < images.size(); ++i) {
+    const Image& image = images[i];
+    CHECK(image.data) << "Image " << i << " has no pixels";
+    CHECK_GT(image.height, 0);
+    CHECK_GT(image.width, 0);
+    CHECK_GT(image.scale, 0);
+    CHECK(rois_ == NULL || image.boxes || image.num_boxes == 0)
+        << "Image " << i << " has no proposals";
+    const Size size(
+        (image.height + bucket_step_ - 1) / bucket_step_ * bucket_step_,
+        (image.width + bucket_step_ - 1) / bucket_step_ * bucket_step_);
+    buckets[size].push_back(i);
+  }
+  // The largest buckets first, so that the first forward pass sizes the
+  // blobs for all the others.
+  vector<std::pair<int, Size> > order;
+  for (typename std::map<Size, vector<int> >::const_iterator it =
+       buckets.begin(); it != buckets.end(); ++it) {
+    order.push_back(std::make_pair(-it->first.first * it->first.second,
+        it->first));
+  }
+  std::sort(order.begin(), order.end());
+
+  detections->clear();
+  detections->resize(images.size());
+  for (int b = 0; b < order.size(); ++b) {
+    const Size& size = order[b].second;
+    const vector<int>& bucket = buckets[size];
+    for (int start = 0; start < bucket.size(); start += max_batch_) {
+      const vector<int> batch(bucket.begin() + start, bucket.begin() +
+          std::min<int>(start + max_batch_, bucket.size()));
+      DetectBatch(images, batch, size.first, size.second, detections);
+    }
+  }
+}
+
+template <typename Dtype>
+void BatchDetector<Dtype>::DetectBatch(const vector<Image>& images,
+    const vector<int>& batch, int height, int width,
+    vector<shared_ptr<Detections> >* detections) {
+  const int num = batch.size();
+  const int channels = data_->channels();
+
+  // The images, top-left aligned and padded with zeros, i.e. with the mean
+  // pixel as im_list_to_blob pads them.
+  data_->Reshape(num, channels, height, width);
+  Dtype* data = data_->mutable_cpu_data();
+  caffe_set(data_->count(), Dtype(0), data);
+  for (int n = 0; n < num; ++n) {
+    const Image& image = images[batch[n]];
+    for (int c = 0; c < channels; ++c) {
+      Dtype* channel = data + data_->offset(n, c);
+      for (int h = 0; h < image.height; ++h) {
+        const Dtype* pixel = image.data + h * image.width * channels + c;
+        Dtype* row = channel + h * width;
+        for (int w = 0; w < image.width; ++w) {
+          row[w] = pixel[w * channels];
+        }
+      }
+    }
+  }
+  vector<int> shape(2, num);
+  shape[1] = 3;
+  if (im_info_) {
+    im_info_->Reshape(shape);
+    Dtype* im_info = im_info_->mutable_cpu_data();
+    for (int n = 0; n < num; ++n) {
+      const Image& image = images[batch[n]];
+      im_info[3 * n] = image.height;
+      im_info[3 * n + 1] = image.width;
+      im_info[3 * n + 2] = image.scale;
+    }
+  }
+  if (rois_) {
+    int num_rois = 0;
+    for (int n = 0; n < num; ++n) {
+      num_rois += images[batch[n]].num_boxes;
+    }
+    if (num_rois == 0) {
+      // Nothing to run the net on.
+      const int num_classes = net_->blob_by_name(score_blob_)->count(1);
+      shape[0] = 0;
+      for (int n = 0; n < num; ++n) {
+        shared_ptr<Detections> detection(new Detections());
+        shape[1] = num_classes;
+        detection->scores.Reshape(shape);
+        shape[1] = 4 * num_classes;
+        detection->boxes.Reshape(shape);
+        (*detections)[batch[n]] = detection;
+      }
+      return;
+    }
+    shape[0] = num_rois;
+    shape[1] = 5;
+    rois_->Reshape(shape);
+    Dtype* rois = rois_->mutable_cpu_data();
+    for (int n = 0; n < num; ++n) {
+      const Image& image = images[batch[n]];
+      for (int i = 0; i < image.num_boxes; ++i, rois += 5) {
+        rois[0] = n;
+        for (int k = 0; k < 4; ++k) {
+          rois[k + 1] = image.boxes[4 * i + k] * image.scale;
+        }
+      }
+    }
+  }
+
+  net_->ForwardPrefilled();
+  ++num_forwards_;
+
+  const Blob<Dtype>& roi_blob = *net_->blob_by_name("rois");
+  const Blob<Dtype>& score_blob = *net_->blob_by_name(score_blob_);
+  const int num_rois = roi_blob.num();
+  const int num_classes = score_blob.count(1);
+  CHECK_EQ(score_blob.num(), num_rois)
+      << "\"" << score_blob_ << "\" must have a row per roi";
+  const Dtype* deltas = NULL;
+  if (bbox_reg_) {
+    const Blob<Dtype>& bbox_pred = *net_->blob_by_name("bbox_pred");
+    CHECK_EQ(bbox_pred.num(), num_rois);
+    CHECK_EQ(bbox_pred.count(1), 4 * num_classes)
+        << "\"bbox_pred\" must have 4 deltas per class";
+    deltas = bbox_pred.cpu_data();
+  }
+
+  // Split the rows by the batch index of their roi.
+  const Dtype* rois = roi_blob.cpu_data();
+  vector<int> counts(num);
+  for (int r = 0; r < num_rois; ++r) {
+    const int n = static_cast<int>(rois[5 * r]);
+    CHECK_GE(n, 0) << "Bad batch index of roi " << r;
+    CHECK_LT(n, num) << "Bad batch index of roi " << r;
+    ++counts[n];
+  }
+  vector<Dtype*> scores(num);
+  vector<Dtype*> boxes(num);
+  for (int n = 0; n < num; ++n) {
+    shared_ptr<Detections> detection(new Detections());
+    shape[0] = counts[n];
+    shape[1] = num_classes;
+    detection->scores.Reshape(shape);
+    shape[1] = 4 * num_classes;
+    detection->boxes.Reshape(shape);
+    if (counts[n] > 0) {
+      scores[n] = detection->scores.mutable_cpu_data();
+      boxes[n] = detection->boxes.mutable_cpu_data();
+    }
+    (*detections)[batch[n]] = detection;
+  }
+  const Dtype* score_data = score_blob.cpu_data();
+  for (int r = 0; r < num_rois; ++r) {
+    const int n = static_cast<int>(rois[5 * r]);
+    const Image& image = images[batch[n]];
+    scores[n] = std::copy(score_data + r * num_classes,
+        score_data + (r + 1) * num_classes, scores[n]);
+    // Back to the original image.
+    Dtype box[4];
+    for (int k = 0; k < 4; ++k) {
+      box[k] = rois[5 * r + k + 1] / image.scale;
+    }
+    for (int j = 0; j < num_classes; ++j, boxes[n] += 4) {
+      if (deltas) {
+        const Dtype* delta = deltas + 4 * (r * num_classes + j);
+        bbox_transform_inv(box, delta[0], delta[1], delta[2], delta[3],
+            boxes[n]);
+        clip_box<Dtype>(image.im_height, image.im_width, boxes[n]);
+      } else {
+        std::copy(box, box + 4, boxes[n]);
+      }
+    }
+  }
+}
+
+// Orders the rows of a score column by decreasing score, then by index.
+template <typename Dtype>
+class ColumnGreater {
+ public:
+  ColumnGreater(const Dtype* scores, int stride)
+      : scores_(scores), stride_(stride) {}
+  bool operator()(const int a, const int b) const {
+    const Dtype score_a = scores_[a * stride_];
+    const Dtype score_b = scores_[b * stride_];
+    return score_a > score_b || (score_a == score_b && a < b);
+  }
+
+ private:
+  const Dtype* scores_;
+  int stride_;
+};
+
+template <typename Dtype>
+void BatchDetector<Dtype>::Suppress(const Detections& detections, Dtype thresh,
+    Dtype nms_thresh, int max_per_image,
+    vector<vector<Dtype> >* class_dets) {
+  const int num_rois = detections.scores.num();
+  const int num_classes = detections.scores.count(1);
+  class_dets->clear();
+  class_dets->resize(std::max(num_classes - 1, 0));
+  if (num_rois == 0) {
+    return;
+  }
+  const Dtype* scores = detections.scores.cpu_data();
+  const Dtype* boxes = detections.boxes.cpu_data();
+
+  // The rows above thresh of each class, by decreasing score.
+  vector<vector<int> > rows(class_dets->size());
+  vector<int> offsets(1, 0);
+  vector<Dtype> sorted_boxes;
+  for (int j = 1; j < num_classes; ++j) {
+    vector<int>& row = rows[j - 1];
+    for (int r = 0; r < num_rois; ++r) {
+      if (scores[r * num_classes + j] > thresh) {
+        row.push_back(r);
+      }
+    }
+    std::sort(row.begin(), row.end(),
+        ColumnGreater<Dtype>(scores + j, num_classes));
+    for (int i = 0; i < row.size(); ++i) {
+      const Dtype* box = boxes + 4 * (row[i] * num_classes + j);
+      sorted_boxes.insert(sorted_boxes.end(), box, box + 4);
+    }
+    offsets.push_back(offsets.back() + row.size());
+  }
+  vector<vector<int> > keep;
+  nms_cpu_batched(offsets, sorted_boxes.empty() ? NULL : &sorted_boxes[0],
+      nms_thresh, &keep);
+
+  // The score of the max_per_image-th best detection over all classes.
+  Dtype min_score = -FLT_MAX;
+  if (max_per_image > 0) {
+    vector<Dtype> kept_scores;
+    for (int j = 1; j < num_classes; ++j) {
+      for (int i = 0; i < keep[j - 1].size(); ++i) {
+        kept_scores.push_back(
+            scores[rows[j - 1][keep[j - 1][i]] * num_classes + j]);
+      }
+    }
+    if (kept_scores.size() > max_per_image) {
+      std::nth_element(kept_scores.begin(),
+          kept_scores.begin() + max_per_image - 1, kept_scores.end(),
+          std::greater<Dtype>());
+      min_score = kept_scores[max_per_image - 1];
+    }
+  }
+
+  for (int j = 1; j < num_classes; ++j) {
+    vector<Dtype>& dets = (*class_dets)[j - 1];
+    for (int i = 0; i < keep[j - 1].size(); ++i) {
+      const int r = rows[j - 1][keep[j - 1][i]];
+      const Dtype score = scores[r * num_classes + j];
+      if (score >= min_score) {
+        const Dtype* box = boxes + 4 * (r * num_classes + j);
+        dets.insert(dets.end(), box, box + 4);
+        dets.push_back(score);
+      }
+    }
+  }
+}
+
+INSTANTIATE_CLASS(BatchDetector);
+
+}  // namespace caffe
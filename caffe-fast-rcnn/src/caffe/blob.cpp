@@ -1,3 +1,4 @@
+#include <algorithm>
 #include <climits>
 #include <vector>
 
@@ -30,14 +31,24 @@ void Blob<Dtype>::Reshape(const vector<int>& shape) {
   int* shape_data = static_cast<int*>(shape_data_->mutable_cpu_data());
   for (int i = 0; i < shape.size(); ++i) {
     CHECK_GE(shape[i], 0);
-    CHECK_LE(shape[i], INT_MAX / count_) << "blob size exceeds INT_MAX";
+    if (count_ != 0) {
+      CHECK_LE(shape[i], INT_MAX / count_) << "blob size exceeds INT_MAX";
+    }
     count_ *= shape[i];
     shape_[i] = shape[i];
     shape_data[i] = shape[i];
   }
   if (count_ > capacity_) {
-    capacity_ = count_;
+    if (capacity_ > 0) {
+      // Leave room to grow, within INT_MAX.
+      Caffe::count_blob_reallocation();
+      capacity_ = std::max<int64_t>(count_, std::min<int64_t>(INT_MAX,
+          static_cast<int64_t>(capacity_) + capacity_ / 4));
+    } else {
+      capacity_ = count_;
+    }
     data_.reset(new SyncedMemory(capacity_ * sizeof(Dtype)));
+    data_->set_zero_fill(zero_fill_);
     diff_.reset(new SyncedMemory(capacity_ * sizeof(Dtype)));
   }
 }
@@ -61,14 +72,14 @@ template <typename Dtype>
 Blob<Dtype>::Blob(const int num, const int channels, const int height,
     const int width)
   // capacity_ must be initialized before calling Reshape
-  : capacity_(0) {
+  : capacity_(0), zero_fill_(true) {
   Reshape(num, channels, height, width);
 }
 
 template <typename Dtype>
 Blob<Dtype>::Blob(const vector<int>& shape)
   // capacity_ must be initialized before calling Reshape
-  : capacity_(0) {
+  : capacity_(0), zero_fill_(true) {
   Reshape(shape);
 }
 
@@ -144,6 +155,23 @@ void Blob<Dtype>::ShareDiff(const Blob& other) {
   diff_ = other.diff();
 }
 
+template <typename Dtype>
+void Blob<Dtype>::ShareDataMemory(const shared_ptr<SyncedMemory>& memory) {
+  CHECK(memory);
+  CHECK_GE(memory->size(), count_ * sizeof(Dtype));
+  data_ = memory;
+  capacity_ = memory->size() / sizeof(Dtype);
+  diff_.reset(new SyncedMemory(capacity_ * sizeof(Dtype)));
+}
+
+template <typename Dtype>
+void Blob<Dtype>::set_zero_fill(bool zero_fill) {
+  zero_fill_ = zero_fill;
+  if (data_) {
+    data_->set_zero_fill(zero_fill);
+  }
+}
+
 // The "update" method is used for parameter blobs in a Net, which are stored
 // as Blob<float> or Blob<double> -- hence we do not define it for
 // Blob<int> or Blob<unsigned int>.
@@ -41,7 +41,8 @@ DataReader::~DataReader() {
 
 //
 
-DataReader::QueuePair::QueuePair(int size) {
+DataReader::QueuePair::QueuePair(int size)
+    : free_(size), full_(size) {
   // Initialize the free queue with requested number of datums
   for (int i = 0; i < size; ++i) {
     free_.push(new Datum());
@@ -60,9 +61,47 @@ DataReader::QueuePair::~QueuePair() {
 
 //
 
+DataReader::Shard::Shard(db::Cursor* cursor, int index, int count, int size)
+    : queue_pair_(size),
+      cursor_(cursor),
+      index_(index),
+      count_(count) {
+  StartInternalThread();
+}
+
+DataReader::Shard::~Shard() {
+  StopInternalThread();
+}
+
+void DataReader::Shard::InternalThreadEntry() {
+  skip(index_);
+  try {
+    while (!must_stop()) {
+      Datum* datum = queue_pair_.free_.pop();
+      datum->ParseFromString(cursor_->value());
+      queue_pair_.full_.push(datum);
+      skip(count_);
+    }
+  } catch (boost::thread_interrupted&) {
+    // Interrupted exception is expected on shutdown
+  }
+}
+
+void DataReader::Shard::skip(int count) {
+  for (int i = 0; i < count; ++i) {
+    cursor_->Next();
+    if (!cursor_->valid()) {
+      cursor_->SeekToFirst();
+    }
+  }
+}
+
+//
+
 DataReader::Body::Body(const LayerParameter& param)
     : param_(param),
-      new_queue_pairs_() {
+      new_queue_pairs_(),
+      next_shard_(0) {
   StartInternalThread();
 }
 
@@ -74,6 +113,15 @@ void DataReader::Body::InternalThreadEntry() {
   shared_ptr<db::DB> db(db::GetDB(param_.data_param().backend()));
   db->Open(param_.data_param().source(), db::READ);
   shared_ptr<db::Cursor> cursor(db->NewCursor());
+  // The shards share the database, and hold a cursor each
+  const int num_shards = param_.data_param().reader_threads();
+  if (num_shards > 1) {
+    const int size = param_.data_param().batch_size();
+    for (int i = 0; i < num_shards; ++i) {
+      shards_.push_back(shared_ptr<Shard>(
+          new Shard(db->NewCursor(), i, num_shards, size)));
+    }
+  }
   vector<shared_ptr<QueuePair> > qps;
   try {
     int solver_count = param_.phase() == TRAIN ? Caffe::solver_count() : 1;
@@ -100,9 +148,15 @@ void DataReader::Body::InternalThreadEntry() {
   } catch (boost::thread_interrupted&) {
     // Interrupted exception is expected on shutdown
   }
+  // Stop the shards before their cursors outlive the database
+  shards_.clear();
 }
 
 void DataReader::Body::read_one(db::Cursor* cursor, QueuePair* qp) {
+  if (!shards_.empty()) {
+    read_one_sharded(qp);
+    return;
+  }
   Datum* datum = qp->free_.pop();
   // TODO deserialize in-place instead of copy?
   datum->ParseFromString(cursor->value());
@@ -116,4 +170,26 @@ void DataReader::Body::read_one(db::Cursor* cursor, QueuePair* qp) {
   }
 }
 
+void DataReader::Body::read_one_sharded(QueuePair* qp) {
+  Datum* datum = qp->free_.pop();
+  const int num_shards = shards_.size();
+  Datum* parsed = NULL;
+  if (!param_.data_param().deterministic()) {
+    // Take from the first shard that is ready, starting after the last one
+    for (int i = 0; i < num_shards && !parsed; ++i) {
+      if (!shards_[next_shard_]->queue_pair_.full_.try_pop(&parsed)) {
+        next_shard_ = (next_shard_ + 1) % num_shards;
+      }
+    }
+  }
+  QueuePair& shard_qp = shards_[next_shard_]->queue_pair_;
+  if (!parsed) {
+    parsed = shard_qp.full_.pop();
+  }
+  datum->Swap(parsed);
+  shard_qp.free_.push(parsed);
+  next_shard_ = (next_shard_ + 1) % num_shards;
+  qp->full_.push(datum);
+}
+
 }  // namespace caffe
@@ -38,94 +38,141 @@ DataTransformer<Dtype>::DataTransformer(const TransformationParameter& param,
   }
 }
 
-template<typename Dtype>
-void DataTransformer<Dtype>::Transform(const Datum& datum,
-                                       Dtype* transformed_data) {
-  const string& data = datum.data();
-  const int datum_channels = datum.channels();
-  const int datum_height = datum.height();
-  const int datum_width = datum.width();
-
-  const int crop_size = param_.crop_size();
-  const Dtype scale = param_.scale();
-  const bool do_mirror = param_.mirror() && Rand(2);
-  const bool has_mean_file = param_.has_mean_file();
-  const bool has_uint8 = data.size() > 0;
-  const bool has_mean_values = mean_values_.size() > 0;
-
-  CHECK_GT(datum_channels, 0);
-  CHECK_GE(datum_height, crop_size);
-  CHECK_GE(datum_width, crop_size);
-
-  Dtype* mean = NULL;
-  if (has_mean_file) {
-    CHECK_EQ(datum_channels, data_mean_.channels());
-    CHECK_EQ(datum_height, data_mean_.height());
-    CHECK_EQ(datum_width, data_mean_.width());
-    mean = data_mean_.mutable_cpu_data();
+// Transforms a row of width pixels, each src_step elements apart in src, to
+// dst[w] = (src[w] - mean[w]) * scale, in reverse order if mirrored. Without
+// a mean file, mean_value is subtracted instead. The options are template
+// arguments, so that the loop has no branches and can be vectorized.
+template <typename Dtype, typename SrcType, bool kMirror, bool kMeanFile,
+    bool kContiguous>
+static void TransformRow(const SrcType* src, int src_step, const Dtype* mean,
+    Dtype mean_value, Dtype scale, int width, Dtype* dst) {
+  const int step = kContiguous ? 1 : src_step;
+  Dtype* out = kMirror ? dst + width - 1 : dst;
+  const int out_step = kMirror ? -1 : 1;
+  for (int w = 0; w < width; ++w) {
+    const Dtype pixel = static_cast<Dtype>(src[w * step]);
+    out[w * out_step] = (pixel - (kMeanFile ? mean[w] : mean_value)) * scale;
   }
-  if (has_mean_values) {
-    CHECK(mean_values_.size() == 1 || mean_values_.size() == datum_channels) <<
-     "Specify either 1 mean_value or as many as channels: " << datum_channels;
-    if (datum_channels > 1 && mean_values_.size() == 1) {
-      // Replicate the mean_value for simplicity
-      for (int c = 1; c < datum_channels; ++c) {
-        mean_values_.push_back(mean_values_[0]);
-      }
+}
+
+// Transforms the channels x height x width pixels at src, with the given
+// steps between channels, rows and pixels, to dst in CHW order. mean is
+// either NULL or a mean image with its own channel and row steps, and
+// mean_values either NULL or a value per channel.
+template <typename Dtype, typename SrcType>
+static void TransformImage(const SrcType* src, int src_channel_step,
+    int src_row_step, int src_step, const Dtype* mean, int mean_channel_step,
+    int mean_row_step, const Dtype* mean_values, int channels, int height,
+    int width, Dtype scale, bool mirror, Dtype* dst) {
+  typedef void (*RowKernel)(const SrcType*, int, const Dtype*, Dtype, Dtype,
+      int, Dtype*);
+  // Indexed by mirror, mean file and contiguous source
+  static const RowKernel kernels[8] = {
+    &TransformRow<Dtype, SrcType, false, false, false>,
+    &TransformRow<Dtype, SrcType, false, false, true>,
+    &TransformRow<Dtype, SrcType, false, true, false>,
+    &TransformRow<Dtype, SrcType, false, true, true>,
+    &TransformRow<Dtype, SrcType, true, false, false>,
+    &TransformRow<Dtype, SrcType, true, false, true>,
+    &TransformRow<Dtype, SrcType, true, true, false>,
+    &TransformRow<Dtype, SrcType, true, true, true>
+  };
+  const RowKernel row_kernel =
+      kernels[mirror * 4 + (mean != NULL) * 2 + (src_step == 1)];
+  for (int c = 0; c < channels; ++c) {
+    const Dtype mean_value = mean_values ? mean_values[c] : Dtype(0);
+    for (int h = 0; h < height; ++h) {
+      row_kernel(src + c * src_channel_step + h * src_row_step, src_step,
+          mean ? mean + c * mean_channel_step + h * mean_row_step : NULL,
+          mean_value, scale, width, dst + (c * height + h) * width);
     }
   }
+}
 
-  int height = datum_height;
-  int width = datum_width;
-
-  int h_off = 0;
-  int w_off = 0;
+template<typename Dtype>
+typename DataTransformer<Dtype>::CropMirror
+DataTransformer<Dtype>::RandCropMirror(int height, int width) {
+  const int crop_size = param_.crop_size();
+  CropMirror crop_mirror;
+  crop_mirror.mirror = param_.mirror() && Rand(2);
+  crop_mirror.h_off = 0;
+  crop_mirror.w_off = 0;
   if (crop_size) {
-    height = crop_size;
-    width = crop_size;
     // We only do random crop when we do training.
     if (phase_ == TRAIN) {
-      h_off = Rand(datum_height - crop_size + 1);
-      w_off = Rand(datum_width - crop_size + 1);
+      crop_mirror.h_off = Rand(height - crop_size + 1);
+      crop_mirror.w_off = Rand(width - crop_size + 1);
     } else {
-      h_off = (datum_height - crop_size) / 2;
-      w_off = (datum_width - crop_size) / 2;
+      crop_mirror.h_off = (height - crop_size) / 2;
+      crop_mirror.w_off = (width - crop_size) / 2;
     }
   }
+  return crop_mirror;
+}
 
-  Dtype datum_element;
-  int top_index, data_index;
-  for (int c = 0; c < datum_channels; ++c) {
-    for (int h = 0; h < height; ++h) {
-      for (int w = 0; w < width; ++w) {
-        data_index = (c * datum_height + h_off + h) * datum_width + w_off + w;
-        if (do_mirror) {
-          top_index = (c * height + h) * width + (width - 1 - w);
-        } else {
-          top_index = (c * height + h) * width + w;
-        }
-        if (has_uint8) {
-          datum_element =
-            static_cast<Dtype>(static_cast<uint8_t>(data[data_index]));
-        } else {
-          datum_element = datum.float_data(data_index);
-        }
-        if (has_mean_file) {
-          transformed_data[top_index] =
-            (datum_element - mean[data_index]) * scale;
-        } else {
-          if (has_mean_values) {
-            transformed_data[top_index] =
-              (datum_element - mean_values_[c]) * scale;
-          } else {
-            transformed_data[top_index] = datum_element * scale;
-          }
-        }
+template<typename Dtype>
+void DataTransformer<Dtype>::CheckMean(int channels, int height,
+    int width) {
+  const int crop_size = param_.crop_size();
+  CHECK_GT(channels, 0);
+  CHECK_GE(height, crop_size);
+  CHECK_GE(width, crop_size);
+
+  if (param_.has_mean_file()) {
+    CHECK_EQ(channels, data_mean_.channels());
+    CHECK_EQ(height, data_mean_.height());
+    CHECK_EQ(width, data_mean_.width());
+  }
+  if (mean_values_.size() > 0) {
+    CHECK(mean_values_.size() == 1 || mean_values_.size() == channels) <<
+     "Specify either 1 mean_value or as many as channels: " << channels;
+    if (channels > 1 && mean_values_.size() == 1) {
+      // Replicate the mean_value for simplicity
+      for (int c = 1; c < channels; ++c) {
+        mean_values_.push_back(mean_values_[0]);
       }
     }
   }
 }
 
+template<typename Dtype>
+void DataTransformer<Dtype>::Transform(const Datum& datum,
+                                       Dtype* transformed_data) {
+  CheckMean(datum.channels(), datum.height(), datum.width());
+  const CropMirror crop_mirror = RandCropMirror(datum.height(), datum.width());
+  Transform(datum, crop_mirror, transformed_data);
+}
+
+template<typename Dtype>
+void DataTransformer<Dtype>::Transform(const Datum& datum,
+    const CropMirror& crop_mirror, Dtype* transformed_data) {
+  const int datum_channels = datum.channels();
+  const int datum_height = datum.height();
+  const int datum_width = datum.width();
+  const int crop_size = param_.crop_size();
+  const int height = crop_size ? crop_size : datum_height;
+  const int width = crop_size ? crop_size : datum_width;
+
+  // The datum and the mean are both CHW, of the same shape
+  const int plane = datum_height * datum_width;
+  const int origin = crop_mirror.h_off * datum_width + crop_mirror.w_off;
+  const Dtype* mean = param_.has_mean_file() ?
+      data_mean_.cpu_data() + origin : NULL;
+  const Dtype* mean_values = mean_values_.size() > 0 ? &mean_values_[0] : NULL;
+  const Dtype scale = param_.scale();
+  const string& data = datum.data();
+  if (data.size() > 0) {
+    TransformImage(reinterpret_cast<const uint8_t*>(data.data()) + origin,
+        plane, datum_width, 1, mean, plane, datum_width, mean_values,
+        datum_channels, height, width, scale, crop_mirror.mirror,
+        transformed_data);
+  } else {
+    TransformImage(datum.float_data().data() + origin, plane, datum_width, 1,
+        mean, plane, datum_width, mean_values, datum_channels, height, width,
+        scale, crop_mirror.mirror, transformed_data);
+  }
+}
+
 
 template<typename Dtype>
 void DataTransformer<Dtype>::Transform(const Datum& datum,
@@ -133,17 +180,8 @@ void DataTransformer<Dtype>::Transform(const Datum& datum,
   // If datum is encoded, decoded and transform the cv::image.
   if (datum.encoded()) {
 #ifdef USE_OPENCV
-    CHECK(!(param_.force_color() && param_.force_gray()))
-        << "cannot set both force_color and force_gray";
-    cv::Mat cv_img;
-    if (param_.force_color() || param_.force_gray()) {
-    // If force_color then decode in color otherwise decode in gray.
-      cv_img = DecodeDatumToCVMat(datum, param_.force_color());
-    } else {
-      cv_img = DecodeDatumToCVMatNative(datum);
-    }
     // Transform the cv::image into blob.
-    return Transform(cv_img, transformed_blob);
+    return Transform(DecodeDatum(datum), transformed_blob);
 #else
     LOG(FATAL) << "Encoded datum requires OpenCV; compile with USE_OPENCV.";
 #endif  // USE_OPENCV
@@ -193,11 +231,40 @@ void DataTransformer<Dtype>::Transform(const vector<Datum> & datum_vector,
   CHECK_GT(datum_num, 0) << "There is no datum to add";
   CHECK_LE(datum_num, num) <<
     "The size of datum_vector must be no greater than transformed_blob->num()";
-  Blob<Dtype> uni_blob(1, channels, height, width);
+  if (datum_vector[0].encoded()) {
+#ifdef USE_OPENCV
+    vector<cv::Mat> mat_vector(datum_num);
+#pragma omp parallel for
+    for (int item_id = 0; item_id < datum_num; ++item_id) {
+      mat_vector[item_id] = DecodeDatum(datum_vector[item_id]);
+    }
+    Blob<Dtype> uni_blob(datum_num, channels, height, width);
+    uni_blob.set_cpu_data(transformed_blob->mutable_cpu_data());
+    return Transform(mat_vector, &uni_blob);
+#else
+    LOG(FATAL) << "Encoded datum requires OpenCV; compile with USE_OPENCV.";
+#endif  // USE_OPENCV
+  }
+  // Draw the random choices in order, then transform in parallel.
+  vector<CropMirror> crop_mirrors(datum_num);
+  for (int item_id = 0; item_id < datum_num; ++item_id) {
+    const Datum& datum = datum_vector[item_id];
+    CHECK_EQ(channels, datum.channels());
+    if (param_.crop_size()) {
+      CHECK_EQ(param_.crop_size(), height);
+      CHECK_EQ(param_.crop_size(), width);
+    } else {
+      CHECK_EQ(datum.height(), height);
+      CHECK_EQ(datum.width(), width);
+    }
+    CheckMean(datum.channels(), datum.height(), datum.width());
+    crop_mirrors[item_id] = RandCropMirror(datum.height(), datum.width());
+  }
+  Dtype* transformed_data = transformed_blob->mutable_cpu_data();
+#pragma omp parallel for
   for (int item_id = 0; item_id < datum_num; ++item_id) {
-    int offset = transformed_blob->offset(item_id);
-    uni_blob.set_cpu_data(transformed_blob->mutable_cpu_data() + offset);
-    Transform(datum_vector[item_id], &uni_blob);
+    Transform(datum_vector[item_id], crop_mirrors[item_id],
+        transformed_data + transformed_blob->offset(item_id));
   }
 }
 
@@ -214,11 +281,27 @@ void DataTransformer<Dtype>::Transform(const vector<cv::Mat> & mat_vector,
   CHECK_GT(mat_num, 0) << "There is no MAT to add";
   CHECK_EQ(mat_num, num) <<
     "The size of mat_vector must be equals to transformed_blob->num()";
-  Blob<Dtype> uni_blob(1, channels, height, width);
+  // Draw the random choices in order, then transform in parallel.
+  vector<CropMirror> crop_mirrors(mat_num);
   for (int item_id = 0; item_id < mat_num; ++item_id) {
-    int offset = transformed_blob->offset(item_id);
-    uni_blob.set_cpu_data(transformed_blob->mutable_cpu_data() + offset);
-    Transform(mat_vector[item_id], &uni_blob);
+    const cv::Mat& cv_img = mat_vector[item_id];
+    CHECK_EQ(channels, cv_img.channels());
+    CHECK(cv_img.depth() == CV_8U) << "Image data type must be unsigned byte";
+    if (param_.crop_size()) {
+      CHECK_EQ(param_.crop_size(), height);
+      CHECK_EQ(param_.crop_size(), width);
+    } else {
+      CHECK_EQ(cv_img.rows, height);
+      CHECK_EQ(cv_img.cols, width);
+    }
+    CheckMean(cv_img.channels(), cv_img.rows, cv_img.cols);
+    crop_mirrors[item_id] = RandCropMirror(cv_img.rows, cv_img.cols);
+  }
+  Dtype* transformed_data = transformed_blob->mutable_cpu_data();
+#pragma omp parallel for
+  for (int item_id = 0; item_id < mat_num; ++item_id) {
+    Transform(mat_vector[item_id], crop_mirrors[item_id],
+        transformed_data + transformed_blob->offset(item_id));
   }
 }
 
@@ -243,85 +326,49 @@ void DataTransformer<Dtype>::Transform(const cv::Mat& cv_img,
 
   CHECK(cv_img.depth() == CV_8U) << "Image data type must be unsigned byte";
 
-  const Dtype scale = param_.scale();
-  const bool do_mirror = param_.mirror() && Rand(2);
-  const bool has_mean_file = param_.has_mean_file();
-  const bool has_mean_values = mean_values_.size() > 0;
-
-  CHECK_GT(img_channels, 0);
-  CHECK_GE(img_height, crop_size);
-  CHECK_GE(img_width, crop_size);
-
-  Dtype* mean = NULL;
-  if (has_mean_file) {
-    CHECK_EQ(img_channels, data_mean_.channels());
-    CHECK_EQ(img_height, data_mean_.height());
-    CHECK_EQ(img_width, data_mean_.width());
-    mean = data_mean_.mutable_cpu_data();
-  }
-  if (has_mean_values) {
-    CHECK(mean_values_.size() == 1 || mean_values_.size() == img_channels) <<
-     "Specify either 1 mean_value or as many as channels: " << img_channels;
-    if (img_channels > 1 && mean_values_.size() == 1) {
-      // Replicate the mean_value for simplicity
-      for (int c = 1; c < img_channels; ++c) {
-        mean_values_.push_back(mean_values_[0]);
-      }
-    }
-  }
-
-  int h_off = 0;
-  int w_off = 0;
-  cv::Mat cv_cropped_img = cv_img;
   if (crop_size) {
     CHECK_EQ(crop_size, height);
     CHECK_EQ(crop_size, width);
-    // We only do random crop when we do training.
-    if (phase_ == TRAIN) {
-      h_off = Rand(img_height - crop_size + 1);
-      w_off = Rand(img_width - crop_size + 1);
-    } else {
-      h_off = (img_height - crop_size) / 2;
-      w_off = (img_width - crop_size) / 2;
-    }
-    cv::Rect roi(w_off, h_off, crop_size, crop_size);
-    cv_cropped_img = cv_img(roi);
   } else {
     CHECK_EQ(img_height, height);
     CHECK_EQ(img_width, width);
   }
+  CheckMean(img_channels, img_height, img_width);
+  const CropMirror crop_mirror = RandCropMirror(img_height, img_width);
+  Transform(cv_img, crop_mirror, transformed_blob->mutable_cpu_data());
+}
 
-  CHECK(cv_cropped_img.data);
+template<typename Dtype>
+void DataTransformer<Dtype>::Transform(const cv::Mat& cv_img,
+    const CropMirror& crop_mirror, Dtype* transformed_data) {
+  const int img_channels = cv_img.channels();
+  const int img_height = cv_img.rows;
+  const int img_width = cv_img.cols;
+  const int crop_size = param_.crop_size();
+  const int height = crop_size ? crop_size : img_height;
+  const int width = crop_size ? crop_size : img_width;
+
+  // The image is HWC, the mean CHW
+  const uchar* src = cv_img.ptr<uchar>(crop_mirror.h_off) +
+      crop_mirror.w_off * img_channels;
+  CHECK(src);
+  const Dtype* mean = param_.has_mean_file() ? data_mean_.cpu_data() +
+      crop_mirror.h_off * img_width + crop_mirror.w_off : NULL;
+  const Dtype* mean_values = mean_values_.size() > 0 ? &mean_values_[0] : NULL;
+  TransformImage(src, 1, static_cast<int>(cv_img.step1()), img_channels, mean,
+      img_height * img_width, img_width, mean_values, img_channels, height,
+      width, Dtype(param_.scale()), crop_mirror.mirror, transformed_data);
+}
 
-  Dtype* transformed_data = transformed_blob->mutable_cpu_data();
-  int top_index;
-  for (int h = 0; h < height; ++h) {
-    const uchar* ptr = cv_cropped_img.ptr<uchar>(h);
-    int img_index = 0;
-    for (int w = 0; w < width; ++w) {
-      for (int c = 0; c < img_channels; ++c) {
-        if (do_mirror) {
-          top_index = (c * height + h) * width + (width - 1 - w);
-        } else {
-          top_index = (c * height + h) * width + w;
-        }
-        // int top_index = (c * height + h) * width + w;
-        Dtype pixel = static_cast<Dtype>(ptr[img_index++]);
-        if (has_mean_file) {
-          int mean_index = (c * img_height + h_off + h) * img_width + w_off + w;
-          transformed_data[top_index] =
-            (pixel - mean[mean_index]) * scale;
-        } else {
-          if (has_mean_values) {
-            transformed_data[top_index] =
-              (pixel - mean_values_[c]) * scale;
-          } else {
-            transformed_data[top_index] = pixel * scale;
-          }
-        }
-      }
-    }
+template<typename Dtype>
+cv::Mat DataTransformer<Dtype>::DecodeDatum(const Datum& datum) {
+  CHECK(!(param_.force_color() && param_.force_gray()))
+      << "cannot set both force_color and force_gray";
+  if (param_.force_color() || param_.force_gray()) {
+    // If force_color then decode in color otherwise decode in gray.
+    return DecodeDatumToCVMat(datum, param_.force_color());
   }
+  return DecodeDatumToCVMatNative(datum);
 }
 #endif  // USE_OPENCV
 
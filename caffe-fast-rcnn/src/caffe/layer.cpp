@@ -86,8 +86,8 @@ void Layer<Dtype>::UpdateNumPrunedRow() {
     cout << "        " << this->layer_param_.name() << " in UpdateNumPrunedRow" << endl;
     vector<int>::iterator it;
     for (it = APP<Dtype>::rows_to_prune[L].begin(); it != APP<Dtype>::rows_to_prune[L].end(); ++it) {
-        caffe_gpu_set(num_col, (Dtype)0, this->blobs_[0]->mutable_gpu_data() + *it * num_col);
-        caffe_gpu_set(num_col, (Dtype)0, this->masks_[0]->mutable_gpu_data() + *it * num_col);
+        caffe_set(num_col, (Dtype)0, this->blobs_[0]->mutable_cpu_data() + *it * num_col);
+        caffe_set(num_col, (Dtype)0, this->masks_[0]->mutable_cpu_data() + *it * num_col);
         APP<Dtype>::IF_row_pruned[L][*it] = true;
         cout << " " << this->layer_param_.name() << " prune a row successfully: " << (*it) << endl;
     }
@@ -252,7 +252,7 @@ void Layer<Dtype>::RestoreMasks() {
     int   num_pruned_row = 0;
 
     // Clear existing pruning state
-    caffe_gpu_set(this->masks_[0]->count(), Dtype(1), this->masks_[0]->mutable_gpu_data());
+    caffe_set(this->masks_[0]->count(), Dtype(1), this->masks_[0]->mutable_cpu_data());
     APP<Dtype>::num_pruned_weight[L] = 0;
     APP<Dtype>::num_pruned_col[L]    = 0;
     APP<Dtype>::num_pruned_row[L]    = 0;
@@ -379,6 +379,12 @@ void Layer<Dtype>::PruneSetUp(const PruneParameter& prune_param) {
 /// @luoyang
 template <typename Dtype>
 void Layer<Dtype>::PruneForward() {
+    /// Only the train net prunes. Test nets may run their layers on several
+    /// threads (see NetParameter.forward_threads), so they must not touch APP.
+    if (this->phase_ != TRAIN) {
+        this->IF_restore = false;
+        return;
+    }
     const int count = this->blobs_[0]->count();
     const int num_row = this->blobs_[0]->shape()[0];
     const int num_col = count / num_row;
@@ -445,10 +451,21 @@ void Layer<Dtype>::PruneForward() {
 
         // Apply masks
         if (mthd != "None") {
-            caffe_gpu_mul(this->blobs_[0]->count(),
-                          this->blobs_[0]->gpu_data(),
-                          this->masks_[0]->gpu_data(),
-                          this->blobs_[0]->mutable_gpu_data());
+            if (Caffe::mode() == Caffe::CPU) {
+                caffe_mul(this->blobs_[0]->count(),
+                          this->blobs_[0]->cpu_data(),
+                          this->masks_[0]->cpu_data(),
+                          this->blobs_[0]->mutable_cpu_data());
+            } else {
+#ifndef CPU_ONLY
+                caffe_gpu_mul(this->blobs_[0]->count(),
+                              this->blobs_[0]->gpu_data(),
+                              this->masks_[0]->gpu_data(),
+                              this->blobs_[0]->mutable_gpu_data());
+#else
+                NO_GPU;
+#endif
+            }
         }
     }
   
@@ -481,10 +498,21 @@ void Layer<Dtype>::PruneBackward() {
     }
     // Apply masks to grads
     if (APP<Dtype>::pruned_ratio[L] > 0) {
-        caffe_gpu_mul(this->blobs_[0]->count(),
-                      this->blobs_[0]->gpu_diff(),
-                      this->masks_[0]->gpu_data(),
-                      this->blobs_[0]->mutable_gpu_diff());
+        if (Caffe::mode() == Caffe::CPU) {
+            caffe_mul(this->blobs_[0]->count(),
+                      this->blobs_[0]->cpu_diff(),
+                      this->masks_[0]->cpu_data(),
+                      this->blobs_[0]->mutable_cpu_diff());
+        } else {
+#ifndef CPU_ONLY
+            caffe_gpu_mul(this->blobs_[0]->count(),
+                          this->blobs_[0]->gpu_diff(),
+                          this->masks_[0]->gpu_data(),
+                          this->blobs_[0]->mutable_gpu_diff());
+#else
+            NO_GPU;
+#endif
+        }
     }
   
     //string self_prune_uint = this->layer_param_.prune_param().prune_unit();
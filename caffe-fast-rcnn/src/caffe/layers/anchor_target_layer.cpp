@@ -0,0 +1,266 @@
+// ------------------------------------------------------------------
+// Faster R-CNN
+// Copyright (c) 2015 Microsoft
+// Licensed under The MIT License [see fast-rcnn/LICENSE for details]
+// Written by Ross Girshick and Sean Bell
+// ------------------------------------------------------------------
+
+#include <algorithm>
+#include <cmath>
+#include <utility>
+#include <vector>
+
+#include "caffe/fast_rcnn_layers.hpp"
+#include "caffe/util/bbox_util.hpp"
+#include "caffe/util/math_functions.hpp"
+
+namespace caffe {
+
+template <typename Dtype>
+void AnchorTargetLayer<Dtype>::LayerSetUp(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top) {
+  const AnchorTargetParameter& anchor_param =
+      this->layer_param_.anchor_target_param();
+  CHECK_GT(anchor_param.feat_stride(), 0) << "feat_stride must be > 0";
+  CHECK_GT(anchor_param.base_size(), 0) << "base_size must be > 0";
+  CHECK(anchor_param.positive_weight() < 0 ||
+      (anchor_param.positive_weight() > 0 &&
+       anchor_param.positive_weight() < 1))
+      << "positive_weight must be in (0, 1), or negative";
+  feat_stride_ = anchor_param.feat_stride();
+
+  vector<Dtype> ratios(anchor_param.ratio().begin(),
+      anchor_param.ratio().end());
+  if (ratios.empty()) {
+    ratios.push_back(0.5);
+    ratios.push_back(1);
+    ratios.push_back(2);
+  }
+  vector<Dtype> scales(anchor_param.scale().begin(),
+      anchor_param.scale().end());
+  if (scales.empty()) {
+    scales.push_back(8);
+    scales.push_back(16);
+    scales.push_back(32);
+  }
+  generate_anchors(anchor_param.base_size(), ratios, scales, &anchors_);
+  height_ = -1;
+  width_ = -1;
+}
+
+template <typename Dtype>
+void AnchorTargetLayer<Dtype>::Reshape(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top) {
+  CHECK_EQ(bottom[0]->num(), 1) << "Only single item batches are supported";
+  CHECK_EQ(bottom[1]->count(1), 5) << "gt_boxes must be (x1, y1, x2, y2, "
+      << "label)";
+  CHECK_GE(bottom[2]->count(), 3) << "im_info must be (height, width, scale)";
+  const int num_anchors = anchors_.size() / 4;
+  const int height = bottom[0]->height();
+  const int width = bottom[0]->width();
+  top[0]->Reshape(1, 1, num_anchors * height, width);
+  for (int i = 1; i < 4; ++i) {
+    top[i]->Reshape(1, 4 * num_anchors, height, width);
+  }
+  if (height == height_ && width == width_) {
+    return;
+  }
+  // Shift the anchors to every cell, in (h, w, a) order.
+  height_ = height;
+  width_ = width;
+  all_anchors_.resize(height * width * anchors_.size());
+  for (int h = 0; h < height; ++h) {
+    for (int w = 0; w < width; ++w) {
+      Dtype* cell_anchors = &all_anchors_[(h * width + w) * anchors_.size()];
+      for (int a = 0; a < num_anchors; ++a) {
+        cell_anchors[4 * a] = anchors_[4 * a] + w * feat_stride_;
+        cell_anchors[4 * a + 1] = anchors_[4 * a + 1] + h * feat_stride_;
+        cell_anchors[4 * a + 2] = anchors_[4 * a + 2] + w * feat_stride_;
+        cell_anchors[4 * a + 3] = anchors_[4 * a + 3] + h * feat_stride_;
+      }
+    }
+  }
+}
+
+template <typename Dtype>
+void AnchorTargetLayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top) {
+  const AnchorTargetParameter& anchor_param =
+      this->layer_param_.anchor_target_param();
+  const int num_anchors = anchors_.size() / 4;
+  const int spatial_dim = height_ * width_;
+  const int total_anchors = spatial_dim * num_anchors;
+  const Dtype* gt_boxes = bottom[1]->cpu_data();
+  const int num_gt = bottom[1]->num();
+  CHECK_GT(num_gt, 0) << "AnchorTarget needs at least one gt box";
+  const Dtype* im_info = bottom[2]->cpu_data();
+  const Dtype border = anchor_param.allowed_border();
+
+  // Only keep the anchors inside the image.
+  vector<char> inside(total_anchors);
+  for (int i = 0; i < total_anchors; ++i) {
+    const Dtype* anchor = &all_anchors_[4 * i];
+    inside[i] = anchor[0] >= -border && anchor[1] >= -border &&
+        anchor[2] < im_info[1] + border && anchor[3] < im_info[0] + border;
+  }
+
+  // The overlaps of the anchors with each gt box. Only the cells whose
+  // anchors can intersect the box are visited, so instead of a dense
+  // anchors x gt matrix this holds the few nonzero entries.
+  vector<vector<std::pair<int, Dtype> > > gt_overlaps(num_gt);
+#pragma omp parallel for schedule(dynamic)
+  for (int g = 0; g < num_gt; ++g) {
+    const Dtype* gt_box = gt_boxes + 5 * g;
+    for (int a = 0; a < num_anchors; ++a) {
+      const Dtype* anchor = &anchors_[4 * a];
+      // Shifts for which the anchor and the box may intersect.
+      const int w_start = std::max(0, static_cast<int>(
+          std::ceil((gt_box[0] - anchor[2] - 1) / feat_stride_)));
+      const int w_end = std::min(width_ - 1, static_cast<int>(
+          std::floor((gt_box[2] - anchor[0] + 1) / feat_stride_)));
+      const int h_start = std::max(0, static_cast<int>(
+          std::ceil((gt_box[1] - anchor[3] - 1) / feat_stride_)));
+      const int h_end = std::min(height_ - 1, static_cast<int>(
+          std::floor((gt_box[3] - anchor[1] + 1) / feat_stride_)));
+      for (int h = h_start; h <= h_end; ++h) {
+        for (int w = w_start; w <= w_end; ++w) {
+          const int index = (h * width_ + w) * num_anchors + a;
+          if (!inside[index]) {
+            continue;
+          }
+          const Dtype overlap = bbox_overlap(&all_anchors_[4 * index],
+              gt_box);
+          if (overlap > 0) {
+            gt_overlaps[g].push_back(std::make_pair(index, overlap));
+          }
+        }
+      }
+    }
+  }
+
+  // The best gt box of each anchor (the first one on ties, 0 if none
+  // overlaps), and the best overlap of each gt box.
+  vector<Dtype> max_overlaps(total_anchors, 0);
+  vector<int> argmax_overlaps(total_anchors, 0);
+  vector<Dtype> gt_max_overlaps(num_gt, 0);
+  for (int g = 0; g < num_gt; ++g) {
+    for (int j = 0; j < gt_overlaps[g].size(); ++j) {
+      const int index = gt_overlaps[g][j].first;
+      const Dtype overlap = gt_overlaps[g][j].second;
+      if (overlap > max_overlaps[index]) {
+        max_overlaps[index] = overlap;
+        argmax_overlaps[index] = g;
+      }
+      gt_max_overlaps[g] = std::max(gt_max_overlaps[g], overlap);
+    }
+  }
+
+  // label: 1 is positive, 0 is negative, -1 is dont care
+  const Dtype negative_overlap = anchor_param.negative_overlap();
+  const Dtype positive_overlap = anchor_param.positive_overlap();
+  vector<int> labels(total_anchors, -1);
+  if (!anchor_param.clobber_positives()) {
+    // Assign bg labels first so that positive labels can clobber them.
+    for (int i = 0; i < total_anchors; ++i) {
+      if (inside[i] && max_overlaps[i] < negative_overlap) {
+        labels[i] = 0;
+      }
+    }
+  }
+  // fg label: for each gt, the anchors with the highest overlap. A gt box
+  // that overlaps no anchor gets none (anchor_target_layer.py would then
+  // flag every anchor that misses it).
+  for (int g = 0; g < num_gt; ++g) {
+    for (int j = 0; j < gt_overlaps[g].size(); ++j) {
+      if (gt_overlaps[g][j].second == gt_max_overlaps[g]) {
+        labels[gt_overlaps[g][j].first] = 1;
+      }
+    }
+  }
+  // fg label: above threshold IoU
+  for (int i = 0; i < total_anchors; ++i) {
+    if (inside[i] && max_overlaps[i] >= positive_overlap) {
+      labels[i] = 1;
+    }
+  }
+  if (anchor_param.clobber_positives()) {
+    // Assign bg labels last so that negative labels can clobber positives.
+    for (int i = 0; i < total_anchors; ++i) {
+      if (inside[i] && max_overlaps[i] < negative_overlap) {
+        labels[i] = 0;
+      }
+    }
+  }
+
+  // Subsample the positive, then the negative labels if there are too many.
+  const int batch_size = anchor_param.batch_size();
+  const int max_fg = anchor_param.fg_fraction() * batch_size;
+  vector<int> fg_inds, bg_inds;
+  for (int i = 0; i < total_anchors; ++i) {
+    if (labels[i] == 1) {
+      fg_inds.push_back(i);
+    } else if (labels[i] == 0) {
+      bg_inds.push_back(i);
+    }
+  }
+  int num_fg = fg_inds.size();
+  if (num_fg > max_fg) {
+    sample_without_replacement(num_fg - max_fg, &fg_inds);
+    for (int j = 0; j < num_fg - max_fg; ++j) {
+      labels[fg_inds[j]] = -1;
+    }
+    num_fg = max_fg;
+  }
+  int num_bg = bg_inds.size();
+  const int max_bg = batch_size - num_fg;
+  if (num_bg > max_bg) {
+    sample_without_replacement(num_bg - max_bg, &bg_inds);
+    for (int j = 0; j < num_bg - max_bg; ++j) {
+      labels[bg_inds[j]] = -1;
+    }
+    num_bg = max_bg;
+  }
+
+  Dtype positive_weight, negative_weight;
+  if (anchor_param.positive_weight() < 0) {
+    // uniform weighting of examples (given non-uniform sampling)
+    positive_weight = negative_weight = Dtype(1) / (num_fg + num_bg);
+  } else {
+    positive_weight = anchor_param.positive_weight() / num_fg;
+    negative_weight = (1 - anchor_param.positive_weight()) / num_bg;
+  }
+
+  // Write the outputs, transposed from (h, w, a) to (a, h, w) order.
+  Dtype* top_labels = top[0]->mutable_cpu_data();
+  Dtype* bbox_targets = top[1]->mutable_cpu_data();
+  Dtype* bbox_inside_weights = top[2]->mutable_cpu_data();
+  Dtype* bbox_outside_weights = top[3]->mutable_cpu_data();
+  caffe_set(top[1]->count(), Dtype(0), bbox_targets);
+  caffe_set(top[2]->count(), Dtype(0), bbox_inside_weights);
+  caffe_set(top[3]->count(), Dtype(0), bbox_outside_weights);
+  for (int hw = 0; hw < spatial_dim; ++hw) {
+    for (int a = 0; a < num_anchors; ++a) {
+      const int index = hw * num_anchors + a;
+      top_labels[a * spatial_dim + hw] = labels[index];
+      if (!inside[index]) {
+        continue;
+      }
+      Dtype targets[4];
+      bbox_transform(&all_anchors_[4 * index],
+          gt_boxes + 5 * argmax_overlaps[index], targets);
+      const Dtype outside_weight = labels[index] == 1 ? positive_weight :
+          labels[index] == 0 ? negative_weight : Dtype(0);
+      for (int k = 0; k < 4; ++k) {
+        const int offset = (4 * a + k) * spatial_dim + hw;
+        bbox_targets[offset] = targets[k];
+        bbox_inside_weights[offset] = labels[index] == 1;
+        bbox_outside_weights[offset] = outside_weight;
+      }
+    }
+  }
+}
+
+INSTANTIATE_CLASS(AnchorTargetLayer);
+REGISTER_LAYER_CLASS(AnchorTarget);
+
+}  // namespace caffe
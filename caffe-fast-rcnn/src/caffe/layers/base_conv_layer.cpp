@@ -1,3 +1,4 @@
+#include <boost/thread.hpp>
 #include <algorithm>
 #include <vector>
 
@@ -9,12 +10,25 @@
 
 namespace caffe {
 
+// The im2col tiles of all the layers a thread runs go to one buffer, which
+// only grows to the largest tile.
+template <typename Dtype>
+static Dtype* col_tile_buffer(int count) {
+  static boost::thread_specific_ptr<Blob<Dtype> > buffer;
+  if (!buffer.get()) {
+    buffer.reset(new Blob<Dtype>());
+  }
+  buffer->Reshape(vector<int>(1, count));
+  return buffer->mutable_cpu_data();
+}
+
 template <typename Dtype>
 void BaseConvolutionLayer<Dtype>::LayerSetUp(const vector<Blob<Dtype>*>& bottom,
       const vector<Blob<Dtype>*>& top) {
   // Configure the kernel size, padding, stride, and inputs.
   ConvolutionParameter conv_param = this->layer_param_.convolution_param();
   force_nd_im2col_ = conv_param.force_nd_im2col();
+  use_live_cols_ = false;
   channel_axis_ = bottom[0]->CanonicalAxisIndex(conv_param.axis());
   const int first_spatial_axis = channel_axis_ + 1;
   const int num_axes = bottom[0]->num_axes();
@@ -218,26 +232,40 @@ void BaseConvolutionLayer<Dtype>::LayerSetUp(const vector<Blob<Dtype>*>& bottom,
     /// @luoyang initialize masks
     //if (this->layer_param_.prune_param().prune_unit() != "None") {
     if (APP<Dtype>::prune_method != "None") {
-      caffe_gpu_set(this->masks_[0]->count(), Dtype(1), this->masks_[0]->mutable_gpu_data());
+      caffe_set(this->masks_[0]->count(), Dtype(1), this->masks_[0]->mutable_cpu_data());
     }
     /// @lixiang, for pruning
     if (APP<Dtype>::prune_method.substr(0, 3) == "Reg") {
-        caffe_gpu_set(this->history_score_[0]->count(),  Dtype(0), this->history_score_[0]->mutable_gpu_data());
-        caffe_gpu_set(this->history_punish_[0]->count(), Dtype(0), this->history_punish_[0]->mutable_gpu_data());
+        caffe_set(this->history_score_[0]->count(),  Dtype(0), this->history_score_[0]->mutable_cpu_data());
+        caffe_set(this->history_punish_[0]->count(), Dtype(0), this->history_punish_[0]->mutable_cpu_data());
     }
     if (bias_term_) {
       //if (this->layer_param_.prune_param().prune_unit() != "None") {
       if (APP<Dtype>::prune_method != "None") {
-        caffe_gpu_set(this->masks_[1]->count(), Dtype(1), this->masks_[1]->mutable_gpu_data());
+        caffe_set(this->masks_[1]->count(), Dtype(1), this->masks_[1]->mutable_cpu_data());
       }
       if (APP<Dtype>::prune_method.substr(0, 3) == "Reg") {
-        caffe_gpu_set(this->history_score_[1]->count(),  Dtype(0), this->history_score_[1]->mutable_gpu_data());
-        caffe_gpu_set(this->history_punish_[1]->count(), Dtype(0), this->history_punish_[1]->mutable_gpu_data());
+        caffe_set(this->history_score_[1]->count(),  Dtype(0), this->history_score_[1]->mutable_cpu_data());
+        caffe_set(this->history_punish_[1]->count(), Dtype(0), this->history_punish_[1]->mutable_cpu_data());
       }
     }
   }
   kernel_dim_ = this->blobs_[0]->count(1);
   weight_offset_ = conv_out_channels_ * kernel_dim_ / group_;
+  all_cols_.resize(kernel_dim_);
+  for (int j = 0; j < kernel_dim_; ++j) {
+    all_cols_[j] = j;
+  }
+  // Batch threads
+  const int batch_threads = conv_param.batch_threads();
+  CHECK_GT(batch_threads, 0);
+  batch_threads_.clear();
+  for (int i = 1; i < batch_threads; ++i) {
+    batch_threads_.push_back(shared_ptr<BatchThread>(new BatchThread()));
+  }
+  if (batch_threads > 1) {
+    batch_pool_.reset(new ThreadPool(batch_threads));
+  }
   // Propagate gradients to the parameters (as directed by backward pass).
   this->param_propagate_down_.resize(this->blobs_.size(), true);
 
@@ -304,6 +332,19 @@ void BaseConvolutionLayer<Dtype>::Reshape(const vector<Blob<Dtype>*>& bottom,
     }
   }
   col_buffer_.Reshape(col_buffer_shape_);
+  for (int i = 0; i < batch_threads_.size(); ++i) {
+    batch_threads_[i]->col_buffer.Reshape(col_buffer_shape_);
+  }
+  // Tiles of whole output rows, but no larger than im2col_tile_bytes.
+  col_tile_rows_ = 0;
+  const int tile_bytes =
+      this->layer_param_.convolution_param().im2col_tile_bytes();
+  if (tile_bytes > 0 && !is_1x1_ && !force_nd_im2col_
+      && num_spatial_axes_ == 2) {
+    const int row_bytes = kernel_dim_ * col_buffer_shape_[2] * sizeof(Dtype);
+    col_tile_rows_ = std::min(std::max(tile_bytes / row_bytes, 1),
+        col_buffer_shape_[1]);
+  }
   bottom_dim_ = bottom[0]->count(channel_axis_);
   top_dim_ = top[0]->count(channel_axis_);
   num_kernels_im2col_ = conv_in_channels_ * conv_out_spatial_dim_;
@@ -318,15 +359,136 @@ void BaseConvolutionLayer<Dtype>::Reshape(const vector<Blob<Dtype>*>& bottom,
   }
 }
 
+template <typename Dtype>
+void BaseConvolutionLayer<Dtype>::update_live_cols() {
+  use_live_cols_ = false;
+  if (reverse_dimensions() || force_nd_im2col_ || num_spatial_axes_ != 2) {
+    return;
+  }
+  // While pruning, the dead columns are those of APP::IF_col_pruned (masked
+  // to zero, weights and gradients). A test net has no gradients, so there
+  // any all-zero weight column, e.g. of a pruned caffemodel, is dead.
+  const string& layer_name = this->layer_param_.name();
+  int L = -1;
+  if (APP<Dtype>::prune_method != "None"
+      && APP<Dtype>::layer_index.count(layer_name)) {
+    L = APP<Dtype>::layer_index[layer_name];
+    if (L >= APP<Dtype>::IF_col_pruned.size()
+        || APP<Dtype>::IF_col_pruned[L].size() != kernel_dim_) {
+      L = -1;
+    }
+  }
+  if (L == -1 && this->phase_ != TEST) {
+    return;
+  }
+  const Dtype* weight = this->blobs_[0]->cpu_data();
+  const int rows_per_group = conv_out_channels_ / group_;
+  live_cols_.resize(group_);
+  int num_live = 0;
+  for (int g = 0; g < group_; ++g) {
+    live_cols_[g].clear();
+    const Dtype* group_weight = weight + weight_offset_ * g;
+    for (int j = 0; j < kernel_dim_; ++j) {
+      bool dead = true;
+      if (L != -1) {
+        dead = APP<Dtype>::IF_col_pruned[L][j][g];
+      } else {
+        for (int i = 0; i < rows_per_group && dead; ++i) {
+          dead = group_weight[i * kernel_dim_ + j] == 0;
+        }
+      }
+      if (!dead) {
+        live_cols_[g].push_back(j);
+      }
+    }
+    num_live += live_cols_[g].size();
+  }
+  if (num_live == kernel_dim_ * group_) {
+    return;
+  }
+  use_live_cols_ = true;
+  vector<int> live_weight_shape(1, std::max(rows_per_group * num_live, 1));
+  live_weight_.Reshape(live_weight_shape);
+  Dtype* live_weight = live_weight_.mutable_cpu_data();
+  for (int g = 0; g < group_; ++g) {
+    const vector<int>& live = live_cols_[g];
+    const Dtype* group_weight = weight + weight_offset_ * g;
+    for (int i = 0; i < rows_per_group; ++i) {
+      for (int k = 0; k < live.size(); ++k) {
+        *(live_weight++) = group_weight[i * kernel_dim_ + live[k]];
+      }
+    }
+  }
+}
+
 template <typename Dtype>
 void BaseConvolutionLayer<Dtype>::forward_cpu_gemm(const Dtype* input,
-    const Dtype* weights, Dtype* output, bool skip_im2col) {
+    const Dtype* weights, Dtype* output, bool skip_im2col, int thread_id) {
+  if (col_tile_rows_ > 0) {
+    // Multiply each tile as soon as it is built, while it is still in cache.
+    const int rows_per_group = conv_out_channels_ / group_;
+    const int group_input_dim = conv_in_channels_ / group_ *
+        conv_input_shape_.cpu_data()[1] * conv_input_shape_.cpu_data()[2];
+    const int output_h = col_buffer_shape_[1];
+    const int output_w = col_buffer_shape_[2];
+    const Dtype* live_weight =
+        use_live_cols_ ? live_weight_.cpu_data() : NULL;
+    Dtype* col_buff = col_tile_buffer<Dtype>(
+        kernel_dim_ * col_tile_rows_ * output_w);
+    for (int g = 0; g < group_; ++g) {
+      const vector<int>& rows = use_live_cols_ ? live_cols_[g] : all_cols_;
+      Dtype* group_output = output + output_offset_ * g;
+      if (rows.empty()) {
+        caffe_set(output_offset_, Dtype(0), group_output);
+        continue;
+      }
+      const Dtype* group_weights = use_live_cols_ ? live_weight :
+          weights + weight_offset_ * g;
+      for (int h = 0; h < output_h; h += col_tile_rows_) {
+        const int h_end = std::min(h + col_tile_rows_, output_h);
+        conv_im2col_tile_cpu(input + group_input_dim * g, rows, h, h_end,
+            col_buff);
+        caffe_cpu_gemm<Dtype>(CblasNoTrans, CblasNoTrans, rows_per_group,
+            (h_end - h) * output_w, rows.size(),
+            (Dtype)1., group_weights, col_buff,
+            (Dtype)0., group_output + h * output_w, conv_out_spatial_dim_);
+      }
+      if (use_live_cols_) {
+        live_weight += rows_per_group * rows.size();
+      }
+    }
+    return;
+  }
+  if (use_live_cols_) {
+    // weights were packed into live_weight_ by update_live_cols()
+    const int rows_per_group = conv_out_channels_ / group_;
+    const int group_input_dim = bottom_dim_ / group_;
+    const Dtype* live_weight = live_weight_.cpu_data();
+    Dtype* col_buff = col_buffer(thread_id)->mutable_cpu_data();
+    for (int g = 0; g < group_; ++g) {
+      const vector<int>& live = live_cols_[g];
+      if (live.empty()) {
+        caffe_set(output_offset_, Dtype(0), output + output_offset_ * g);
+        continue;
+      }
+      if (!skip_im2col) {
+        conv_im2col_rows_cpu(input + group_input_dim * g, live, col_buff);
+      }
+      caffe_cpu_gemm<Dtype>(CblasNoTrans, CblasNoTrans, rows_per_group,
+          conv_out_spatial_dim_, live.size(),
+          (Dtype)1., live_weight, col_buff,
+          (Dtype)0., output + output_offset_ * g);
+      live_weight += rows_per_group * live.size();
+      col_buff += live.size() * conv_out_spatial_dim_;
+    }
+    return;
+  }
   const Dtype* col_buff = input;
   if (!is_1x1_) {
     if (!skip_im2col) {
-      conv_im2col_cpu(input, col_buffer_.mutable_cpu_data());
+      conv_im2col_cpu(input, col_buffer(thread_id)->mutable_cpu_data());
     }
-    col_buff = col_buffer_.cpu_data();
+    col_buff = col_buffer(thread_id)->cpu_data();
   }
   for (int g = 0; g < group_; ++g) {
     caffe_cpu_gemm<Dtype>(CblasNoTrans, CblasNoTrans, conv_out_channels_ /
@@ -346,8 +508,28 @@ void BaseConvolutionLayer<Dtype>::forward_cpu_bias(Dtype* output,
 
 template <typename Dtype>
 void BaseConvolutionLayer<Dtype>::backward_cpu_gemm(const Dtype* output,
-    const Dtype* weights, Dtype* input) {
-  Dtype* col_buff = col_buffer_.mutable_cpu_data();
+    const Dtype* weights, Dtype* input, int thread_id) {
+  if (use_live_cols_) {
+    // The dead rows of the column gradient are all zero: skip them.
+    const int rows_per_group = conv_out_channels_ / group_;
+    const int group_input_dim = bottom_dim_ / group_;
+    const Dtype* live_weight = live_weight_.cpu_data();
+    Dtype* col_buff = col_buffer(thread_id)->mutable_cpu_data();
+    for (int g = 0; g < group_; ++g) {
+      const vector<int>& live = live_cols_[g];
+      if (!live.empty()) {
+        caffe_cpu_gemm<Dtype>(CblasTrans, CblasNoTrans, live.size(),
+            conv_out_spatial_dim_, rows_per_group,
+            (Dtype)1., live_weight, output + output_offset_ * g,
+            (Dtype)0., col_buff);
+      }
+      conv_col2im_rows_cpu(col_buff, live, input + group_input_dim * g);
+      live_weight += rows_per_group * live.size();
+      col_buff += live.size() * conv_out_spatial_dim_;
+    }
+    return;
+  }
+  Dtype* col_buff = col_buffer(thread_id)->mutable_cpu_data();
   if (is_1x1_) {
     col_buff = input;
   }
@@ -364,11 +546,42 @@ void BaseConvolutionLayer<Dtype>::backward_cpu_gemm(const Dtype* output,
 
 template <typename Dtype>
 void BaseConvolutionLayer<Dtype>::weight_cpu_gemm(const Dtype* input,
-    const Dtype* output, Dtype* weights) {
+    const Dtype* output, Dtype* weights, int thread_id) {
+  if (use_live_cols_) {
+    // Only the live columns get a gradient, the dead ones are masked anyway.
+    const int rows_per_group = conv_out_channels_ / group_;
+    const int group_input_dim = bottom_dim_ / group_;
+    Blob<Dtype>* live_weight = &live_weight_;
+    if (thread_id > 0) {
+      live_weight = &batch_threads_[thread_id - 1]->live_weight_diff;
+      live_weight->ReshapeLike(live_weight_);
+    }
+    Dtype* live_weight_diff = live_weight->mutable_cpu_diff();
+    Dtype* col_buff = col_buffer(thread_id)->mutable_cpu_data();
+    for (int g = 0; g < group_; ++g) {
+      const vector<int>& live = live_cols_[g];
+      if (live.empty()) {
+        continue;
+      }
+      conv_im2col_rows_cpu(input + group_input_dim * g, live, col_buff);
+      caffe_cpu_gemm<Dtype>(CblasNoTrans, CblasTrans, rows_per_group,
+          live.size(), conv_out_spatial_dim_,
+          (Dtype)1., output + output_offset_ * g, col_buff,
+          (Dtype)0., live_weight_diff);
+      Dtype* group_weights = weights + weight_offset_ * g;
+      for (int i = 0; i < rows_per_group; ++i) {
+        for (int k = 0; k < live.size(); ++k) {
+          group_weights[i * kernel_dim_ + live[k]] += *(live_weight_diff++);
+        }
+      }
+      col_buff += live.size() * conv_out_spatial_dim_;
+    }
+    return;
+  }
   const Dtype* col_buff = input;
   if (!is_1x1_) {
-    conv_im2col_cpu(input, col_buffer_.mutable_cpu_data());
-    col_buff = col_buffer_.cpu_data();
+    conv_im2col_cpu(input, col_buffer(thread_id)->mutable_cpu_data());
+    col_buff = col_buffer(thread_id)->cpu_data();
   }
   for (int g = 0; g < group_; ++g) {
     caffe_cpu_gemm<Dtype>(CblasNoTrans, CblasTrans, conv_out_channels_ / group_,
@@ -385,6 +598,55 @@ void BaseConvolutionLayer<Dtype>::backward_cpu_bias(Dtype* bias,
       input, bias_multiplier_.cpu_data(), 1., bias);
 }
 
+template <typename Dtype>
+void BaseConvolutionLayer<Dtype>::run_batch(
+    const boost::function<void(int)>& task) {
+  if (batch_pool_) {
+    batch_pool_->Run(task);
+  } else {
+    task(0);
+  }
+}
+
+template <typename Dtype>
+Dtype* BaseConvolutionLayer<Dtype>::batch_weight_diff(int thread_id) {
+  if (thread_id == 0) {
+    return this->blobs_[0]->mutable_cpu_diff();
+  }
+  Blob<Dtype>& weight_diff = batch_threads_[thread_id - 1]->weight_diff;
+  weight_diff.ReshapeLike(*this->blobs_[0]);
+  caffe_set(weight_diff.count(), Dtype(0), weight_diff.mutable_cpu_data());
+  return weight_diff.mutable_cpu_data();
+}
+
+template <typename Dtype>
+Dtype* BaseConvolutionLayer<Dtype>::batch_bias_diff(int thread_id) {
+  if (thread_id == 0) {
+    return this->blobs_[1]->mutable_cpu_diff();
+  }
+  Blob<Dtype>& bias_diff = batch_threads_[thread_id - 1]->bias_diff;
+  bias_diff.ReshapeLike(*this->blobs_[1]);
+  caffe_set(bias_diff.count(), Dtype(0), bias_diff.mutable_cpu_data());
+  return bias_diff.mutable_cpu_data();
+}
+
+template <typename Dtype>
+void BaseConvolutionLayer<Dtype>::reduce_batch_diffs() {
+  // In thread order, so that the sum does not depend on the timing.
+  for (int i = 0; i < batch_threads_.size(); ++i) {
+    if (this->param_propagate_down_[0]) {
+      caffe_axpy(this->blobs_[0]->count(), Dtype(1),
+          batch_threads_[i]->weight_diff.cpu_data(),
+          this->blobs_[0]->mutable_cpu_diff());
+    }
+    if (bias_term_ && this->param_propagate_down_[1]) {
+      caffe_axpy(this->blobs_[1]->count(), Dtype(1),
+          batch_threads_[i]->bias_diff.cpu_data(),
+          this->blobs_[1]->mutable_cpu_diff());
+    }
+  }
+}
+
 #ifndef CPU_ONLY
 
 template <typename Dtype>
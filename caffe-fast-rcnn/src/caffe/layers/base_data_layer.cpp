@@ -7,7 +7,7 @@
 #include "caffe/layer.hpp"
 #include "caffe/layers/base_data_layer.hpp"
 #include "caffe/proto/caffe.pb.h"
-#include "caffe/util/blocking_queue.hpp"
+#include "caffe/util/lock_free_queue.hpp"
 
 namespace caffe {
 
@@ -36,7 +36,7 @@ template <typename Dtype>
 BasePrefetchingDataLayer<Dtype>::BasePrefetchingDataLayer(
     const LayerParameter& param)
     : BaseDataLayer<Dtype>(param),
-      prefetch_free_(), prefetch_full_() {
+      prefetch_free_(PREFETCH_COUNT), prefetch_full_(PREFETCH_COUNT) {
   for (int i = 0; i < PREFETCH_COUNT; ++i) {
     prefetch_free_.push(&prefetch_[i]);
   }
@@ -106,7 +106,11 @@ void BasePrefetchingDataLayer<Dtype>::InternalThreadEntry() {
 template <typename Dtype>
 void BasePrefetchingDataLayer<Dtype>::Forward_cpu(
     const vector<Blob<Dtype>*>& bottom, const vector<Blob<Dtype>*>& top) {
-  Batch<Dtype>* batch = prefetch_full_.pop("Data layer prefetch queue empty");
+  Batch<Dtype>* batch;
+  {
+    ProfileScope scope(this->profile_, LayerProfile::DATA_WAIT);
+    batch = prefetch_full_.pop("Data layer prefetch queue empty");
+  }
   // Reshape to loaded data.
   top[0]->ReshapeLike(batch->data_);
   // Copy the data
@@ -7,7 +7,11 @@ namespace caffe {
 template <typename Dtype>
 void BasePrefetchingDataLayer<Dtype>::Forward_gpu(
     const vector<Blob<Dtype>*>& bottom, const vector<Blob<Dtype>*>& top) {
-  Batch<Dtype>* batch = prefetch_full_.pop("Data layer prefetch queue empty");
+  Batch<Dtype>* batch;
+  {
+    ProfileScope scope(this->profile_, LayerProfile::DATA_WAIT);
+    batch = prefetch_full_.pop("Data layer prefetch queue empty");
+  }
   // Reshape to loaded data.
   top[0]->ReshapeLike(batch->data_);
   // Copy the data
@@ -1,3 +1,4 @@
+#include <boost/bind.hpp>
 #include <vector>
 
 #include "caffe/layers/conv_layer.hpp"
@@ -24,17 +25,28 @@ void ConvolutionLayer<Dtype>::compute_output_shape() {
 template <typename Dtype>
 void ConvolutionLayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
       const vector<Blob<Dtype>*>& top) {
+  this->PruneForward(); // @luoyang, for pruning
+  this->update_live_cols();
+
   const Dtype* weight = this->blobs_[0]->cpu_data();
+  const Dtype* bias = this->bias_term_ ? this->blobs_[1]->cpu_data() : NULL;
   for (int i = 0; i < bottom.size(); ++i) {
     const Dtype* bottom_data = bottom[i]->cpu_data();
     Dtype* top_data = top[i]->mutable_cpu_data();
-    for (int n = 0; n < this->num_; ++n) {
-      this->forward_cpu_gemm(bottom_data + n * this->bottom_dim_, weight,
-          top_data + n * this->top_dim_);
-      if (this->bias_term_) {
-        const Dtype* bias = this->blobs_[1]->cpu_data();
-        this->forward_cpu_bias(top_data + n * this->top_dim_, bias);
-      }
+    this->run_batch(boost::bind(&ConvolutionLayer<Dtype>::forward_cpu_batch,
+        this, bottom_data, weight, bias, top_data, _1));
+  }
+}
+
+template <typename Dtype>
+void ConvolutionLayer<Dtype>::forward_cpu_batch(const Dtype* bottom_data,
+    const Dtype* weight, const Dtype* bias, Dtype* top_data, int thread_id) {
+  for (int n = this->batch_begin(thread_id);
+      n < this->batch_begin(thread_id + 1); ++n) {
+    this->forward_cpu_gemm(bottom_data + n * this->bottom_dim_, weight,
+        top_data + n * this->top_dim_, false, thread_id);
+    if (this->bias_term_) {
+      this->forward_cpu_bias(top_data + n * this->top_dim_, bias);
     }
   }
 }
@@ -43,30 +55,44 @@ template <typename Dtype>
 void ConvolutionLayer<Dtype>::Backward_cpu(const vector<Blob<Dtype>*>& top,
       const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom) {
   const Dtype* weight = this->blobs_[0]->cpu_data();
-  Dtype* weight_diff = this->blobs_[0]->mutable_cpu_diff();
   for (int i = 0; i < top.size(); ++i) {
     const Dtype* top_diff = top[i]->cpu_diff();
     const Dtype* bottom_data = bottom[i]->cpu_data();
     Dtype* bottom_diff = bottom[i]->mutable_cpu_diff();
-    // Bias gradient, if necessary.
-    if (this->bias_term_ && this->param_propagate_down_[1]) {
-      Dtype* bias_diff = this->blobs_[1]->mutable_cpu_diff();
-      for (int n = 0; n < this->num_; ++n) {
-        this->backward_cpu_bias(bias_diff, top_diff + n * this->top_dim_);
-      }
+    this->run_batch(boost::bind(&ConvolutionLayer<Dtype>::backward_cpu_batch,
+        this, top_diff, weight, bottom_data, bottom_diff,
+        static_cast<bool>(propagate_down[i]), _1));
+    this->reduce_batch_diffs();
+  }
+  this->PruneBackward(); // @luoyang, for pruning
+}
+
+template <typename Dtype>
+void ConvolutionLayer<Dtype>::backward_cpu_batch(const Dtype* top_diff,
+    const Dtype* weight, const Dtype* bottom_data, Dtype* bottom_diff,
+    bool propagate_down, int thread_id) {
+  const int begin = this->batch_begin(thread_id);
+  const int end = this->batch_begin(thread_id + 1);
+  // Bias gradient, if necessary.
+  if (this->bias_term_ && this->param_propagate_down_[1]) {
+    Dtype* bias_diff = this->batch_bias_diff(thread_id);
+    for (int n = begin; n < end; ++n) {
+      this->backward_cpu_bias(bias_diff, top_diff + n * this->top_dim_);
     }
-    if (this->param_propagate_down_[0] || propagate_down[i]) {
-      for (int n = 0; n < this->num_; ++n) {
-        // gradient w.r.t. weight. Note that we will accumulate diffs.
-        if (this->param_propagate_down_[0]) {
-          this->weight_cpu_gemm(bottom_data + n * this->bottom_dim_,
-              top_diff + n * this->top_dim_, weight_diff);
-        }
-        // gradient w.r.t. bottom data, if necessary.
-        if (propagate_down[i]) {
-          this->backward_cpu_gemm(top_diff + n * this->top_dim_, weight,
-              bottom_diff + n * this->bottom_dim_);
-        }
+  }
+  if (this->param_propagate_down_[0] || propagate_down) {
+    Dtype* weight_diff = this->param_propagate_down_[0] ?
+        this->batch_weight_diff(thread_id) : NULL;
+    for (int n = begin; n < end; ++n) {
+      // gradient w.r.t. weight. Note that we will accumulate diffs.
+      if (this->param_propagate_down_[0]) {
+        this->weight_cpu_gemm(bottom_data + n * this->bottom_dim_,
+            top_diff + n * this->top_dim_, weight_diff, thread_id);
+      }
+      // gradient w.r.t. bottom data, if necessary.
+      if (propagate_down) {
+        this->backward_cpu_gemm(top_diff + n * this->top_dim_, weight,
+            bottom_diff + n * this->bottom_dim_, thread_id);
       }
     }
   }
@@ -3,6 +3,8 @@
 #endif  // USE_OPENCV
 #include <stdint.h>
 
+#include <boost/bind.hpp>
+#include <boost/thread.hpp>
 #include <vector>
 
 #include "caffe/data_transformer.hpp"
@@ -14,7 +16,11 @@ namespace caffe {
 template <typename Dtype>
 DataLayer<Dtype>::DataLayer(const LayerParameter& param)
   : BasePrefetchingDataLayer<Dtype>(param),
-    reader_(param) {
+    reader_(param),
+    read_time_(0),
+    decode_time_(0),
+    transform_time_(0),
+    time_mutex_(new boost::mutex()) {
 }
 
 template <typename Dtype>
@@ -22,6 +28,24 @@ DataLayer<Dtype>::~DataLayer() {
   this->StopInternalThread();
 }
 
+template <typename Dtype>
+double DataLayer<Dtype>::read_time() const {
+  boost::mutex::scoped_lock lock(*time_mutex_);
+  return read_time_ / 1000;
+}
+
+template <typename Dtype>
+double DataLayer<Dtype>::decode_time() const {
+  boost::mutex::scoped_lock lock(*time_mutex_);
+  return decode_time_ / 1000;
+}
+
+template <typename Dtype>
+double DataLayer<Dtype>::transform_time() const {
+  boost::mutex::scoped_lock lock(*time_mutex_);
+  return transform_time_ / 1000;
+}
+
 template <typename Dtype>
 void DataLayer<Dtype>::DataLayerSetUp(const vector<Blob<Dtype>*>& bottom,
       const vector<Blob<Dtype>*>& top) {
@@ -49,6 +73,24 @@ void DataLayer<Dtype>::DataLayerSetUp(const vector<Blob<Dtype>*>& bottom,
       this->prefetch_[i].label_.Reshape(label_shape);
     }
   }
+  // Decode threads
+  const int decode_threads = this->layer_param_.data_param().decode_threads();
+  CHECK_GT(decode_threads, 0);
+  transformers_.push_back(this->data_transformer_);
+  for (int i = 1; i < decode_threads; ++i) {
+    transformers_.push_back(shared_ptr<DataTransformer<Dtype> >(
+        new DataTransformer<Dtype>(this->transform_param_, this->phase_)));
+    transformers_[i]->InitRand();
+  }
+  for (int i = 0; i < decode_threads; ++i) {
+    transformed_items_.push_back(shared_ptr<Blob<Dtype> >(new Blob<Dtype>()));
+  }
+  if (decode_threads > 1) {
+    decode_pool_.reset(new ThreadPool(decode_threads));
+  }
+  decode_times_.resize(decode_threads);
+  transform_times_.resize(decode_threads);
+  batch_datums_.resize(batch_size);
 }
 
 // This function is called on prefetch thread
@@ -57,7 +99,6 @@ void DataLayer<Dtype>::load_batch(Batch<Dtype>* batch) {
   CPUTimer batch_timer;
   batch_timer.Start();
   double read_time = 0;
-  double trans_time = 0;
   CPUTimer timer;
   CHECK(batch->data_.count());
   CHECK(this->transformed_data_.count());
@@ -69,6 +110,9 @@ void DataLayer<Dtype>::load_batch(Batch<Dtype>* batch) {
   // Use data_transformer to infer the expected blob shape from datum.
   vector<int> top_shape = this->data_transformer_->InferBlobShape(datum);
   this->transformed_data_.Reshape(top_shape);
+  for (int i = 0; i < transformed_items_.size(); ++i) {
+    transformed_items_[i]->Reshape(top_shape);
+  }
   // Reshape batch according to the batch_size.
   top_shape[0] = batch_size;
   batch->data_.Reshape(top_shape);
@@ -82,28 +126,77 @@ void DataLayer<Dtype>::load_batch(Batch<Dtype>* batch) {
   for (int item_id = 0; item_id < batch_size; ++item_id) {
     timer.Start();
     // get a datum
-    Datum& datum = *(reader_.full().pop("Waiting for data"));
+    batch_datums_[item_id] = reader_.full().pop("Waiting for data");
     read_time += timer.MicroSeconds();
-    timer.Start();
-    // Apply data transformations (mirror, scale, crop...)
-    int offset = batch->data_.offset(item_id);
-    this->transformed_data_.set_cpu_data(top_data + offset);
-    this->data_transformer_->Transform(datum, &(this->transformed_data_));
-    // Copy label.
-    if (this->output_labels_) {
-      top_label[item_id] = datum.label();
-    }
-    trans_time += timer.MicroSeconds();
-
-    reader_.free().push(const_cast<Datum*>(&datum));
+  }
+  // Apply data transformations (mirror, scale, crop...)
+  for (int i = 0; i < decode_times_.size(); ++i) {
+    decode_times_[i] = 0;
+    transform_times_[i] = 0;
+  }
+  if (decode_pool_) {
+    decode_pool_->Run(boost::bind(&DataLayer<Dtype>::TransformItems, this, _1,
+        batch->data_.count(1), top_data, top_label));
+  } else {
+    TransformItems(0, batch->data_.count(1), top_data, top_label);
+  }
+  double decode_time = 0;
+  double trans_time = 0;
+  for (int i = 0; i < decode_times_.size(); ++i) {
+    decode_time += decode_times_[i];
+    trans_time += transform_times_[i];
+  }
+  for (int item_id = 0; item_id < batch_size; ++item_id) {
+    reader_.free().push(batch_datums_[item_id]);
   }
   timer.Stop();
   batch_timer.Stop();
+  {
+    boost::mutex::scoped_lock lock(*time_mutex_);
+    read_time_ += read_time;
+    decode_time_ += decode_time;
+    transform_time_ += trans_time;
+  }
   DLOG(INFO) << "Prefetch batch: " << batch_timer.MilliSeconds() << " ms.";
   DLOG(INFO) << "     Read time: " << read_time / 1000 << " ms.";
+  DLOG(INFO) << "   Decode time: " << decode_time / 1000 << " ms.";
   DLOG(INFO) << "Transform time: " << trans_time / 1000 << " ms.";
 }
 
+// This function is called on the decode threads
+template<typename Dtype>
+void DataLayer<Dtype>::TransformItems(int thread_id, int item_size,
+    Dtype* top_data, Dtype* top_label) {
+  DataTransformer<Dtype>* transformer = transformers_[thread_id].get();
+  Blob<Dtype>* transformed_item = transformed_items_[thread_id].get();
+  CPUTimer timer;
+  for (int item_id = thread_id; item_id < batch_datums_.size();
+      item_id += transformers_.size()) {
+    const Datum& datum = *batch_datums_[item_id];
+    transformed_item->set_cpu_data(top_data + item_id * item_size);
+#ifdef USE_OPENCV
+    if (datum.encoded()) {
+      timer.Start();
+      cv::Mat cv_img = transformer->DecodeDatum(datum);
+      decode_times_[thread_id] += timer.MicroSeconds();
+      timer.Start();
+      transformer->Transform(cv_img, transformed_item);
+    } else {
+      timer.Start();
+      transformer->Transform(datum, transformed_item);
+    }
+#else
+    timer.Start();
+    transformer->Transform(datum, transformed_item);
+#endif  // USE_OPENCV
+    // Copy label.
+    if (this->output_labels_) {
+      top_label[item_id] = datum.label();
+    }
+    transform_times_[thread_id] += timer.MicroSeconds();
+  }
+}
+
 INSTANTIATE_CLASS(DataLayer);
 REGISTER_LAYER_CLASS(Data);
 
@@ -0,0 +1,356 @@
+#include <algorithm>
+#include <vector>
+
+#include "caffe/layers/direct_conv_layer.hpp"
+#include "caffe/util/math_functions.hpp"
+
+namespace caffe {
+
+// The transformed input of a block of Winograd tiles is 16 x live channels x
+// tiles; blocks are sized to about this many elements to stay in cache.
+static const int kWinogradBlockCount = 1 << 18;
+// Output channels the direct convolution accumulates together, so that each
+// input row is read once for the whole block.
+static const int kDirectBlock = 8;
+
+template <typename Dtype>
+void DirectConvolutionLayer<Dtype>::LayerSetUp(
+    const vector<Blob<Dtype>*>& bottom, const vector<Blob<Dtype>*>& top) {
+  ConvolutionLayer<Dtype>::LayerSetUp(bottom, top);
+  use_direct_ = this->num_spatial_axes_ == 2 && !this->force_nd_im2col_;
+  if (!use_direct_) {
+    LOG(INFO) << "Layer " << this->layer_param_.name()
+        << " is not 2D, using the im2col GEMM path.";
+  }
+  const int* kernel_shape = this->kernel_shape_.cpu_data();
+  const int* stride = this->stride_.cpu_data();
+  const int* dilation = this->dilation_.cpu_data();
+  use_winograd_ = use_direct_ && this->layer_param_.convolution_param().engine()
+      == ConvolutionParameter_Engine_WINOGRAD
+      && kernel_shape[0] == 3 && kernel_shape[1] == 3
+      && stride[0] == 1 && stride[1] == 1
+      && dilation[0] == 1 && dilation[1] == 1;
+}
+
+template <typename Dtype>
+void DirectConvolutionLayer<Dtype>::Forward_cpu(
+    const vector<Blob<Dtype>*>& bottom, const vector<Blob<Dtype>*>& top) {
+  if (!use_direct_) {
+    ConvolutionLayer<Dtype>::Forward_cpu(bottom, top);
+    return;
+  }
+  this->PruneForward();  // for pruning
+  this->update_live_cols();
+  update_live_channels();
+
+  const Dtype* weight = this->blobs_[0]->cpu_data();
+  if (use_winograd_) {
+    winograd_transform_weights(weight);
+  }
+  for (int i = 0; i < bottom.size(); ++i) {
+    const Dtype* bottom_data = bottom[i]->cpu_data();
+    Dtype* top_data = top[i]->mutable_cpu_data();
+    for (int n = 0; n < this->num_; ++n) {
+      if (use_winograd_) {
+        forward_cpu_winograd(bottom_data + n * this->bottom_dim_,
+            top_data + n * this->top_dim_);
+      } else {
+        forward_cpu_direct(bottom_data + n * this->bottom_dim_, weight,
+            top_data + n * this->top_dim_);
+      }
+      if (this->bias_term_) {
+        const Dtype* bias = this->blobs_[1]->cpu_data();
+        this->forward_cpu_bias(top_data + n * this->top_dim_, bias);
+      }
+    }
+  }
+}
+
+template <typename Dtype>
+void DirectConvolutionLayer<Dtype>::update_live_channels() {
+  const int group = this->group_;
+  const int channels = this->channels_ / group;
+  const int kernel_size =
+      this->kernel_shape_.cpu_data()[0] * this->kernel_shape_.cpu_data()[1];
+  live_channels_.resize(group);
+  for (int g = 0; g < group; ++g) {
+    live_channels_[g].clear();
+    vector<bool> live(channels, !this->use_live_cols_);
+    if (this->use_live_cols_) {
+      const vector<int>& live_cols = this->live_cols_[g];
+      for (int j = 0; j < live_cols.size(); ++j) {
+        live[live_cols[j] / kernel_size] = true;
+      }
+    }
+    for (int c = 0; c < channels; ++c) {
+      if (live[c]) {
+        live_channels_[g].push_back(c);
+      }
+    }
+  }
+}
+
+template <typename Dtype>
+void DirectConvolutionLayer<Dtype>::forward_cpu_direct(const Dtype* input,
+    const Dtype* weights, Dtype* output) {
+  const int group = this->group_;
+  const int channels = this->channels_ / group;
+  const int num_output = this->num_output_ / group;
+  const int height = this->conv_input_shape_.cpu_data()[1];
+  const int width = this->conv_input_shape_.cpu_data()[2];
+  const int kernel_h = this->kernel_shape_.cpu_data()[0];
+  const int kernel_w = this->kernel_shape_.cpu_data()[1];
+  const int pad_h = this->pad_.cpu_data()[0];
+  const int pad_w = this->pad_.cpu_data()[1];
+  const int stride_h = this->stride_.cpu_data()[0];
+  const int stride_w = this->stride_.cpu_data()[1];
+  const int dilation_h = this->dilation_.cpu_data()[0];
+  const int dilation_w = this->dilation_.cpu_data()[1];
+  const int output_h = this->output_shape_[0];
+  const int output_w = this->output_shape_[1];
+  const int kernel_dim = channels * kernel_h * kernel_w;
+  const int output_dim = output_h * output_w;
+  caffe_set(this->top_dim_, Dtype(0), output);
+
+  vector<int> cols;
+  for (int g = 0; g < group; ++g) {
+    // The columns (input channel, kernel row, kernel column) to go through
+    if (this->use_live_cols_) {
+      cols = this->live_cols_[g];
+    } else {
+      cols.resize(kernel_dim);
+      for (int j = 0; j < kernel_dim; ++j) {
+        cols[j] = j;
+      }
+    }
+    const Dtype* group_input = input + channels * height * width * g;
+    const Dtype* group_weights = weights + this->weight_offset_ * g;
+    Dtype* group_output = output + num_output * output_dim * g;
+    for (int o_begin = 0; o_begin < num_output; o_begin += kDirectBlock) {
+      const int o_end = std::min(o_begin + kDirectBlock, num_output);
+      for (int k = 0; k < cols.size(); ++k) {
+        const int j = cols[k];
+        const int c = j / (kernel_h * kernel_w);
+        const int kh = j / kernel_w % kernel_h;
+        const int kw = j % kernel_w;
+        // The output columns whose input column is inside the image
+        const int w_offset = kw * dilation_w - pad_w;
+        int ow_begin = 0;
+        while (ow_begin < output_w && ow_begin * stride_w + w_offset < 0) {
+          ++ow_begin;
+        }
+        int ow_end = output_w;
+        while (ow_end > ow_begin
+            && (ow_end - 1) * stride_w + w_offset >= width) {
+          --ow_end;
+        }
+        for (int oh = 0; oh < output_h; ++oh) {
+          const int ih = oh * stride_h + kh * dilation_h - pad_h;
+          if (ih < 0 || ih >= height) {
+            continue;
+          }
+          const Dtype* input_row = group_input + (c * height + ih) * width
+              + w_offset;
+          for (int o = o_begin; o < o_end; ++o) {
+            const Dtype weight = group_weights[o * kernel_dim + j];
+            if (weight == 0) {
+              continue;
+            }
+            Dtype* output_row = group_output + o * output_dim + oh * output_w;
+            for (int ow = ow_begin; ow < ow_end; ++ow) {
+              output_row[ow] += weight * input_row[ow * stride_w];
+            }
+          }
+        }
+      }
+    }
+  }
+}
+
+// U = G g G^T for a 3x3 filter g, with
+// G = [1 0 0; 1/2 1/2 1/2; 1/2 -1/2 1/2; 0 0 1].
+template <typename Dtype>
+static void winograd_filter_transform(const Dtype g[9], Dtype u[16]) {
+  Dtype t[12];  // G g, 4x3
+  for (int j = 0; j < 3; ++j) {
+    t[j] = g[j];
+    t[3 + j] = (g[j] + g[3 + j] + g[6 + j]) / 2;
+    t[6 + j] = (g[j] - g[3 + j] + g[6 + j]) / 2;
+    t[9 + j] = g[6 + j];
+  }
+  for (int i = 0; i < 4; ++i) {
+    const Dtype* r = t + 3 * i;
+    u[4 * i] = r[0];
+    u[4 * i + 1] = (r[0] + r[1] + r[2]) / 2;
+    u[4 * i + 2] = (r[0] - r[1] + r[2]) / 2;
+    u[4 * i + 3] = r[2];
+  }
+}
+
+// V = B^T d B for a 4x4 input tile d, with
+// B^T = [1 0 -1 0; 0 1 1 0; 0 -1 1 0; 0 1 0 -1].
+template <typename Dtype>
+static void winograd_input_transform(const Dtype d[16], Dtype v[16]) {
+  Dtype t[16];  // B^T d
+  for (int j = 0; j < 4; ++j) {
+    t[j] = d[j] - d[8 + j];
+    t[4 + j] = d[4 + j] + d[8 + j];
+    t[8 + j] = d[8 + j] - d[4 + j];
+    t[12 + j] = d[4 + j] - d[12 + j];
+  }
+  for (int i = 0; i < 4; ++i) {
+    const Dtype* r = t + 4 * i;
+    v[4 * i] = r[0] - r[2];
+    v[4 * i + 1] = r[1] + r[2];
+    v[4 * i + 2] = r[2] - r[1];
+    v[4 * i + 3] = r[1] - r[3];
+  }
+}
+
+// Y = A^T m A for a 4x4 product tile m, with A^T = [1 1 1 0; 0 1 -1 -1].
+template <typename Dtype>
+static void winograd_output_transform(const Dtype m[16], Dtype y[4]) {
+  Dtype t[8];  // A^T m, 2x4
+  for (int j = 0; j < 4; ++j) {
+    t[j] = m[j] + m[4 + j] + m[8 + j];
+    t[4 + j] = m[4 + j] - m[8 + j] - m[12 + j];
+  }
+  for (int i = 0; i < 2; ++i) {
+    const Dtype* r = t + 4 * i;
+    y[2 * i] = r[0] + r[1] + r[2];
+    y[2 * i + 1] = r[1] - r[2] - r[3];
+  }
+}
+
+template <typename Dtype>
+void DirectConvolutionLayer<Dtype>::winograd_transform_weights(
+    const Dtype* weights) {
+  const int group = this->group_;
+  const int channels = this->channels_ / group;
+  const int num_output = this->num_output_ / group;
+  vector<int> shape(1, group * 16 * num_output * channels);
+  winograd_weight_.Reshape(shape);
+  Dtype* transformed = winograd_weight_.mutable_cpu_data();
+  Dtype g[9];
+  Dtype u[16];
+  for (int gr = 0; gr < group; ++gr) {
+    const vector<int>& live = live_channels_[gr];
+    const int num_live = live.size();
+    const Dtype* group_weights = weights + this->weight_offset_ * gr;
+    // The dead columns of a live channel count as zero, as in the GEMM path
+    vector<bool> live_col(channels * 9, !this->use_live_cols_);
+    if (this->use_live_cols_) {
+      for (int j = 0; j < this->live_cols_[gr].size(); ++j) {
+        live_col[this->live_cols_[gr][j]] = true;
+      }
+    }
+    Dtype* group_transformed = transformed + 16 * num_output * channels * gr;
+    for (int o = 0; o < num_output; ++o) {
+      for (int i = 0; i < num_live; ++i) {
+        const int c = live[i];
+        for (int k = 0; k < 9; ++k) {
+          g[k] = live_col[c * 9 + k] ?
+              group_weights[(o * channels + c) * 9 + k] : Dtype(0);
+        }
+        winograd_filter_transform(g, u);
+        for (int xi = 0; xi < 16; ++xi) {
+          group_transformed[(xi * num_output + o) * num_live + i] = u[xi];
+        }
+      }
+    }
+  }
+}
+
+template <typename Dtype>
+void DirectConvolutionLayer<Dtype>::forward_cpu_winograd(const Dtype* input,
+    Dtype* output) {
+  const int group = this->group_;
+  const int channels = this->channels_ / group;
+  const int num_output = this->num_output_ / group;
+  const int height = this->conv_input_shape_.cpu_data()[1];
+  const int width = this->conv_input_shape_.cpu_data()[2];
+  const int pad_h = this->pad_.cpu_data()[0];
+  const int pad_w = this->pad_.cpu_data()[1];
+  const int output_h = this->output_shape_[0];
+  const int output_w = this->output_shape_[1];
+  const int output_dim = output_h * output_w;
+  const int tiles_h = (output_h + 1) / 2;
+  const int tiles_w = (output_w + 1) / 2;
+  const int num_tiles = tiles_h * tiles_w;
+
+  Dtype d[16];
+  Dtype v[16];
+  Dtype m[16];
+  Dtype y[4];
+  for (int g = 0; g < group; ++g) {
+    const vector<int>& live = live_channels_[g];
+    const int num_live = live.size();
+    Dtype* group_output = output + num_output * output_dim * g;
+    if (num_live == 0) {
+      caffe_set(num_output * output_dim, Dtype(0), group_output);
+      continue;
+    }
+    const Dtype* group_input = input + channels * height * width * g;
+    const Dtype* group_weight = winograd_weight_.cpu_data()
+        + 16 * num_output * channels * g;
+    const int block = std::min(num_tiles,
+        std::max(kWinogradBlockCount / (16 * num_live), 4));
+    vector<int> shape(1, 16 * num_live * block);
+    winograd_input_.Reshape(shape);
+    shape[0] = 16 * num_output * block;
+    winograd_output_.Reshape(shape);
+    Dtype* transformed_input = winograd_input_.mutable_cpu_data();
+    Dtype* transformed_output = winograd_output_.mutable_cpu_data();
+    for (int t_begin = 0; t_begin < num_tiles; t_begin += block) {
+      const int tiles = std::min(block, num_tiles - t_begin);
+      // Transform the input tiles, the 16 elements 16 matrices apart
+      for (int i = 0; i < num_live; ++i) {
+        const Dtype* channel_input = group_input + live[i] * height * width;
+        for (int t = 0; t < tiles; ++t) {
+          const int h0 = (t_begin + t) / tiles_w * 2 - pad_h;
+          const int w0 = (t_begin + t) % tiles_w * 2 - pad_w;
+          for (int r = 0; r < 4; ++r) {
+            const int h = h0 + r;
+            for (int s = 0; s < 4; ++s) {
+              const int w = w0 + s;
+              d[4 * r + s] = (h >= 0 && h < height && w >= 0 && w < width) ?
+                  channel_input[h * width + w] : Dtype(0);
+            }
+          }
+          winograd_input_transform(d, v);
+          for (int xi = 0; xi < 16; ++xi) {
+            transformed_input[(xi * num_live + i) * tiles + t] = v[xi];
+          }
+        }
+      }
+      // Sum the products over the input channels
+      for (int xi = 0; xi < 16; ++xi) {
+        caffe_cpu_gemm<Dtype>(CblasNoTrans, CblasNoTrans, num_output, tiles,
+            num_live, (Dtype)1., group_weight + xi * num_output * num_live,
+            transformed_input + xi * num_live * tiles,
+            (Dtype)0., transformed_output + xi * num_output * tiles);
+      }
+      // Transform back into the output tiles, cut at the bottom and right
+      for (int o = 0; o < num_output; ++o) {
+        Dtype* channel_output = group_output + o * output_dim;
+        for (int t = 0; t < tiles; ++t) {
+          for (int xi = 0; xi < 16; ++xi) {
+            m[xi] = transformed_output[(xi * num_output + o) * tiles + t];
+          }
+          winograd_output_transform(m, y);
+          const int h0 = (t_begin + t) / tiles_w * 2;
+          const int w0 = (t_begin + t) % tiles_w * 2;
+          for (int r = 0; r < 2 && h0 + r < output_h; ++r) {
+            for (int s = 0; s < 2 && w0 + s < output_w; ++s) {
+              channel_output[(h0 + r) * output_w + w0 + s] = y[2 * r + s];
+            }
+          }
+        }
+      }
+    }
+  }
+}
+
+INSTANTIATE_CLASS(DirectConvolutionLayer);
+
+}  // namespace caffe
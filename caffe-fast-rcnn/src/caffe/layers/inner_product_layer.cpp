@@ -1,3 +1,4 @@
+#include <boost/bind.hpp>
 #include <vector>
 
 #include "caffe/filler.hpp"
@@ -103,25 +104,38 @@ void InnerProductLayer<Dtype>::LayerSetUp(const vector<Blob<Dtype>*>& bottom,
     /// @luoyang: initialize masks
     // if (this->layer_param_.prune_param().prune_unit() != "None") {
     if (APP<Dtype>::prune_method != "None") {
-      caffe_gpu_set(this->masks_[0]->count(), Dtype(1), this->masks_[0]->mutable_gpu_data());
+      caffe_set(this->masks_[0]->count(), Dtype(1), this->masks_[0]->mutable_cpu_data());
     }
     if (APP<Dtype>::prune_method.substr(0, 3) == "Reg") {
-        caffe_gpu_set(this->history_score_[0]->count(),  Dtype(0), this->history_score_[0]->mutable_gpu_data());
-        caffe_gpu_set(this->history_punish_[0]->count(), Dtype(0), this->history_punish_[0]->mutable_gpu_data());
+        caffe_set(this->history_score_[0]->count(),  Dtype(0), this->history_score_[0]->mutable_cpu_data());
+        caffe_set(this->history_punish_[0]->count(), Dtype(0), this->history_punish_[0]->mutable_cpu_data());
     }
     if (bias_term_) {
       // if (this->layer_param_.prune_param().prune_unit() != "None") {
       if (APP<Dtype>::prune_method != "None") {
-        caffe_gpu_set(this->masks_[1]->count(), Dtype(1), this->masks_[1]->mutable_gpu_data());
+        caffe_set(this->masks_[1]->count(), Dtype(1), this->masks_[1]->mutable_cpu_data());
       }
       if (APP<Dtype>::prune_method.substr(0, 3) == "Reg") {
-        caffe_gpu_set(this->history_score_[1]->count(),  Dtype(0), this->history_score_[1]->mutable_gpu_data());
-        caffe_gpu_set(this->history_punish_[1]->count(), Dtype(0), this->history_punish_[1]->mutable_gpu_data());
+        caffe_set(this->history_score_[1]->count(),  Dtype(0), this->history_score_[1]->mutable_cpu_data());
+        caffe_set(this->history_punish_[1]->count(), Dtype(0), this->history_punish_[1]->mutable_cpu_data());
       }
     }
       
   }  // parameter initialization
   this->param_propagate_down_.resize(this->blobs_.size(), true);
+  // Batch threads
+  const int batch_threads =
+      this->layer_param_.inner_product_param().batch_threads();
+  CHECK_GT(batch_threads, 0);
+  batch_weight_diffs_.clear();
+  batch_bias_diffs_.clear();
+  for (int i = 1; i < batch_threads; ++i) {
+    batch_weight_diffs_.push_back(shared_ptr<Blob<Dtype> >(new Blob<Dtype>()));
+    batch_bias_diffs_.push_back(shared_ptr<Blob<Dtype> >(new Blob<Dtype>()));
+  }
+  if (batch_threads > 1) {
+    batch_pool_.reset(new ThreadPool(batch_threads));
+  }
 
   /// @lixiang, for pruning
   APP<Dtype>::group.push_back(1);
@@ -159,13 +173,32 @@ void InnerProductLayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
     const vector<Blob<Dtype>*>& top) {
   const Dtype* bottom_data = bottom[0]->cpu_data();
   Dtype* top_data = top[0]->mutable_cpu_data();
+  this->PruneForward(); // @luoyang, for pruning
   const Dtype* weight = this->blobs_[0]->cpu_data();
-  caffe_cpu_gemm<Dtype>(CblasNoTrans, transpose_ ? CblasNoTrans : CblasTrans, M_, N_, K_, (Dtype)1.,
+  const Dtype* bias = bias_term_ ? this->blobs_[1]->cpu_data() : NULL;
+  if (batch_pool_) {
+    batch_pool_->Run(boost::bind(&InnerProductLayer<Dtype>::forward_cpu_rows,
+        this, bottom_data, weight, bias, top_data, _1));
+  } else {
+    forward_cpu_rows(bottom_data, weight, bias, top_data, 0);
+  }
+}
+
+template <typename Dtype>
+void InnerProductLayer<Dtype>::forward_cpu_rows(const Dtype* bottom_data,
+    const Dtype* weight, const Dtype* bias, Dtype* top_data, int thread_id) {
+  const int begin = batch_begin(thread_id);
+  const int M = batch_begin(thread_id + 1) - begin;
+  if (M == 0) {
+    return;
+  }
+  bottom_data += begin * K_;
+  top_data += begin * N_;
+  caffe_cpu_gemm<Dtype>(CblasNoTrans, transpose_ ? CblasNoTrans : CblasTrans, M, N_, K_, (Dtype)1.,
       bottom_data, weight, (Dtype)0., top_data);
   if (bias_term_) {
-    caffe_cpu_gemm<Dtype>(CblasNoTrans, CblasNoTrans, M_, N_, 1, (Dtype)1.,
-        bias_multiplier_.cpu_data(),
-        this->blobs_[1]->cpu_data(), (Dtype)1., top_data);
+    caffe_cpu_gemm<Dtype>(CblasNoTrans, CblasNoTrans, M, N_, 1, (Dtype)1.,
+        bias_multiplier_.cpu_data(), bias, (Dtype)1., top_data);
   }
 }
 
@@ -173,43 +206,106 @@ template <typename Dtype>
 void InnerProductLayer<Dtype>::Backward_cpu(const vector<Blob<Dtype>*>& top,
     const vector<bool>& propagate_down,
     const vector<Blob<Dtype>*>& bottom) {
-  if (this->param_propagate_down_[0]) {
-    const Dtype* top_diff = top[0]->cpu_diff();
-    const Dtype* bottom_data = bottom[0]->cpu_data();
+  const Dtype* top_diff = top[0]->cpu_diff();
+  const Dtype* weight = this->blobs_[0]->cpu_data();
+  const Dtype* bottom_data = bottom[0]->cpu_data();
+  Dtype* bottom_diff =
+      propagate_down[0] ? bottom[0]->mutable_cpu_diff() : NULL;
+  if (batch_pool_) {
+    batch_pool_->Run(boost::bind(&InnerProductLayer<Dtype>::backward_cpu_rows,
+        this, top_diff, weight, bottom_data, bottom_diff,
+        static_cast<bool>(propagate_down[0]), _1));
+    // In thread order, so that the sum does not depend on the timing.
+    for (int i = 0; i < batch_weight_diffs_.size(); ++i) {
+      if (this->param_propagate_down_[0]) {
+        caffe_axpy(this->blobs_[0]->count(), Dtype(1),
+            batch_weight_diffs_[i]->cpu_data(),
+            this->blobs_[0]->mutable_cpu_diff());
+      }
+      if (bias_term_ && this->param_propagate_down_[1]) {
+        caffe_axpy(this->blobs_[1]->count(), Dtype(1),
+            batch_bias_diffs_[i]->cpu_data(),
+            this->blobs_[1]->mutable_cpu_diff());
+      }
+    }
+  } else {
+    backward_cpu_rows(top_diff, weight, bottom_data, bottom_diff,
+        propagate_down[0], 0);
+  }
+  this->PruneBackward(); // @luoyang, for pruning
+}
+
+template <typename Dtype>
+void InnerProductLayer<Dtype>::backward_cpu_rows(const Dtype* top_diff,
+    const Dtype* weight, const Dtype* bottom_data, Dtype* bottom_diff,
+    bool propagate_down, int thread_id) {
+  const int begin = batch_begin(thread_id);
+  const int M = batch_begin(thread_id + 1) - begin;
+  top_diff += begin * N_;
+  bottom_data += begin * K_;
+  // The first thread accumulates into the layer's gradients, the others
+  // overwrite their own.
+  Dtype beta = 1;
+  Dtype* weight_diff = NULL;
+  Dtype* bias_diff = NULL;
+  if (thread_id == 0) {
+    if (this->param_propagate_down_[0]) {
+      weight_diff = this->blobs_[0]->mutable_cpu_diff();
+    }
+    if (bias_term_ && this->param_propagate_down_[1]) {
+      bias_diff = this->blobs_[1]->mutable_cpu_diff();
+    }
+  } else {
+    beta = 0;
+    if (this->param_propagate_down_[0]) {
+      batch_weight_diffs_[thread_id - 1]->ReshapeLike(*this->blobs_[0]);
+      weight_diff = batch_weight_diffs_[thread_id - 1]->mutable_cpu_data();
+      if (M == 0) {
+        caffe_set(this->blobs_[0]->count(), Dtype(0), weight_diff);
+      }
+    }
+    if (bias_term_ && this->param_propagate_down_[1]) {
+      batch_bias_diffs_[thread_id - 1]->ReshapeLike(*this->blobs_[1]);
+      bias_diff = batch_bias_diffs_[thread_id - 1]->mutable_cpu_data();
+      if (M == 0) {
+        caffe_set(this->blobs_[1]->count(), Dtype(0), bias_diff);
+      }
+    }
+  }
+  if (M == 0) {
+    return;
+  }
+  if (weight_diff) {
     // Gradient with respect to weight
     /// @lixiang
     if (transpose_) {
-        caffe_cpu_gemm<Dtype>(CblasTrans, CblasNoTrans, K_, N_, M_,
+        caffe_cpu_gemm<Dtype>(CblasTrans, CblasNoTrans, K_, N_, M,
                              (Dtype)1., bottom_data, top_diff,
-                             (Dtype)1., this->blobs_[0]->mutable_cpu_diff());
+                             beta, weight_diff);
     } 
     else {
-        caffe_cpu_gemm<Dtype>(CblasTrans, CblasNoTrans, N_, K_, M_,
+        caffe_cpu_gemm<Dtype>(CblasTrans, CblasNoTrans, N_, K_, M,
                              (Dtype)1., top_diff, bottom_data,
-                             (Dtype)1., this->blobs_[0]->mutable_cpu_diff());
+                             beta, weight_diff);
     }
   }
-  if (bias_term_ && this->param_propagate_down_[1]) {
-    const Dtype* top_diff = top[0]->cpu_diff();
+  if (bias_diff) {
     // Gradient with respect to bias
-    caffe_cpu_gemv<Dtype>(CblasTrans, M_, N_, (Dtype)1., top_diff,
-        bias_multiplier_.cpu_data(), (Dtype)1.,
-        this->blobs_[1]->mutable_cpu_diff());
+    caffe_cpu_gemv<Dtype>(CblasTrans, M, N_, (Dtype)1., top_diff,
+        bias_multiplier_.cpu_data(), beta, bias_diff);
   }
-  if (propagate_down[0]) {
-    const Dtype* top_diff = top[0]->cpu_diff();
+  if (propagate_down) {
     // Gradient with respect to bottom data
-
     /// @lixiang
     if (transpose_) {
-        caffe_cpu_gemm<Dtype>(CblasNoTrans, CblasTrans, M_, K_, N_,
-        (Dtype)1., top_diff, this->blobs_[0]->cpu_data(),
-        (Dtype)0., bottom[0]->mutable_cpu_diff());
+        caffe_cpu_gemm<Dtype>(CblasNoTrans, CblasTrans, M, K_, N_,
+        (Dtype)1., top_diff, weight,
+        (Dtype)0., bottom_diff + begin * K_);
     }
     else {
-        caffe_cpu_gemm<Dtype>(CblasNoTrans, CblasNoTrans, M_, K_, N_,
-        (Dtype)1., top_diff, this->blobs_[0]->cpu_data(),
-        (Dtype)0., bottom[0]->mutable_cpu_diff());
+        caffe_cpu_gemm<Dtype>(CblasNoTrans, CblasNoTrans, M, K_, N_,
+        (Dtype)1., top_diff, weight,
+        (Dtype)0., bottom_diff + begin * K_);
     }
   }
 }
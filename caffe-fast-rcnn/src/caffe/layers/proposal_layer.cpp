@@ -0,0 +1,192 @@
+// ------------------------------------------------------------------
+// Faster R-CNN
+// Copyright (c) 2015 Microsoft
+// Licensed under The MIT License [see fast-rcnn/LICENSE for details]
+// Written by Ross Girshick and Sean Bell
+// ------------------------------------------------------------------
+
+#include <algorithm>
+#include <vector>
+
+#include "caffe/fast_rcnn_layers.hpp"
+#include "caffe/util/bbox_util.hpp"
+#include "caffe/util/nms.hpp"
+
+namespace caffe {
+
+template <typename Dtype>
+void ProposalLayer<Dtype>::LayerSetUp(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top) {
+  const ProposalParameter& proposal_param =
+      this->layer_param_.proposal_param();
+  CHECK_GT(proposal_param.feat_stride(), 0) << "feat_stride must be > 0";
+  CHECK_GT(proposal_param.base_size(), 0) << "base_size must be > 0";
+  feat_stride_ = proposal_param.feat_stride();
+  pre_nms_topn_ = proposal_param.pre_nms_topn();
+  post_nms_topn_ = proposal_param.post_nms_topn();
+  nms_thresh_ = proposal_param.nms_thresh();
+  min_size_ = proposal_param.min_size();
+
+  vector<Dtype> ratios(proposal_param.ratio().begin(),
+      proposal_param.ratio().end());
+  if (ratios.empty()) {
+    ratios.push_back(0.5);
+    ratios.push_back(1);
+    ratios.push_back(2);
+  }
+  vector<Dtype> scales(proposal_param.scale().begin(),
+      proposal_param.scale().end());
+  if (scales.empty()) {
+    scales.push_back(8);
+    scales.push_back(16);
+    scales.push_back(32);
+  }
+  generate_anchors(proposal_param.base_size(), ratios, scales, &anchors_);
+}
+
+template <typename Dtype>
+void ProposalLayer<Dtype>::Reshape(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top) {
+  const int num_anchors = anchors_.size() / 4;
+  CHECK_EQ(bottom[0]->channels(), 2 * num_anchors)
+      << "bottom[0] must hold a bg and a fg score per anchor";
+  CHECK_EQ(bottom[1]->num(), bottom[0]->num());
+  CHECK_EQ(bottom[1]->channels(), 4 * num_anchors)
+      << "bottom[1] must hold 4 deltas per anchor";
+  CHECK_EQ(bottom[1]->height(), bottom[0]->height());
+  CHECK_EQ(bottom[1]->width(), bottom[0]->width());
+  CHECK_GE(bottom[2]->count(), 3 * bottom[0]->num())
+      << "im_info must hold a (height, width, scale) row per image";
+  proposals_.Reshape(bottom[0]->height(), bottom[0]->width(), num_anchors, 4);
+  // The number of proposals is only known after the forward pass.
+  vector<int> top_shape(2, 1);
+  top_shape[1] = 5;
+  top[0]->Reshape(top_shape);
+  if (top.size() > 1) {
+    top_shape[1] = 1;
+    top[1]->Reshape(top_shape);
+  }
+}
+
+// Orders boxes by decreasing score, then by index to break ties
+// deterministically.
+template <typename Dtype>
+class ScoreGreater {
+ public:
+  explicit ScoreGreater(const Dtype* scores) : scores_(scores) {}
+  bool operator()(const int a, const int b) const {
+    return scores_[a] > scores_[b] || (scores_[a] == scores_[b] && a < b);
+  }
+
+ private:
+  const Dtype* scores_;
+};
+
+template <typename Dtype>
+void ProposalLayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top) {
+  const int num_anchors = anchors_.size() / 4;
+  const int height = bottom[0]->height();
+  const int width = bottom[0]->width();
+  const int spatial_dim = height * width;
+  Dtype* proposals = proposals_.mutable_cpu_data();
+  // The rois and scores of all the images, in image order.
+  vector<Dtype> rois;
+  vector<Dtype> roi_scores;
+
+  for (int n = 0; n < bottom[0]->num(); ++n) {
+    // The first num_anchors channels are the bg scores, the fg ones follow.
+    const Dtype* fg_scores = bottom[0]->cpu_data() + bottom[0]->offset(n) +
+        num_anchors * spatial_dim;
+    const Dtype* bbox_deltas = bottom[1]->cpu_data() + bottom[1]->offset(n);
+    const Dtype* im_info = bottom[2]->cpu_data() + 3 * n;
+    const Dtype im_height = im_info[0];
+    const Dtype im_width = im_info[1];
+    const Dtype min_size = min_size_ * im_info[2];
+
+    // 1. Shift the anchors to every cell and apply the predicted deltas.
+    //    Boxes are ordered by (h, w, a) as in proposal_layer.py.
+    // 2. Clip the boxes to the image; in a padded batch that is the image
+    //    itself, not the padding.
+    // 3. Mark the boxes narrower or shorter than min_size.
+    vector<char> valid(spatial_dim * num_anchors);
+#pragma omp parallel for
+    for (int hw = 0; hw < spatial_dim; ++hw) {
+      const Dtype shift_x = (hw % width) * feat_stride_;
+      const Dtype shift_y = (hw / width) * feat_stride_;
+      for (int a = 0; a < num_anchors; ++a) {
+        const int index = hw * num_anchors + a;
+        const Dtype anchor[4] = {
+          anchors_[4 * a] + shift_x, anchors_[4 * a + 1] + shift_y,
+          anchors_[4 * a + 2] + shift_x, anchors_[4 * a + 3] + shift_y };
+        const Dtype* delta = bbox_deltas + 4 * a * spatial_dim + hw;
+        Dtype* box = proposals + 4 * index;
+        bbox_transform_inv(anchor, delta[0], delta[spatial_dim],
+            delta[2 * spatial_dim], delta[3 * spatial_dim], box);
+        clip_box(im_height, im_width, box);
+        valid[index] = box[2] - box[0] + 1 >= min_size &&
+            box[3] - box[1] + 1 >= min_size;
+      }
+    }
+
+    // Scores in box order; the fg scores are A x H x W.
+    vector<Dtype> scores(spatial_dim * num_anchors);
+    vector<int> order;
+    order.reserve(scores.size());
+    for (int hw = 0; hw < spatial_dim; ++hw) {
+      for (int a = 0; a < num_anchors; ++a) {
+        const int index = hw * num_anchors + a;
+        scores[index] = fg_scores[a * spatial_dim + hw];
+        if (valid[index]) {
+          order.push_back(index);
+        }
+      }
+    }
+
+    // 4. Sort the boxes by decreasing score.
+    // 5. Keep the top pre_nms_topn; only those need to be sorted.
+    const ScoreGreater<Dtype> greater(&scores[0]);
+    if (pre_nms_topn_ > 0 && pre_nms_topn_ < static_cast<int>(order.size())) {
+      std::nth_element(order.begin(), order.begin() + pre_nms_topn_,
+          order.end(), greater);
+      order.resize(pre_nms_topn_);
+    }
+    std::sort(order.begin(), order.end(), greater);
+
+    // 6. Apply NMS.
+    // 7. Keep the top post_nms_topn, which lets NMS stop early.
+    const int num_boxes = order.size();
+    vector<Dtype> sorted_boxes(4 * num_boxes);
+    for (int i = 0; i < num_boxes; ++i) {
+      std::copy(proposals + 4 * order[i], proposals + 4 * order[i] + 4,
+          sorted_boxes.begin() + 4 * i);
+    }
+    vector<int> keep;
+    nms_cpu(num_boxes, num_boxes > 0 ? &sorted_boxes[0] : NULL, nms_thresh_,
+        &keep, post_nms_topn_);
+
+    // 8. Append the rois, tagged with the image, and their scores.
+    for (int i = 0; i < keep.size(); ++i) {
+      rois.push_back(n);
+      rois.insert(rois.end(), sorted_boxes.begin() + 4 * keep[i],
+          sorted_boxes.begin() + 4 * keep[i] + 4);
+      roi_scores.push_back(scores[order[keep[i]]]);
+    }
+  }
+
+  vector<int> top_shape(2, roi_scores.size());
+  top_shape[1] = 5;
+  top[0]->Reshape(top_shape);
+  std::copy(rois.begin(), rois.end(), top[0]->mutable_cpu_data());
+  if (top.size() > 1) {
+    top_shape[1] = 1;
+    top[1]->Reshape(top_shape);
+    std::copy(roi_scores.begin(), roi_scores.end(),
+        top[1]->mutable_cpu_data());
+  }
+}
+
+INSTANTIATE_CLASS(ProposalLayer);
+REGISTER_LAYER_CLASS(Proposal);
+
+}  // namespace caffe
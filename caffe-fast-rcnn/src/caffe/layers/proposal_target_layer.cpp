@@ -0,0 +1,170 @@
+// ------------------------------------------------------------------
+// Faster R-CNN
+// Copyright (c) 2015 Microsoft
+// Licensed under The MIT License [see fast-rcnn/LICENSE for details]
+// Written by Ross Girshick and Sean Bell
+// ------------------------------------------------------------------
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#include "caffe/fast_rcnn_layers.hpp"
+#include "caffe/util/bbox_util.hpp"
+#include "caffe/util/math_functions.hpp"
+
+namespace caffe {
+
+template <typename Dtype>
+void ProposalTargetLayer<Dtype>::LayerSetUp(
+      const vector<Blob<Dtype>*>& bottom, const vector<Blob<Dtype>*>& top) {
+  const ProposalTargetParameter& target_param =
+      this->layer_param_.proposal_target_param();
+  CHECK_GT(target_param.num_classes(), 0) << "num_classes must be > 0";
+  num_classes_ = target_param.num_classes();
+  target_mean_.assign(target_param.target_mean().begin(),
+      target_param.target_mean().end());
+  if (target_mean_.empty()) {
+    target_mean_.resize(4, 0);
+  }
+  target_std_.assign(target_param.target_std().begin(),
+      target_param.target_std().end());
+  if (target_std_.empty()) {
+    target_std_.push_back(0.1);
+    target_std_.push_back(0.1);
+    target_std_.push_back(0.2);
+    target_std_.push_back(0.2);
+  }
+  CHECK_EQ(target_mean_.size(), 4) << "target_mean must have 4 values";
+  CHECK_EQ(target_std_.size(), 4) << "target_std must have 4 values";
+}
+
+template <typename Dtype>
+void ProposalTargetLayer<Dtype>::Reshape(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top) {
+  CHECK_EQ(bottom[0]->count(1), 5) << "rois must be (batch index, x1, y1, "
+      << "x2, y2)";
+  CHECK_EQ(bottom[1]->count(1), 5) << "gt_boxes must be (x1, y1, x2, y2, "
+      << "label)";
+  // The number of sampled rois is only known after the forward pass.
+  vector<int> top_shape(2, 1);
+  top_shape[1] = 5;
+  top[0]->Reshape(top_shape);
+  top[1]->Reshape(vector<int>(1, 1));
+  top_shape[1] = 4 * num_classes_;
+  for (int i = 2; i < 5; ++i) {
+    top[i]->Reshape(top_shape);
+  }
+}
+
+template <typename Dtype>
+void ProposalTargetLayer<Dtype>::Forward_cpu(
+      const vector<Blob<Dtype>*>& bottom, const vector<Blob<Dtype>*>& top) {
+  const ProposalTargetParameter& target_param =
+      this->layer_param_.proposal_target_param();
+  const Dtype* rpn_rois = bottom[0]->cpu_data();
+  const int num_rpn_rois = bottom[0]->num();
+  const Dtype* gt_boxes = bottom[1]->cpu_data();
+  const int num_gt = bottom[1]->num();
+  CHECK_GT(num_gt, 0) << "ProposalTarget needs at least one gt box";
+
+  // Include the ground-truth boxes in the set of candidate rois.
+  const int num_rois = num_rpn_rois + num_gt;
+  vector<Dtype> all_rois(5 * num_rois, 0);
+  std::copy(rpn_rois, rpn_rois + 5 * num_rpn_rois, all_rois.begin());
+  for (int g = 0; g < num_gt; ++g) {
+    std::copy(gt_boxes + 5 * g, gt_boxes + 5 * g + 4,
+        all_rois.begin() + 5 * (num_rpn_rois + g) + 1);
+  }
+  for (int i = 0; i < num_rpn_rois; ++i) {
+    CHECK_EQ(rpn_rois[5 * i], 0) << "Only single item batches are supported";
+  }
+
+  // The best gt box of each roi (the first one on ties).
+  vector<Dtype> max_overlaps(num_rois);
+  vector<int> gt_assignment(num_rois);
+#pragma omp parallel for
+  for (int i = 0; i < num_rois; ++i) {
+    const Dtype* roi = &all_rois[5 * i + 1];
+    max_overlaps[i] = bbox_overlap(roi, gt_boxes);
+    gt_assignment[i] = 0;
+    for (int g = 1; g < num_gt; ++g) {
+      const Dtype overlap = bbox_overlap(roi, gt_boxes + 5 * g);
+      if (overlap > max_overlaps[i]) {
+        max_overlaps[i] = overlap;
+        gt_assignment[i] = g;
+      }
+    }
+  }
+
+  // Foreground rois are those with >= fg_thresh overlap, background ones
+  // those within [bg_thresh_lo, bg_thresh_hi).
+  vector<int> fg_inds, bg_inds;
+  for (int i = 0; i < num_rois; ++i) {
+    if (max_overlaps[i] >= target_param.fg_thresh()) {
+      fg_inds.push_back(i);
+    }
+    if (max_overlaps[i] < target_param.bg_thresh_hi() &&
+        max_overlaps[i] >= target_param.bg_thresh_lo()) {
+      bg_inds.push_back(i);
+    }
+  }
+  // Sample without replacement, guarding against an image with fewer
+  // foreground or background rois than desired.
+  const int rois_per_image = target_param.batch_size();
+  const int fg_rois_per_image =
+      std::floor(target_param.fg_fraction() * rois_per_image + 0.5);
+  const int num_fg = std::min<int>(fg_rois_per_image, fg_inds.size());
+  sample_without_replacement(num_fg, &fg_inds);
+  const int num_bg = std::min<int>(rois_per_image - num_fg, bg_inds.size());
+  sample_without_replacement(num_bg, &bg_inds);
+  vector<int> keep_inds(fg_inds.begin(), fg_inds.begin() + num_fg);
+  keep_inds.insert(keep_inds.end(), bg_inds.begin(), bg_inds.begin() + num_bg);
+
+  const int num_keep = keep_inds.size();
+  vector<int> top_shape(2, num_keep);
+  top_shape[1] = 5;
+  top[0]->Reshape(top_shape);
+  top[1]->Reshape(vector<int>(1, num_keep));
+  top_shape[1] = 4 * num_classes_;
+  for (int i = 2; i < 5; ++i) {
+    top[i]->Reshape(top_shape);
+  }
+  Dtype* rois = top[0]->mutable_cpu_data();
+  Dtype* labels = top[1]->mutable_cpu_data();
+  Dtype* bbox_targets = top[2]->mutable_cpu_data();
+  Dtype* bbox_inside_weights = top[3]->mutable_cpu_data();
+  Dtype* bbox_outside_weights = top[4]->mutable_cpu_data();
+  caffe_set(top[2]->count(), Dtype(0), bbox_targets);
+  caffe_set(top[3]->count(), Dtype(0), bbox_inside_weights);
+  caffe_set(top[4]->count(), Dtype(0), bbox_outside_weights);
+  for (int j = 0; j < num_keep; ++j) {
+    const int i = keep_inds[j];
+    const Dtype* gt_box = gt_boxes + 5 * gt_assignment[i];
+    std::copy(all_rois.begin() + 5 * i, all_rois.begin() + 5 * i + 5,
+        rois + 5 * j);
+    // The background rois are labeled 0 and have no regression targets.
+    const int label = j < num_fg ? static_cast<int>(gt_box[4]) : 0;
+    labels[j] = label;
+    if (label <= 0) {
+      continue;
+    }
+    CHECK_LT(label, num_classes_) << "gt label out of range";
+    Dtype targets[4];
+    bbox_transform(&all_rois[5 * i + 1], gt_box, targets);
+    const int offset = j * 4 * num_classes_ + 4 * label;
+    for (int k = 0; k < 4; ++k) {
+      if (target_param.normalize_targets()) {
+        targets[k] = (targets[k] - target_mean_[k]) / target_std_[k];
+      }
+      bbox_targets[offset + k] = targets[k];
+      bbox_inside_weights[offset + k] = 1;
+      bbox_outside_weights[offset + k] = 1;
+    }
+  }
+}
+
+INSTANTIATE_CLASS(ProposalTargetLayer);
+REGISTER_LAYER_CLASS(ProposalTarget);
+
+}  // namespace caffe
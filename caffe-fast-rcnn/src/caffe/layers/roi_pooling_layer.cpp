@@ -6,6 +6,7 @@
 // ------------------------------------------------------------------
 
 #include <cfloat>
+#include <vector>
 
 #include "caffe/fast_rcnn_layers.hpp"
 
@@ -40,6 +41,7 @@ void ROIPoolingLayer<Dtype>::Reshape(const vector<Blob<Dtype>*>& bottom,
       pooled_width_);
   max_idx_.Reshape(bottom[1]->num(), channels_, pooled_height_,
       pooled_width_);
+  bottom_hwc_.Reshape(bottom[0]->num(), height_, width_, channels_);
 }
 
 template <typename Dtype>
@@ -48,86 +50,140 @@ void ROIPoolingLayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
   const Dtype* bottom_data = bottom[0]->cpu_data();
   const Dtype* bottom_rois = bottom[1]->cpu_data();
   // Number of ROIs
-  int num_rois = bottom[1]->num();
-  int batch_size = bottom[0]->num();
-  int top_count = top[0]->count();
+  const int num_rois = bottom[1]->num();
+  const int batch_size = bottom[0]->num();
+  const int spatial_dim = height_ * width_;
+  const int pooled_count = pooled_height_ * pooled_width_;
   Dtype* top_data = top[0]->mutable_cpu_data();
-  caffe_set(top_count, Dtype(-FLT_MAX), top_data);
   int* argmax_data = max_idx_.mutable_cpu_data();
-  caffe_set(top_count, -1, argmax_data);
-
-  // For each ROI R = [batch_index x1 y1 x2 y2]: max pool over R
   for (int n = 0; n < num_rois; ++n) {
-    int roi_batch_ind = bottom_rois[0];
-    int roi_start_w = round(bottom_rois[1] * spatial_scale_);
-    int roi_start_h = round(bottom_rois[2] * spatial_scale_);
-    int roi_end_w = round(bottom_rois[3] * spatial_scale_);
-    int roi_end_h = round(bottom_rois[4] * spatial_scale_);
+    const int roi_batch_ind = bottom_rois[bottom[1]->offset(n)];
     CHECK_GE(roi_batch_ind, 0);
     CHECK_LT(roi_batch_ind, batch_size);
+  }
 
-    int roi_height = max(roi_end_h - roi_start_h + 1, 1);
-    int roi_width = max(roi_end_w - roi_start_w + 1, 1);
-    const Dtype bin_size_h = static_cast<Dtype>(roi_height)
-                             / static_cast<Dtype>(pooled_height_);
-    const Dtype bin_size_w = static_cast<Dtype>(roi_width)
-                             / static_cast<Dtype>(pooled_width_);
-
-    const Dtype* batch_data = bottom_data + bottom[0]->offset(roi_batch_ind);
-
-    for (int c = 0; c < channels_; ++c) {
-      for (int ph = 0; ph < pooled_height_; ++ph) {
-        for (int pw = 0; pw < pooled_width_; ++pw) {
-          // Compute pooling region for this output unit:
-          //  start (included) = floor(ph * roi_height / pooled_height_)
-          //  end (excluded) = ceil((ph + 1) * roi_height / pooled_height_)
-          int hstart = static_cast<int>(floor(static_cast<Dtype>(ph)
-                                              * bin_size_h));
-          int wstart = static_cast<int>(floor(static_cast<Dtype>(pw)
-                                              * bin_size_w));
-          int hend = static_cast<int>(ceil(static_cast<Dtype>(ph + 1)
-                                           * bin_size_h));
-          int wend = static_cast<int>(ceil(static_cast<Dtype>(pw + 1)
-                                           * bin_size_w));
-
-          hstart = min(max(hstart + roi_start_h, 0), height_);
-          hend = min(max(hend + roi_start_h, 0), height_);
-          wstart = min(max(wstart + roi_start_w, 0), width_);
-          wend = min(max(wend + roi_start_w, 0), width_);
-
-          bool is_empty = (hend <= hstart) || (wend <= wstart);
-
-          const int pool_index = ph * pooled_width_ + pw;
-          if (is_empty) {
-            top_data[pool_index] = 0;
-            argmax_data[pool_index] = -1;
-          }
+  // Go channel-last: the pixels of a bin are then visited once for all the
+  // channels, and the max over the channels is a unit-stride (SIMD) loop.
+  Dtype* hwc_data = bottom_hwc_.mutable_cpu_data();
+#pragma omp parallel for
+  for (int i = 0; i < batch_size * channels_; ++i) {
+    const int n = i / channels_;
+    const int c = i % channels_;
+    const Dtype* channel_data = bottom_data + i * spatial_dim;
+    Dtype* pixel_data = hwc_data + n * spatial_dim * channels_ + c;
+    for (int index = 0; index < spatial_dim; ++index) {
+      pixel_data[index * channels_] = channel_data[index];
+    }
+  }
 
-          for (int h = hstart; h < hend; ++h) {
-            for (int w = wstart; w < wend; ++w) {
-              const int index = h * width_ + w;
-              if (batch_data[index] > top_data[pool_index]) {
-                top_data[pool_index] = batch_data[index];
-                argmax_data[pool_index] = index;
-              }
-            }
+  // For each ROI R = [batch_index x1 y1 x2 y2]: max pool over R, one bin
+  // (all the channels) per task
+#pragma omp parallel
+  {
+    vector<Dtype> bin_max(channels_);
+    vector<int> bin_argmax(channels_);
+#pragma omp for
+    for (int i = 0; i < num_rois * pooled_count; ++i) {
+      const int n = i / pooled_count;
+      const int ph = (i % pooled_count) / pooled_width_;
+      const int pw = i % pooled_width_;
+      const Dtype* roi = bottom_rois + bottom[1]->offset(n);
+      const int roi_batch_ind = roi[0];
+      const int roi_start_w = round(roi[1] * spatial_scale_);
+      const int roi_start_h = round(roi[2] * spatial_scale_);
+      const int roi_end_w = round(roi[3] * spatial_scale_);
+      const int roi_end_h = round(roi[4] * spatial_scale_);
+
+      const int roi_height = max(roi_end_h - roi_start_h + 1, 1);
+      const int roi_width = max(roi_end_w - roi_start_w + 1, 1);
+      const Dtype bin_size_h = static_cast<Dtype>(roi_height)
+                               / static_cast<Dtype>(pooled_height_);
+      const Dtype bin_size_w = static_cast<Dtype>(roi_width)
+                               / static_cast<Dtype>(pooled_width_);
+
+      // Compute pooling region for this output unit:
+      //  start (included) = floor(ph * roi_height / pooled_height_)
+      //  end (excluded) = ceil((ph + 1) * roi_height / pooled_height_)
+      int hstart = static_cast<int>(floor(static_cast<Dtype>(ph)
+                                          * bin_size_h));
+      int wstart = static_cast<int>(floor(static_cast<Dtype>(pw)
+                                          * bin_size_w));
+      int hend = static_cast<int>(ceil(static_cast<Dtype>(ph + 1)
+                                       * bin_size_h));
+      int wend = static_cast<int>(ceil(static_cast<Dtype>(pw + 1)
+                                       * bin_size_w));
+
+      hstart = min(max(hstart + roi_start_h, 0), height_);
+      hend = min(max(hend + roi_start_h, 0), height_);
+      wstart = min(max(wstart + roi_start_w, 0), width_);
+      wend = min(max(wend + roi_start_w, 0), width_);
+
+      const bool is_empty = (hend <= hstart) || (wend <= wstart);
+
+      if (is_empty) {
+        caffe_set(channels_, Dtype(0), &bin_max[0]);
+      } else {
+        caffe_set(channels_, Dtype(-FLT_MAX), &bin_max[0]);
+      }
+      caffe_set(channels_, -1, &bin_argmax[0]);
+
+      const Dtype* batch_data = hwc_data + roi_batch_ind * spatial_dim *
+          channels_;
+      Dtype* max_data = &bin_max[0];
+      int* max_index = &bin_argmax[0];
+      for (int h = hstart; h < hend; ++h) {
+        for (int w = wstart; w < wend; ++w) {
+          const int index = h * width_ + w;
+          const Dtype* pixel_data = batch_data + index * channels_;
+          // Branch free, so that the compiler vectorizes it; a strict > keeps
+          // the first maximum, as the GPU kernel does.
+          for (int c = 0; c < channels_; ++c) {
+            const bool is_max = pixel_data[c] > max_data[c];
+            max_data[c] = is_max ? pixel_data[c] : max_data[c];
+            max_index[c] = is_max ? index : max_index[c];
           }
         }
       }
-      // Increment all data pointers by one channel
-      batch_data += bottom[0]->offset(0, 1);
-      top_data += top[0]->offset(0, 1);
-      argmax_data += max_idx_.offset(0, 1);
+
+      const int top_offset = top[0]->offset(n) + ph * pooled_width_ + pw;
+      for (int c = 0; c < channels_; ++c) {
+        top_data[top_offset + c * pooled_count] = max_data[c];
+        argmax_data[top_offset + c * pooled_count] = max_index[c];
+      }
     }
-    // Increment ROI data pointer
-    bottom_rois += bottom[1]->offset(1);
   }
 }
 
 template <typename Dtype>
 void ROIPoolingLayer<Dtype>::Backward_cpu(const vector<Blob<Dtype>*>& top,
       const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom) {
-  NOT_IMPLEMENTED;
+  if (!propagate_down[0]) {
+    return;
+  }
+  const Dtype* bottom_rois = bottom[1]->cpu_data();
+  const Dtype* top_diff = top[0]->cpu_diff();
+  const int* argmax_data = max_idx_.cpu_data();
+  Dtype* bottom_diff = bottom[0]->mutable_cpu_diff();
+  caffe_set(bottom[0]->count(), Dtype(0), bottom_diff);
+  const int num_rois = top[0]->num();
+  const int pooled_count = pooled_height_ * pooled_width_;
+  // Route each top gradient back to the input element that won the max.
+  // ROIs overlap, so shard over channels: a channel is only ever written by
+  // one thread, and it sums its ROIs in the same order as the serial loop.
+#pragma omp parallel for
+  for (int c = 0; c < channels_; ++c) {
+    for (int n = 0; n < num_rois; ++n) {
+      const int roi_batch_ind = bottom_rois[bottom[1]->offset(n)];
+      Dtype* channel_diff = bottom_diff + bottom[0]->offset(roi_batch_ind, c);
+      const int top_offset = top[0]->offset(n, c);
+      for (int i = 0; i < pooled_count; ++i) {
+        const int index = argmax_data[top_offset + i];
+        if (index >= 0) {
+          channel_diff[index] += top_diff[top_offset + i];
+        }
+      }
+    }
+  }
 }
 
 
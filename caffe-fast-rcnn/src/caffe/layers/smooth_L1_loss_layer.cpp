@@ -5,6 +5,8 @@
 // Written by Ross Girshick
 // ------------------------------------------------------------------
 
+#include <cmath>
+
 #include "caffe/fast_rcnn_layers.hpp"
 
 namespace caffe {
@@ -40,24 +42,97 @@ void SmoothL1LossLayer<Dtype>::Reshape(
       bottom[0]->height(), bottom[0]->width());
   errors_.Reshape(bottom[0]->num(), bottom[0]->channels(),
       bottom[0]->height(), bottom[0]->width());
-  // vector of ones used to sum
-  ones_.Reshape(bottom[0]->num(), bottom[0]->channels(),
-      bottom[0]->height(), bottom[0]->width());
-  for (int i = 0; i < bottom[0]->count(); ++i) {
-    ones_.mutable_cpu_data()[i] = Dtype(1);
+  // vector of ones used to sum; the number of ROIs changes from image to
+  // image, so only refill it when the count actually changes
+  if (ones_.count() != bottom[0]->count()) {
+    ones_.Reshape(bottom[0]->num(), bottom[0]->channels(),
+        bottom[0]->height(), bottom[0]->width());
+    caffe_set(ones_.count(), Dtype(1), ones_.mutable_cpu_data());
   }
 }
 
 template <typename Dtype>
 void SmoothL1LossLayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
     const vector<Blob<Dtype>*>& top) {
-  NOT_IMPLEMENTED;
+  int count = bottom[0]->count();
+  caffe_sub(
+      count,
+      bottom[0]->cpu_data(),
+      bottom[1]->cpu_data(),
+      diff_.mutable_cpu_data());    // d := b0 - b1
+  if (has_weights_) {
+    // apply "inside" weights
+    caffe_mul(
+        count,
+        bottom[2]->cpu_data(),
+        diff_.cpu_data(),
+        diff_.mutable_cpu_data());  // d := w_in * (b0 - b1)
+  }
+  // f(x) = 0.5 * (sigma * x)^2          if |x| < 1 / sigma / sigma
+  //        |x| - 0.5 / sigma / sigma    otherwise
+  const Dtype* in = diff_.cpu_data();
+  Dtype* out = errors_.mutable_cpu_data();
+  const Dtype inv_sigma2 = Dtype(1) / sigma2_;
+  const Dtype half_sigma2 = Dtype(0.5) * sigma2_;
+  const Dtype half_inv_sigma2 = Dtype(0.5) * inv_sigma2;
+  for (int index = 0; index < count; ++index) {
+    const Dtype val = in[index];
+    const Dtype abs_val = std::abs(val);
+    out[index] = (abs_val < inv_sigma2) ? half_sigma2 * val * val :
+        abs_val - half_inv_sigma2;
+  }
+  if (has_weights_) {
+    // apply "outside" weights
+    caffe_mul(
+        count,
+        bottom[3]->cpu_data(),
+        errors_.cpu_data(),
+        errors_.mutable_cpu_data());  // d := w_out * SmoothL1(w_in * (b0 - b1))
+  }
+  Dtype loss = caffe_cpu_dot(count, ones_.cpu_data(), errors_.cpu_data());
+  top[0]->mutable_cpu_data()[0] = loss / bottom[0]->num();
 }
 
 template <typename Dtype>
 void SmoothL1LossLayer<Dtype>::Backward_cpu(const vector<Blob<Dtype>*>& top,
     const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom) {
-  NOT_IMPLEMENTED;
+  // after forwards, diff_ holds w_in * (b0 - b1)
+  int count = diff_.count();
+  // f'(x) = sigma * sigma * x         if |x| < 1 / sigma / sigma
+  //       = sign(x)                   otherwise
+  Dtype* grad = diff_.mutable_cpu_data();
+  const Dtype inv_sigma2 = Dtype(1) / sigma2_;
+  for (int index = 0; index < count; ++index) {
+    const Dtype val = grad[index];
+    grad[index] = (std::abs(val) < inv_sigma2) ? sigma2_ * val :
+        Dtype((Dtype(0) < val) - (val < Dtype(0)));
+  }
+  for (int i = 0; i < 2; ++i) {
+    if (propagate_down[i]) {
+      const Dtype sign = (i == 0) ? 1 : -1;
+      const Dtype alpha = sign * top[0]->cpu_diff()[0] / bottom[i]->num();
+      caffe_cpu_axpby(
+          count,                           // count
+          alpha,                           // alpha
+          diff_.cpu_data(),                // x
+          Dtype(0),                        // beta
+          bottom[i]->mutable_cpu_diff());  // y
+      if (has_weights_) {
+        // Scale by "inside" weight
+        caffe_mul(
+            count,
+            bottom[2]->cpu_data(),
+            bottom[i]->cpu_diff(),
+            bottom[i]->mutable_cpu_diff());
+        // Scale by "outside" weight
+        caffe_mul(
+            count,
+            bottom[3]->cpu_data(),
+            bottom[i]->cpu_diff(),
+            bottom[i]->mutable_cpu_diff());
+      }
+    }
+  }
 }
 
 #ifdef CPU_ONLY
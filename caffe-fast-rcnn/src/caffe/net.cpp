@@ -1,4 +1,7 @@
+#include <boost/bind.hpp>
+#include <boost/thread.hpp>
 #include <algorithm>
+#include <climits>
 #include <map>
 #include <set>
 #include <string>
@@ -16,7 +19,10 @@
 #include "caffe/proto/caffe.pb.h"
 #include "caffe/util/hdf5.hpp"
 #include "caffe/util/insert_splits.hpp"
+#include "caffe/util/mapped_weights.hpp"
+#include "caffe/util/profiler.hpp"
 #include "caffe/util/math_functions.hpp"
+#include "caffe/util/thread_pool.hpp"
 #include "caffe/util/upgrade_proto.hpp"
 
 #include "caffe/test/test_caffe_main.hpp"
@@ -291,9 +297,256 @@ void Net<Dtype>::Init(const NetParameter& in_param) {
   }
   ShareWeights();
   debug_info_ = param.debug_info();
+  profiling_ = false;
+  zero_fill_activations_ = param.zero_fill_activations();
+  if (!zero_fill_activations_) {
+    for (int blob_id = 0; blob_id < blobs_.size(); ++blob_id) {
+      blobs_[blob_id]->set_zero_fill(false);
+    }
+  }
+  if (param.share_activations()) {
+    if (phase_ == TEST) {
+      InitActivationSharing(param);
+    } else {
+      LOG(WARNING) << "Ignoring share_activations: only test nets can share "
+          << "the memory of their activations.";
+    }
+  }
+  // Layers only run concurrently where that cannot change their results:
+  // train nets draw from the shared RNG (e.g. dropout) and prune through
+  // the global APP state, Python layers hold the GIL, and the debug info
+  // is printed in layer order.
+  forward_threads_ = param.forward_threads();
+  CHECK_GT(forward_threads_, 0) << "forward_threads must be > 0";
+  if (forward_threads_ > 1) {
+    bool has_python_layer = false;
+    for (int layer_id = 0; layer_id < layers_.size(); ++layer_id) {
+      has_python_layer |= string(layers_[layer_id]->type()) == "Python";
+    }
+    if (phase_ != TEST || has_python_layer || debug_info_) {
+      LOG(WARNING) << "Ignoring forward_threads: only test nets without "
+          << "Python layers or debug_info run layers in parallel.";
+      forward_threads_ = 1;
+    } else {
+      InitForwardDependencies();
+    }
+  }
   LOG_IF(INFO, Caffe::root_solver()) << "Network initialization done.";
 }
 
+template <typename Dtype>
+void Net<Dtype>::BlobAliases(vector<int>* alias) const {
+  alias->resize(blobs_.size());
+  for (int blob_id = 0; blob_id < blobs_.size(); ++blob_id) {
+    (*alias)[blob_id] = blob_id;
+  }
+  for (int layer_id = 0; layer_id < layers_.size(); ++layer_id) {
+    // Split and flatten layers only share their data in Forward.
+    const string type = layers_[layer_id]->type();
+    const bool shares_data = type == "Split" || type == "Flatten";
+    for (int top_id = 0; top_id < top_id_vecs_[layer_id].size(); ++top_id) {
+      const int top = top_id_vecs_[layer_id][top_id];
+      for (int bottom_id = 0; bottom_id < bottom_id_vecs_[layer_id].size();
+           ++bottom_id) {
+        const int bottom = bottom_id_vecs_[layer_id][bottom_id];
+        if (shares_data || (blobs_[top]->count() > 0 &&
+            blobs_[bottom]->count() > 0 &&
+            blobs_[top]->data() == blobs_[bottom]->data())) {
+          (*alias)[top] = (*alias)[bottom];
+        }
+      }
+    }
+  }
+}
+
+template <typename Dtype>
+void Net<Dtype>::InitActivationSharing(const NetParameter& param) {
+  vector<int> alias;
+  BlobAliases(&alias);
+  // The net inputs and outputs, and the blobs asked for, keep their memory.
+  vector<bool> keep(blobs_.size(), false);
+  for (int i = 0; i < net_input_blob_indices_.size(); ++i) {
+    keep[alias[net_input_blob_indices_[i]]] = true;
+  }
+  for (int i = 0; i < net_output_blob_indices_.size(); ++i) {
+    keep[alias[net_output_blob_indices_[i]]] = true;
+  }
+  for (int i = 0; i < param.keep_activation_size(); ++i) {
+    const string& blob_name = param.keep_activation(i);
+    CHECK(has_blob(blob_name)) << "Unknown keep_activation " << blob_name;
+    keep[alias[blob_names_index_.find(blob_name)->second]] = true;
+  }
+  // So do the tops of layers that do not write them on every forward:
+  // MemoryData points its tops at the caller's arrays, so the other blobs in
+  // a shared buffer would write over the caller's data, and DummyData fills
+  // constant tops only once, in LayerSetUp.
+  for (int layer_id = 0; layer_id < layers_.size(); ++layer_id) {
+    const string type = layers_[layer_id]->type();
+    if (type != "MemoryData" && type != "DummyData") {
+      continue;
+    }
+    for (int i = 0; i < top_id_vecs_[layer_id].size(); ++i) {
+      keep[alias[top_id_vecs_[layer_id][i]]] = true;
+    }
+  }
+  // The first and last layers using each group of aliased blobs, and the
+  // bytes it needs.
+  vector<int> first_use(blobs_.size(), -1);
+  vector<int> last_use(blobs_.size(), -1);
+  vector<size_t> group_bytes(blobs_.size(), 0);
+  for (int layer_id = 0; layer_id < layers_.size(); ++layer_id) {
+    for (int i = 0; i < bottom_id_vecs_[layer_id].size() +
+         top_id_vecs_[layer_id].size(); ++i) {
+      const int blob_id = i < bottom_id_vecs_[layer_id].size() ?
+          bottom_id_vecs_[layer_id][i] :
+          top_id_vecs_[layer_id][i - bottom_id_vecs_[layer_id].size()];
+      const int group = alias[blob_id];
+      if (first_use[group] < 0) {
+        first_use[group] = layer_id;
+      }
+      last_use[group] = layer_id;
+      group_bytes[group] = std::max(group_bytes[group],
+          blobs_[blob_id]->count() * sizeof(Dtype));
+    }
+  }
+  // Blobs are numbered in the order they are produced, so this visits the
+  // groups by their first use. Each takes, among the buffers whose groups
+  // are no longer used, the smallest one it fits in, or else the largest
+  // one, grown; a layer never shares a buffer between its bottoms and tops.
+  vector<int> group_buffer(blobs_.size(), -1);
+  vector<size_t> buffer_bytes;
+  vector<int> buffer_last_use;
+  size_t total_bytes = 0;
+  for (int group = 0; group < blobs_.size(); ++group) {
+    if (alias[group] != group || keep[group] || first_use[group] < 0) {
+      continue;
+    }
+    total_bytes += group_bytes[group];
+    int best = -1;
+    for (int b = 0; b < buffer_bytes.size(); ++b) {
+      if (buffer_last_use[b] >= first_use[group]) {
+        continue;
+      }
+      if (best < 0) {
+        best = b;
+        continue;
+      }
+      const bool fits = buffer_bytes[b] >= group_bytes[group];
+      const bool best_fits = buffer_bytes[best] >= group_bytes[group];
+      if (fits ? !best_fits || buffer_bytes[b] < buffer_bytes[best] :
+          !best_fits && buffer_bytes[b] > buffer_bytes[best]) {
+        best = b;
+      }
+    }
+    if (best < 0) {
+      best = buffer_bytes.size();
+      buffer_bytes.push_back(0);
+      buffer_last_use.push_back(-1);
+    }
+    buffer_bytes[best] = std::max(buffer_bytes[best], group_bytes[group]);
+    buffer_last_use[best] = last_use[group];
+    group_buffer[group] = best;
+  }
+  activation_buffers_.resize(buffer_bytes.size());
+  activation_buffer_blobs_.resize(buffer_bytes.size());
+  for (int blob_id = 0; blob_id < blobs_.size(); ++blob_id) {
+    const int buffer = group_buffer[alias[blob_id]];
+    if (buffer >= 0) {
+      activation_buffer_blobs_[buffer].push_back(blob_id);
+    }
+  }
+  ShareActivationBuffers();
+  size_t shared_bytes = 0;
+  for (int b = 0; b < buffer_bytes.size(); ++b) {
+    shared_bytes += buffer_bytes[b];
+  }
+  LOG_IF(INFO, Caffe::root_solver()) << "Sharing " << total_bytes
+      << " bytes of activations in " << activation_buffers_.size()
+      << " buffers of " << shared_bytes << " bytes";
+}
+
+template <typename Dtype>
+void Net<Dtype>::ShareActivationBuffers() {
+  for (int b = 0; b < activation_buffers_.size(); ++b) {
+    const vector<int>& blob_ids = activation_buffer_blobs_[b];
+    size_t bytes = 0;
+    bool shared = activation_buffers_[b].get() != NULL;
+    for (int i = 0; i < blob_ids.size(); ++i) {
+      const Blob<Dtype>& blob = *blobs_[blob_ids[i]];
+      bytes = std::max(bytes, blob.count() * sizeof(Dtype));
+      // A blob reshaped beyond the buffer allocates memory of its own.
+      shared &= blob.count() == 0 || blob.data() == activation_buffers_[b];
+    }
+    if (shared) {
+      continue;
+    }
+    if (!activation_buffers_[b] || activation_buffers_[b]->size() < bytes) {
+      if (activation_buffers_[b]) {
+        // Grow as Blob::Reshape does, so that inputs of varying size soon
+        // stop reallocating; blobs keep within INT_MAX elements.
+        Caffe::count_blob_reallocation();
+        const size_t size = activation_buffers_[b]->size();
+        bytes = std::max(bytes, std::min(INT_MAX * sizeof(Dtype),
+            size + size / 4));
+      }
+      activation_buffers_[b].reset(new SyncedMemory(bytes));
+      activation_buffers_[b]->set_zero_fill(zero_fill_activations_);
+    }
+    for (int i = 0; i < blob_ids.size(); ++i) {
+      blobs_[blob_ids[i]]->ShareDataMemory(activation_buffers_[b]);
+    }
+  }
+}
+
+template <typename Dtype>
+void Net<Dtype>::InitForwardDependencies() {
+  // Aliased blobs, and the blobs sharing an activation buffer, are one
+  // piece of memory.
+  vector<int> memory_id;
+  BlobAliases(&memory_id);
+  for (int b = 0; b < activation_buffer_blobs_.size(); ++b) {
+    for (int i = 0; i < activation_buffer_blobs_[b].size(); ++i) {
+      memory_id[activation_buffer_blobs_[b][i]] = blobs_.size() + b;
+    }
+  }
+  const int num_memory = blobs_.size() + activation_buffer_blobs_.size();
+  // A layer waits for the last layer that wrote each memory it reads or
+  // writes, and for the layers that read a memory since then before it
+  // overwrites it, which keeps the sequential order of every access.
+  vector<int> last_writer(num_memory, -1);
+  vector<vector<int> > readers(num_memory);
+  layer_forward_deps_.assign(layers_.size(), vector<int>());
+  for (int layer_id = 0; layer_id < layers_.size(); ++layer_id) {
+    set<int> deps;
+    for (int bottom_id = 0; bottom_id < bottom_id_vecs_[layer_id].size();
+         ++bottom_id) {
+      const int memory = memory_id[bottom_id_vecs_[layer_id][bottom_id]];
+      if (last_writer[memory] >= 0) {
+        deps.insert(last_writer[memory]);
+      }
+    }
+    for (int top_id = 0; top_id < top_id_vecs_[layer_id].size(); ++top_id) {
+      const int memory = memory_id[top_id_vecs_[layer_id][top_id]];
+      if (last_writer[memory] >= 0) {
+        deps.insert(last_writer[memory]);
+      }
+      deps.insert(readers[memory].begin(), readers[memory].end());
+    }
+    deps.erase(layer_id);
+    layer_forward_deps_[layer_id].assign(deps.begin(), deps.end());
+    for (int bottom_id = 0; bottom_id < bottom_id_vecs_[layer_id].size();
+         ++bottom_id) {
+      readers[memory_id[bottom_id_vecs_[layer_id][bottom_id]]].push_back(
+          layer_id);
+    }
+    for (int top_id = 0; top_id < top_id_vecs_[layer_id].size(); ++top_id) {
+      const int memory = memory_id[top_id_vecs_[layer_id][top_id]];
+      last_writer[memory] = layer_id;
+      readers[memory].clear();
+    }
+  }
+}
+
 template <typename Dtype>
 void Net<Dtype>::FilterNet(const NetParameter& param,
     NetParameter* param_filtered) {
@@ -576,21 +829,115 @@ template <typename Dtype>
 Dtype Net<Dtype>::ForwardFromTo(int start, int end) {
   CHECK_GE(start, 0);
   CHECK_LT(end, layers_.size());
+  CHECK(activation_buffers_.empty() || start == 0)
+      << "With share_activations, the net can only be forwarded from the "
+      << "first layer";
+  ProfileScope scope(profiling_ ? profiler_.get() : NULL, "net_forward");
   Dtype loss = 0;
-  if (debug_info_) {
-    for (int i = 0; i < net_input_blobs_.size(); ++i) {
-      InputDebugInfo(i);
+  if (forward_threads_ > 1 && Caffe::mode() == Caffe::CPU && end > start) {
+    loss = ForwardFromToParallel(start, end);
+  } else {
+    if (debug_info_) {
+      for (int i = 0; i < net_input_blobs_.size(); ++i) {
+        InputDebugInfo(i);
+      }
     }
+    for (int i = start; i <= end; ++i) {
+      // LOG(ERROR) << "Forwarding " << layer_names_[i];
+      Dtype layer_loss = layers_[i]->Forward(bottom_vecs_[i], top_vecs_[i]);
+      loss += layer_loss;
+      if (debug_info_) { ForwardDebugInfo(i); }
+    }
+  }
+  if (!activation_buffers_.empty()) {
+    ShareActivationBuffers();
   }
+  return loss;
+}
+
+template <typename Dtype>
+struct Net<Dtype>::ForwardState {
+  int start;
+  boost::mutex mutex;
+  boost::condition_variable ready_condition;
+  /// Layers whose dependencies are done, run in order of their index.
+  set<int> ready;
+  /// Per layer in [start, end]: the number of dependencies not yet done,
+  /// the layers waiting for it, and its loss.
+  vector<int> num_pending;
+  vector<vector<int> > waiting;
+  vector<Dtype> losses;
+  int num_left;
+};
+
+template <typename Dtype>
+Dtype Net<Dtype>::ForwardFromToParallel(int start, int end) {
+  ForwardState state;
+  state.start = start;
+  state.num_left = end - start + 1;
+  state.num_pending.resize(state.num_left, 0);
+  state.waiting.resize(state.num_left);
+  state.losses.resize(state.num_left, 0);
   for (int i = start; i <= end; ++i) {
-    // LOG(ERROR) << "Forwarding " << layer_names_[i];
-    Dtype layer_loss = layers_[i]->Forward(bottom_vecs_[i], top_vecs_[i]);
-    loss += layer_loss;
-    if (debug_info_) { ForwardDebugInfo(i); }
+    for (int j = 0; j < layer_forward_deps_[i].size(); ++j) {
+      // Layers before start are assumed to be done.
+      const int dep = layer_forward_deps_[i][j];
+      if (dep >= start) {
+        ++state.num_pending[i - start];
+        state.waiting[dep - start].push_back(i);
+      }
+    }
+    if (state.num_pending[i - start] == 0) {
+      state.ready.insert(i);
+    }
+  }
+  if (!forward_pool_) {
+    forward_pool_.reset(new ThreadPool(forward_threads_));
+  }
+  forward_pool_->Run(boost::bind(&Net<Dtype>::ForwardWorker, this, &state,
+      _1));
+  CHECK_EQ(state.num_left, 0);
+  // Sum the losses in layer order, as the sequential Forward does.
+  Dtype loss = 0;
+  for (int i = 0; i < state.losses.size(); ++i) {
+    loss += state.losses[i];
   }
   return loss;
 }
 
+template <typename Dtype>
+void Net<Dtype>::ForwardWorker(ForwardState* state, int thread_id) {
+  // The workers are new threads, with their own Caffe state.
+  Caffe::set_mode(Caffe::CPU);
+  boost::mutex::scoped_lock lock(state->mutex);
+  while (true) {
+    while (state->ready.empty() && state->num_left > 0) {
+      state->ready_condition.wait(lock);
+    }
+    if (state->ready.empty()) {
+      return;
+    }
+    const int i = *state->ready.begin();
+    state->ready.erase(state->ready.begin());
+    lock.unlock();
+    const Dtype layer_loss = layers_[i]->Forward(bottom_vecs_[i],
+        top_vecs_[i]);
+    lock.lock();
+    state->losses[i - state->start] = layer_loss;
+    --state->num_left;
+    const vector<int>& waiting = state->waiting[i - state->start];
+    for (int j = 0; j < waiting.size(); ++j) {
+      if (--state->num_pending[waiting[j] - state->start] == 0) {
+        state->ready.insert(waiting[j]);
+      }
+    }
+    // Wake the others up for the new ready layers, or to finish.
+    if (!state->ready.empty() || state->num_left == 0) {
+      state->ready_condition.notify_all();
+    }
+  }
+}
+
 template <typename Dtype>
 Dtype Net<Dtype>::ForwardFrom(int start) {
   return ForwardFromTo(start, layers_.size() - 1);
@@ -646,6 +993,9 @@ template <typename Dtype>
 void Net<Dtype>::BackwardFromTo(int start, int end) {
   CHECK_GE(end, 0);
   CHECK_LT(start, layers_.size());
+  CHECK(activation_buffers_.empty())
+      << "Backward needs the activations, which share_activations overwrites";
+  ProfileScope scope(profiling_ ? profiler_.get() : NULL, "net_backward");
   for (int i = start; i >= end; --i) {
     if (layer_need_backward_[i]) {
       layers_[i]->Backward(
@@ -655,6 +1005,46 @@ void Net<Dtype>::BackwardFromTo(int start, int end) {
   }
 }
 
+template <typename Dtype>
+void Net<Dtype>::set_profiling(const bool value) {
+  if (value && !profiler_) {
+    profiler_.reset(new Profiler());
+    for (int i = 0; i < layers_.size(); ++i) {
+      profiler_->AddLayer(layer_names_[i], layers_[i]->type());
+    }
+  }
+  for (int i = 0; i < layers_.size(); ++i) {
+    layers_[i]->set_profile(value ? profiler_->layer(i) : NULL);
+  }
+  profiling_ = value;
+}
+
+template <typename Dtype>
+void Net<Dtype>::WriteProfile(const string& json_file,
+    const string& trace_file) {
+  CHECK(profiler_) << "Profiling was not enabled for net " << name_;
+  for (int i = 0; i < layers_.size(); ++i) {
+    LayerProfile* profile = profiler_->layer(i);
+    map<string, int>::const_iterator index =
+        APP<Dtype>::layer_index.find(layer_names_[i]);
+    if (index == APP<Dtype>::layer_index.end() ||
+        index->second >= APP<Dtype>::GFLOPs.size()) {
+      continue;
+    }
+    const int L = index->second;
+    const Dtype pr = APP<Dtype>::pruned_ratio_row[L];
+    const Dtype pc = APP<Dtype>::pruned_ratio_col[L];
+    profile->flops = APP<Dtype>::GFLOPs[L];
+    profile->flops_left = APP<Dtype>::GFLOPs[L] * (1 - (pr + pc - pr * pc));
+  }
+  if (!json_file.empty()) {
+    profiler_->WriteJSON(json_file);
+  }
+  if (!trace_file.empty()) {
+    profiler_->WriteTrace(trace_file);
+  }
+}
+
 template <typename Dtype>
 void Net<Dtype>::InputDebugInfo(const int input_id) {
   const Blob<Dtype>& blob = *net_input_blobs_[input_id];
@@ -862,6 +1252,9 @@ void Net<Dtype>::CopyTrainedLayersFrom(const string trained_filename) {
   if (trained_filename.size() >= 3 &&
       trained_filename.compare(trained_filename.size() - 3, 3, ".h5") == 0) {
     CopyTrainedLayersFromHDF5(trained_filename);
+  } else if (trained_filename.size() >= 9 && trained_filename.compare(
+      trained_filename.size() - 9, 9, ".caffemap") == 0) {
+    CopyTrainedLayersFromMapped(trained_filename);
   } else {
     CopyTrainedLayersFromBinaryProto(trained_filename);
   }
@@ -875,6 +1268,43 @@ void Net<Dtype>::CopyTrainedLayersFromBinaryProto(
   CopyTrainedLayersFrom(param);
 }
 
+template <typename Dtype>
+void Net<Dtype>::CopyTrainedLayersFromMapped(const string trained_filename) {
+  shared_ptr<MappedWeights> weights(new MappedWeights(trained_filename));
+  const MappedWeightsIndex& index = weights->index();
+  for (int i = 0; i < index.layer_size(); ++i) {
+    const MappedLayer& source_layer = index.layer(i);
+    const string& source_layer_name = source_layer.name();
+    if (!layer_names_index_.count(source_layer_name)) {
+      LOG(INFO) << "Ignoring source layer " << source_layer_name;
+      continue;
+    }
+    const int target_layer_id = layer_names_index_[source_layer_name];
+    DLOG(INFO) << "Mapping source layer " << source_layer_name;
+    vector<shared_ptr<Blob<Dtype> > >& target_blobs =
+        layers_[target_layer_id]->blobs();
+    CHECK_EQ(target_blobs.size(), source_layer.blobs_size())
+        << "Incompatible number of blobs for layer " << source_layer_name;
+    for (int j = 0; j < target_blobs.size(); ++j) {
+      const MappedBlob& source_blob = source_layer.blobs(j);
+      if (!target_blobs[j]->ShapeEquals(source_blob.header()) ||
+          target_blobs[j]->count() != source_blob.count()) {
+        LOG(FATAL) << "Cannot copy param " << j << " weights from layer '"
+            << source_layer_name << "'; shape mismatch.  Target param shape is "
+            << target_blobs[j]->shape_string() << ". "
+            << "To learn this layer's parameters from scratch rather than "
+            << "copying from a saved net, rename the layer.";
+      }
+      weights->ShareInto(source_blob, target_blobs[j].get());
+    }
+    /// @luoyang, restore masks
+    if (APP<Dtype>::prune_method != "None" && phase_ == TRAIN && target_blobs.size() && APP<Dtype>::layer_index.count(source_layer_name)) {
+        layers_[target_layer_id]->RestoreMasks();
+    }
+  }
+  mapped_weights_.push_back(weights);
+}
+
 template <typename Dtype>
 void Net<Dtype>::CopyTrainedLayersFromHDF5(const string trained_filename) {
   hid_t file_hid = H5Fopen(trained_filename.c_str(), H5F_ACC_RDONLY,
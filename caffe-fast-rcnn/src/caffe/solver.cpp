@@ -1,12 +1,18 @@
+#include <boost/bind.hpp>
 #include <cstdio>
 
+#include <algorithm>
+#include <set>
 #include <string>
 #include <vector>
 
 #include "caffe/solver.hpp"
+#include "caffe/util/async_proto_writer.hpp"
 #include "caffe/util/format.hpp"
 #include "caffe/util/hdf5.hpp"
 #include "caffe/util/io.hpp"
+#include "caffe/util/profiler.hpp"
+#include "caffe/util/thread_pool.hpp"
 #include "caffe/util/upgrade_proto.hpp"
 
 #include "caffe/adaptive_probabilistic_pruning.hpp"
@@ -95,6 +101,10 @@ void Solver<Dtype>::Init(const SolverParameter& param) {
 
   CHECK_GE(param_.average_loss(), 1) << "average_loss should be non-negative.";
   CheckSnapshotWritePermissions();
+  snapshot_writer_.reset();
+  if (Caffe::root_solver() && param_.snapshot_async()) {
+    snapshot_writer_.reset(new AsyncProtoWriter());
+  }
   if (Caffe::root_solver() && param_.random_seed() >= 0) {
     Caffe::set_random_seed(param_.random_seed());
   }
@@ -151,6 +161,13 @@ void Solver<Dtype>::InitTrainNet() {
   } else {
     net_.reset(new Net<Dtype>(net_param, root_solver_->net_.get()));
   }
+  if (Caffe::root_solver() &&
+      (param_.has_profile_file() || param_.has_profile_trace_file())) {
+    net_->set_profiling(true);
+    if (param_.has_profile_trace_file()) {
+      net_->profiler()->set_max_trace_events(param_.profile_trace_events());
+    }
+  }
 }
 
 template <typename Dtype>
@@ -214,6 +231,9 @@ void Solver<Dtype>::InitTestNets() {
     }
   }
   test_nets_.resize(num_test_net_instances);
+  test_scores_.resize(num_test_net_instances);
+  test_net_replicas_.resize(num_test_net_instances);
+  test_net_num_data_layers_.resize(num_test_net_instances, 0);
   for (int i = 0; i < num_test_net_instances; ++i) {
     // Set the correct NetState.  We start with the solver defaults (lowest
     // precedence); then, merge in any NetState specified by the net_param
@@ -235,7 +255,74 @@ void Solver<Dtype>::InitTestNets() {
           root_solver_->test_nets_[i].get()));
     }
     test_nets_[i]->set_debug_info(param_.debug_info());
+    if (param_.test_threads() > 1) {
+      InitTestNetReplicas(i, net_params[i]);
+    }
+  }
+}
+
+template <typename Dtype>
+void Solver<Dtype>::InitTestNetReplicas(const int test_net_id,
+    const NetParameter& net_param) {
+  const Net<Dtype>& test_net = *test_nets_[test_net_id];
+  // The data layers are the leading layers without bottoms. They keep running
+  // in the test net, so the batches are read in the same order as without
+  // replicas.
+  int num_data_layers = 0;
+  while (num_data_layers < test_net.layers().size() &&
+      test_net.bottom_vecs()[num_data_layers].empty()) {
+    ++num_data_layers;
+  }
+  string reason;
+  if (Caffe::mode() != Caffe::CPU) {
+    reason = "only supported in CPU mode";
+  } else if (num_data_layers == 0 || test_net.num_inputs() > 0) {
+    reason = "the net does not start with data layers";
+  }
+  for (int i = num_data_layers; i < test_net.layers().size(); ++i) {
+    if (test_net.bottom_vecs()[i].empty()) {
+      reason = "the data layers do not all come first";
+    } else if (string(test_net.layers()[i]->type()) == "Python") {
+      reason = "the net has Python layers";
+    }
+  }
+  if (!reason.empty()) {
+    LOG(WARNING) << "Testing net (#" << test_net_id << ") on one thread: "
+        << reason;
+    return;
+  }
+  NetParameter replica_param(net_param);
+  replica_param.clear_layer();
+  replica_param.clear_input();
+  replica_param.clear_input_shape();
+  replica_param.clear_input_dim();
+  std::set<string> data_layer_names;
+  for (int i = 0; i < num_data_layers; ++i) {
+    data_layer_names.insert(test_net.layer_names()[i]);
+    for (int j = 0; j < test_net.top_vecs()[i].size(); ++j) {
+      replica_param.add_input(test_net.blob_names()[test_net.top_ids(i)[j]]);
+      const vector<int>& shape = test_net.top_vecs()[i][j]->shape();
+      BlobShape* input_shape = replica_param.add_input_shape();
+      for (int k = 0; k < shape.size(); ++k) {
+        input_shape->add_dim(shape[k]);
+      }
+    }
+  }
+  for (int i = 0; i < net_param.layer_size(); ++i) {
+    if (!data_layer_names.count(net_param.layer(i).name())) {
+      replica_param.add_layer()->CopyFrom(net_param.layer(i));
+    }
+  }
+  vector<shared_ptr<Net<Dtype> > >& replicas = test_net_replicas_[test_net_id];
+  for (int i = 0; i < param_.test_threads(); ++i) {
+    replicas.push_back(shared_ptr<Net<Dtype> >(new Net<Dtype>(replica_param)));
+    replicas.back()->set_debug_info(param_.debug_info());
+    CHECK_EQ(replicas.back()->num_outputs(), test_net.num_outputs());
   }
+  test_net_num_data_layers_[test_net_id] = num_data_layers;
+  test_replica_losses_.resize(param_.test_threads());
+  LOG(INFO) << "Testing net (#" << test_net_id << ") on "
+      << param_.test_threads() << " threads";
 }
 
 template <typename Dtype>
@@ -294,7 +381,9 @@ void Solver<Dtype>::Step(int iters) {
     }
   }
 
+  Profiler* profiler = net_->profiling() ? net_->profiler() : NULL;
   while (iter_ < stop_iter) {
+    ProfileScope step_scope(profiler, "solver_step");
     APP<Dtype>::step_ = iter_ + 1;
     time(&rawtime);
     const struct tm* timeinfo = localtime(&rawtime);
@@ -325,9 +414,12 @@ void Solver<Dtype>::Step(int iters) {
     clock_t t1 = clock();
 
     APP<Dtype>::inner_iter = 0;
-    for (int i = 0; i < APP<Dtype>::iter_size * param_.iter_size(); ++i) {
-      loss += net_->ForwardBackward(bottom_vec);
-      ++ APP<Dtype>::inner_iter;
+    {
+      ProfileScope scope(profiler, "solver_forward_backward");
+      for (int i = 0; i < APP<Dtype>::iter_size * param_.iter_size(); ++i) {
+        loss += net_->ForwardBackward(bottom_vec);
+        ++ APP<Dtype>::inner_iter;
+      }
     }
     cout << "--- after ForwardBackward: " << (double)(clock() - t1) / CLOCKS_PER_SEC << endl;
 
@@ -374,7 +466,10 @@ void Solver<Dtype>::Step(int iters) {
     for (int i = 0; i < callbacks_.size(); ++i) {
       callbacks_[i]->on_gradients_ready();
     }
-    ApplyUpdate();
+    {
+      ProfileScope scope(profiler, "solver_update");
+      ApplyUpdate();
+    }
     cout << "--- after ApplyUpdate: " << (double)(clock() - t1) / CLOCKS_PER_SEC << endl;     // @lixiang
 
     // --------------------------------------------------------------------------
@@ -497,6 +592,10 @@ void Solver<Dtype>::Step(int iters) {
       break;
     }
   }
+  if (profiler &&
+      (param_.has_profile_file() || param_.has_profile_trace_file())) {
+    net_->WriteProfile(param_.profile_file(), param_.profile_trace_file());
+  }
 }
 
 template <typename Dtype>
@@ -548,6 +647,7 @@ void Solver<Dtype>::CheckMaxAcc(const string& prune_state, const int& cnt_after_
             cout << logstr << endl;
             PrintFinalPrunedRatio();
             RemoveUselessSnapshot(snapshot_iters_.back());
+            FlushSnapshots();
             exit(0);
         }
         
@@ -568,6 +668,7 @@ void Solver<Dtype>::CheckMaxAcc(const string& prune_state, const int& cnt_after_
 
             if (APP<Dtype>::acc_borderline <= 0) {
                 cout << "[app]    'Given pr to get acc' task done!" << endl;
+                FlushSnapshots();
                 exit(0);
             }
         }
@@ -636,6 +737,7 @@ void Solver<Dtype>::SetPruneState(const string& prune_state) {
     }
     else {
         LOG(INFO) << "Wrong: unknown prune_state, please check." << endl;
+        FlushSnapshots();
         exit(1);
     }
 }
@@ -656,6 +758,7 @@ void Solver<Dtype>::CheckIfFinalTargetAchieved() {
         if (APP<Dtype>::IF_eswpf) {
             cout << " - early stopped." << endl;
             PrintFinalPrunedRatio();
+            FlushSnapshots();
             exit(0);
         }
         else {
@@ -758,8 +861,14 @@ void Solver<Dtype>::RemoveUselessSnapshot(const int& iter) {
     if (iter >= 0) {
         const string caffemodel_path = param_.snapshot_prefix() + "_iter_" + caffe::format_int(iter) + ".caffemodel";
         const string solverstate_path = param_.snapshot_prefix() + "_iter_" + caffe::format_int(iter) + ".solverstate";
-        std::remove(caffemodel_path.c_str());
-        std::remove(solverstate_path.c_str());
+        // Removed after the snapshots being written, if any.
+        if (snapshot_writer_) {
+            snapshot_writer_->Remove(caffemodel_path);
+            snapshot_writer_->Remove(solverstate_path);
+        } else {
+            std::remove(caffemodel_path.c_str());
+            std::remove(solverstate_path.c_str());
+        }
     }
 }
 
@@ -880,7 +989,15 @@ void Solver<Dtype>::Test(const int test_net_id) {
     }
   }
 
-  for (int i = 0; i < param_.test_iter(test_net_id); ++i) {
+  // With test_threads, each pass forwards one batch per replica; the scores
+  // are still summed in batch order.
+  const vector<shared_ptr<Net<Dtype> > >& replicas =
+      test_net_replicas_[test_net_id];
+  for (int i = 0; i < replicas.size(); ++i) {
+    replicas[i]->ShareTrainedLayersWith(net_.get());
+  }
+  const int batches_per_pass = std::max<int>(replicas.size(), 1);
+  for (int i = 0; i < param_.test_iter(test_net_id); i += batches_per_pass) {
     SolverAction::Enum request = GetRequestedAction();
     // Check to see if stoppage of testing/training has been requested.
     while (request != SolverAction::NONE) {
@@ -896,26 +1013,35 @@ void Solver<Dtype>::Test(const int test_net_id) {
       break;
     }
 
+    const int num_batches =
+        std::min(batches_per_pass, param_.test_iter(test_net_id) - i);
     Dtype iter_loss;
-    const vector<Blob<Dtype>*>& result =
-        test_net->Forward(bottom_vec, &iter_loss);
-    if (param_.test_compute_loss()) {
-      loss += iter_loss;
+    if (replicas.size()) {
+      ForwardTestNetReplicas(test_net_id, num_batches);
+    } else {
+      test_net->Forward(bottom_vec, &iter_loss);
     }
-    if (i == 0) {
-      for (int j = 0; j < result.size(); ++j) {
-        const Dtype* result_vec = result[j]->cpu_data();
-        for (int k = 0; k < result[j]->count(); ++k) {
-          test_score.push_back(result_vec[k]);
-          test_score_output_id.push_back(j);
-        }
+    for (int b = 0; b < num_batches; ++b) {
+      const Net<Dtype>& batch_net = replicas.size() ? *replicas[b] : *test_net;
+      if (param_.test_compute_loss()) {
+        loss += replicas.size() ? test_replica_losses_[b] : iter_loss;
       }
-    } else {
-      int idx = 0;
-      for (int j = 0; j < result.size(); ++j) {
-        const Dtype* result_vec = result[j]->cpu_data();
-        for (int k = 0; k < result[j]->count(); ++k) {
-          test_score[idx++] += result_vec[k];
+      const vector<Blob<Dtype>*>& result = batch_net.output_blobs();
+      if (i + b == 0) {
+        for (int j = 0; j < result.size(); ++j) {
+          const Dtype* result_vec = result[j]->cpu_data();
+          for (int k = 0; k < result[j]->count(); ++k) {
+            test_score.push_back(result_vec[k]);
+            test_score_output_id.push_back(j);
+          }
+        }
+      } else {
+        int idx = 0;
+        for (int j = 0; j < result.size(); ++j) {
+          const Dtype* result_vec = result[j]->cpu_data();
+          for (int k = 0; k < result[j]->count(); ++k) {
+            test_score[idx++] += result_vec[k];
+          }
         }
       }
     }
@@ -928,6 +1054,7 @@ void Solver<Dtype>::Test(const int test_net_id) {
     loss /= param_.test_iter(test_net_id);
     LOG(INFO) << "Test loss: " << loss;
   }
+  test_scores_[test_net_id].clear();
   for (int i = 0; i < test_score.size(); ++i) {
     const int output_blob_index =
         test_net->output_blob_indices()[test_score_output_id[i]];
@@ -935,6 +1062,7 @@ void Solver<Dtype>::Test(const int test_net_id) {
     const Dtype loss_weight = test_net->blob_loss_weights()[output_blob_index];
     ostringstream loss_msg_stream;
     const Dtype mean_score = test_score[i] / param_.test_iter(test_net_id);
+    test_scores_[test_net_id].push_back(mean_score);
     if (loss_weight) {
       loss_msg_stream << " (* " << loss_weight
                       << " = " << loss_weight * mean_score << " loss)";
@@ -949,6 +1077,39 @@ void Solver<Dtype>::Test(const int test_net_id) {
   }
 }
 
+template <typename Dtype>
+void Solver<Dtype>::ForwardTestNetReplicas(const int test_net_id,
+    const int num_batches) {
+  Net<Dtype>* test_net = test_nets_[test_net_id].get();
+  const vector<shared_ptr<Net<Dtype> > >& replicas =
+      test_net_replicas_[test_net_id];
+  const int num_data_layers = test_net_num_data_layers_[test_net_id];
+  for (int b = 0; b < num_batches; ++b) {
+    test_net->ForwardFromTo(0, num_data_layers - 1);
+    const vector<Blob<Dtype>*>& inputs = replicas[b]->input_blobs();
+    int input_id = 0;
+    for (int i = 0; i < num_data_layers; ++i) {
+      for (int j = 0; j < test_net->top_vecs()[i].size(); ++j) {
+        inputs[input_id++]->CopyFrom(*test_net->top_vecs()[i][j], false, true);
+      }
+    }
+  }
+  if (!test_pool_) {
+    test_pool_.reset(new ThreadPool(param_.test_threads()));
+  }
+  test_pool_->Run(boost::bind(&Solver<Dtype>::TestReplicaWorker, this,
+      test_net_id, num_batches, _1));
+}
+
+template <typename Dtype>
+void Solver<Dtype>::TestReplicaWorker(const int test_net_id,
+    const int num_batches, const int thread_id) {
+  if (thread_id < num_batches) {
+    test_net_replicas_[test_net_id][thread_id]->ForwardPrefilled(
+        &test_replica_losses_[thread_id]);
+  }
+}
+
 /// @lixiang, for pruning
 template <typename Dtype>
 void Solver<Dtype>::UpdateSnapshotNaming() {
@@ -989,6 +1150,24 @@ void Solver<Dtype>::Snapshot() {
   SnapshotSolverState(model_filename);          // save solverstate
 }
 
+template <typename Dtype>
+void Solver<Dtype>::FlushSnapshots() {
+  if (snapshot_writer_) {
+    snapshot_writer_->Flush();
+  }
+}
+
+template <typename Dtype>
+void Solver<Dtype>::WriteSnapshotProto(
+    const shared_ptr<google::protobuf::Message>& proto,
+    const string& filename) {
+  if (snapshot_writer_) {
+    snapshot_writer_->Write(proto, filename);
+  } else {
+    WriteProtoToBinaryFile(*proto, filename);
+  }
+}
+
 template <typename Dtype>
 void Solver<Dtype>::CheckSnapshotWritePermissions() {
   if (Caffe::root_solver() && param_.snapshot()) {
@@ -1016,9 +1195,9 @@ template <typename Dtype>
 string Solver<Dtype>::SnapshotToBinaryProto() {
   string model_filename = SnapshotFilename(".caffemodel");
   LOG(INFO) << "Snapshotting to binary proto file " << model_filename;
-  NetParameter net_param;
-  net_->ToProto(&net_param, param_.snapshot_diff());
-  WriteProtoToBinaryFile(net_param, model_filename);
+  shared_ptr<NetParameter> net_param(new NetParameter());
+  net_->ToProto(net_param.get(), param_.snapshot_diff());
+  WriteSnapshotProto(net_param, model_filename);
   return model_filename;
 }
 
@@ -1033,6 +1212,7 @@ string Solver<Dtype>::SnapshotToHDF5() {
 template <typename Dtype>
 void Solver<Dtype>::Restore(const char* state_file, const bool& restore_prune_state) {
   CHECK(Caffe::root_solver());
+  FlushSnapshots();
   string state_filename(state_file);
   if (state_filename.size() >= 3 &&
       state_filename.compare(state_filename.size() - 3, 3, ".h5") == 0) {
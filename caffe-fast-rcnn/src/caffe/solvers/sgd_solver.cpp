@@ -172,6 +172,175 @@ void SGDSolver<Dtype>::Normalize(int param_id) {
   }
 }
 
+// Leaves v ordered as by std::sort from position k on, but only partitions
+// the first k entries around it: O(n) + O((n-k) log(n-k)) instead of a full
+// O(n log n) sort.
+template <typename T>
+static void SortFrom(vector<T>* v, int k) {
+  k = std::min(std::max(k, 0), static_cast<int>(v->size()));
+  std::nth_element(v->begin(), v->begin() + k, v->end());
+  std::sort(v->begin() + k, v->end());
+}
+
+/// @lixiang, the incremental regularization of Reg_Col, shared by the CPU and
+/// GPU solvers. Every prune_interval steps the columns are ranked, their
+/// punishment is raised (or lowered) by rank, and those reaching target_reg
+/// are pruned. Returns false if the param is not regularized by column.
+template <typename Dtype>
+bool SGDSolver<Dtype>::UpdateColPunish(int param_id) {
+  const vector<Blob<Dtype>*>& net_params = this->net_->learnable_params();
+  const string& layer_name = this->net_->layer_names()[this->net_->param_layer_indices()[param_id].first];
+  const int L = GetLayerIndex(param_id);
+  if (L == -1) { return false; }
+
+  const int count   = net_params[param_id]->count();
+  const int num_row = net_params[param_id]->shape()[0];
+  const int num_col = count / num_row;
+  const int num_pruned_col = APP<Dtype>::num_pruned_col[L];
+  const int real_num_col_to_prune_ = ceil(num_col * APP<Dtype>::current_prune_ratio[L]) - num_pruned_col;
+  int num_col_to_prune_ = real_num_col_to_prune_;
+  const int num_col_ = num_col - num_pruned_col;
+
+  // This should not happen, but check here in case.
+  if (num_col_to_prune_ <= 0) {
+    cout << "BUG: num_col_to_prune_ = " << num_col_to_prune_ << endl;
+    return false;
+  }
+
+  const Dtype AA = APP<Dtype>::AA;
+  if (APP<Dtype>::step_ % APP<Dtype>::prune_interval == 0) {
+    if (APP<Dtype>::prune_coremthd == "Reg-rank" || APP<Dtype>::prune_coremthd == "Reg") {
+      Layer<Dtype>* layer = this->net_->layer_by_name(layer_name).get();
+      Dtype* muhistory_score  = layer->history_score()[0]->mutable_cpu_data();
+      Dtype* muhistory_punish = layer->history_punish()[0]->mutable_cpu_data();
+      Dtype* mumasks          = layer->masks()[0]->mutable_cpu_data();
+      Dtype* muweight   = net_params[param_id]->mutable_cpu_data();
+
+      // Sort 01: sort by L1-norm
+      // The weights are row-major, so each task sums a block of adjacent
+      // columns down all the rows: unit-stride reads, and every column is
+      // summed in the same order whatever the number of threads.
+      typedef std::pair<Dtype, int> mypair;
+      vector<mypair> col_score(num_col);
+      const int col_block = 256;
+#pragma omp parallel for
+      for (int jb = 0; jb < num_col; jb += col_block) {
+        const int je = std::min(jb + col_block, num_col);
+        for (int j = jb; j < je; ++j) {
+          col_score[j].first  = 0;
+          col_score[j].second = j;
+        }
+        for (int i = 0; i < num_row; ++i) {
+          const Dtype* weight_row = muweight + i * num_col;
+          for (int j = jb; j < je; ++j) {
+            col_score[j].first += fabs(weight_row[j]);
+          }
+        }
+        for (int j = jb; j < je; ++j) {
+          if (APP<Dtype>::IF_col_pruned[L][j][0]) {
+            col_score[j].first = muhistory_score[j]; // make the pruned sink down
+          }
+        }
+      }
+      // The pruned columns sink to the first num_pruned_col ranks and their
+      // ranks are not used, so only the live columns need to be sorted.
+      SortFrom(&col_score, num_pruned_col);
+      for (int rk = 0; rk < num_pruned_col; ++rk) {
+        if (!APP<Dtype>::IF_col_pruned[L][col_score[rk].second][0]) {
+          // a live column scored below a pruned one, rank the front too
+          sort(col_score.begin(), col_score.begin() + num_pruned_col);
+          break;
+        }
+      }
+
+      // Make new criteria, i.e. history_rank, by rank
+      const int n = this->iter_ + 1; // No.n iter (n starts from 1)
+      for (int rk = 0; rk < num_col; ++rk) {
+        const int col_of_rank_rk = col_score[rk].second;
+        if (APP<Dtype>::IF_col_pruned[L][col_of_rank_rk][0]) { continue; }
+        muhistory_score[col_of_rank_rk] = ((n-1) * muhistory_score[col_of_rank_rk] + rk) / n;
+      }
+
+      // Sort 02: sort by history_rank, only ranks from num_pruned_col on are used
+      vector<mypair> col_hrank(num_col); // the history_rank of each column, history_rank is like the new score
+      for (int j = 0; j < num_col; ++j) {
+        col_hrank[j].first  = muhistory_score[j];
+        col_hrank[j].second = j;
+      }
+      SortFrom(&col_hrank, num_pruned_col);
+
+      // scheme 1, the exponential center-symmetrical function
+      const Dtype kk = APP<Dtype>::kk; // u in the paper
+      const Dtype alpha = log(2/kk) / (num_col_to_prune_);
+      const Dtype N1 = -log(kk)/alpha; // the symmetry point
+
+      // scheme 2, the dis-continual function
+
+      // The new punishments and the newly pruned columns are written to the
+      // (row-major) matrices afterwards, one row per task.
+      vector<std::pair<int, Dtype> > new_punish;
+      vector<int> newly_pruned_col;
+      new_punish.reserve(num_col_);
+      for (int j = 0; j < num_col_; ++j) { // j: rank
+        const int col_of_rank_j = col_hrank[j + num_pruned_col].second; // Note the real rank is j + num_pruned_col
+        const Dtype Delta = j < N1 ? AA * exp(-alpha * j) : 2*kk*AA - AA * exp(-alpha * (2 * N1 - j));
+
+        const Dtype old_reg = muhistory_punish[col_of_rank_j];
+        const Dtype new_reg = std::max(old_reg + Delta, Dtype(0));
+        new_punish.push_back(std::make_pair(col_of_rank_j, new_reg));
+        if (new_reg >= APP<Dtype>::target_reg) {
+          for (int g = 0; g < APP<Dtype>::group[L]; ++g) {
+            APP<Dtype>::IF_col_pruned[L][col_of_rank_j][g] = true;
+          }
+          APP<Dtype>::num_pruned_col[L] += 1;
+          newly_pruned_col.push_back(col_of_rank_j);
+          muhistory_score[col_of_rank_j] = APP<Dtype>::step_ - 1000000 - (new_reg - APP<Dtype>::target_reg);
+
+          // make the pruned weight group sorted in left in sort 01 and 02 above, and the earlier pruned the lefter sorted
+          // Check whether the corresponding row in the last layer could be pruned
+          if (L != 0 && L != APP<Dtype>::conv_layer_cnt) { // Not the fist Conv and first FC layer
+            const int filter_spatial_size = net_params[param_id]->count(2);
+            const int channel = col_of_rank_j / filter_spatial_size;
+            bool IF_consecutively_pruned = true;
+            for (int j = channel * filter_spatial_size; j < (channel+1) * filter_spatial_size; ++j) {
+              if (!APP<Dtype>::IF_col_pruned[L][j][0]) {
+                IF_consecutively_pruned = false;
+                break;
+              }
+            }
+            if (IF_consecutively_pruned) {
+              const int num_chl_per_g = num_col / filter_spatial_size;
+              for (int g = 0; g < APP<Dtype>::group[L]; ++g) {
+                APP<Dtype>::rows_to_prune[L - 1].push_back(channel + g * num_chl_per_g);
+              }
+            }
+          }
+        }
+        if (new_reg < old_reg) {
+          cout << "reduce reg: " << layer_name << "-" << col_of_rank_j
+               << "   old reg: "  << old_reg
+               << "   new reg: "  << new_reg << endl;
+        }
+      }
+
+#pragma omp parallel for
+      for (int i = 0; i < num_row; ++i) {
+        Dtype* punish_row = muhistory_punish + i * num_col;
+        Dtype* masks_row  = mumasks + i * num_col;
+        Dtype* weight_row = muweight + i * num_col;
+        for (int k = 0; k < new_punish.size(); ++k) {
+          punish_row[new_punish[k].first] = new_punish[k].second;
+        }
+        for (int k = 0; k < newly_pruned_col.size(); ++k) {
+          masks_row[newly_pruned_col[k]]  = 0;
+          weight_row[newly_pruned_col[k]] = 0;
+        }
+      }
+    }
+  }
+  return true;
+}
+
 template <typename Dtype>
 void SGDSolver<Dtype>::Regularize(int param_id) {
   const vector<Blob<Dtype>*>& net_params = this->net_->learnable_params();
@@ -200,6 +369,24 @@ void SGDSolver<Dtype>::Regularize(int param_id) {
             temp_[param_id]->cpu_data(),
             net_params[param_id]->mutable_cpu_diff());
 
+      } else if (regularization_type == "Reg_Col") {
+        /// @lixiang, add new weight decay, weight decay still used
+        caffe_axpy(net_params[param_id]->count(),
+                   local_decay,
+                   net_params[param_id]->cpu_data(),
+                   net_params[param_id]->mutable_cpu_diff());
+        if (!UpdateColPunish(param_id)) { return; }
+        // Apply Reg
+        const string& layer_name = this->net_->layer_names()[this->net_->param_layer_indices()[param_id].first];
+        caffe_mul(net_params[param_id]->count(),
+                  net_params[param_id]->cpu_data(),
+                  this->net_->layer_by_name(layer_name)->history_punish()[0]->cpu_data(),
+                  tmp_[param_id]->mutable_cpu_data());
+        caffe_add(net_params[param_id]->count(),
+                  tmp_[param_id]->cpu_data(),
+                  net_params[param_id]->cpu_diff(),
+                  net_params[param_id]->mutable_cpu_diff());
+
       } else {
         LOG(FATAL) << "Unknown regularization type: " << regularization_type;
       }
@@ -232,132 +419,14 @@ void SGDSolver<Dtype>::Regularize(int param_id) {
                        local_decay,
                        net_params[param_id]->gpu_data(),
                        net_params[param_id]->mutable_gpu_diff());
-        // If return
-        const string& layer_name = this->net_->layer_names()[this->net_->param_layer_indices()[param_id].first];
-        const int L = GetLayerIndex(param_id);
-        if (L == -1) { return; }
-
-        Dtype* muhistory_score  = this->net_->layer_by_name(layer_name)->history_score()[0]->mutable_cpu_data();
-        Dtype* muhistory_punish = this->net_->layer_by_name(layer_name)->history_punish()[0]->mutable_cpu_data();
-        Dtype* mumasks          = this->net_->layer_by_name(layer_name)->masks()[0]->mutable_cpu_data();
-        Dtype* muweight   = net_params[param_id]->mutable_cpu_data();
-        const int count   = net_params[param_id]->count();
-        const int num_row = net_params[param_id]->shape()[0];
-        const int num_col = count / num_row;
-        const int num_pruned_col = APP<Dtype>::num_pruned_col[L];
-        const int real_num_col_to_prune_ = ceil(num_col * APP<Dtype>::current_prune_ratio[L]) - num_pruned_col;
-        int num_col_to_prune_ = real_num_col_to_prune_;
-        const int num_col_ = num_col - num_pruned_col;
-        
-        //LOG(INFO) << "-----------------------------------------------" << endl;
-        //LOG(INFO) << "-------------- layer L: " << L << endl;
-        //LOG(INFO) << "-------------- num_row: " << num_row << endl;
-        //LOG(INFO) << "-------------- num_col: " << num_col << endl;
-        //LOG(INFO) << "-------------- num_col_to_prune_: " << num_col_to_prune_ << endl;
-        //LOG(INFO) << "-----------------------------------------------" << endl;
-
-        // This should not happen, but check here in case.
-        if (num_col_to_prune_ <= 0) {
-          cout << "BUG: num_col_to_prune_ = " << num_col_to_prune_ << endl;
-          return;
-        }
-        
-        const Dtype AA = APP<Dtype>::AA;
-        if (APP<Dtype>::step_ % APP<Dtype>::prune_interval == 0) {
-          if (APP<Dtype>::prune_coremthd == "Reg-rank" || APP<Dtype>::prune_coremthd == "Reg") {
-            // Sort 01: sort by L1-norm
-            typedef std::pair<Dtype, int> mypair;
-            vector<mypair> col_score(num_col);
-            for (int j = 0; j < num_col; ++j) {
-              col_score[j].second = j;
-              if (APP<Dtype>::IF_col_pruned[L][j][0]) {
-                col_score[j].first = muhistory_score[j]; // make the pruned sink down
-                continue;
-              }
-              col_score[j].first  = 0;
-              for (int i = 0; i < num_row; ++i) {
-                col_score[j].first += fabs(muweight[i * num_col + j]);
-              }
-            }
-            sort(col_score.begin(), col_score.end());
-
-            // Make new criteria, i.e. history_rank, by rank
-            const int n = this->iter_ + 1; // No.n iter (n starts from 1)
-            for (int rk = 0; rk < num_col; ++rk) {
-              const int col_of_rank_rk = col_score[rk].second;
-              if (APP<Dtype>::IF_col_pruned[L][col_of_rank_rk][0]) { continue; }
-              muhistory_score[col_of_rank_rk] = ((n-1) * muhistory_score[col_of_rank_rk] + rk) / n;
-            }
-
-            // Sort 02: sort by history_rank
-            vector<mypair> col_hrank(num_col); // the history_rank of each column, history_rank is like the new score
-            for (int j = 0; j < num_col; ++j) {
-              col_hrank[j].first  = muhistory_score[j];
-              col_hrank[j].second = j;
-            }
-            sort(col_hrank.begin(), col_hrank.end());
-
-            // scheme 1, the exponential center-symmetrical function
-            const Dtype kk = APP<Dtype>::kk; // u in the paper
-            const Dtype alpha = log(2/kk) / (num_col_to_prune_);
-            const Dtype N1 = -log(kk)/alpha; // the symmetry point
-
-            // scheme 2, the dis-continual function
-
-            for (int j = 0; j < num_col_; ++j) { // j: rank
-              const int col_of_rank_j = col_hrank[j + num_pruned_col].second; // Note the real rank is j + num_pruned_col
-              const Dtype Delta = j < N1 ? AA * exp(-alpha * j) : 2*kk*AA - AA * exp(-alpha * (2 * N1 - j));
-
-              const Dtype old_reg = muhistory_punish[col_of_rank_j];
-              const Dtype new_reg = std::max(old_reg + Delta, Dtype(0));
-              for (int i = 0; i < num_row; ++i) {
-                muhistory_punish[i * num_col + col_of_rank_j] = new_reg;
-              }
-              if (new_reg >= APP<Dtype>::target_reg) {
-                for (int g = 0; g < APP<Dtype>::group[L]; ++g) {
-                  APP<Dtype>::IF_col_pruned[L][col_of_rank_j][g] = true;
-                }
-                APP<Dtype>::num_pruned_col[L] += 1;
-                for (int i = 0; i < num_row; ++i) {
-                  mumasks[i * num_col + col_of_rank_j] = 0;
-                  muweight[i* num_col + col_of_rank_j] = 0;
-                }
-                muhistory_score[col_of_rank_j] = APP<Dtype>::step_ - 1000000 - (muhistory_punish[col_of_rank_j] - APP<Dtype>::target_reg);
-
-                // make the pruned weight group sorted in left in sort 01 and 02 above, and the earlier pruned the lefter sorted
-                // Check whether the corresponding row in the last layer could be pruned
-                if (L != 0 && L != APP<Dtype>::conv_layer_cnt) { // Not the fist Conv and first FC layer
-                  const int filter_spatial_size = net_params[param_id]->count(2);
-                  const int channel = col_of_rank_j / filter_spatial_size;
-                  bool IF_consecutively_pruned = true;
-                  for (int j = channel * filter_spatial_size; j < (channel+1) * filter_spatial_size; ++j) {
-                    if (!APP<Dtype>::IF_col_pruned[L][j][0]) {
-                      IF_consecutively_pruned = false;
-                      break;
-                    }
-                  }
-                  if (IF_consecutively_pruned) {
-                    const int num_chl_per_g = num_col / filter_spatial_size;
-                    for (int g = 0; g < APP<Dtype>::group[L]; ++g) {
-                      APP<Dtype>::rows_to_prune[L - 1].push_back(channel + g * num_chl_per_g);
-                    }
-                  }
-                }
-              }
-              if (new_reg < old_reg) {
-                cout << "reduce reg: " << layer_name << "-" << col_of_rank_j
-                     << "   old reg: "  << old_reg
-                     << "   new reg: "  << new_reg << endl;
-              }
-            }
-          }
-        }
+        if (!UpdateColPunish(param_id)) { return; }
         // Apply Reg
-        caffe_gpu_mul(count,
+        const string& layer_name = this->net_->layer_names()[this->net_->param_layer_indices()[param_id].first];
+        caffe_gpu_mul(net_params[param_id]->count(),
                       net_params[param_id]->gpu_data(),
-                      muhistory_punish,
+                      this->net_->layer_by_name(layer_name)->history_punish()[0]->gpu_data(),
                       tmp_[param_id]->mutable_gpu_data());
-        caffe_gpu_add(count,
+        caffe_gpu_add(net_params[param_id]->count(),
                       tmp_[param_id]->gpu_data(),
                       net_params[param_id]->gpu_diff(),
                       net_params[param_id]->mutable_gpu_diff());
@@ -427,10 +496,26 @@ void SGDSolver<Dtype>::ClearHistory(const int& param_id) {
   if (APP<Dtype>::pruned_ratio[L] == 0) {
     return;
   }
-  caffe_gpu_mul(history_[param_id]->count(),
-                this->net_->layer_by_name(layer_name)->masks()[0]->gpu_data(),
-                history_[param_id]->gpu_data(),
-                history_[param_id]->mutable_gpu_data());
+  switch (Caffe::mode()) {
+  case Caffe::CPU:
+    caffe_mul(history_[param_id]->count(),
+              this->net_->layer_by_name(layer_name)->masks()[0]->cpu_data(),
+              history_[param_id]->cpu_data(),
+              history_[param_id]->mutable_cpu_data());
+    break;
+  case Caffe::GPU:
+#ifndef CPU_ONLY
+    caffe_gpu_mul(history_[param_id]->count(),
+                  this->net_->layer_by_name(layer_name)->masks()[0]->gpu_data(),
+                  history_[param_id]->gpu_data(),
+                  history_[param_id]->mutable_gpu_data());
+#else
+    NO_GPU;
+#endif
+    break;
+  default:
+    LOG(FATAL) << "Unknown caffe mode: " << Caffe::mode();
+  }
 }
 
 template <typename Dtype>
@@ -450,7 +535,8 @@ void SGDSolver<Dtype>::SnapshotSolverState(const string& model_filename) {
 template <typename Dtype>
 void SGDSolver<Dtype>::SnapshotSolverStateToBinaryProto(
     const string& model_filename) {
-  SolverState state;
+  shared_ptr<SolverState> state_ptr(new SolverState());
+  SolverState& state = *state_ptr;
   state.set_iter(this->iter_);
   state.set_learned_net(model_filename);
   state.set_current_step(this->current_step_);
@@ -505,7 +591,7 @@ void SGDSolver<Dtype>::SnapshotSolverStateToBinaryProto(
   string snapshot_filename = Solver<Dtype>::SnapshotFilename(".solverstate");
   LOG(INFO)
     << "Snapshotting solver state to binary proto file " << snapshot_filename;
-  WriteProtoToBinaryFile(state, snapshot_filename.c_str());
+  this->WriteSnapshotProto(state_ptr, snapshot_filename);
 }
 
 template <typename Dtype>
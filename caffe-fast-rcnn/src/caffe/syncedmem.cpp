@@ -26,7 +26,11 @@ inline void SyncedMemory::to_cpu() {
   switch (head_) {
   case UNINITIALIZED:
     CaffeMallocHost(&cpu_ptr_, size_, &cpu_malloc_use_cuda_);
-    caffe_memset(size_, 0, cpu_ptr_);
+    Caffe::count_allocation(size_);
+    if (zero_fill_) {
+      caffe_memset(size_, 0, cpu_ptr_);
+      Caffe::count_zeroed(size_);
+    }
     head_ = HEAD_AT_CPU;
     own_cpu_data_ = true;
     break;
@@ -34,6 +38,7 @@ inline void SyncedMemory::to_cpu() {
 #ifndef CPU_ONLY
     if (cpu_ptr_ == NULL) {
       CaffeMallocHost(&cpu_ptr_, size_, &cpu_malloc_use_cuda_);
+      Caffe::count_allocation(size_);
       own_cpu_data_ = true;
     }
     caffe_gpu_memcpy(size_, gpu_ptr_, cpu_ptr_);
@@ -54,7 +59,11 @@ inline void SyncedMemory::to_gpu() {
   case UNINITIALIZED:
     CUDA_CHECK(cudaGetDevice(&gpu_device_));
     CUDA_CHECK(cudaMalloc(&gpu_ptr_, size_));
-    caffe_gpu_memset(size_, 0, gpu_ptr_);
+    Caffe::count_allocation(size_);
+    if (zero_fill_) {
+      caffe_gpu_memset(size_, 0, gpu_ptr_);
+      Caffe::count_zeroed(size_);
+    }
     head_ = HEAD_AT_GPU;
     own_gpu_data_ = true;
     break;
@@ -62,6 +71,7 @@ inline void SyncedMemory::to_gpu() {
     if (gpu_ptr_ == NULL) {
       CUDA_CHECK(cudaGetDevice(&gpu_device_));
       CUDA_CHECK(cudaMalloc(&gpu_ptr_, size_));
+      Caffe::count_allocation(size_);
       own_gpu_data_ = true;
     }
     caffe_gpu_memcpy(size_, cpu_ptr_, gpu_ptr_);
@@ -144,6 +154,7 @@ void SyncedMemory::async_gpu_push(const cudaStream_t& stream) {
   if (gpu_ptr_ == NULL) {
     CUDA_CHECK(cudaGetDevice(&gpu_device_));
     CUDA_CHECK(cudaMalloc(&gpu_ptr_, size_));
+    Caffe::count_allocation(size_);
     own_gpu_data_ = true;
   }
   const cudaMemcpyKind put = cudaMemcpyHostToDevice;
@@ -0,0 +1,193 @@
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "caffe/blob.hpp"
+#include "caffe/common.hpp"
+#include "caffe/fast_rcnn_layers.hpp"
+#include "caffe/util/bbox_util.hpp"
+
+#include "caffe/test/test_caffe_main.hpp"
+
+namespace caffe {
+
+template <typename Dtype>
+class AnchorTargetLayerTest : public CPUDeviceTest<Dtype> {
+ protected:
+  AnchorTargetLayerTest()
+      : blob_bottom_score_(new Blob<Dtype>(1, 4, 6, 8)),
+        blob_bottom_gt_boxes_(new Blob<Dtype>(2, 5, 1, 1)),
+        blob_bottom_im_info_(new Blob<Dtype>(1, 3, 1, 1)),
+        blob_top_labels_(new Blob<Dtype>()),
+        blob_top_targets_(new Blob<Dtype>()),
+        blob_top_inside_weights_(new Blob<Dtype>()),
+        blob_top_outside_weights_(new Blob<Dtype>()) {
+    const Dtype gt_boxes[] = { 10, 12, 50, 40, 1, 60, 30, 110, 90, 2 };
+    std::copy(gt_boxes, gt_boxes + 10,
+        blob_bottom_gt_boxes_->mutable_cpu_data());
+    // A 96 x 128 image: the 6 x 8 map at stride 16 covers it exactly.
+    Dtype* im_info = blob_bottom_im_info_->mutable_cpu_data();
+    im_info[0] = 96;
+    im_info[1] = 128;
+    im_info[2] = 1;
+    blob_bottom_vec_.push_back(blob_bottom_score_);
+    blob_bottom_vec_.push_back(blob_bottom_gt_boxes_);
+    blob_bottom_vec_.push_back(blob_bottom_im_info_);
+    blob_top_vec_.push_back(blob_top_labels_);
+    blob_top_vec_.push_back(blob_top_targets_);
+    blob_top_vec_.push_back(blob_top_inside_weights_);
+    blob_top_vec_.push_back(blob_top_outside_weights_);
+    // Two anchors per cell, 16 x 16 and 32 x 32.
+    AnchorTargetParameter* anchor_param =
+        layer_param_.mutable_anchor_target_param();
+    anchor_param->add_ratio(1);
+    anchor_param->add_scale(1);
+    anchor_param->add_scale(2);
+  }
+  virtual ~AnchorTargetLayerTest() {
+    delete blob_bottom_score_;
+    delete blob_bottom_gt_boxes_;
+    delete blob_bottom_im_info_;
+    delete blob_top_labels_;
+    delete blob_top_targets_;
+    delete blob_top_inside_weights_;
+    delete blob_top_outside_weights_;
+  }
+
+  // The labels anchor_target_layer.py assigns before subsampling, from the
+  // dense anchors x gt overlaps, and the best gt box of each anchor.
+  void ReferenceLabels(vector<int>* labels, vector<int>* argmax) {
+    const Dtype anchors[] = { 0, 0, 15, 15, -8, -8, 23, 23 };
+    const Dtype* gt_boxes = blob_bottom_gt_boxes_->cpu_data();
+    labels->assign(96, -1);
+    argmax->assign(96, 0);
+    vector<vector<Dtype> > overlaps(96, vector<Dtype>(2, 0));
+    vector<Dtype> gt_max(2, 0);
+    for (int h = 0; h < 6; ++h) {
+      for (int w = 0; w < 8; ++w) {
+        for (int a = 0; a < 2; ++a) {
+          const int i = (h * 8 + w) * 2 + a;
+          const Dtype anchor[] = { anchors[4 * a] + w * 16,
+              anchors[4 * a + 1] + h * 16, anchors[4 * a + 2] + w * 16,
+              anchors[4 * a + 3] + h * 16 };
+          if (anchor[0] < 0 || anchor[1] < 0 || anchor[2] >= 128 ||
+              anchor[3] >= 96) {
+            continue;
+          }
+          labels->at(i) = 0;
+          for (int g = 0; g < 2; ++g) {
+            overlaps[i][g] = bbox_overlap(anchor, gt_boxes + 5 * g);
+            gt_max[g] = std::max(gt_max[g], overlaps[i][g]);
+          }
+          (*argmax)[i] = overlaps[i][1] > overlaps[i][0];
+        }
+      }
+    }
+    for (int i = 0; i < 96; ++i) {
+      if ((*labels)[i] < 0) {
+        continue;
+      }
+      const Dtype max_overlap = overlaps[i][(*argmax)[i]];
+      (*labels)[i] = max_overlap >= 0.7 || overlaps[i][0] == gt_max[0] ||
+          overlaps[i][1] == gt_max[1] ? 1 : max_overlap < 0.3 ? 0 : -1;
+    }
+  }
+
+  Blob<Dtype>* const blob_bottom_score_;
+  Blob<Dtype>* const blob_bottom_gt_boxes_;
+  Blob<Dtype>* const blob_bottom_im_info_;
+  Blob<Dtype>* const blob_top_labels_;
+  Blob<Dtype>* const blob_top_targets_;
+  Blob<Dtype>* const blob_top_inside_weights_;
+  Blob<Dtype>* const blob_top_outside_weights_;
+  vector<Blob<Dtype>*> blob_bottom_vec_;
+  vector<Blob<Dtype>*> blob_top_vec_;
+  LayerParameter layer_param_;
+};
+
+TYPED_TEST_CASE(AnchorTargetLayerTest, TestDtypes);
+
+TYPED_TEST(AnchorTargetLayerTest, TestForward) {
+  typedef TypeParam Dtype;
+  AnchorTargetLayer<Dtype> layer(this->layer_param_);
+  layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  EXPECT_EQ(12, this->blob_top_labels_->height());
+  EXPECT_EQ(8, this->blob_top_targets_->channels());
+  layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+  vector<int> labels, argmax;
+  this->ReferenceLabels(&labels, &argmax);
+  // No subsampling: 96 anchors fit in the default batch of 256.
+  const Dtype* gt_boxes = this->blob_bottom_gt_boxes_->cpu_data();
+  int num_fg = 0, num_labeled = 0;
+  for (int h = 0; h < 6; ++h) {
+    for (int w = 0; w < 8; ++w) {
+      for (int a = 0; a < 2; ++a) {
+        const int i = (h * 8 + w) * 2 + a;
+        EXPECT_EQ(labels[i], this->blob_top_labels_->data_at(0, 0,
+            a * 6 + h, w));
+        num_fg += labels[i] == 1;
+        num_labeled += labels[i] >= 0;
+        if (labels[i] < 0) {
+          continue;
+        }
+        const Dtype anchor[] = { Dtype(a ? -8 : 0) + w * 16,
+            Dtype(a ? -8 : 0) + h * 16, Dtype(a ? 23 : 15) + w * 16,
+            Dtype(a ? 23 : 15) + h * 16 };
+        Dtype targets[4];
+        bbox_transform(anchor, gt_boxes + 5 * argmax[i], targets);
+        for (int k = 0; k < 4; ++k) {
+          EXPECT_NEAR(targets[k],
+              this->blob_top_targets_->data_at(0, 4 * a + k, h, w), 1e-5);
+          EXPECT_EQ(labels[i] == 1,
+              this->blob_top_inside_weights_->data_at(0, 4 * a + k, h, w));
+        }
+      }
+    }
+  }
+  EXPECT_GT(num_fg, 1);
+  for (int i = 0; i < this->blob_top_outside_weights_->count(); ++i) {
+    const Dtype weight = this->blob_top_outside_weights_->cpu_data()[i];
+    EXPECT_TRUE(weight == 0 || std::abs(weight * num_labeled - 1) < 1e-5);
+  }
+}
+
+TYPED_TEST(AnchorTargetLayerTest, TestSubsample) {
+  typedef TypeParam Dtype;
+  this->layer_param_.mutable_anchor_target_param()->set_batch_size(8);
+  vector<vector<Dtype> > runs;
+  for (int run = 0; run < 2; ++run) {
+    Caffe::set_random_seed(1701);
+    AnchorTargetLayer<Dtype> layer(this->layer_param_);
+    layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+    layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+    const Dtype* top_labels = this->blob_top_labels_->cpu_data();
+    runs.push_back(vector<Dtype>(top_labels,
+        top_labels + this->blob_top_labels_->count()));
+  }
+  vector<int> labels, argmax;
+  this->ReferenceLabels(&labels, &argmax);
+  int num_fg = 0, num_bg = 0;
+  for (int h = 0; h < 6; ++h) {
+    for (int w = 0; w < 8; ++w) {
+      for (int a = 0; a < 2; ++a) {
+        const int label = this->blob_top_labels_->data_at(0, 0, a * 6 + h, w);
+        // Sampled anchors keep their label, the others are ignored.
+        if (label >= 0) {
+          EXPECT_EQ(labels[(h * 8 + w) * 2 + a], label);
+        }
+        num_fg += label == 1;
+        num_bg += label == 0;
+      }
+    }
+  }
+  EXPECT_LE(num_fg, 4);
+  EXPECT_EQ(8, num_fg + num_bg);
+  // Seeded through Caffe's RNG, the sampling is reproducible.
+  for (int i = 0; i < runs[0].size(); ++i) {
+    EXPECT_EQ(runs[0][i], runs[1][i]);
+  }
+}
+
+}  // namespace caffe
@@ -0,0 +1,66 @@
+#include <boost/filesystem.hpp>
+
+#include <string>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "caffe/common.hpp"
+#include "caffe/proto/caffe.pb.h"
+#include "caffe/util/async_proto_writer.hpp"
+#include "caffe/util/format.hpp"
+#include "caffe/util/io.hpp"
+
+#include "caffe/test/test_caffe_main.hpp"
+
+namespace caffe {
+
+class AsyncProtoWriterTest : public ::testing::Test {
+ protected:
+  AsyncProtoWriterTest() {
+    MakeTempDir(&temp_dir_);
+  }
+
+  // A largish proto, to keep the writer busy for a moment.
+  shared_ptr<BlobProto> MakeProto(const int value) {
+    shared_ptr<BlobProto> proto(new BlobProto());
+    proto->set_num(value);
+    for (int i = 0; i < 100000; ++i) {
+      proto->add_data(value + i);
+    }
+    return proto;
+  }
+
+  string temp_dir_;
+};
+
+TEST_F(AsyncProtoWriterTest, TestWriteAndRemove) {
+  vector<string> filenames;
+  {
+    AsyncProtoWriter writer;
+    for (int i = 0; i < 4; ++i) {
+      filenames.push_back(temp_dir_ + "/proto_" + format_int(i) + ".bin");
+      writer.Write(MakeProto(i), filenames.back());
+    }
+    // Queued after the write, so the file is gone when done.
+    writer.Remove(filenames[1]);
+    writer.Flush();
+    for (int i = 0; i < 4; ++i) {
+      EXPECT_EQ(i != 1, boost::filesystem::exists(filenames[i]));
+      // No temporary file is left behind.
+      EXPECT_FALSE(boost::filesystem::exists(filenames[i] + ".tmp"));
+    }
+    // Left for the destructor to write.
+    writer.Write(MakeProto(4), filenames[1]);
+  }
+  for (int i = 0; i < 4; ++i) {
+    BlobProto proto;
+    ASSERT_TRUE(ReadProtoFromBinaryFile(filenames[i], &proto));
+    const int value = i == 1 ? 4 : i;
+    EXPECT_EQ(value, proto.num());
+    ASSERT_EQ(100000, proto.data_size());
+    EXPECT_EQ(value + 99999, proto.data(99999));
+  }
+}
+
+}  // namespace caffe
@@ -0,0 +1,243 @@
+#include <string>
+#include <vector>
+
+#include "google/protobuf/text_format.h"
+
+#include "gtest/gtest.h"
+
+#include "caffe/common.hpp"
+#include "caffe/batch_detector.hpp"
+#include "caffe/filler.hpp"
+#include "caffe/net.hpp"
+
+#include "caffe/test/test_caffe_main.hpp"
+
+namespace caffe {
+
+template <typename Dtype>
+class BatchDetectorTest : public CPUDeviceTest<Dtype> {
+ protected:
+  typedef typename BatchDetector<Dtype>::Image Image;
+  typedef typename BatchDetector<Dtype>::Detections Detections;
+
+  BatchDetectorTest() {}
+
+  virtual void SetUp() {
+    Caffe::set_random_seed(1701);
+  }
+
+  // A Fast R-CNN net: rois pooled from the image itself, then the class
+  // scores and box deltas of K = 3 classes.
+  void InitFastNet() {
+    InitNet(
+        "input: 'data' "
+        "input_shape { dim: 1 dim: 3 dim: 16 dim: 16 } "
+        "input: 'rois' "
+        "input_shape { dim: 1 dim: 5 } "
+        "layer { name: 'pool' type: 'ROIPooling' bottom: 'data' "
+        "  bottom: 'rois' top: 'pool' "
+        "  roi_pooling_param { pooled_h: 2 pooled_w: 2 spatial_scale: 1 } } "
+        + Head("pool"));
+  }
+
+  // A Faster R-CNN net: an RPN on a stride 4 feature map, then the head.
+  void InitFasterNet() {
+    InitNet(
+        "input: 'data' "
+        "input_shape { dim: 1 dim: 3 dim: 16 dim: 16 } "
+        "input: 'im_info' "
+        "input_shape { dim: 1 dim: 3 } "
+        "layer { name: 'conv' type: 'Convolution' bottom: 'data' "
+        "  top: 'conv' convolution_param { num_output: 4 kernel_size: 4 "
+        "  stride: 4 weight_filler { type: 'gaussian' std: 0.1 } } } "
+        "layer { name: 'rpn_cls' type: 'Convolution' bottom: 'conv' "
+        "  top: 'rpn_cls' convolution_param { num_output: 18 kernel_size: 1 "
+        "  weight_filler { type: 'gaussian' std: 0.5 } } } "
+        "layer { name: 'rpn_bbox' type: 'Convolution' bottom: 'conv' "
+        "  top: 'rpn_bbox' convolution_param { num_output: 36 "
+        "  kernel_size: 1 weight_filler { type: 'gaussian' std: 0.05 } } } "
+        "layer { name: 'proposal' type: 'Proposal' bottom: 'rpn_cls' "
+        "  bottom: 'rpn_bbox' bottom: 'im_info' top: 'rois' "
+        "  proposal_param { feat_stride: 4 scale: 1 scale: 2 scale: 4 "
+        "  pre_nms_topn: 50 post_nms_topn: 10 min_size: 2 } } "
+        "layer { name: 'pool' type: 'ROIPooling' bottom: 'conv' "
+        "  bottom: 'rois' top: 'pool' "
+        "  roi_pooling_param { pooled_h: 2 pooled_w: 2 "
+        "  spatial_scale: 0.25 } } "
+        + Head("pool"));
+  }
+
+  string Head(const string& bottom) {
+    return
+        "layer { name: 'cls_score' type: 'InnerProduct' bottom: '" + bottom +
+        "'  top: 'cls_score' inner_product_param { num_output: 3 "
+        "  weight_filler { type: 'gaussian' std: 0.1 } } } "
+        "layer { name: 'cls_prob' type: 'Softmax' bottom: 'cls_score' "
+        "  top: 'cls_prob' } "
+        "layer { name: 'bbox_pred' type: 'InnerProduct' bottom: '" + bottom +
+        "'  top: 'bbox_pred' inner_product_param { num_output: 12 "
+        "  weight_filler { type: 'gaussian' std: 0.1 } } } ";
+  }
+
+  void InitNet(const string& proto) {
+    NetParameter param;
+    CHECK(google::protobuf::TextFormat::ParseFromString(proto, &param));
+    param.mutable_state()->set_phase(TEST);
+    net_.reset(new Net<Dtype>(param));
+  }
+
+  // Add a random height x width x 3 image, resized by scale from an image
+  // of im_height x im_width, with num_boxes proposals.
+  void AddImage(int height, int width, Dtype scale, int num_boxes) {
+    shared_ptr<Blob<Dtype> > pixels(new Blob<Dtype>(height, width, 3, 1));
+    FillerParameter filler_param;
+    filler_param.set_min(-50);
+    filler_param.set_max(50);
+    UniformFiller<Dtype>(filler_param).Fill(pixels.get());
+    shared_ptr<Blob<Dtype> > boxes(new Blob<Dtype>(num_boxes + 1, 4, 1, 1));
+    const int im_height = height / scale;
+    const int im_width = width / scale;
+    Dtype* box = boxes->mutable_cpu_data();
+    for (int i = 0; i < num_boxes; ++i, box += 4) {
+      box[0] = i % im_width;
+      box[1] = (2 * i) % im_height;
+      box[2] = im_width - 1 - i % 3;
+      box[3] = im_height - 1 - i % 5;
+    }
+    pixels_.push_back(pixels);
+    boxes_.push_back(boxes);
+    Image image;
+    image.data = pixels->cpu_data();
+    image.height = height;
+    image.width = width;
+    image.scale = scale;
+    image.im_height = im_height;
+    image.im_width = im_width;
+    image.boxes = boxes->cpu_data();
+    image.num_boxes = num_boxes;
+    images_.push_back(image);
+  }
+
+  void ExpectSame(const vector<shared_ptr<Detections> >& expected,
+      const vector<shared_ptr<Detections> >& actual) {
+    ASSERT_EQ(expected.size(), actual.size());
+    for (int i = 0; i < expected.size(); ++i) {
+      const Detections& e = *expected[i];
+      const Detections& a = *actual[i];
+      ASSERT_EQ(e.scores.shape(), a.scores.shape()) << "image " << i;
+      ASSERT_EQ(e.boxes.shape(), a.boxes.shape()) << "image " << i;
+      ASSERT_GT(e.scores.count(), 0);
+      for (int k = 0; k < e.scores.count(); ++k) {
+        EXPECT_NEAR(e.scores.cpu_data()[k], a.scores.cpu_data()[k], 1e-5);
+      }
+      for (int k = 0; k < e.boxes.count(); ++k) {
+        EXPECT_NEAR(e.boxes.cpu_data()[k], a.boxes.cpu_data()[k], 1e-3);
+      }
+    }
+  }
+
+  shared_ptr<Net<Dtype> > net_;
+  vector<shared_ptr<Blob<Dtype> > > pixels_;
+  vector<shared_ptr<Blob<Dtype> > > boxes_;
+  vector<Image> images_;
+};
+
+TYPED_TEST_CASE(BatchDetectorTest, TestDtypes);
+
+TYPED_TEST(BatchDetectorTest, TestFastBatched) {
+  typedef TypeParam Dtype;
+  this->InitFastNet();
+  this->AddImage(10, 12, 0.5, 4);
+  this->AddImage(14, 9, 1, 3);
+  this->AddImage(20, 30, 2, 5);
+  this->AddImage(16, 16, 1, 0);
+  // One by one, with no padding.
+  BatchDetector<Dtype> single(this->net_, 1, 1);
+  vector<shared_ptr<typename BatchDetector<Dtype>::Detections> > expected;
+  single.Detect(this->images_, &expected);
+  EXPECT_EQ(3, single.num_forwards());
+  // The rois only see their own image, so padding changes nothing.
+  BatchDetector<Dtype> batched(this->net_, 4, 16);
+  vector<shared_ptr<typename BatchDetector<Dtype>::Detections> > actual;
+  batched.Detect(this->images_, &actual);
+  EXPECT_EQ(2, batched.num_forwards());
+  ASSERT_EQ(4, actual.size());
+  EXPECT_EQ(0, actual[3]->scores.num());
+  EXPECT_EQ(3, actual[3]->scores.count(1));
+  actual.pop_back();
+  expected.pop_back();
+  this->ExpectSame(expected, actual);
+  for (int i = 0; i < actual.size(); ++i) {
+    const Dtype* boxes = actual[i]->boxes.cpu_data();
+    for (int k = 0; k < actual[i]->boxes.count(); k += 2) {
+      EXPECT_GE(boxes[k], 0);
+      EXPECT_LE(boxes[k], this->images_[i].im_width - 1);
+      EXPECT_GE(boxes[k + 1], 0);
+      EXPECT_LE(boxes[k + 1], this->images_[i].im_height - 1);
+    }
+  }
+}
+
+TYPED_TEST(BatchDetectorTest, TestFasterBatched) {
+  typedef TypeParam Dtype;
+  this->InitFasterNet();
+  this->AddImage(32, 48, 1, 0);
+  this->AddImage(24, 20, 2, 0);
+  this->AddImage(32, 48, 0.5, 0);
+  BatchDetector<Dtype> single(this->net_, 1, 1);
+  vector<shared_ptr<typename BatchDetector<Dtype>::Detections> > expected;
+  single.Detect(this->images_, &expected);
+  // The images of the same size share a forward pass.
+  BatchDetector<Dtype> batched(this->net_, 2, 1);
+  vector<shared_ptr<typename BatchDetector<Dtype>::Detections> > actual;
+  batched.Detect(this->images_, &actual);
+  EXPECT_EQ(2, batched.num_forwards());
+  this->ExpectSame(expected, actual);
+}
+
+TYPED_TEST(BatchDetectorTest, TestSuppress) {
+  typedef TypeParam Dtype;
+  // 4 rois, 3 classes.
+  const Dtype scores[] = {
+    0.1, 0.8, 0.1,
+    0.2, 0.7, 0.1,
+    0.3, 0.01, 0.69,
+    0.5, 0.3, 0.2 };
+  const Dtype roi_boxes[] = {
+    0, 0, 10, 10,
+    1, 1, 10, 10,
+    20, 20, 30, 30,
+    40, 40, 50, 50 };
+  typename BatchDetector<Dtype>::Detections detections;
+  detections.scores.Reshape(4, 3, 1, 1);
+  detections.boxes.Reshape(4, 12, 1, 1);
+  std::copy(scores, scores + 12, detections.scores.mutable_cpu_data());
+  Dtype* boxes = detections.boxes.mutable_cpu_data();
+  for (int r = 0; r < 4; ++r) {
+    for (int j = 0; j < 3; ++j) {
+      std::copy(roi_boxes + 4 * r, roi_boxes + 4 * r + 4,
+          boxes + 4 * (3 * r + j));
+    }
+  }
+  vector<vector<Dtype> > dets;
+  BatchDetector<Dtype>::Suppress(detections, 0.05, 0.5, 0, &dets);
+  ASSERT_EQ(2, dets.size());
+  // Class 1: roi 1 overlaps roi 0 too much, roi 2 scores too low.
+  ASSERT_EQ(10, dets[0].size());
+  EXPECT_EQ(0, dets[0][0]);
+  EXPECT_EQ(Dtype(0.8), dets[0][4]);
+  EXPECT_EQ(40, dets[0][5]);
+  EXPECT_EQ(Dtype(0.3), dets[0][9]);
+  // Class 2: all above thresh, rois 0 and 1 overlap.
+  ASSERT_EQ(15, dets[1].size());
+  EXPECT_EQ(Dtype(0.69), dets[1][4]);
+  EXPECT_EQ(Dtype(0.2), dets[1][9]);
+  EXPECT_EQ(Dtype(0.1), dets[1][14]);
+  // The 3 best over both classes.
+  BatchDetector<Dtype>::Suppress(detections, 0.05, 0.5, 3, &dets);
+  ASSERT_EQ(10, dets[0].size());
+  ASSERT_EQ(5, dets[1].size());
+  EXPECT_EQ(Dtype(0.69), dets[1][4]);
+}
+
+}  // namespace caffe
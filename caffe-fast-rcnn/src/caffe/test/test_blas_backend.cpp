@@ -0,0 +1,162 @@
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "caffe/blob.hpp"
+#include "caffe/common.hpp"
+#include "caffe/filler.hpp"
+#include "caffe/util/blas_backend.hpp"
+#include "caffe/util/math_functions.hpp"
+
+#include "caffe/test/test_caffe_main.hpp"
+
+namespace caffe {
+
+static void Gemm(BlasBackend* backend, const CBLAS_TRANSPOSE TransA,
+    const CBLAS_TRANSPOSE TransB, const int M, const int N, const int K,
+    const float alpha, const float* A, const int lda, const float* B,
+    const int ldb, const float beta, float* C, const int ldc) {
+  backend->sgemm(TransA, TransB, M, N, K, alpha, A, lda, B, ldb, beta, C,
+      ldc);
+}
+
+static void Gemm(BlasBackend* backend, const CBLAS_TRANSPOSE TransA,
+    const CBLAS_TRANSPOSE TransB, const int M, const int N, const int K,
+    const double alpha, const double* A, const int lda, const double* B,
+    const int ldb, const double beta, double* C, const int ldc) {
+  backend->dgemm(TransA, TransB, M, N, K, alpha, A, lda, B, ldb, beta, C,
+      ldc);
+}
+
+static void Gemv(BlasBackend* backend, const CBLAS_TRANSPOSE TransA,
+    const int M, const int N, const float alpha, const float* A,
+    const float* x, const float beta, float* y) {
+  backend->sgemv(TransA, M, N, alpha, A, x, beta, y);
+}
+
+static void Gemv(BlasBackend* backend, const CBLAS_TRANSPOSE TransA,
+    const int M, const int N, const double alpha, const double* A,
+    const double* x, const double beta, double* y) {
+  backend->dgemv(TransA, M, N, alpha, A, x, beta, y);
+}
+
+template <typename Dtype>
+class BlasBackendTest : public ::testing::Test {
+ protected:
+  BlasBackendTest()
+      : builtin_(CreateBlasBackend("builtin")),
+        cblas_(CreateBlasBackend("cblas")) {}
+
+  virtual void SetUp() {
+    Caffe::set_random_seed(1701);
+  }
+
+  // Fill the blob with gaussian values.
+  void Fill(Blob<Dtype>* blob) {
+    FillerParameter filler_param;
+    GaussianFiller<Dtype> filler(filler_param);
+    filler.Fill(blob);
+  }
+
+  // Compare the builtin GEMM with cblas on op(A) (M x K) times op(B) (K x N),
+  // written into the first N columns of a C with ldc columns.
+  void CheckGemm(const CBLAS_TRANSPOSE TransA, const CBLAS_TRANSPOSE TransB,
+      const int M, const int N, const int K, const Dtype alpha,
+      const Dtype beta, const int ldc) {
+    const int lda = TransA == CblasNoTrans ? K : M;
+    const int ldb = TransB == CblasNoTrans ? N : K;
+    Blob<Dtype> A(1, 1, M, K), B(1, 1, K, N), C(1, 1, M, ldc),
+        expected_C(1, 1, M, ldc);
+    Fill(&A);
+    Fill(&B);
+    Fill(&C);
+    caffe_copy(C.count(), C.cpu_data(), expected_C.mutable_cpu_data());
+    Gemm(cblas_.get(), TransA, TransB, M, N, K, alpha, A.cpu_data(), lda,
+        B.cpu_data(), ldb, beta, expected_C.mutable_cpu_data(), ldc);
+    Gemm(builtin_.get(), TransA, TransB, M, N, K, alpha, A.cpu_data(), lda,
+        B.cpu_data(), ldb, beta, C.mutable_cpu_data(), ldc);
+    for (int i = 0; i < C.count(); ++i) {
+      EXPECT_NEAR(expected_C.cpu_data()[i], C.cpu_data()[i], 1e-4 * (1 + K))
+          << "M " << M << " N " << N << " K " << K << " TransA " << TransA
+          << " TransB " << TransB << " at " << i;
+    }
+  }
+
+  shared_ptr<BlasBackend> builtin_;
+  shared_ptr<BlasBackend> cblas_;
+};
+
+TYPED_TEST_CASE(BlasBackendTest, TestDtypes);
+
+TYPED_TEST(BlasBackendTest, TestCreate) {
+  EXPECT_EQ("builtin", this->builtin_->name());
+  EXPECT_EQ("cblas", this->cblas_->name());
+  EXPECT_TRUE(GetBlasBackend());
+}
+
+TYPED_TEST(BlasBackendTest, TestGemm) {
+  const CBLAS_TRANSPOSE trans[2] = {CblasNoTrans, CblasTrans};
+  // Shapes across the edges of the register and cache blocks, the row and
+  // column vectors and an outer product.
+  const int shapes[][3] = {
+    {1, 1, 1}, {5, 9, 3}, {4, 8, 256}, {67, 13, 259}, {130, 2050, 7},
+    {1, 300, 70}, {1, 3, 600}, {70, 1, 300}, {300, 1, 5}, {7, 33, 1},
+  };
+  for (int s = 0; s < sizeof(shapes) / sizeof(shapes[0]); ++s) {
+    for (int a = 0; a < 2; ++a) {
+      for (int b = 0; b < 2; ++b) {
+        const int N = shapes[s][1];
+        this->CheckGemm(trans[a], trans[b], shapes[s][0], N, shapes[s][2],
+            1., 0., N);
+        this->CheckGemm(trans[a], trans[b], shapes[s][0], N, shapes[s][2],
+            0.5, 1., N + 3);
+        this->CheckGemm(trans[a], trans[b], shapes[s][0], N, shapes[s][2],
+            -2., 0.25, N);
+      }
+    }
+  }
+}
+
+TYPED_TEST(BlasBackendTest, TestGemv) {
+  const int M = 37, N = 300;
+  Blob<TypeParam> A(1, 1, M, N), x(1, 1, 1, N), y(1, 1, 1, N),
+      expected_y(1, 1, 1, N);
+  this->Fill(&A);
+  this->Fill(&x);
+  for (int trans = 0; trans < 2; ++trans) {
+    const CBLAS_TRANSPOSE TransA = trans ? CblasTrans : CblasNoTrans;
+    const int length = trans ? N : M;
+    this->Fill(&y);
+    caffe_copy(y.count(), y.cpu_data(), expected_y.mutable_cpu_data());
+    Gemv(this->cblas_.get(), TransA, M, N, TypeParam(1.5), A.cpu_data(),
+        x.cpu_data(), TypeParam(0.5), expected_y.mutable_cpu_data());
+    Gemv(this->builtin_.get(), TransA, M, N, TypeParam(1.5), A.cpu_data(),
+        x.cpu_data(), TypeParam(0.5), y.mutable_cpu_data());
+    for (int i = 0; i < y.count(); ++i) {
+      EXPECT_NEAR(expected_y.cpu_data()[i], y.cpu_data()[i], 1e-4 * N)
+          << "TransA " << TransA << " at " << i << " of " << length;
+    }
+  }
+}
+
+TYPED_TEST(BlasBackendTest, TestMathFunctionsDispatch) {
+  const int M = 3, N = 5, K = 4;
+  Blob<TypeParam> A(1, 1, M, K), B(1, 1, K, N), C(1, 1, M, N),
+      expected_C(1, 1, M, N);
+  this->Fill(&A);
+  this->Fill(&B);
+  caffe_cpu_gemm<TypeParam>(CblasNoTrans, CblasNoTrans, M, N, K, 1.,
+      A.cpu_data(), B.cpu_data(), 0., expected_C.mutable_cpu_data());
+  SetBlasBackend(this->builtin_);
+  EXPECT_EQ(this->builtin_.get(), GetBlasBackend());
+  caffe_cpu_gemm<TypeParam>(CblasNoTrans, CblasNoTrans, M, N, K, 1.,
+      A.cpu_data(), B.cpu_data(), 0., C.mutable_cpu_data());
+  caffe_axpy<TypeParam>(C.count(), -1., expected_C.cpu_data(),
+      C.mutable_cpu_data());
+  SetBlasBackend(this->cblas_);
+  for (int i = 0; i < C.count(); ++i) {
+    EXPECT_NEAR(0, C.cpu_data()[i], 1e-4);
+  }
+}
+
+}  // namespace caffe
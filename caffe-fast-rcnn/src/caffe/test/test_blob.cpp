@@ -51,6 +51,46 @@ TYPED_TEST(BlobSimpleTest, TestReshape) {
   EXPECT_EQ(this->blob_->count(), 120);
 }
 
+TYPED_TEST(BlobSimpleTest, TestReshapeCapacity) {
+  Blob<TypeParam>* blob = this->blob_preshaped_;
+  // The first allocation is exact.
+  EXPECT_EQ(blob->capacity(), 120);
+  const TypeParam* data = blob->cpu_data();
+  const size_t reallocations = Caffe::blob_reallocations();
+  // Shrinking and growing back within the capacity keeps the buffer.
+  blob->Reshape(1, 3, 4, 5);
+  EXPECT_EQ(blob->count(), 60);
+  blob->Reshape(2, 3, 4, 5);
+  EXPECT_EQ(blob->capacity(), 120);
+  EXPECT_EQ(blob->cpu_data(), data);
+  EXPECT_EQ(Caffe::blob_reallocations(), reallocations);
+  // Growing past the capacity leaves a quarter of headroom.
+  blob->Reshape(2, 3, 4, 6);
+  EXPECT_EQ(blob->capacity(), 150);
+  EXPECT_EQ(Caffe::blob_reallocations(), reallocations + 1);
+  blob->Reshape(2, 3, 5, 5);
+  EXPECT_EQ(blob->capacity(), 150);
+  EXPECT_EQ(Caffe::blob_reallocations(), reallocations + 1);
+  // Growth beyond the headroom allocates exactly what is needed.
+  blob->Reshape(10, 3, 4, 5);
+  EXPECT_EQ(blob->capacity(), 600);
+  EXPECT_EQ(Caffe::blob_reallocations(), reallocations + 2);
+}
+
+TYPED_TEST(BlobSimpleTest, TestZeroFill) {
+  size_t zeroed = Caffe::zeroed_bytes();
+  this->blob_preshaped_->cpu_data();
+  EXPECT_EQ(Caffe::zeroed_bytes(), zeroed + 120 * sizeof(TypeParam));
+  this->blob_->set_zero_fill(false);
+  this->blob_->Reshape(2, 3, 4, 5);
+  zeroed = Caffe::zeroed_bytes();
+  EXPECT_TRUE(this->blob_->mutable_cpu_data());
+  EXPECT_EQ(Caffe::zeroed_bytes(), zeroed);
+  // The diff is always zeroed.
+  this->blob_->cpu_diff();
+  EXPECT_EQ(Caffe::zeroed_bytes(), zeroed + 120 * sizeof(TypeParam));
+}
+
 TYPED_TEST(BlobSimpleTest, TestLegacyBlobProtoShapeEquals) {
   BlobProto blob_proto;
 
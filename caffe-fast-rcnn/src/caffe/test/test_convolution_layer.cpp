@@ -5,7 +5,9 @@
 #include "caffe/blob.hpp"
 #include "caffe/common.hpp"
 #include "caffe/filler.hpp"
+#include "caffe/layer_factory.hpp"
 #include "caffe/layers/conv_layer.hpp"
+#include "caffe/util/math_functions.hpp"
 
 #ifdef USE_CUDNN
 #include "caffe/layers/cudnn_conv_layer.hpp"
@@ -181,6 +183,44 @@ class ConvolutionLayerTest : public MultiDeviceTest<TypeParam> {
     return this->ref_blob_top_.get();
   }
 
+  // Check the engine and im2col tiling of layer_param against the GEMM path
+  // on an odd sized input, with the columns of dead, if any, pruned in all
+  // filters.
+  void TestAgainstGEMM(LayerParameter layer_param, const bool* dead) {
+    Blob<Dtype> bottom(2, 4, 9, 7);
+    FillerParameter filler_param;
+    GaussianFiller<Dtype> filler(filler_param);
+    filler.Fill(&bottom);
+    vector<Blob<Dtype>*> bottom_vec(1, &bottom);
+    layer_param.set_type("Convolution");
+    layer_param.set_phase(TEST);
+    shared_ptr<Layer<Dtype> > layer =
+        LayerRegistry<Dtype>::CreateLayer(layer_param);
+    layer->SetUp(bottom_vec, this->blob_top_vec_);
+    Blob<Dtype>* weight = layer->blobs()[0].get();
+    if (dead) {
+      for (int i = 0; i < weight->count(); ++i) {
+        if (dead[i % weight->count(1)]) {
+          weight->mutable_cpu_data()[i] = 0;
+        }
+      }
+    }
+    layer->Forward(bottom_vec, this->blob_top_vec_);
+    layer_param.mutable_convolution_param()->clear_im2col_tile_bytes();
+    ConvolutionLayer<Dtype> gemm_layer(layer_param);
+    vector<Blob<Dtype>*> gemm_top_vec(1, this->blob_top_2_);
+    gemm_layer.SetUp(bottom_vec, gemm_top_vec);
+    for (int i = 0; i < layer->blobs().size(); ++i) {
+      gemm_layer.blobs()[i]->CopyFrom(*layer->blobs()[i]);
+    }
+    gemm_layer.Forward(bottom_vec, gemm_top_vec);
+    ASSERT_EQ(this->blob_top_2_->shape(), this->blob_top_->shape());
+    for (int i = 0; i < this->blob_top_->count(); ++i) {
+      EXPECT_NEAR(this->blob_top_2_->cpu_data()[i],
+          this->blob_top_->cpu_data()[i], 1e-4);
+    }
+  }
+
   Blob<Dtype>* const blob_bottom_;
   Blob<Dtype>* const blob_bottom_2_;
   Blob<Dtype>* const blob_top_;
@@ -495,6 +535,214 @@ TYPED_TEST(ConvolutionLayerTest, TestSimpleConvolutionGroup) {
   }
 }
 
+TYPED_TEST(ConvolutionLayerTest, TestPrunedColumns) {
+  typedef typename TypeParam::Dtype Dtype;
+  LayerParameter layer_param;
+  ConvolutionParameter* convolution_param =
+      layer_param.mutable_convolution_param();
+  convolution_param->add_kernel_size(3);
+  convolution_param->add_pad(1);
+  convolution_param->set_num_output(6);
+  convolution_param->set_group(3);
+  convolution_param->mutable_weight_filler()->set_type("gaussian");
+  convolution_param->mutable_bias_filler()->set_type("gaussian");
+  // A test net runs only the weight columns which are not all zero.
+  layer_param.set_phase(TEST);
+  ConvolutionLayer<Dtype> layer(layer_param);
+  layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  // Prune 2 columns of group 0, all but one of group 1 and all of group 2.
+  const bool dead[3][9] = {
+    {true, false, false, false, true, false, false, false, false},
+    {false, true, true, true, true, true, true, true, true},
+    {true, true, true, true, true, true, true, true, true} };
+  Blob<Dtype>* weight = layer.blobs()[0].get();
+  for (int i = 0; i < weight->num(); ++i) {
+    for (int j = 0; j < weight->count(1); ++j) {
+      if (dead[i / 2][j]) {
+        weight->mutable_cpu_data()[i * weight->count(1) + j] = 0;
+      }
+    }
+  }
+  layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+  caffe_conv(this->blob_bottom_, convolution_param, layer.blobs(),
+      this->MakeReferenceTop(this->blob_top_));
+  for (int i = 0; i < this->blob_top_->count(); ++i) {
+    EXPECT_NEAR(this->blob_top_->cpu_data()[i],
+        this->ref_blob_top_->cpu_data()[i], 1e-4);
+  }
+  // The gradients match those of the dense layer, but for the dead columns.
+  layer_param.set_phase(TRAIN);
+  ConvolutionLayer<Dtype> dense_layer(layer_param);
+  vector<Blob<Dtype>*> dense_bottom_vec(1, this->blob_bottom_2_);
+  vector<Blob<Dtype>*> dense_top_vec(1, this->blob_top_2_);
+  this->blob_bottom_2_->CopyFrom(*this->blob_bottom_);
+  dense_layer.SetUp(dense_bottom_vec, dense_top_vec);
+  for (int i = 0; i < layer.blobs().size(); ++i) {
+    dense_layer.blobs()[i]->CopyFrom(*layer.blobs()[i]);
+  }
+  dense_layer.Forward(dense_bottom_vec, dense_top_vec);
+  FillerParameter filler_param;
+  GaussianFiller<Dtype> filler(filler_param);
+  filler.Fill(this->blob_top_);
+  this->blob_top_2_->CopyFrom(*this->blob_top_, true);
+  vector<bool> propagate_down(1, true);
+  layer.Backward(this->blob_top_vec_, propagate_down, this->blob_bottom_vec_);
+  dense_layer.Backward(dense_top_vec, propagate_down, dense_bottom_vec);
+  for (int i = 0; i < this->blob_bottom_->count(); ++i) {
+    EXPECT_NEAR(this->blob_bottom_2_->cpu_diff()[i],
+        this->blob_bottom_->cpu_diff()[i], 1e-4);
+  }
+  const Blob<Dtype>* dense_weight = dense_layer.blobs()[0].get();
+  for (int i = 0; i < weight->num(); ++i) {
+    for (int j = 0; j < weight->count(1); ++j) {
+      const int index = i * weight->count(1) + j;
+      if (!dead[i / 2][j] || Caffe::mode() == Caffe::GPU) {
+        EXPECT_NEAR(dense_weight->cpu_diff()[index],
+            weight->cpu_diff()[index], 1e-4);
+      }
+    }
+  }
+}
+
+TYPED_TEST(ConvolutionLayerTest, TestWinogradAgainstGEMM) {
+  LayerParameter layer_param;
+  ConvolutionParameter* convolution_param =
+      layer_param.mutable_convolution_param();
+  convolution_param->add_kernel_size(3);
+  convolution_param->add_pad(1);
+  convolution_param->set_num_output(6);
+  convolution_param->set_group(2);
+  convolution_param->set_engine(ConvolutionParameter_Engine_WINOGRAD);
+  convolution_param->mutable_weight_filler()->set_type("gaussian");
+  convolution_param->mutable_bias_filler()->set_type("gaussian");
+  this->TestAgainstGEMM(layer_param, NULL);
+  // Without padding, and with the columns of a whole input channel pruned
+  convolution_param->clear_pad();
+  const bool dead[18] = {
+    true, true, true, true, true, true, true, true, true,
+    false, true, false, false, false, false, true, false, false };
+  this->TestAgainstGEMM(layer_param, dead);
+}
+
+TYPED_TEST(ConvolutionLayerTest, TestDirectAgainstGEMM) {
+  LayerParameter layer_param;
+  ConvolutionParameter* convolution_param =
+      layer_param.mutable_convolution_param();
+  convolution_param->set_kernel_h(3);
+  convolution_param->set_kernel_w(2);
+  convolution_param->set_pad_h(2);
+  convolution_param->set_pad_w(1);
+  convolution_param->set_stride_h(2);
+  convolution_param->set_stride_w(1);
+  convolution_param->add_dilation(2);
+  convolution_param->set_num_output(4);
+  convolution_param->set_group(2);
+  convolution_param->set_engine(ConvolutionParameter_Engine_DIRECT);
+  convolution_param->mutable_weight_filler()->set_type("gaussian");
+  convolution_param->mutable_bias_filler()->set_type("gaussian");
+  this->TestAgainstGEMM(layer_param, NULL);
+  const bool dead[12] = {
+    true, false, false, true, false, false,
+    true, true, true, true, true, true };
+  this->TestAgainstGEMM(layer_param, dead);
+  // The WINOGRAD engine falls back to it for kernels other than 3x3
+  convolution_param->set_engine(ConvolutionParameter_Engine_WINOGRAD);
+  this->TestAgainstGEMM(layer_param, NULL);
+}
+
+TYPED_TEST(ConvolutionLayerTest, TestTiledIm2colAgainstGEMM) {
+  LayerParameter layer_param;
+  ConvolutionParameter* convolution_param =
+      layer_param.mutable_convolution_param();
+  convolution_param->set_kernel_h(3);
+  convolution_param->set_kernel_w(2);
+  convolution_param->set_pad_h(2);
+  convolution_param->set_pad_w(1);
+  convolution_param->set_stride_h(2);
+  convolution_param->set_stride_w(1);
+  convolution_param->add_dilation(2);
+  convolution_param->set_num_output(4);
+  convolution_param->set_group(2);
+  convolution_param->set_engine(ConvolutionParameter_Engine_CAFFE);
+  convolution_param->mutable_weight_filler()->set_type("gaussian");
+  convolution_param->mutable_bias_filler()->set_type("gaussian");
+  // One output row per tile
+  convolution_param->set_im2col_tile_bytes(1);
+  this->TestAgainstGEMM(layer_param, NULL);
+  const bool dead[12] = {
+    true, false, false, true, false, false,
+    true, true, true, true, true, true };
+  this->TestAgainstGEMM(layer_param, dead);
+  // Tiles of two of the five output rows for float
+  convolution_param->set_im2col_tile_bytes(1000);
+  this->TestAgainstGEMM(layer_param, NULL);
+  this->TestAgainstGEMM(layer_param, dead);
+}
+
+TYPED_TEST(ConvolutionLayerTest, TestBatchThreads) {
+  typedef typename TypeParam::Dtype Dtype;
+  LayerParameter layer_param;
+  ConvolutionParameter* convolution_param =
+      layer_param.mutable_convolution_param();
+  convolution_param->add_kernel_size(3);
+  convolution_param->add_pad(1);
+  convolution_param->set_num_output(4);
+  convolution_param->mutable_weight_filler()->set_type("gaussian");
+  convolution_param->mutable_bias_filler()->set_type("gaussian");
+  FillerParameter filler_param;
+  GaussianFiller<Dtype> filler(filler_param);
+  // With 2 images, the first of the 3 threads has none.
+  for (int num = 5; num >= 2; num -= 3) {
+    Blob<Dtype> bottom(num, 3, 6, 4);
+    filler.Fill(&bottom);
+    vector<Blob<Dtype>*> bottom_vec(1, &bottom);
+    vector<bool> propagate_down(1, true);
+    ConvolutionLayer<Dtype> layer(layer_param);
+    layer.SetUp(bottom_vec, this->blob_top_vec_);
+    layer.Forward(bottom_vec, this->blob_top_vec_);
+    Blob<Dtype> top_diff;
+    top_diff.ReshapeLike(*this->blob_top_);
+    filler.Fill(&top_diff);
+    caffe_copy(top_diff.count(), top_diff.cpu_data(),
+        this->blob_top_->mutable_cpu_diff());
+    layer.Backward(this->blob_top_vec_, propagate_down, bottom_vec);
+    // The same with 3 threads, starting from the parameter gradients of the
+    // first backward pass, which they add to.
+    LayerParameter threads_param(layer_param);
+    threads_param.mutable_convolution_param()->set_batch_threads(3);
+    ConvolutionLayer<Dtype> threads_layer(threads_param);
+    Blob<Dtype> threads_bottom;
+    threads_bottom.CopyFrom(bottom, false, true);
+    vector<Blob<Dtype>*> threads_bottom_vec(1, &threads_bottom);
+    vector<Blob<Dtype>*> threads_top_vec(1, this->blob_top_2_);
+    threads_layer.SetUp(threads_bottom_vec, threads_top_vec);
+    for (int i = 0; i < layer.blobs().size(); ++i) {
+      threads_layer.blobs()[i]->CopyFrom(*layer.blobs()[i]);
+      threads_layer.blobs()[i]->CopyFrom(*layer.blobs()[i], true);
+    }
+    threads_layer.Forward(threads_bottom_vec, threads_top_vec);
+    for (int i = 0; i < this->blob_top_2_->count(); ++i) {
+      EXPECT_NEAR(this->blob_top_->cpu_data()[i],
+          this->blob_top_2_->cpu_data()[i], 1e-4);
+    }
+    caffe_copy(top_diff.count(), top_diff.cpu_data(),
+        this->blob_top_2_->mutable_cpu_diff());
+    threads_layer.Backward(threads_top_vec, propagate_down,
+        threads_bottom_vec);
+    layer.Backward(this->blob_top_vec_, propagate_down, bottom_vec);
+    for (int i = 0; i < bottom.count(); ++i) {
+      EXPECT_NEAR(bottom.cpu_diff()[i], threads_bottom.cpu_diff()[i], 1e-4);
+    }
+    for (int i = 0; i < layer.blobs().size(); ++i) {
+      const Blob<Dtype>& param = *layer.blobs()[i];
+      const Blob<Dtype>& threads_param = *threads_layer.blobs()[i];
+      for (int j = 0; j < param.count(); ++j) {
+        EXPECT_NEAR(param.cpu_diff()[j], threads_param.cpu_diff()[j], 1e-4);
+      }
+    }
+  }
+}
+
 TYPED_TEST(ConvolutionLayerTest, TestSobelConvolution) {
   // Test separable convolution by computing the Sobel operator
   // as a single filter then comparing the result
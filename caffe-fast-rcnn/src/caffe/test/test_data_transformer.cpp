@@ -341,5 +341,42 @@ TYPED_TEST(DataTransformTest, TestMeanFile) {
   }
 }
 
+TYPED_TEST(DataTransformTest, TestBatchCropMirrorTrain) {
+  TransformationParameter transform_param;
+  const bool unique_pixels = true;  // pixels are consecutive ints [0,size]
+  const int num = 8;
+  const int channels = 3;
+  const int height = 4;
+  const int width = 5;
+  const int crop_size = 2;
+
+  transform_param.set_crop_size(crop_size);
+  transform_param.set_mirror(true);
+  transform_param.add_mean_value(2);
+  transform_param.set_scale(0.5);
+  vector<Datum> datum_vector(num);
+  for (int i = 0; i < num; ++i) {
+    FillDatum(i, channels, height, width, unique_pixels, &datum_vector[i]);
+  }
+  // The batch should draw the same crops and mirrors as single transforms.
+  Blob<TypeParam> batch_blob(num, channels, crop_size, crop_size);
+  DataTransformer<TypeParam> batch_transformer(transform_param, TRAIN);
+  Caffe::set_random_seed(this->seed_);
+  batch_transformer.InitRand();
+  batch_transformer.Transform(datum_vector, &batch_blob);
+
+  Blob<TypeParam> blob(1, channels, crop_size, crop_size);
+  DataTransformer<TypeParam> transformer(transform_param, TRAIN);
+  Caffe::set_random_seed(this->seed_);
+  transformer.InitRand();
+  for (int i = 0; i < num; ++i) {
+    transformer.Transform(datum_vector[i], &blob);
+    for (int j = 0; j < blob.count(); ++j) {
+      EXPECT_EQ(blob.cpu_data()[j],
+          batch_blob.cpu_data()[batch_blob.offset(i) + j]);
+    }
+  }
+}
+
 }  // namespace caffe
 #endif  // USE_OPENCV
@@ -0,0 +1,73 @@
+#ifdef USE_OPENCV
+#include <opencv2/core/core.hpp>
+
+#include "gtest/gtest.h"
+
+#include "caffe/common.hpp"
+#include "caffe/util/image_cache.hpp"
+
+#include "caffe/test/test_caffe_main.hpp"
+
+namespace caffe {
+
+class ImageCacheTest : public ::testing::Test {
+ protected:
+  // A 10 x 10 color image of 300 bytes, filled with value.
+  cv::Mat Image(int value) {
+    return cv::Mat(10, 10, CV_8UC3, cv::Scalar(value, value, value));
+  }
+};
+
+TEST_F(ImageCacheTest, TestGetPut) {
+  ImageCache cache(1000);
+  cv::Mat image;
+  EXPECT_FALSE(cache.Get(7, &image));
+  cache.Put(7, Image(7));
+  ASSERT_TRUE(cache.Get(7, &image));
+  EXPECT_EQ(7, image.at<cv::Vec3b>(5, 5)[0]);
+  EXPECT_EQ(1, cache.count());
+  EXPECT_EQ(300, cache.size());
+  EXPECT_EQ(1, cache.hits());
+  EXPECT_EQ(1, cache.misses());
+  // Adding an image twice keeps one copy.
+  cache.Put(7, Image(7));
+  EXPECT_EQ(1, cache.count());
+  EXPECT_EQ(300, cache.size());
+}
+
+TEST_F(ImageCacheTest, TestEvictLeastRecentlyUsed) {
+  ImageCache cache(1000);
+  for (int i = 0; i < 3; ++i) {
+    cache.Put(i, Image(i));
+  }
+  cv::Mat image;
+  // Use image 0, so that image 1 is the least recently used.
+  ASSERT_TRUE(cache.Get(0, &image));
+  cache.Put(3, Image(3));
+  EXPECT_EQ(3, cache.count());
+  EXPECT_EQ(900, cache.size());
+  EXPECT_TRUE(cache.Get(0, &image));
+  EXPECT_FALSE(cache.Get(1, &image));
+  EXPECT_TRUE(cache.Get(2, &image));
+  EXPECT_TRUE(cache.Get(3, &image));
+  // An evicted image stays valid for whoever still holds it.
+  cv::Mat held;
+  ASSERT_TRUE(cache.Get(3, &held));
+  cache.Put(4, Image(4));
+  cache.Put(5, Image(5));
+  cache.Put(6, Image(6));
+  EXPECT_FALSE(cache.Get(3, &image));
+  EXPECT_EQ(3, held.at<cv::Vec3b>(0, 0)[2]);
+}
+
+TEST_F(ImageCacheTest, TestTooLarge) {
+  ImageCache cache(200);
+  cache.Put(0, Image(0));
+  cv::Mat image;
+  EXPECT_FALSE(cache.Get(0, &image));
+  EXPECT_EQ(0, cache.count());
+  EXPECT_EQ(0, cache.size());
+}
+
+}  // namespace caffe
+#endif  // USE_OPENCV
@@ -6,6 +6,7 @@
 #include "caffe/common.hpp"
 #include "caffe/filler.hpp"
 #include "caffe/layers/inner_product_layer.hpp"
+#include "caffe/util/math_functions.hpp"
 
 #include "caffe/test/test_caffe_main.hpp"
 #include "caffe/test/test_gradient_check_util.hpp"
@@ -148,4 +149,67 @@ TYPED_TEST(InnerProductLayerTest, TestGradient) {
   }
 }
 
+TYPED_TEST(InnerProductLayerTest, TestBatchThreads) {
+  typedef typename TypeParam::Dtype Dtype;
+  LayerParameter layer_param;
+  InnerProductParameter* inner_product_param =
+      layer_param.mutable_inner_product_param();
+  inner_product_param->set_num_output(10);
+  inner_product_param->mutable_weight_filler()->set_type("gaussian");
+  inner_product_param->mutable_bias_filler()->set_type("gaussian");
+  FillerParameter filler_param;
+  GaussianFiller<Dtype> filler(filler_param);
+  // With 2 rows, the first of the 3 threads has none.
+  for (int num = 5; num >= 2; num -= 3) {
+    Blob<Dtype> bottom(num, 3, 2, 2);
+    filler.Fill(&bottom);
+    vector<Blob<Dtype>*> bottom_vec(1, &bottom);
+    vector<bool> propagate_down(1, true);
+    InnerProductLayer<Dtype> layer(layer_param);
+    layer.SetUp(bottom_vec, this->blob_top_vec_);
+    layer.Forward(bottom_vec, this->blob_top_vec_);
+    Blob<Dtype> top_diff;
+    top_diff.ReshapeLike(*this->blob_top_);
+    filler.Fill(&top_diff);
+    caffe_copy(top_diff.count(), top_diff.cpu_data(),
+        this->blob_top_->mutable_cpu_diff());
+    layer.Backward(this->blob_top_vec_, propagate_down, bottom_vec);
+    // The same with 3 threads, starting from the parameter gradients of the
+    // first backward pass, which they add to.
+    LayerParameter threads_param(layer_param);
+    threads_param.mutable_inner_product_param()->set_batch_threads(3);
+    InnerProductLayer<Dtype> threads_layer(threads_param);
+    Blob<Dtype> threads_bottom;
+    threads_bottom.CopyFrom(bottom, false, true);
+    vector<Blob<Dtype>*> threads_bottom_vec(1, &threads_bottom);
+    Blob<Dtype> threads_top;
+    vector<Blob<Dtype>*> threads_top_vec(1, &threads_top);
+    threads_layer.SetUp(threads_bottom_vec, threads_top_vec);
+    for (int i = 0; i < layer.blobs().size(); ++i) {
+      threads_layer.blobs()[i]->CopyFrom(*layer.blobs()[i]);
+      threads_layer.blobs()[i]->CopyFrom(*layer.blobs()[i], true);
+    }
+    threads_layer.Forward(threads_bottom_vec, threads_top_vec);
+    for (int i = 0; i < threads_top.count(); ++i) {
+      EXPECT_NEAR(this->blob_top_->cpu_data()[i], threads_top.cpu_data()[i],
+          1e-4);
+    }
+    caffe_copy(top_diff.count(), top_diff.cpu_data(),
+        threads_top.mutable_cpu_diff());
+    threads_layer.Backward(threads_top_vec, propagate_down,
+        threads_bottom_vec);
+    layer.Backward(this->blob_top_vec_, propagate_down, bottom_vec);
+    for (int i = 0; i < bottom.count(); ++i) {
+      EXPECT_NEAR(bottom.cpu_diff()[i], threads_bottom.cpu_diff()[i], 1e-4);
+    }
+    for (int i = 0; i < layer.blobs().size(); ++i) {
+      const Blob<Dtype>& param = *layer.blobs()[i];
+      const Blob<Dtype>& threads_param = *threads_layer.blobs()[i];
+      for (int j = 0; j < param.count(); ++j) {
+        EXPECT_NEAR(param.cpu_diff()[j], threads_param.cpu_diff()[j], 1e-4);
+      }
+    }
+  }
+}
+
 }  // namespace caffe
@@ -0,0 +1,89 @@
+#include <boost/bind.hpp>
+#include <boost/thread.hpp>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "caffe/common.hpp"
+#include "caffe/proto/caffe.pb.h"
+#include "caffe/util/lock_free_queue.hpp"
+
+#include "caffe/test/test_caffe_main.hpp"
+
+namespace caffe {
+
+// Push items [begin, end).
+static void Produce(LockFreeQueue<Datum*>* queue, Datum* items, int begin,
+    int end) {
+  for (int i = begin; i < end; ++i) {
+    queue->push(&items[i]);
+  }
+}
+
+// Pop num_items items, counting how often each one is received.
+static void Consume(LockFreeQueue<Datum*>* queue, Datum* items,
+    int num_items, vector<int>* received) {
+  for (int i = 0; i < num_items; ++i) {
+    ++(*received)[queue->pop() - items];
+  }
+}
+
+class LockFreeQueueTest : public ::testing::Test {
+ protected:
+  LockFreeQueueTest() : items_(1000) {}
+
+  vector<Datum> items_;
+};
+
+TEST_F(LockFreeQueueTest, TestFIFO) {
+  LockFreeQueue<Datum*> queue(3);
+  EXPECT_EQ(4, queue.capacity());
+  Datum* item;
+  EXPECT_FALSE(queue.try_pop(&item));
+  EXPECT_FALSE(queue.try_peek(&item));
+  for (int i = 0; i < 4; ++i) {
+    EXPECT_TRUE(queue.try_push(&items_[i]));
+  }
+  EXPECT_FALSE(queue.try_push(&items_[4]));
+  EXPECT_EQ(4, queue.size());
+  EXPECT_EQ(&items_[0], queue.peek());
+  // Wrap around the ring a few times.
+  for (int i = 4; i < 20; ++i) {
+    EXPECT_EQ(&items_[i - 4], queue.pop());
+    queue.push(&items_[i]);
+  }
+  for (int i = 16; i < 20; ++i) {
+    ASSERT_TRUE(queue.try_pop(&item));
+    EXPECT_EQ(&items_[i], item);
+  }
+  EXPECT_EQ(0, queue.size());
+}
+
+TEST_F(LockFreeQueueTest, TestMultipleProducersAndConsumers) {
+  // Without spinning, the threads park as soon as the small queue is full or
+  // empty.
+  for (int spin_count = 0; spin_count <= 100; spin_count += 100) {
+    LockFreeQueue<Datum*> queue(8, spin_count);
+    const int kNumThreads = 4;
+    const int kItemsPerThread = items_.size() / kNumThreads;
+    vector<vector<int> > received(kNumThreads, vector<int>(items_.size()));
+    boost::thread_group threads;
+    for (int i = 0; i < kNumThreads; ++i) {
+      threads.create_thread(boost::bind(&Consume, &queue, &this->items_[0],
+          kItemsPerThread, &received[i]));
+      threads.create_thread(boost::bind(&Produce, &queue, &this->items_[0],
+          i * kItemsPerThread, (i + 1) * kItemsPerThread));
+    }
+    threads.join_all();
+    for (int j = 0; j < items_.size(); ++j) {
+      int count = 0;
+      for (int i = 0; i < kNumThreads; ++i) {
+        count += received[i][j];
+      }
+      EXPECT_EQ(1, count);
+    }
+    EXPECT_EQ(0, queue.size());
+  }
+}
+
+}  // namespace caffe
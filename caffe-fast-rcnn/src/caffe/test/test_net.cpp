@@ -8,7 +8,10 @@
 
 #include "caffe/common.hpp"
 #include "caffe/filler.hpp"
+#include "caffe/layers/memory_data_layer.hpp"
 #include "caffe/net.hpp"
+#include "caffe/util/io.hpp"
+#include "caffe/util/mapped_weights.hpp"
 #include "caffe/util/math_functions.hpp"
 
 #include "caffe/test/test_caffe_main.hpp"
@@ -614,6 +617,106 @@ class NetTest : public MultiDeviceTest<TypeParam> {
     InitNetFromProtoString(proto);
   }
 
+  virtual void InitBranchedNet(const string& net_options = "") {
+    string proto =
+        "name: 'BranchedNetwork' "
+        "state { phase: TEST } "
+        "input: 'data' "
+        "input_shape { dim: 2 dim: 3 dim: 12 dim: 12 } "
+        "layer { "
+        "  name: 'conv1' "
+        "  type: 'Convolution' "
+        "  bottom: 'data' "
+        "  top: 'conv1' "
+        "  convolution_param { "
+        "    num_output: 4 "
+        "    kernel_size: 3 "
+        "    weight_filler { "
+        "      type: 'gaussian' "
+        "      std: 0.1 "
+        "    } "
+        "  } "
+        "} "
+        "layer { "
+        "  name: 'cls_conv' "
+        "  type: 'Convolution' "
+        "  bottom: 'conv1' "
+        "  top: 'cls_conv' "
+        "  convolution_param { "
+        "    num_output: 6 "
+        "    kernel_size: 1 "
+        "    weight_filler { "
+        "      type: 'gaussian' "
+        "      std: 0.1 "
+        "    } "
+        "  } "
+        "} "
+        "layer { "
+        "  name: 'cls_relu' "
+        "  type: 'ReLU' "
+        "  bottom: 'cls_conv' "
+        "  top: 'cls_conv' "
+        "} "
+        "layer { "
+        "  name: 'cls_flat' "
+        "  type: 'Flatten' "
+        "  bottom: 'cls_conv' "
+        "  top: 'cls_flat' "
+        "} "
+        "layer { "
+        "  name: 'cls_ip' "
+        "  type: 'InnerProduct' "
+        "  bottom: 'cls_flat' "
+        "  top: 'cls_ip' "
+        "  inner_product_param { "
+        "    num_output: 5 "
+        "    weight_filler { "
+        "      type: 'gaussian' "
+        "      std: 0.1 "
+        "    } "
+        "  } "
+        "} "
+        "layer { "
+        "  name: 'bbox_pool' "
+        "  type: 'Pooling' "
+        "  bottom: 'conv1' "
+        "  top: 'bbox_pool' "
+        "  pooling_param { "
+        "    pool: MAX "
+        "    kernel_size: 2 "
+        "    stride: 2 "
+        "  } "
+        "} "
+        "layer { "
+        "  name: 'bbox_ip' "
+        "  type: 'InnerProduct' "
+        "  bottom: 'bbox_pool' "
+        "  top: 'bbox_ip' "
+        "  inner_product_param { "
+        "    num_output: 5 "
+        "    weight_filler { "
+        "      type: 'gaussian' "
+        "      std: 0.1 "
+        "    } "
+        "  } "
+        "} "
+        "layer { "
+        "  name: 'sum' "
+        "  type: 'Eltwise' "
+        "  bottom: 'cls_ip' "
+        "  bottom: 'bbox_ip' "
+        "  top: 'sum' "
+        "} "
+        "layer { "
+        "  name: 'loss' "
+        "  type: 'EuclideanLoss' "
+        "  bottom: 'cls_ip' "
+        "  bottom: 'bbox_ip' "
+        "  top: 'loss' "
+        "} ";
+    InitNetFromProtoString(proto + net_options);
+  }
+
   virtual void InitSkipPropNet(bool test_skip_true) {
     string proto =
       "name: 'SkipPropTestNetwork' "
@@ -1226,6 +1329,46 @@ TYPED_TEST(NetTest, TestSharedWeightsResume) {
   }
 }
 
+TYPED_TEST(NetTest, TestCopyTrainedLayersFromMapped) {
+  typedef typename TypeParam::Dtype Dtype;
+  Caffe::set_random_seed(this->seed_);
+  this->InitUnsharedWeightsNet();
+  Dtype loss;
+  this->net_->ForwardPrefilled(&loss);
+  NetParameter net_param;
+  this->net_->ToProto(&net_param);
+  vector<shared_ptr<Blob<Dtype> > > params;
+  for (int i = 0; i < this->net_->params().size(); ++i) {
+    params.push_back(shared_ptr<Blob<Dtype> >(new Blob<Dtype>()));
+    params.back()->CopyFrom(*this->net_->params()[i], false, true);
+  }
+  string filename;
+  MakeTempFilename(&filename);
+  filename += ".caffemap";
+  WriteMappedWeights(net_param, filename);
+
+  // Reinitialize the net with other weights, then load the mapped ones (which
+  // are stored as float).
+  Caffe::set_random_seed(this->seed_ + 1);
+  this->InitUnsharedWeightsNet();
+  this->net_->CopyTrainedLayersFrom(filename);
+  ASSERT_EQ(params.size(), this->net_->params().size());
+  for (int i = 0; i < params.size(); ++i) {
+    const Blob<Dtype>* param = this->net_->params()[i].get();
+    ASSERT_EQ(params[i]->count(), param->count());
+    for (int j = 0; j < param->count(); ++j) {
+      EXPECT_FLOAT_EQ(params[i]->cpu_data()[j], param->cpu_data()[j]);
+    }
+  }
+  // The data layer is seeded the same, so the loss is the same.
+  Caffe::set_random_seed(this->seed_);
+  this->InitUnsharedWeightsNet();
+  this->net_->CopyTrainedLayersFrom(filename);
+  Dtype mapped_loss;
+  this->net_->ForwardPrefilled(&mapped_loss);
+  EXPECT_FLOAT_EQ(loss, mapped_loss);
+}
+
 TYPED_TEST(NetTest, TestParamPropagateDown) {
   typedef typename TypeParam::Dtype Dtype;
   vector<Blob<Dtype>*> bottom;
@@ -1342,6 +1485,251 @@ TYPED_TEST(NetTest, TestFromTo) {
   }
 }
 
+TYPED_TEST(NetTest, TestParallelForward) {
+  typedef typename TypeParam::Dtype Dtype;
+  FillerParameter filler_param;
+  filler_param.set_std(1);
+  GaussianFiller<Dtype> filler(filler_param);
+  Blob<Dtype> data(2, 3, 12, 12);
+  filler.Fill(&data);
+  // Forward the net sequentially, then on 4 threads with the same weights.
+  vector<vector<Dtype> > outputs(2);
+  for (int run = 0; run < 2; ++run) {
+    Caffe::set_random_seed(this->seed_);
+    this->InitBranchedNet(run == 0 ? "" : "forward_threads: 4 ");
+    // Repeat the parallel forward to give a race a chance to show.
+    for (int iter = 0; iter < (run == 0 ? 1 : 20); ++iter) {
+      this->net_->input_blobs()[0]->CopyFrom(data);
+      Dtype loss;
+      this->net_->ForwardPrefilled(&loss);
+      outputs[run].clear();
+      outputs[run].push_back(loss);
+      const Blob<Dtype>* sum = this->net_->blob_by_name("sum").get();
+      outputs[run].insert(outputs[run].end(), sum->cpu_data(),
+          sum->cpu_data() + sum->count());
+      if (run > 0) {
+        ASSERT_EQ(outputs[0].size(), outputs[run].size());
+        for (int i = 0; i < outputs[0].size(); ++i) {
+          EXPECT_EQ(outputs[0][i], outputs[run][i]);
+        }
+      }
+    }
+  }
+  EXPECT_GT(outputs[0][0], 0);
+}
+
+TYPED_TEST(NetTest, TestProfiling) {
+  typedef typename TypeParam::Dtype Dtype;
+  this->InitTinyNet(true);
+  EXPECT_FALSE(this->net_->profiler());
+  this->net_->set_profiling(true);
+  Profiler* profiler = this->net_->profiler();
+  ASSERT_TRUE(profiler);
+  profiler->set_max_trace_events(1000);
+  const int num_iters = 2;
+  for (int iter = 0; iter < num_iters; ++iter) {
+    this->net_->ForwardPrefilled();
+    this->net_->Backward();
+  }
+  const int num_layers = this->net_->layers().size();
+  ASSERT_EQ(num_layers, profiler->num_layers());
+  int num_events = 2 * num_iters;
+  for (int i = 0; i < num_layers; ++i) {
+    const LayerProfile* layer = profiler->layer(i);
+    EXPECT_EQ(this->net_->layer_names()[i], layer->name);
+    EXPECT_EQ(string(this->net_->layers()[i]->type()), layer->type);
+    const int num_backward =
+        this->net_->layer_need_backward()[i] ? num_iters : 0;
+    EXPECT_EQ(num_iters, layer->phases[LayerProfile::FORWARD].calls);
+    EXPECT_EQ(num_iters, layer->phases[LayerProfile::RESHAPE].calls);
+    EXPECT_EQ(num_backward, layer->phases[LayerProfile::BACKWARD].calls);
+    EXPECT_EQ(0, layer->phases[LayerProfile::DATA_WAIT].calls);
+    EXPECT_GE(layer->phases[LayerProfile::FORWARD].microseconds, 0);
+    num_events += 2 * num_iters + num_backward;
+  }
+  // The first forward of the inner product layer allocates its output.
+  EXPECT_GE(profiler->layer(1)->phases[LayerProfile::FORWARD].bytes_allocated,
+      5 * 1000 * sizeof(Dtype));
+  EXPECT_EQ(num_iters, profiler->sections().find("net_forward")->second.calls);
+  EXPECT_EQ(num_iters,
+      profiler->sections().find("net_backward")->second.calls);
+  EXPECT_EQ(num_events, profiler->num_trace_events());
+  // Nothing is recorded once profiling stops.
+  this->net_->set_profiling(false);
+  this->net_->ForwardPrefilled();
+  EXPECT_EQ(num_iters, profiler->layer(1)->phases[LayerProfile::FORWARD].calls);
+  EXPECT_EQ(num_iters, profiler->sections().find("net_forward")->second.calls);
+}
+
+TYPED_TEST(NetTest, TestShareActivations) {
+  typedef typename TypeParam::Dtype Dtype;
+  FillerParameter filler_param;
+  filler_param.set_std(1);
+  GaussianFiller<Dtype> filler(filler_param);
+  Blob<Dtype> data(2, 3, 12, 12);
+  filler.Fill(&data);
+  // Also forward a larger batch, which outgrows the shared buffers.
+  Blob<Dtype> large_data(3, 3, 12, 12);
+  filler.Fill(&large_data);
+  const string options[] = { "", "share_activations: true ",
+      "share_activations: true keep_activation: 'cls_ip' ",
+      "share_activations: true forward_threads: 4 " };
+  vector<vector<Dtype> > outputs(4);
+  vector<int> num_buffers(4);
+  for (int run = 0; run < 4; ++run) {
+    Caffe::set_random_seed(this->seed_);
+    this->InitBranchedNet(options[run]);
+    for (int iter = 0; iter < 3; ++iter) {
+      const Blob<Dtype>& input = iter == 1 ? large_data : data;
+      this->net_->input_blobs()[0]->ReshapeLike(input);
+      this->net_->input_blobs()[0]->CopyFrom(input);
+      Dtype loss;
+      this->net_->ForwardPrefilled(&loss);
+      outputs[run].push_back(loss);
+      const Blob<Dtype>* sum = this->net_->blob_by_name("sum").get();
+      outputs[run].insert(outputs[run].end(), sum->cpu_data(),
+          sum->cpu_data() + sum->count());
+    }
+    if (run == 2) {
+      // A kept blob still holds its output.
+      const Blob<Dtype>* cls_ip = this->net_->blob_by_name("cls_ip").get();
+      const Blob<Dtype>* sum = this->net_->blob_by_name("sum").get();
+      const Blob<Dtype>* bbox_ip = this->net_->blob_by_name("bbox_ip").get();
+      ASSERT_EQ(cls_ip->count(), sum->count());
+      for (int i = 0; i < sum->count(); ++i) {
+        EXPECT_NEAR(sum->cpu_data()[i], cls_ip->cpu_data()[i] +
+            bbox_ip->cpu_data()[i], 1e-5);
+      }
+    }
+    set<const void*> buffers;
+    for (int i = 0; i < this->net_->blobs().size(); ++i) {
+      buffers.insert(this->net_->blobs()[i]->data().get());
+    }
+    num_buffers[run] = buffers.size();
+  }
+  for (int run = 1; run < 4; ++run) {
+    EXPECT_LT(num_buffers[run], num_buffers[0]);
+    ASSERT_EQ(outputs[0].size(), outputs[run].size());
+    for (int i = 0; i < outputs[0].size(); ++i) {
+      EXPECT_EQ(outputs[0][i], outputs[run][i]);
+    }
+  }
+}
+
+TYPED_TEST(NetTest, TestShareActivationsGrowth) {
+  typedef typename TypeParam::Dtype Dtype;
+  this->InitBranchedNet("share_activations: true ");
+  Blob<Dtype>* input = this->net_->input_blobs()[0];
+  // Growing the batch from 8 to 9 leaves the shared buffers room for 10.
+  for (int num = 8; num <= 10; ++num) {
+    const size_t reallocations = Caffe::blob_reallocations();
+    input->Reshape(num, 3, 12, 12);
+    this->net_->ForwardPrefilled();
+    if (num == 9) {
+      EXPECT_GT(Caffe::blob_reallocations(), reallocations);
+    } else if (num == 10) {
+      EXPECT_EQ(Caffe::blob_reallocations(), reallocations);
+    }
+  }
+}
+
+TYPED_TEST(NetTest, TestShareActivationsMemoryData) {
+  typedef typename TypeParam::Dtype Dtype;
+  const string proto =
+      "name: 'MemoryDataNet' "
+      "layer { name: 'data' type: 'MemoryData' top: 'data' top: 'label' "
+      "  memory_data_param { batch_size: 2 channels: 1 height: 2 width: 3 } "
+      "} "
+      "layer { name: 'ip1' type: 'InnerProduct' bottom: 'data' top: 'ip1' "
+      "  inner_product_param { num_output: 4 "
+      "    weight_filler { type: 'gaussian' } } } "
+      "layer { name: 'ip2' type: 'InnerProduct' bottom: 'ip1' top: 'ip2' "
+      "  inner_product_param { num_output: 20 "
+      "    weight_filler { type: 'gaussian' } } } "
+      "layer { name: 'ip3' type: 'InnerProduct' bottom: 'ip2' top: 'ip3' "
+      "  inner_product_param { num_output: 6 "
+      "    weight_filler { type: 'gaussian' } } } "
+      "layer { name: 'ip4' type: 'InnerProduct' bottom: 'ip3' top: 'ip4' "
+      "  inner_product_param { num_output: 2 "
+      "    weight_filler { type: 'gaussian' } } } ";
+  // Two batches of input, which the net reads in place.
+  vector<Dtype> data(4 * 6);
+  vector<Dtype> labels(4, 0);
+  for (int i = 0; i < data.size(); ++i) {
+    data[i] = i * 0.1 - 1;
+  }
+  vector<vector<Dtype> > outputs(2);
+  for (int run = 0; run < 2; ++run) {
+    Caffe::set_random_seed(this->seed_);
+    this->InitNetFromProtoString(
+        run == 0 ? proto : proto + "share_activations: true ");
+    vector<Dtype> input(data);
+    boost::static_pointer_cast<MemoryDataLayer<Dtype> >(
+        this->net_->layers()[0])->Reset(&input[0], &labels[0], 4);
+    for (int iter = 0; iter < 2; ++iter) {
+      this->net_->ForwardPrefilled();
+      const Blob<Dtype>* ip4 = this->net_->blob_by_name("ip4").get();
+      outputs[run].insert(outputs[run].end(), ip4->cpu_data(),
+          ip4->cpu_data() + ip4->count());
+    }
+    // The caller's array is left as it was.
+    for (int i = 0; i < data.size(); ++i) {
+      EXPECT_EQ(data[i], input[i]);
+    }
+    if (run == 1) {
+      // ip3 takes the buffer of ip1, but ip2 not the one of data.
+      EXPECT_EQ(this->net_->blob_by_name("ip1")->data(),
+          this->net_->blob_by_name("ip3")->data());
+      EXPECT_NE(this->net_->blob_by_name("data")->data(),
+          this->net_->blob_by_name("ip2")->data());
+    }
+  }
+  ASSERT_EQ(outputs[0].size(), outputs[1].size());
+  for (int i = 0; i < outputs[0].size(); ++i) {
+    EXPECT_EQ(outputs[0][i], outputs[1][i]);
+  }
+}
+
+TYPED_TEST(NetTest, TestShareActivationsDummyData) {
+  typedef typename TypeParam::Dtype Dtype;
+  // DummyData fills the constant 'bias' once, in LayerSetUp.
+  this->InitNetFromProtoString(
+      "name: 'DummyDataNet' "
+      "share_activations: true "
+      "layer { name: 'data' type: 'DummyData' top: 'data' top: 'bias' "
+      "  dummy_data_param { "
+      "    shape { dim: 2 dim: 3 } shape { dim: 2 dim: 4 } "
+      "    data_filler { type: 'gaussian' } "
+      "    data_filler { type: 'constant' value: 0.5 } } } "
+      "layer { name: 'ip1' type: 'InnerProduct' bottom: 'data' top: 'ip1' "
+      "  inner_product_param { num_output: 4 "
+      "    weight_filler { type: 'gaussian' } } } "
+      "layer { name: 'sum' type: 'Eltwise' bottom: 'ip1' bottom: 'bias' "
+      "  top: 'sum' } "
+      "layer { name: 'ip2' type: 'InnerProduct' bottom: 'sum' top: 'ip2' "
+      "  inner_product_param { num_output: 4 "
+      "    weight_filler { type: 'gaussian' } } } "
+      "layer { name: 'ip3' type: 'InnerProduct' bottom: 'ip2' top: 'ip3' "
+      "  inner_product_param { num_output: 2 "
+      "    weight_filler { type: 'gaussian' } } } ");
+  // ip2 takes the buffer of ip1; bias keeps its own memory.
+  const vector<shared_ptr<Blob<Dtype> > >& blobs = this->net_->blobs();
+  const Blob<Dtype>* bias = this->net_->blob_by_name("bias").get();
+  EXPECT_EQ(this->net_->blob_by_name("ip1")->data(),
+      this->net_->blob_by_name("ip2")->data());
+  for (int i = 0; i < blobs.size(); ++i) {
+    if (blobs[i].get() != bias) {
+      EXPECT_NE(bias->data(), blobs[i]->data());
+    }
+  }
+  for (int iter = 0; iter < 2; ++iter) {
+    this->net_->ForwardPrefilled();
+    for (int i = 0; i < bias->count(); ++i) {
+      EXPECT_EQ(0.5, bias->cpu_data()[i]);
+    }
+  }
+}
+
 class FilterNetTest : public ::testing::Test {
  protected:
   void RunFilterNetTest(
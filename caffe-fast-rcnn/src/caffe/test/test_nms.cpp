@@ -0,0 +1,137 @@
+#include <algorithm>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "caffe/common.hpp"
+#include "caffe/util/math_functions.hpp"
+#include "caffe/util/nms.hpp"
+
+#include "caffe/test/test_caffe_main.hpp"
+
+namespace caffe {
+
+template <typename Dtype>
+class NMSTest : public ::testing::Test {
+ protected:
+  NMSTest() {
+    Caffe::set_random_seed(1701);
+  }
+
+  // Random boxes of 5 to 50 pixels in a 200 x 200 image.
+  void MakeBoxes(const int num_boxes, vector<Dtype>* boxes) {
+    vector<Dtype> corners(2 * num_boxes), sizes(2 * num_boxes);
+    caffe_rng_uniform<Dtype>(corners.size(), 0, 150, &corners[0]);
+    caffe_rng_uniform<Dtype>(sizes.size(), 5, 50, &sizes[0]);
+    boxes->resize(4 * num_boxes);
+    for (int i = 0; i < num_boxes; ++i) {
+      (*boxes)[4 * i] = corners[2 * i];
+      (*boxes)[4 * i + 1] = corners[2 * i + 1];
+      (*boxes)[4 * i + 2] = corners[2 * i] + sizes[2 * i];
+      (*boxes)[4 * i + 3] = corners[2 * i + 1] + sizes[2 * i + 1];
+    }
+  }
+
+  // The loop of lib/nms/cpu_nms.pyx.
+  void ReferenceNMS(const int num_boxes, const Dtype* boxes,
+      const Dtype thresh, vector<int>* keep) {
+    keep->clear();
+    vector<bool> suppressed(num_boxes, false);
+    for (int i = 0; i < num_boxes; ++i) {
+      if (suppressed[i]) {
+        continue;
+      }
+      keep->push_back(i);
+      const Dtype* a = boxes + 4 * i;
+      const Dtype area_a = (a[2] - a[0] + 1) * (a[3] - a[1] + 1);
+      for (int j = i + 1; j < num_boxes; ++j) {
+        const Dtype* b = boxes + 4 * j;
+        const Dtype area_b = (b[2] - b[0] + 1) * (b[3] - b[1] + 1);
+        const Dtype w = std::max(Dtype(0),
+            std::min(a[2], b[2]) - std::max(a[0], b[0]) + 1);
+        const Dtype h = std::max(Dtype(0),
+            std::min(a[3], b[3]) - std::max(a[1], b[1]) + 1);
+        const Dtype inter = w * h;
+        if (inter / (area_a + area_b - inter) >= thresh) {
+          suppressed[j] = true;
+        }
+      }
+    }
+  }
+};
+
+TYPED_TEST_CASE(NMSTest, TestDtypes);
+
+TYPED_TEST(NMSTest, TestSmall) {
+  const TypeParam boxes[] = {
+    0, 0, 9, 9,
+    0, 0, 9, 9,
+    20, 20, 29, 29,
+    // IoU with the first box is 50 / 150.
+    0, 5, 9, 14 };
+  vector<int> keep;
+  nms_cpu(4, boxes, TypeParam(0.3), &keep);
+  ASSERT_EQ(2, keep.size());
+  EXPECT_EQ(0, keep[0]);
+  EXPECT_EQ(2, keep[1]);
+  nms_cpu(4, boxes, TypeParam(0.5), &keep);
+  ASSERT_EQ(3, keep.size());
+  EXPECT_EQ(3, keep[2]);
+  nms_cpu(0, boxes, TypeParam(0.5), &keep);
+  EXPECT_EQ(0, keep.size());
+}
+
+TYPED_TEST(NMSTest, TestMatchesReference) {
+  // Spans several 64 box blocks, the last one partial.
+  const int num_boxes = 300;
+  vector<TypeParam> boxes;
+  this->MakeBoxes(num_boxes, &boxes);
+  const TypeParam threshs[] = { 0.3, 0.5, 0.7 };
+  for (int t = 0; t < 3; ++t) {
+    vector<int> keep, expected;
+    nms_cpu(num_boxes, &boxes[0], threshs[t], &keep);
+    this->ReferenceNMS(num_boxes, &boxes[0], threshs[t], &expected);
+    EXPECT_GT(expected.size(), 64);
+    ASSERT_EQ(expected.size(), keep.size());
+    for (int i = 0; i < expected.size(); ++i) {
+      EXPECT_EQ(expected[i], keep[i]);
+    }
+  }
+}
+
+TYPED_TEST(NMSTest, TestMaxKeep) {
+  const int num_boxes = 200;
+  vector<TypeParam> boxes;
+  this->MakeBoxes(num_boxes, &boxes);
+  vector<int> keep, expected;
+  nms_cpu(num_boxes, &boxes[0], TypeParam(0.5), &keep, 70);
+  this->ReferenceNMS(num_boxes, &boxes[0], TypeParam(0.5), &expected);
+  ASSERT_EQ(70, keep.size());
+  for (int i = 0; i < keep.size(); ++i) {
+    EXPECT_EQ(expected[i], keep[i]);
+  }
+}
+
+TYPED_TEST(NMSTest, TestBatched) {
+  vector<int> offsets(1, 0);
+  offsets.push_back(100);
+  offsets.push_back(100);
+  offsets.push_back(170);
+  offsets.push_back(240);
+  vector<TypeParam> boxes;
+  this->MakeBoxes(offsets.back(), &boxes);
+  vector<vector<int> > keep;
+  nms_cpu_batched(offsets, &boxes[0], TypeParam(0.4), &keep);
+  ASSERT_EQ(4, keep.size());
+  for (int g = 0; g < 4; ++g) {
+    vector<int> expected;
+    this->ReferenceNMS(offsets[g + 1] - offsets[g], &boxes[4 * offsets[g]],
+        TypeParam(0.4), &expected);
+    ASSERT_EQ(expected.size(), keep[g].size());
+    for (int i = 0; i < expected.size(); ++i) {
+      EXPECT_EQ(expected[i], keep[g][i]);
+    }
+  }
+}
+
+}  // namespace caffe
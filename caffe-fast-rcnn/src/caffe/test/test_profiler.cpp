@@ -0,0 +1,133 @@
+#include <sstream>
+#include <string>
+
+#include "gtest/gtest.h"
+
+#include "caffe/common.hpp"
+#include "caffe/syncedmem.hpp"
+#include "caffe/util/profiler.hpp"
+
+#include "caffe/test/test_caffe_main.hpp"
+
+namespace caffe {
+
+class ProfilerTest : public ::testing::Test {
+ protected:
+  // The number of times pattern occurs in text.
+  int Count(const string& text, const string& pattern) {
+    int count = 0;
+    for (size_t i = text.find(pattern); i != string::npos;
+         i = text.find(pattern, i + 1)) {
+      ++count;
+    }
+    return count;
+  }
+
+  // Whether the braces and brackets outside strings balance.
+  bool Balanced(const string& text) {
+    string open;
+    bool in_string = false;
+    for (int i = 0; i < text.size(); ++i) {
+      const char c = text[i];
+      if (in_string) {
+        if (c == '\\') {
+          ++i;
+        } else if (c == '"') {
+          in_string = false;
+        }
+      } else if (c == '"') {
+        in_string = true;
+      } else if (c == '{' || c == '[') {
+        open += c;
+      } else if (c == '}' || c == ']') {
+        if (open.empty() || open[open.size() - 1] != (c == '}' ? '{' : '[')) {
+          return false;
+        }
+        open.erase(open.size() - 1);
+      }
+    }
+    return open.empty() && !in_string;
+  }
+
+  Profiler profiler_;
+};
+
+TEST_F(ProfilerTest, TestScopes) {
+  LayerProfile* layer = profiler_.AddLayer("conv1", "Convolution");
+  EXPECT_EQ(1, profiler_.num_layers());
+  for (int i = 0; i < 3; ++i) {
+    ProfileScope scope(layer, LayerProfile::FORWARD);
+  }
+  {
+    ProfileScope scope(&profiler_, "step");
+    ProfileScope layer_scope(layer, LayerProfile::BACKWARD);
+    SyncedMemory memory(100);
+    memory.cpu_data();
+  }
+  {
+    // Scopes without a profiler record nothing.
+    ProfileScope scope(static_cast<LayerProfile*>(NULL),
+        LayerProfile::FORWARD);
+    ProfileScope section_scope(static_cast<Profiler*>(NULL), "step");
+  }
+  EXPECT_EQ(3, layer->phases[LayerProfile::FORWARD].calls);
+  EXPECT_EQ(1, layer->phases[LayerProfile::BACKWARD].calls);
+  EXPECT_EQ(0, layer->phases[LayerProfile::RESHAPE].calls);
+  EXPECT_EQ(0, layer->phases[LayerProfile::FORWARD].bytes_allocated);
+  EXPECT_EQ(100, layer->phases[LayerProfile::BACKWARD].bytes_allocated);
+  ASSERT_EQ(1, profiler_.sections().size());
+  const ProfileStat& step = profiler_.sections().find("step")->second;
+  EXPECT_EQ(1, step.calls);
+  EXPECT_EQ(100, step.bytes_allocated);
+  EXPECT_EQ(100, step.bytes_zeroed);
+  EXPECT_EQ(0, step.reallocations);
+  EXPECT_GE(step.microseconds,
+      layer->phases[LayerProfile::BACKWARD].microseconds);
+  EXPECT_EQ(0, profiler_.num_trace_events());
+  profiler_.Reset();
+  EXPECT_EQ(0, layer->phases[LayerProfile::FORWARD].calls);
+  EXPECT_EQ(0, profiler_.sections().find("step")->second.calls);
+}
+
+TEST_F(ProfilerTest, TestJSON) {
+  LayerProfile* layer = profiler_.AddLayer("a \"quoted\" name", "ReLU");
+  layer->flops = 100;
+  layer->flops_left = 40;
+  {
+    ProfileScope scope(layer, LayerProfile::DATA_WAIT);
+  }
+  {
+    ProfileScope scope(&profiler_, "solver_step");
+  }
+  std::ostringstream out;
+  profiler_.ToJSON(&out);
+  const string json = out.str();
+  EXPECT_TRUE(Balanced(json)) << json;
+  EXPECT_EQ(1, Count(json, "\"a \\\"quoted\\\" name\""));
+  EXPECT_EQ(1, Count(json, "\"solver_step\": {\"calls\": 1"));
+  EXPECT_EQ(1, Count(json, "\"data_wait\": {\"calls\": 1"));
+  EXPECT_EQ(1, Count(json, "\"forward\": {\"calls\": 0"));
+  EXPECT_EQ(1, Count(json, "\"flops\": 100.000, \"flops_left\": 40.000"));
+}
+
+TEST_F(ProfilerTest, TestTrace) {
+  LayerProfile* layer = profiler_.AddLayer("fc6", "InnerProduct");
+  profiler_.set_max_trace_events(3);
+  for (int i = 0; i < 2; ++i) {
+    ProfileScope scope(&profiler_, "step");
+    ProfileScope layer_scope(layer, LayerProfile::FORWARD);
+  }
+  EXPECT_EQ(3, profiler_.num_trace_events());
+  EXPECT_EQ(1, profiler_.dropped_trace_events());
+  std::ostringstream out;
+  profiler_.ToTrace(&out);
+  const string trace = out.str();
+  EXPECT_TRUE(Balanced(trace)) << trace;
+  EXPECT_EQ(1, Count(trace, "\"traceEvents\": ["));
+  EXPECT_EQ(3, Count(trace, "\"ph\": \"X\""));
+  EXPECT_EQ(2, Count(trace, "\"name\": \"fc6\", \"cat\": \"forward\""));
+  EXPECT_EQ(1, Count(trace, "\"name\": \"step\", \"cat\": \"section\""));
+  EXPECT_EQ(3, Count(trace, "\"tid\": 0"));
+}
+
+}  // namespace caffe
@@ -0,0 +1,269 @@
+#include <algorithm>
+#include <climits>
+#include <cmath>
+#include <utility>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "caffe/blob.hpp"
+#include "caffe/common.hpp"
+#include "caffe/fast_rcnn_layers.hpp"
+#include "caffe/filler.hpp"
+#include "caffe/util/bbox_util.hpp"
+#include "caffe/util/math_functions.hpp"
+
+#include "caffe/test/test_caffe_main.hpp"
+
+namespace caffe {
+
+template <typename Dtype>
+class ProposalLayerTest : public CPUDeviceTest<Dtype> {
+ protected:
+  ProposalLayerTest()
+      : blob_bottom_scores_(new Blob<Dtype>(1, 18, 5, 7)),
+        blob_bottom_deltas_(new Blob<Dtype>(1, 36, 5, 7)),
+        blob_bottom_im_info_(new Blob<Dtype>(1, 3, 1, 1)),
+        blob_top_rois_(new Blob<Dtype>()),
+        blob_top_scores_(new Blob<Dtype>()) {
+    FillerParameter filler_param;
+    UniformFiller<Dtype> score_filler(filler_param);
+    score_filler.Fill(blob_bottom_scores_);
+    filler_param.set_std(0.3);
+    GaussianFiller<Dtype> delta_filler(filler_param);
+    delta_filler.Fill(blob_bottom_deltas_);
+    // A 75 x 110 image at half scale, so that boxes under 8 pixels go.
+    Dtype* im_info = blob_bottom_im_info_->mutable_cpu_data();
+    im_info[0] = 75;
+    im_info[1] = 110;
+    im_info[2] = 0.5;
+    blob_bottom_vec_.push_back(blob_bottom_scores_);
+    blob_bottom_vec_.push_back(blob_bottom_deltas_);
+    blob_bottom_vec_.push_back(blob_bottom_im_info_);
+    blob_top_vec_.push_back(blob_top_rois_);
+    blob_top_vec_.push_back(blob_top_scores_);
+  }
+  virtual ~ProposalLayerTest() {
+    delete blob_bottom_scores_;
+    delete blob_bottom_deltas_;
+    delete blob_bottom_im_info_;
+    delete blob_top_rois_;
+    delete blob_top_scores_;
+  }
+
+  // A direct port of proposal_layer.py: sort everything, then greedy NMS.
+  void ReferenceProposals(const int pre_nms_topn, const int post_nms_topn,
+      const Dtype nms_thresh, vector<vector<Dtype> >* rois) {
+    vector<Dtype> anchors;
+    vector<Dtype> ratios(1, 0.5), scales(1, 8);
+    ratios.push_back(1);
+    ratios.push_back(2);
+    scales.push_back(16);
+    scales.push_back(32);
+    generate_anchors(16, ratios, scales, &anchors);
+    const int height = blob_bottom_scores_->height();
+    const int width = blob_bottom_scores_->width();
+    const Dtype* im_info = blob_bottom_im_info_->cpu_data();
+    vector<std::pair<Dtype, int> > order;
+    vector<vector<Dtype> > boxes;
+    for (int h = 0; h < height; ++h) {
+      for (int w = 0; w < width; ++w) {
+        for (int a = 0; a < 9; ++a) {
+          Dtype anchor[4] = { anchors[4 * a] + w * 16,
+              anchors[4 * a + 1] + h * 16, anchors[4 * a + 2] + w * 16,
+              anchors[4 * a + 3] + h * 16 };
+          Dtype delta[4];
+          for (int k = 0; k < 4; ++k) {
+            delta[k] = blob_bottom_deltas_->data_at(0, 4 * a + k, h, w);
+          }
+          vector<Dtype> box(5);
+          bbox_transform_inv(anchor, delta[0], delta[1], delta[2], delta[3],
+              &box[0]);
+          clip_box(im_info[0], im_info[1], &box[0]);
+          if (box[2] - box[0] + 1 < 16 * im_info[2] ||
+              box[3] - box[1] + 1 < 16 * im_info[2]) {
+            continue;
+          }
+          box[4] = blob_bottom_scores_->data_at(0, 9 + a, h, w);
+          order.push_back(std::make_pair(-box[4], boxes.size()));
+          boxes.push_back(box);
+        }
+      }
+    }
+    std::sort(order.begin(), order.end());
+    if (static_cast<int>(order.size()) > pre_nms_topn) {
+      order.resize(pre_nms_topn);
+    }
+    rois->clear();
+    vector<bool> suppressed(order.size(), false);
+    for (int i = 0;
+        i < order.size() && static_cast<int>(rois->size()) < post_nms_topn;
+        ++i) {
+      if (suppressed[i]) {
+        continue;
+      }
+      const vector<Dtype>& a = boxes[order[i].second];
+      rois->push_back(a);
+      for (int j = i + 1; j < order.size(); ++j) {
+        const vector<Dtype>& b = boxes[order[j].second];
+        const Dtype iw = std::min(a[2], b[2]) - std::max(a[0], b[0]) + 1;
+        const Dtype ih = std::min(a[3], b[3]) - std::max(a[1], b[1]) + 1;
+        if (iw <= 0 || ih <= 0) {
+          continue;
+        }
+        const Dtype inter = iw * ih;
+        const Dtype area_a = (a[2] - a[0] + 1) * (a[3] - a[1] + 1);
+        const Dtype area_b = (b[2] - b[0] + 1) * (b[3] - b[1] + 1);
+        if (inter / (area_a + area_b - inter) >= nms_thresh) {
+          suppressed[j] = true;
+        }
+      }
+    }
+  }
+
+  Blob<Dtype>* const blob_bottom_scores_;
+  Blob<Dtype>* const blob_bottom_deltas_;
+  Blob<Dtype>* const blob_bottom_im_info_;
+  Blob<Dtype>* const blob_top_rois_;
+  Blob<Dtype>* const blob_top_scores_;
+  vector<Blob<Dtype>*> blob_bottom_vec_;
+  vector<Blob<Dtype>*> blob_top_vec_;
+};
+
+TYPED_TEST_CASE(ProposalLayerTest, TestDtypes);
+
+TYPED_TEST(ProposalLayerTest, TestGenerateAnchors) {
+  // What generate_anchors() in lib/rpn/generate_anchors.py returns.
+  const TypeParam expected[] = {
+     -84,  -40,  99,  55,
+    -176,  -88, 191, 103,
+    -360, -184, 375, 199,
+     -56,  -56,  71,  71,
+    -120, -120, 135, 135,
+    -248, -248, 263, 263,
+     -36,  -80,  51,  95,
+     -80, -168,  95, 183,
+    -168, -344, 183, 359 };
+  vector<TypeParam> ratios(1, 0.5), scales(1, 8);
+  ratios.push_back(1);
+  ratios.push_back(2);
+  scales.push_back(16);
+  scales.push_back(32);
+  vector<TypeParam> anchors;
+  generate_anchors(16, ratios, scales, &anchors);
+  ASSERT_EQ(36, anchors.size());
+  for (int i = 0; i < 36; ++i) {
+    EXPECT_EQ(expected[i], anchors[i]);
+  }
+}
+
+TYPED_TEST(ProposalLayerTest, TestSetUp) {
+  LayerParameter layer_param;
+  ProposalLayer<TypeParam> layer(layer_param);
+  layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  EXPECT_EQ(2, this->blob_top_rois_->num_axes());
+  EXPECT_EQ(5, this->blob_top_rois_->shape(1));
+  EXPECT_EQ(1, this->blob_top_scores_->shape(1));
+}
+
+TYPED_TEST(ProposalLayerTest, TestForward) {
+  typedef TypeParam Dtype;
+  LayerParameter layer_param;
+  ProposalParameter* proposal_param = layer_param.mutable_proposal_param();
+  proposal_param->set_pre_nms_topn(150);
+  proposal_param->set_post_nms_topn(40);
+  proposal_param->set_nms_thresh(0.5);
+  ProposalLayer<Dtype> layer(layer_param);
+  layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+  vector<vector<Dtype> > expected;
+  this->ReferenceProposals(150, 40, 0.5, &expected);
+  ASSERT_GT(expected.size(), 0);
+  ASSERT_EQ(expected.size(), this->blob_top_rois_->num());
+  ASSERT_EQ(expected.size(), this->blob_top_scores_->num());
+  const Dtype* rois = this->blob_top_rois_->cpu_data();
+  const Dtype* scores = this->blob_top_scores_->cpu_data();
+  for (int i = 0; i < expected.size(); ++i) {
+    EXPECT_EQ(0, rois[5 * i]);
+    for (int k = 0; k < 4; ++k) {
+      EXPECT_NEAR(expected[i][k], rois[5 * i + k + 1], 1e-4);
+    }
+    EXPECT_EQ(expected[i][4], scores[i]);
+  }
+}
+
+TYPED_TEST(ProposalLayerTest, TestForwardKeepAll) {
+  typedef TypeParam Dtype;
+  LayerParameter layer_param;
+  ProposalParameter* proposal_param = layer_param.mutable_proposal_param();
+  proposal_param->set_pre_nms_topn(0);
+  proposal_param->set_post_nms_topn(0);
+  proposal_param->set_nms_thresh(0.5);
+  ProposalLayer<Dtype> layer(layer_param);
+  layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+  vector<vector<Dtype> > expected;
+  this->ReferenceProposals(INT_MAX, INT_MAX, 0.5, &expected);
+  ASSERT_EQ(expected.size(), this->blob_top_rois_->num());
+  const Dtype* scores = this->blob_top_scores_->cpu_data();
+  for (int i = 0; i < expected.size(); ++i) {
+    EXPECT_EQ(expected[i][4], scores[i]);
+  }
+}
+
+TYPED_TEST(ProposalLayerTest, TestForwardBatch) {
+  typedef TypeParam Dtype;
+  LayerParameter layer_param;
+  ProposalParameter* proposal_param = layer_param.mutable_proposal_param();
+  proposal_param->set_pre_nms_topn(150);
+  proposal_param->set_post_nms_topn(40);
+  proposal_param->set_nms_thresh(0.5);
+  // Two copies of the features, as a padded batch of a smaller image and of
+  // the fixture's image would have.
+  const Dtype im_info[6] = {50, 80, 0.5, 75, 110, 0.5};
+  vector<vector<Dtype> > single_rois(2);
+  for (int n = 0; n < 2; ++n) {
+    std::copy(im_info + 3 * n, im_info + 3 * n + 3,
+        this->blob_bottom_im_info_->mutable_cpu_data());
+    ProposalLayer<Dtype> layer(layer_param);
+    layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+    layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+    single_rois[n].assign(this->blob_top_rois_->cpu_data(),
+        this->blob_top_rois_->cpu_data() + this->blob_top_rois_->count());
+  }
+  ASSERT_NE(single_rois[0].size(), single_rois[1].size());
+
+  Blob<Dtype> scores(2, 18, 5, 7);
+  Blob<Dtype> deltas(2, 36, 5, 7);
+  Blob<Dtype> batch_im_info(2, 3, 1, 1);
+  for (int n = 0; n < 2; ++n) {
+    caffe_copy(this->blob_bottom_scores_->count(),
+        this->blob_bottom_scores_->cpu_data(),
+        scores.mutable_cpu_data() + scores.offset(n));
+    caffe_copy(this->blob_bottom_deltas_->count(),
+        this->blob_bottom_deltas_->cpu_data(),
+        deltas.mutable_cpu_data() + deltas.offset(n));
+  }
+  std::copy(im_info, im_info + 6, batch_im_info.mutable_cpu_data());
+  vector<Blob<Dtype>*> bottom;
+  bottom.push_back(&scores);
+  bottom.push_back(&deltas);
+  bottom.push_back(&batch_im_info);
+  ProposalLayer<Dtype> layer(layer_param);
+  layer.SetUp(bottom, this->blob_top_vec_);
+  layer.Forward(bottom, this->blob_top_vec_);
+  ASSERT_EQ(single_rois[0].size() + single_rois[1].size(),
+      this->blob_top_rois_->count());
+  const Dtype* rois = this->blob_top_rois_->cpu_data();
+  for (int n = 0; n < 2; ++n) {
+    for (int i = 0; i < single_rois[n].size(); i += 5) {
+      EXPECT_EQ(n, rois[i]);
+      for (int k = 1; k < 5; ++k) {
+        EXPECT_EQ(single_rois[n][i + k], rois[i + k]);
+      }
+    }
+    rois += single_rois[n].size();
+  }
+}
+
+}  // namespace caffe
@@ -0,0 +1,131 @@
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "caffe/blob.hpp"
+#include "caffe/common.hpp"
+#include "caffe/fast_rcnn_layers.hpp"
+#include "caffe/util/bbox_util.hpp"
+#include "caffe/util/math_functions.hpp"
+
+#include "caffe/test/test_caffe_main.hpp"
+
+namespace caffe {
+
+template <typename Dtype>
+class ProposalTargetLayerTest : public CPUDeviceTest<Dtype> {
+ protected:
+  ProposalTargetLayerTest()
+      : blob_bottom_rois_(new Blob<Dtype>(200, 5, 1, 1)),
+        blob_bottom_gt_boxes_(new Blob<Dtype>(2, 5, 1, 1)),
+        blob_top_rois_(new Blob<Dtype>()),
+        blob_top_labels_(new Blob<Dtype>()),
+        blob_top_targets_(new Blob<Dtype>()),
+        blob_top_inside_weights_(new Blob<Dtype>()),
+        blob_top_outside_weights_(new Blob<Dtype>()) {
+    // Random rois in a 100 x 100 image around two gt boxes.
+    Dtype* rois = blob_bottom_rois_->mutable_cpu_data();
+    vector<Dtype> coords(4 * blob_bottom_rois_->num());
+    caffe_rng_uniform<Dtype>(coords.size(), 0, 50, &coords[0]);
+    for (int i = 0; i < blob_bottom_rois_->num(); ++i) {
+      rois[5 * i] = 0;
+      rois[5 * i + 1] = coords[4 * i];
+      rois[5 * i + 2] = coords[4 * i + 1];
+      rois[5 * i + 3] = coords[4 * i] + 10 + coords[4 * i + 2];
+      rois[5 * i + 4] = coords[4 * i + 1] + 10 + coords[4 * i + 3];
+    }
+    const Dtype gt_boxes[] = { 10, 10, 40, 50, 1, 30, 20, 80, 60, 2 };
+    std::copy(gt_boxes, gt_boxes + 10,
+        blob_bottom_gt_boxes_->mutable_cpu_data());
+    blob_bottom_vec_.push_back(blob_bottom_rois_);
+    blob_bottom_vec_.push_back(blob_bottom_gt_boxes_);
+    blob_top_vec_.push_back(blob_top_rois_);
+    blob_top_vec_.push_back(blob_top_labels_);
+    blob_top_vec_.push_back(blob_top_targets_);
+    blob_top_vec_.push_back(blob_top_inside_weights_);
+    blob_top_vec_.push_back(blob_top_outside_weights_);
+  }
+  virtual ~ProposalTargetLayerTest() {
+    delete blob_bottom_rois_;
+    delete blob_bottom_gt_boxes_;
+    delete blob_top_rois_;
+    delete blob_top_labels_;
+    delete blob_top_targets_;
+    delete blob_top_inside_weights_;
+    delete blob_top_outside_weights_;
+  }
+
+  Blob<Dtype>* const blob_bottom_rois_;
+  Blob<Dtype>* const blob_bottom_gt_boxes_;
+  Blob<Dtype>* const blob_top_rois_;
+  Blob<Dtype>* const blob_top_labels_;
+  Blob<Dtype>* const blob_top_targets_;
+  Blob<Dtype>* const blob_top_inside_weights_;
+  Blob<Dtype>* const blob_top_outside_weights_;
+  vector<Blob<Dtype>*> blob_bottom_vec_;
+  vector<Blob<Dtype>*> blob_top_vec_;
+};
+
+TYPED_TEST_CASE(ProposalTargetLayerTest, TestDtypes);
+
+TYPED_TEST(ProposalTargetLayerTest, TestForward) {
+  typedef TypeParam Dtype;
+  LayerParameter layer_param;
+  ProposalTargetParameter* target_param =
+      layer_param.mutable_proposal_target_param();
+  target_param->set_num_classes(3);
+  target_param->set_batch_size(32);
+  target_param->set_normalize_targets(true);
+  ProposalTargetLayer<Dtype> layer(layer_param);
+  layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+  const int num_rois = this->blob_top_rois_->num();
+  ASSERT_EQ(32, num_rois);
+  ASSERT_EQ(1, this->blob_top_labels_->num_axes());
+  ASSERT_EQ(num_rois, this->blob_top_labels_->num());
+  ASSERT_EQ(12, this->blob_top_targets_->shape(1));
+  const Dtype* gt_boxes = this->blob_bottom_gt_boxes_->cpu_data();
+  const Dtype stds[] = { 0.1, 0.1, 0.2, 0.2 };
+  int num_fg = 0;
+  for (int i = 0; i < num_rois; ++i) {
+    const Dtype* roi = this->blob_top_rois_->cpu_data() + 5 * i;
+    EXPECT_EQ(0, roi[0]);
+    const Dtype overlaps[] = { bbox_overlap(roi + 1, gt_boxes),
+        bbox_overlap(roi + 1, gt_boxes + 5) };
+    const int best = overlaps[1] > overlaps[0];
+    const int label = this->blob_top_labels_->cpu_data()[i];
+    const Dtype* targets = this->blob_top_targets_->cpu_data() + 12 * i;
+    const Dtype* inside_weights =
+        this->blob_top_inside_weights_->cpu_data() + 12 * i;
+    if (label > 0) {
+      // fg rois come first.
+      EXPECT_EQ(i, num_fg++);
+      EXPECT_GE(overlaps[best], 0.5);
+      EXPECT_EQ(gt_boxes[5 * best + 4], label);
+      Dtype expected[4];
+      bbox_transform(roi + 1, gt_boxes + 5 * best, expected);
+      for (int k = 0; k < 4; ++k) {
+        EXPECT_NEAR(expected[k] / stds[k], targets[4 * label + k], 1e-4);
+      }
+    } else {
+      EXPECT_LT(overlaps[best], 0.5);
+      EXPECT_GE(overlaps[best], 0.1);
+    }
+    for (int j = 0; j < 12; ++j) {
+      const bool target_slot = label > 0 && j / 4 == label;
+      EXPECT_EQ(target_slot, inside_weights[j]);
+      EXPECT_EQ(target_slot,
+          this->blob_top_outside_weights_->cpu_data()[12 * i + j]);
+      if (!target_slot) {
+        EXPECT_EQ(0, targets[j]);
+      }
+    }
+  }
+  // The gt boxes are candidates, so there are always fg rois.
+  EXPECT_GE(num_fg, 2);
+  EXPECT_LE(num_fg, 8);
+}
+
+}  // namespace caffe
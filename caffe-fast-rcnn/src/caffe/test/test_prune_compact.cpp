@@ -0,0 +1,161 @@
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "google/protobuf/text_format.h"
+#include "gtest/gtest.h"
+
+#include "caffe/blob.hpp"
+#include "caffe/common.hpp"
+#include "caffe/filler.hpp"
+#include "caffe/net.hpp"
+#include "caffe/util/prune_compact.hpp"
+
+#include "caffe/test/test_caffe_main.hpp"
+
+namespace caffe {
+
+class PruneCompactTest : public ::testing::Test {
+ protected:
+  PruneCompactTest() {
+    Caffe::set_mode(Caffe::CPU);
+    Caffe::set_random_seed(1701);
+  }
+
+  // conv1 followed by the given layers.
+  void InitNet(const string& layers) {
+    const string proto =
+        "name: 'PrunedNet' "
+        "input: 'data' "
+        "input_shape { dim: 2 dim: 3 dim: 9 dim: 9 } "
+        "layer { name: 'conv1' type: 'Convolution' bottom: 'data' "
+        "  top: 'conv1' convolution_param { num_output: 6 kernel_size: 3 "
+        "  pad: 1 weight_filler { type: 'gaussian' std: 0.5 } "
+        "  bias_filler { type: 'gaussian' std: 0.5 } } } " + layers;
+    CHECK(google::protobuf::TextFormat::ParseFromString(proto, &net_param_));
+    net_.reset(new Net<float>(net_param_));
+    FillerParameter filler_param;
+    GaussianFiller<float> filler(filler_param);
+    filler.Fill(net_->input_blobs()[0]);
+  }
+
+  // conv1 -> relu1 -> conv2 -> pool2 -> fc3
+  void InitNet(const int conv2_pad) {
+    std::ostringstream proto;
+    proto <<
+        "layer { name: 'relu1' type: 'ReLU' bottom: 'conv1' top: 'conv1' } "
+        "layer { name: 'conv2' type: 'Convolution' bottom: 'conv1' "
+        "  top: 'conv2' convolution_param { num_output: 4 kernel_size: 3 "
+        "  pad: " << conv2_pad << " weight_filler { type: 'gaussian' "
+        "  std: 0.5 } bias_filler { type: 'gaussian' std: 0.5 } } } "
+        "layer { name: 'pool2' type: 'Pooling' bottom: 'conv2' top: 'pool2' "
+        "  pooling_param { pool: MAX kernel_size: 2 stride: 2 } } "
+        "layer { name: 'fc3' type: 'InnerProduct' bottom: 'pool2' top: 'fc3' "
+        "  inner_product_param { num_output: 5 "
+        "  weight_filler { type: 'gaussian' std: 0.5 } "
+        "  bias_filler { type: 'gaussian' std: 0.5 } } } ";
+    InitNet(proto.str());
+  }
+
+  // Zeroes output channel `row` of a layer and sets its bias.
+  void PruneRow(const string& layer_name, const int row, const float bias) {
+    const shared_ptr<Layer<float> > layer = net_->layer_by_name(layer_name);
+    Blob<float>* weight = layer->blobs()[0].get();
+    const int dim = weight->count(1);
+    caffe_set(dim, 0.f, weight->mutable_cpu_data() + row * dim);
+    layer->blobs()[1]->mutable_cpu_data()[row] = bias;
+  }
+
+  // Zeroes the columns of input channel `channel` of a Convolution layer.
+  void PruneChannel(const string& layer_name, const int channel) {
+    Blob<float>* weight = net_->layer_by_name(layer_name)->blobs()[0].get();
+    const int dim = weight->count(2);
+    for (int o = 0; o < weight->shape(0); ++o) {
+      caffe_set(dim, 0.f,
+          weight->mutable_cpu_data() + weight->offset(o, channel));
+    }
+  }
+
+  // Compacts the net and checks that it computes the same outputs.
+  void CompactAndCheck(const int conv1_outputs, const int conv2_outputs) {
+    const vector<Blob<float>*>& outputs = net_->ForwardPrefilled();
+    vector<vector<float> > expected(outputs.size());
+    for (int i = 0; i < outputs.size(); ++i) {
+      expected[i].assign(outputs[i]->cpu_data(),
+          outputs[i]->cpu_data() + outputs[i]->count());
+    }
+    NetParameter weights;
+    net_->ToProto(&weights);
+    NetParameter compact_param, compact_weights;
+    CompactPrunedNet(net_param_, weights, &compact_param, &compact_weights);
+    EXPECT_EQ(conv1_outputs,
+        compact_param.layer(0).convolution_param().num_output());
+    EXPECT_EQ(conv2_outputs,
+        compact_param.layer(2).convolution_param().num_output());
+    Net<float> compact_net(compact_param);
+    compact_net.CopyTrainedLayersFrom(compact_weights);
+    compact_net.input_blobs()[0]->CopyFrom(*net_->input_blobs()[0]);
+    const vector<Blob<float>*>& compact_outputs =
+        compact_net.ForwardPrefilled();
+    ASSERT_EQ(expected.size(), compact_outputs.size());
+    for (int i = 0; i < expected.size(); ++i) {
+      ASSERT_EQ(expected[i].size(), compact_outputs[i]->count());
+      for (int j = 0; j < expected[i].size(); ++j) {
+        EXPECT_NEAR(expected[i][j], compact_outputs[i]->cpu_data()[j], 1e-4);
+      }
+    }
+  }
+
+  NetParameter net_param_;
+  shared_ptr<Net<float> > net_;
+};
+
+TEST_F(PruneCompactTest, TestNothingPruned) {
+  this->InitNet(1);
+  this->CompactAndCheck(6, 4);
+}
+
+TEST_F(PruneCompactTest, TestPrunedRows) {
+  this->InitNet(1);
+  // Rows whose bias is killed by the ReLU carry no signal.
+  this->PruneRow("conv1", 1, -0.5);
+  this->PruneRow("conv1", 4, 0);
+  // A positive bias would leak through conv2's zero padding unevenly.
+  this->PruneRow("conv1", 5, 0.5);
+  this->PruneRow("conv2", 2, 0);
+  this->CompactAndCheck(4, 3);
+}
+
+TEST_F(PruneCompactTest, TestFoldConstantRows) {
+  this->InitNet(0);
+  // Without padding the constant channel folds into conv2's bias.
+  this->PruneRow("conv1", 0, 0.7);
+  this->PruneRow("conv1", 3, 0.2);
+  this->CompactAndCheck(4, 4);
+}
+
+TEST_F(PruneCompactTest, TestReLUBranch) {
+  // conv1 -> relu1 -> conv2, and conv1 -> conv3 without the ReLU
+  this->InitNet(
+      "layer { name: 'relu1' type: 'ReLU' bottom: 'conv1' top: 'relu1' } "
+      "layer { name: 'conv2' type: 'Convolution' bottom: 'relu1' "
+      "  top: 'conv2' convolution_param { num_output: 4 kernel_size: 3 "
+      "  weight_filler { type: 'gaussian' std: 0.5 } "
+      "  bias_filler { type: 'gaussian' std: 0.5 } } } "
+      "layer { name: 'conv3' type: 'Convolution' bottom: 'conv1' "
+      "  top: 'conv3' convolution_param { num_output: 4 kernel_size: 3 "
+      "  weight_filler { type: 'gaussian' std: 0.5 } "
+      "  bias_filler { type: 'gaussian' std: 0.5 } } } ");
+  // The ReLU kills the constant for conv2 only; conv3 folds it as it is.
+  this->PruneRow("conv1", 2, -0.5);
+  this->CompactAndCheck(5, 4);
+}
+
+TEST_F(PruneCompactTest, TestPrunedColumns) {
+  this->InitNet(1);
+  // The channel is computed but never used downstream.
+  this->PruneChannel("conv2", 2);
+  this->CompactAndCheck(5, 4);
+}
+
+}  // namespace caffe
@@ -5,6 +5,8 @@
 // Written by Ross Girshick
 // ------------------------------------------------------------------
 
+#include <algorithm>
+#include <cfloat>
 #include <cmath>
 #include <cstdlib>
 #include <cstring>
@@ -25,8 +27,6 @@ using boost::scoped_ptr;
 
 namespace caffe {
 
-typedef ::testing::Types<GPUDevice<float>, GPUDevice<double> > TestDtypesGPU;
-
 template <typename TypeParam>
 class ROIPoolingLayerTest : public MultiDeviceTest<TypeParam> {
   typedef typename TypeParam::Dtype Dtype;
@@ -85,7 +85,34 @@ class ROIPoolingLayerTest : public MultiDeviceTest<TypeParam> {
   vector<Blob<Dtype>*> blob_top_vec_;
 };
 
-TYPED_TEST_CASE(ROIPoolingLayerTest, TestDtypesGPU);
+TYPED_TEST_CASE(ROIPoolingLayerTest, TestDtypesAndDevices);
+
+TYPED_TEST(ROIPoolingLayerTest, TestForward) {
+  typedef typename TypeParam::Dtype Dtype;
+  LayerParameter layer_param;
+  ROIPoolingParameter* roi_pooling_param =
+      layer_param.mutable_roi_pooling_param();
+  roi_pooling_param->set_pooled_h(1);
+  roi_pooling_param->set_pooled_w(1);
+  ROIPoolingLayer<Dtype> layer(layer_param);
+  // A single bin covering the ROI pools the max of the ROI.
+  layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+  const Blob<Dtype>* data = this->blob_bottom_data_;
+  const Dtype* rois = this->blob_bottom_rois_->cpu_data();
+  for (int n = 0; n < this->blob_top_data_->num(); ++n) {
+    const int batch_ind = rois[5 * n];
+    for (int c = 0; c < data->channels(); ++c) {
+      Dtype expected = -FLT_MAX;
+      for (int h = rois[5 * n + 2]; h <= rois[5 * n + 4]; ++h) {
+        for (int w = rois[5 * n + 1]; w <= rois[5 * n + 3]; ++w) {
+          expected = std::max(expected, data->data_at(batch_ind, c, h, w));
+        }
+      }
+      EXPECT_EQ(expected, this->blob_top_data_->data_at(n, c, 0, 0));
+    }
+  }
+}
 
 TYPED_TEST(ROIPoolingLayerTest, TestGradient) {
   typedef typename TypeParam::Dtype Dtype;
@@ -8,7 +8,6 @@
 #include "caffe/blob.hpp"
 #include "caffe/common.hpp"
 #include "caffe/filler.hpp"
-#include "caffe/vision_layers.hpp"
 #include "caffe/fast_rcnn_layers.hpp"
 
 #include "caffe/test/test_caffe_main.hpp"
@@ -16,8 +15,6 @@
 
 namespace caffe {
 
-typedef ::testing::Types<GPUDevice<float>, GPUDevice<double> > TestDtypesGPU;
-
 template <typename TypeParam>
 class SmoothL1LossLayerTest : public MultiDeviceTest<TypeParam> {
   typedef typename TypeParam::Dtype Dtype;
@@ -67,7 +64,32 @@ class SmoothL1LossLayerTest : public MultiDeviceTest<TypeParam> {
   vector<Blob<Dtype>*> blob_top_vec_;
 };
 
-TYPED_TEST_CASE(SmoothL1LossLayerTest, TestDtypesGPU);
+TYPED_TEST_CASE(SmoothL1LossLayerTest, TestDtypesAndDevices);
+
+TYPED_TEST(SmoothL1LossLayerTest, TestForward) {
+  typedef typename TypeParam::Dtype Dtype;
+  LayerParameter layer_param;
+  SmoothL1LossParameter* loss_param =
+      layer_param.mutable_smooth_l1_loss_param();
+  const Dtype kSigma = 2.4;
+  loss_param->set_sigma(kSigma);
+  SmoothL1LossLayer<Dtype> layer(layer_param);
+  layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+  const Dtype sigma2 = kSigma * kSigma;
+  Dtype expected_loss = 0;
+  for (int i = 0; i < this->blob_bottom_data_->count(); ++i) {
+    const Dtype x = this->blob_bottom_inside_weights_->cpu_data()[i] *
+        (this->blob_bottom_data_->cpu_data()[i] -
+         this->blob_bottom_label_->cpu_data()[i]);
+    const Dtype abs_x = std::abs(x);
+    const Dtype error = (abs_x < 1 / sigma2) ? 0.5 * x * x * sigma2 :
+        abs_x - 0.5 / sigma2;
+    expected_loss += this->blob_bottom_outside_weights_->cpu_data()[i] * error;
+  }
+  expected_loss /= this->blob_bottom_data_->num();
+  EXPECT_NEAR(expected_loss, this->blob_top_loss_->cpu_data()[0], 1e-4);
+}
 
 TYPED_TEST(SmoothL1LossLayerTest, TestGradient) {
   typedef typename TypeParam::Dtype Dtype;
@@ -106,4 +106,72 @@ TYPED_TEST(SolverTest, TestInitTrainTestNets) {
   EXPECT_TRUE(this->solver_->test_nets()[1]->has_layer("accuracy"));
 }
 
+TYPED_TEST(SolverTest, TestParallelTest) {
+  typedef typename TypeParam::Dtype Dtype;
+  const string& proto =
+     "test_interval: 10 "
+     "test_iter: 7 "
+     "base_lr: 0.01 "
+     "lr_policy: 'fixed' "
+     "random_seed: 1701 "
+     "net_param { "
+     "  name: 'TestNetwork' "
+     "  layer { "
+     "    name: 'data' "
+     "    type: 'DummyData' "
+     "    dummy_data_param { "
+     "      shape { dim: 5 dim: 2 dim: 3 dim: 4 } "
+     "      shape { dim: 5 } "
+     "      data_filler { type: 'gaussian' } "
+     "      data_filler { type: 'uniform' min: 0 max: 9.99 } "
+     "    } "
+     "    top: 'data' "
+     "    top: 'label' "
+     "  } "
+     "  layer { "
+     "    name: 'innerprod' "
+     "    type: 'InnerProduct' "
+     "    inner_product_param { "
+     "      num_output: 10 "
+     "      weight_filler { type: 'gaussian' std: 1 } "
+     "    } "
+     "    bottom: 'data' "
+     "    top: 'innerprod' "
+     "  } "
+     "  layer { "
+     "    name: 'accuracy' "
+     "    type: 'Accuracy' "
+     "    bottom: 'innerprod' "
+     "    bottom: 'label' "
+     "    top: 'accuracy' "
+     "    exclude: { phase: TRAIN } "
+     "  } "
+     "  layer { "
+     "    name: 'loss' "
+     "    type: 'SoftmaxWithLoss' "
+     "    bottom: 'innerprod' "
+     "    bottom: 'label' "
+     "    top: 'loss' "
+     "  } "
+     "} ";
+  // Test on one thread, then on three replicas with a partial last pass.
+  vector<vector<Dtype> > scores;
+  for (int num_threads = 1; num_threads <= 3; num_threads += 2) {
+    ostringstream solver_proto;
+    solver_proto << proto << "test_threads: " << num_threads;
+    this->InitSolverFromProtoString(solver_proto.str());
+    // Reseed after the replicas are filled, so the test data is the same.
+    Caffe::set_random_seed(1701);
+    this->solver_->Step(1);
+    ASSERT_EQ(1, this->solver_->test_scores().size());
+    scores.push_back(this->solver_->test_scores()[0]);
+  }
+  ASSERT_EQ(2, scores[0].size());
+  ASSERT_EQ(scores[0].size(), scores[1].size());
+  for (int i = 0; i < scores[0].size(); ++i) {
+    EXPECT_EQ(scores[0][i], scores[1][i]);
+  }
+  EXPECT_GT(scores[0][1], 0);
+}
+
 }  // namespace caffe
@@ -0,0 +1,93 @@
+#include <boost/bind.hpp>
+#include <boost/thread.hpp>
+
+#include <cstdio>
+#include <deque>
+#include <string>
+#include <utility>
+
+#include "caffe/util/async_proto_writer.hpp"
+#include "caffe/util/io.hpp"
+
+namespace caffe {
+
+class AsyncProtoWriter::sync {
+ public:
+  boost::mutex mutex_;
+  boost::condition_variable queued_;
+  boost::condition_variable done_;
+  // Protos to write and their files; a NULL proto removes the file.
+  std::deque<std::pair<shared_ptr<Message>, string> > queue_;
+  bool busy_;
+  bool stop_;
+};
+
+AsyncProtoWriter::AsyncProtoWriter()
+    : sync_(new sync()) {
+  sync_->busy_ = false;
+  sync_->stop_ = false;
+  thread_.reset(new boost::thread(
+      boost::bind(&AsyncProtoWriter::WriterLoop, this)));
+}
+
+AsyncProtoWriter::~AsyncProtoWriter() {
+  {
+    boost::mutex::scoped_lock lock(sync_->mutex_);
+    sync_->stop_ = true;
+  }
+  sync_->queued_.notify_one();
+  thread_->join();
+}
+
+void AsyncProtoWriter::Write(const shared_ptr<Message>& proto,
+    const string& filename) {
+  CHECK(proto);
+  boost::mutex::scoped_lock lock(sync_->mutex_);
+  sync_->queue_.push_back(std::make_pair(proto, filename));
+  lock.unlock();
+  sync_->queued_.notify_one();
+}
+
+void AsyncProtoWriter::Remove(const string& filename) {
+  boost::mutex::scoped_lock lock(sync_->mutex_);
+  sync_->queue_.push_back(std::make_pair(shared_ptr<Message>(), filename));
+  lock.unlock();
+  sync_->queued_.notify_one();
+}
+
+void AsyncProtoWriter::Flush() {
+  boost::mutex::scoped_lock lock(sync_->mutex_);
+  while (!sync_->queue_.empty() || sync_->busy_) {
+    sync_->done_.wait(lock);
+  }
+}
+
+void AsyncProtoWriter::WriterLoop() {
+  boost::mutex::scoped_lock lock(sync_->mutex_);
+  while (true) {
+    while (sync_->queue_.empty() && !sync_->stop_) {
+      sync_->queued_.wait(lock);
+    }
+    // Stopping, with everything written.
+    if (sync_->queue_.empty()) {
+      return;
+    }
+    std::pair<shared_ptr<Message>, string> job = sync_->queue_.front();
+    sync_->queue_.pop_front();
+    sync_->busy_ = true;
+    lock.unlock();
+    if (job.first) {
+      WriteProtoToBinaryFile(*job.first, job.second);
+      job.first.reset();
+    } else {
+      std::remove(job.second.c_str());
+    }
+    lock.lock();
+    sync_->busy_ = false;
+    if (sync_->queue_.empty()) {
+      sync_->done_.notify_all();
+    }
+  }
+}
+
+}  // namespace caffe
@@ -0,0 +1,76 @@
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#include "caffe/util/bbox_util.hpp"
+#include "caffe/util/rng.hpp"
+
+namespace caffe {
+
+// Appends the anchors of the given widths and heights centered on
+// (ctr_x, ctr_y).
+static void make_anchors(const std::vector<double>& ws,
+    const std::vector<double>& hs, const double ctr_x, const double ctr_y,
+    std::vector<double>* anchors) {
+  for (int i = 0; i < ws.size(); ++i) {
+    anchors->push_back(ctr_x - 0.5 * (ws[i] - 1));
+    anchors->push_back(ctr_y - 0.5 * (hs[i] - 1));
+    anchors->push_back(ctr_x + 0.5 * (ws[i] - 1));
+    anchors->push_back(ctr_y + 0.5 * (hs[i] - 1));
+  }
+}
+
+template <typename Dtype>
+void generate_anchors(const int base_size, const std::vector<Dtype>& ratios,
+    const std::vector<Dtype>& scales, std::vector<Dtype>* anchors) {
+  // The reference window is (0, 0, base_size - 1, base_size - 1).
+  const double size = base_size * base_size;
+  const double ctr = 0.5 * (base_size - 1);
+  // Computed in double like numpy; nearbyint rounds half to even as
+  // np.round does.
+  std::vector<double> ws, hs;
+  for (int i = 0; i < ratios.size(); ++i) {
+    ws.push_back(std::nearbyint(std::sqrt(size / ratios[i])));
+    hs.push_back(std::nearbyint(ws.back() * ratios[i]));
+  }
+  std::vector<double> ratio_anchors;
+  make_anchors(ws, hs, ctr, ctr, &ratio_anchors);
+  std::vector<double> all_anchors;
+  for (int i = 0; i < ratios.size(); ++i) {
+    const double* anchor = &ratio_anchors[4 * i];
+    const double w = anchor[2] - anchor[0] + 1;
+    const double h = anchor[3] - anchor[1] + 1;
+    std::vector<double> scale_ws, scale_hs;
+    for (int j = 0; j < scales.size(); ++j) {
+      scale_ws.push_back(w * scales[j]);
+      scale_hs.push_back(h * scales[j]);
+    }
+    make_anchors(scale_ws, scale_hs, anchor[0] + 0.5 * (w - 1),
+        anchor[1] + 0.5 * (h - 1), &all_anchors);
+  }
+  anchors->assign(all_anchors.begin(), all_anchors.end());
+}
+
+template <typename T>
+void sample_without_replacement(const int num_samples, std::vector<T>* items) {
+  // The first num_samples steps of a Fisher-Yates shuffle.
+  const int num_items = items->size();
+  CHECK_LE(num_samples, num_items);
+  rng_t* rng = caffe_rng();
+  for (int i = 0; i < num_samples; ++i) {
+    boost::uniform_int<int> dist(i, num_items - 1);
+    std::swap((*items)[i], (*items)[dist(*rng)]);
+  }
+}
+
+template void generate_anchors<float>(const int base_size,
+    const std::vector<float>& ratios, const std::vector<float>& scales,
+    std::vector<float>* anchors);
+template void generate_anchors<double>(const int base_size,
+    const std::vector<double>& ratios, const std::vector<double>& scales,
+    std::vector<double>* anchors);
+
+template void sample_without_replacement<int>(const int num_samples,
+    std::vector<int>* items);
+
+}  // namespace caffe
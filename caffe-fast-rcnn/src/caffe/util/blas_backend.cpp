@@ -0,0 +1,445 @@
+#include <dlfcn.h>
+#include <stdint.h>
+
+#include <algorithm>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+#include "boost/thread/once.hpp"
+
+#include "caffe/util/blas_backend.hpp"
+
+namespace caffe {
+
+namespace {
+
+// The BLAS library Caffe is linked against.
+class CblasBackend : public BlasBackend {
+ public:
+  CblasBackend() : BlasBackend("cblas") {}
+
+  virtual void sgemm(const CBLAS_TRANSPOSE TransA,
+      const CBLAS_TRANSPOSE TransB, const int M, const int N, const int K,
+      const float alpha, const float* A, const int lda, const float* B,
+      const int ldb, const float beta, float* C, const int ldc) {
+    cblas_sgemm(CblasRowMajor, TransA, TransB, M, N, K, alpha, A, lda, B,
+        ldb, beta, C, ldc);
+  }
+  virtual void dgemm(const CBLAS_TRANSPOSE TransA,
+      const CBLAS_TRANSPOSE TransB, const int M, const int N, const int K,
+      const double alpha, const double* A, const int lda, const double* B,
+      const int ldb, const double beta, double* C, const int ldc) {
+    cblas_dgemm(CblasRowMajor, TransA, TransB, M, N, K, alpha, A, lda, B,
+        ldb, beta, C, ldc);
+  }
+  virtual void sgemv(const CBLAS_TRANSPOSE TransA, const int M, const int N,
+      const float alpha, const float* A, const float* x, const float beta,
+      float* y) {
+    cblas_sgemv(CblasRowMajor, TransA, M, N, alpha, A, N, x, 1, beta, y, 1);
+  }
+  virtual void dgemv(const CBLAS_TRANSPOSE TransA, const int M, const int N,
+      const double alpha, const double* A, const double* x,
+      const double beta, double* y) {
+    cblas_dgemv(CblasRowMajor, TransA, M, N, alpha, A, N, x, 1, beta, y, 1);
+  }
+  virtual void saxpy(const int N, const float alpha, const float* X,
+      float* Y) { cblas_saxpy(N, alpha, X, 1, Y, 1); }
+  virtual void daxpy(const int N, const double alpha, const double* X,
+      double* Y) { cblas_daxpy(N, alpha, X, 1, Y, 1); }
+};
+
+// A CBLAS library loaded at runtime, e.g. to try MKL on a host where Caffe was
+// built with OpenBLAS.
+class SharedLibraryBackend : public BlasBackend {
+ public:
+  explicit SharedLibraryBackend(const string& path) : BlasBackend(path) {
+    handle_ = dlopen(path.c_str(), RTLD_NOW | RTLD_LOCAL);
+    CHECK(handle_) << "Cannot load BLAS library " << path << ": " << dlerror();
+    sgemm_ = reinterpret_cast<Sgemm>(Symbol("cblas_sgemm"));
+    dgemm_ = reinterpret_cast<Dgemm>(Symbol("cblas_dgemm"));
+    sgemv_ = reinterpret_cast<Sgemv>(Symbol("cblas_sgemv"));
+    dgemv_ = reinterpret_cast<Dgemv>(Symbol("cblas_dgemv"));
+    saxpy_ = reinterpret_cast<Saxpy>(Symbol("cblas_saxpy"));
+    daxpy_ = reinterpret_cast<Daxpy>(Symbol("cblas_daxpy"));
+  }
+  virtual ~SharedLibraryBackend() { dlclose(handle_); }
+
+  virtual void sgemm(const CBLAS_TRANSPOSE TransA,
+      const CBLAS_TRANSPOSE TransB, const int M, const int N, const int K,
+      const float alpha, const float* A, const int lda, const float* B,
+      const int ldb, const float beta, float* C, const int ldc) {
+    sgemm_(CblasRowMajor, TransA, TransB, M, N, K, alpha, A, lda, B, ldb,
+        beta, C, ldc);
+  }
+  virtual void dgemm(const CBLAS_TRANSPOSE TransA,
+      const CBLAS_TRANSPOSE TransB, const int M, const int N, const int K,
+      const double alpha, const double* A, const int lda, const double* B,
+      const int ldb, const double beta, double* C, const int ldc) {
+    dgemm_(CblasRowMajor, TransA, TransB, M, N, K, alpha, A, lda, B, ldb,
+        beta, C, ldc);
+  }
+  virtual void sgemv(const CBLAS_TRANSPOSE TransA, const int M, const int N,
+      const float alpha, const float* A, const float* x, const float beta,
+      float* y) {
+    sgemv_(CblasRowMajor, TransA, M, N, alpha, A, N, x, 1, beta, y, 1);
+  }
+  virtual void dgemv(const CBLAS_TRANSPOSE TransA, const int M, const int N,
+      const double alpha, const double* A, const double* x,
+      const double beta, double* y) {
+    dgemv_(CblasRowMajor, TransA, M, N, alpha, A, N, x, 1, beta, y, 1);
+  }
+  virtual void saxpy(const int N, const float alpha, const float* X,
+      float* Y) { saxpy_(N, alpha, X, 1, Y, 1); }
+  virtual void daxpy(const int N, const double alpha, const double* X,
+      double* Y) { daxpy_(N, alpha, X, 1, Y, 1); }
+
+ protected:
+  typedef void (*Sgemm)(CBLAS_ORDER, CBLAS_TRANSPOSE, CBLAS_TRANSPOSE, int,
+      int, int, float, const float*, int, const float*, int, float, float*,
+      int);
+  typedef void (*Dgemm)(CBLAS_ORDER, CBLAS_TRANSPOSE, CBLAS_TRANSPOSE, int,
+      int, int, double, const double*, int, const double*, int, double,
+      double*, int);
+  typedef void (*Sgemv)(CBLAS_ORDER, CBLAS_TRANSPOSE, int, int, float,
+      const float*, int, const float*, int, float, float*, int);
+  typedef void (*Dgemv)(CBLAS_ORDER, CBLAS_TRANSPOSE, int, int, double,
+      const double*, int, const double*, int, double, double*, int);
+  typedef void (*Saxpy)(int, float, const float*, int, float*, int);
+  typedef void (*Daxpy)(int, double, const double*, int, double*, int);
+
+  void* Symbol(const char* symbol) {
+    void* address = dlsym(handle_, symbol);
+    CHECK(address) << name_ << " does not export " << symbol;
+    return address;
+  }
+
+  void* handle_;
+  Sgemm sgemm_;
+  Dgemm dgemm_;
+  Sgemv sgemv_;
+  Dgemv dgemv_;
+  Saxpy saxpy_;
+  Daxpy daxpy_;
+};
+
+// The blocking of the built-in GEMM: C is computed in kMR x kNR blocks from
+// panels of A and B packed so that the micro-kernel reads them sequentially.
+// A kMC x kKC block of A stays in L2 while it meets a kKC x kNC block of B.
+const int kMR = 4;
+const int kNR = 8;
+const int kMC = 64;
+const int kKC = 256;
+const int kNC = 2048;
+// Below this many multiply-adds a product is not worth sharing out.
+const int kMinParallelWork = 1 << 16;
+
+template <typename Dtype>
+inline Dtype Element(const Dtype* X, bool trans, int ld, int row, int col) {
+  return trans ? X[col * ld + row] : X[row * ld + col];
+}
+
+template <typename Dtype>
+Dtype Dot(const int n, const Dtype* x, const Dtype* y) {
+  // Independent partial sums, so the adds do not wait on each other.
+  Dtype s0 = 0, s1 = 0, s2 = 0, s3 = 0;
+  int i = 0;
+  for (; i + 4 <= n; i += 4) {
+    s0 += x[i] * y[i];
+    s1 += x[i + 1] * y[i + 1];
+    s2 += x[i + 2] * y[i + 2];
+    s3 += x[i + 3] * y[i + 3];
+  }
+  for (; i < n; ++i) {
+    s0 += x[i] * y[i];
+  }
+  return (s0 + s1) + (s2 + s3);
+}
+
+template <typename Dtype>
+inline void Axpy(const int n, const Dtype alpha, const Dtype* x, Dtype* y) {
+  for (int i = 0; i < n; ++i) {
+    y[i] += alpha * x[i];
+  }
+}
+
+// Rows [row_begin, row_begin + rows) and columns [col_begin, col_begin +
+// cols) of op(A), in panels of kMR rows stored column by column. The rows past
+// the end of the last panel are zero.
+template <typename Dtype>
+void PackA(const Dtype* A, bool trans, int lda, int row_begin, int rows,
+    int col_begin, int cols, Dtype* packed) {
+  for (int p = 0; p < rows; p += kMR) {
+    for (int k = 0; k < cols; ++k) {
+      for (int r = 0; r < kMR; ++r) {
+        *packed++ = p + r < rows ?
+            Element(A, trans, lda, row_begin + p + r, col_begin + k) : 0;
+      }
+    }
+  }
+}
+
+// The same for op(B), in panels of kNR columns stored row by row.
+template <typename Dtype>
+void PackB(const Dtype* B, bool trans, int ldb, int row_begin, int rows,
+    int col_begin, int cols, Dtype* packed) {
+  for (int p = 0; p < cols; p += kNR) {
+    for (int k = 0; k < rows; ++k) {
+      for (int c = 0; c < kNR; ++c) {
+        *packed++ = p + c < cols ?
+            Element(B, trans, ldb, row_begin + k, col_begin + p + c) : 0;
+      }
+    }
+  }
+}
+
+// C += alpha * a * b for one packed panel of each, writing the top left
+// rows x cols of the kMR x kNR block.
+template <typename Dtype>
+void MicroKernel(const int depth, const Dtype alpha, const Dtype* a,
+    const Dtype* b, Dtype* C, const int ldc, const int rows, const int cols) {
+  Dtype acc[kMR][kNR] = {};
+  for (int k = 0; k < depth; ++k) {
+    for (int r = 0; r < kMR; ++r) {
+      const Dtype a_r = a[r];
+      for (int c = 0; c < kNR; ++c) {
+        acc[r][c] += a_r * b[c];
+      }
+    }
+    a += kMR;
+    b += kNR;
+  }
+  for (int r = 0; r < rows; ++r) {
+    for (int c = 0; c < cols; ++c) {
+      C[r * ldc + c] += alpha * acc[r][c];
+    }
+  }
+}
+
+// C = alpha * a * op(B) + C for a row vector a: the products of inner product
+// layers at batch size 1.
+template <typename Dtype>
+void GemmRowVector(const bool trans_b, const int N, const int K,
+    const Dtype alpha, const Dtype* a, const Dtype* B, const int ldb,
+    Dtype* C) {
+  const bool parallel = static_cast<int64_t>(N) * K >= kMinParallelWork;
+  if (trans_b) {
+    // Each output is a dot product with a contiguous row of B.
+#pragma omp parallel for if (parallel)
+    for (int j = 0; j < N; ++j) {
+      C[j] += alpha * Dot(K, a, B + j * ldb);
+    }
+  } else {
+    // Stream the rows of B into a slice of C small enough to stay in L1.
+    const int kSlice = 512;
+#pragma omp parallel for if (parallel)
+    for (int j = 0; j < N; j += kSlice) {
+      const int cols = std::min(kSlice, N - j);
+      for (int k = 0; k < K; ++k) {
+        Axpy(cols, alpha * a[k], B + k * ldb + j, C + j);
+      }
+    }
+  }
+}
+
+// C = alpha * op(A) * b + C for a column vector b, with C strided by ldc.
+template <typename Dtype>
+void GemmColumnVector(const bool trans_a, const int M, const int K,
+    const Dtype alpha, const Dtype* A, const int lda, const Dtype* b,
+    Dtype* C, const int ldc) {
+  const bool parallel = static_cast<int64_t>(M) * K >= kMinParallelWork;
+  if (!trans_a) {
+#pragma omp parallel for if (parallel)
+    for (int i = 0; i < M; ++i) {
+      C[i * ldc] += alpha * Dot(K, A + i * lda, b);
+    }
+  } else if (ldc == 1) {
+    for (int k = 0; k < K; ++k) {
+      Axpy(M, alpha * b[k], A + k * lda, C);
+    }
+  } else {
+    std::vector<Dtype> c(M, Dtype(0));
+    for (int k = 0; k < K; ++k) {
+      Axpy(M, b[k], A + k * lda, &c[0]);
+    }
+    for (int i = 0; i < M; ++i) {
+      C[i * ldc] += alpha * c[i];
+    }
+  }
+}
+
+template <typename Dtype>
+void BuiltinGemm(const CBLAS_TRANSPOSE TransA, const CBLAS_TRANSPOSE TransB,
+    const int M, const int N, const int K, const Dtype alpha, const Dtype* A,
+    const int lda, const Dtype* B, const int ldb, const Dtype beta, Dtype* C,
+    const int ldc) {
+  if (M <= 0 || N <= 0) {
+    return;
+  }
+  if (beta != Dtype(1)) {
+    for (int i = 0; i < M; ++i) {
+      Dtype* c = C + i * ldc;
+      if (beta == Dtype(0)) {
+        std::fill(c, c + N, Dtype(0));
+      } else {
+        for (int j = 0; j < N; ++j) {
+          c[j] *= beta;
+        }
+      }
+    }
+  }
+  if (K <= 0 || alpha == Dtype(0)) {
+    return;
+  }
+  const bool trans_a = TransA != CblasNoTrans;
+  const bool trans_b = TransB != CblasNoTrans;
+  if (M == 1) {
+    if (!trans_a) {
+      GemmRowVector(trans_b, N, K, alpha, A, B, ldb, C);
+    } else {
+      std::vector<Dtype> a(K);
+      for (int k = 0; k < K; ++k) {
+        a[k] = A[k * lda];
+      }
+      GemmRowVector(trans_b, N, K, alpha, &a[0], B, ldb, C);
+    }
+    return;
+  }
+  if (N == 1) {
+    if (trans_b) {
+      GemmColumnVector(trans_a, M, K, alpha, A, lda, B, C, ldc);
+    } else {
+      std::vector<Dtype> b(K);
+      for (int k = 0; k < K; ++k) {
+        b[k] = B[k * ldb];
+      }
+      GemmColumnVector(trans_a, M, K, alpha, A, lda, &b[0], C, ldc);
+    }
+    return;
+  }
+  if (K == 1) {
+    // An outer product, as the layers add their biases with.
+    std::vector<Dtype> b(N);
+    for (int j = 0; j < N; ++j) {
+      b[j] = B[trans_b ? j * ldb : j];
+    }
+#pragma omp parallel for if (static_cast<int64_t>(M) * N >= kMinParallelWork)
+    for (int i = 0; i < M; ++i) {
+      Axpy(N, alpha * A[trans_a ? i : i * lda], &b[0], C + i * ldc);
+    }
+    return;
+  }
+  const bool parallel =
+      static_cast<int64_t>(M) * N * K >= kMinParallelWork && M > kMC;
+  const int num_row_blocks = (M + kMC - 1) / kMC;
+  std::vector<Dtype> packed_b(kKC * ((std::min(N, kNC) + kNR - 1) / kNR)
+      * kNR);
+  for (int jc = 0; jc < N; jc += kNC) {
+    const int nc = std::min(kNC, N - jc);
+    for (int pc = 0; pc < K; pc += kKC) {
+      const int kc = std::min(kKC, K - pc);
+      PackB(B, trans_b, ldb, pc, kc, jc, nc, &packed_b[0]);
+#pragma omp parallel if (parallel)
+      {
+        std::vector<Dtype> packed_a(kMC * kc);
+#pragma omp for
+        for (int ib = 0; ib < num_row_blocks; ++ib) {
+          const int ic = ib * kMC;
+          const int mc = std::min(kMC, M - ic);
+          PackA(A, trans_a, lda, ic, mc, pc, kc, &packed_a[0]);
+          for (int jr = 0; jr < nc; jr += kNR) {
+            for (int ir = 0; ir < mc; ir += kMR) {
+              MicroKernel(kc, alpha, &packed_a[ir * kc], &packed_b[jr * kc],
+                  C + (ic + ir) * ldc + jc + jr, ldc,
+                  std::min(kMR, mc - ir), std::min(kNR, nc - jr));
+            }
+          }
+        }
+      }
+    }
+  }
+}
+
+class BuiltinBackend : public BlasBackend {
+ public:
+  BuiltinBackend() : BlasBackend("builtin") {}
+
+  virtual void sgemm(const CBLAS_TRANSPOSE TransA,
+      const CBLAS_TRANSPOSE TransB, const int M, const int N, const int K,
+      const float alpha, const float* A, const int lda, const float* B,
+      const int ldb, const float beta, float* C, const int ldc) {
+    BuiltinGemm(TransA, TransB, M, N, K, alpha, A, lda, B, ldb, beta, C, ldc);
+  }
+  virtual void dgemm(const CBLAS_TRANSPOSE TransA,
+      const CBLAS_TRANSPOSE TransB, const int M, const int N, const int K,
+      const double alpha, const double* A, const int lda, const double* B,
+      const int ldb, const double beta, double* C, const int ldc) {
+    BuiltinGemm(TransA, TransB, M, N, K, alpha, A, lda, B, ldb, beta, C, ldc);
+  }
+  virtual void sgemv(const CBLAS_TRANSPOSE TransA, const int M, const int N,
+      const float alpha, const float* A, const float* x, const float beta,
+      float* y) {
+    Gemv(TransA, M, N, alpha, A, x, beta, y);
+  }
+  virtual void dgemv(const CBLAS_TRANSPOSE TransA, const int M, const int N,
+      const double alpha, const double* A, const double* x,
+      const double beta, double* y) {
+    Gemv(TransA, M, N, alpha, A, x, beta, y);
+  }
+  virtual void saxpy(const int N, const float alpha, const float* X,
+      float* Y) { Axpy(N, alpha, X, Y); }
+  virtual void daxpy(const int N, const double alpha, const double* X,
+      double* Y) { Axpy(N, alpha, X, Y); }
+
+ protected:
+  // As a product with a column vector (op(A) * x) or, transposed, with a row
+  // vector (x^T * A).
+  template <typename Dtype>
+  void Gemv(const CBLAS_TRANSPOSE TransA, const int M, const int N,
+      const Dtype alpha, const Dtype* A, const Dtype* x, const Dtype beta,
+      Dtype* y) {
+    if (TransA == CblasNoTrans) {
+      BuiltinGemm(CblasNoTrans, CblasNoTrans, M, 1, N, alpha, A, N, x, 1,
+          beta, y, 1);
+    } else {
+      BuiltinGemm(CblasNoTrans, CblasNoTrans, 1, N, M, alpha, x, M, A, N,
+          beta, y, N);
+    }
+  }
+};
+
+shared_ptr<BlasBackend> g_blas_backend;
+boost::once_flag g_blas_backend_once = BOOST_ONCE_INIT;
+
+void InitBlasBackend() {
+  const char* name = getenv("CAFFE_BLAS");
+  g_blas_backend = CreateBlasBackend(name && *name ? name : "cblas");
+}
+
+}  // namespace
+
+shared_ptr<BlasBackend> CreateBlasBackend(const string& name) {
+  if (name == "cblas") {
+    return shared_ptr<BlasBackend>(new CblasBackend());
+  }
+  if (name == "builtin") {
+    return shared_ptr<BlasBackend>(new BuiltinBackend());
+  }
+  CHECK_NE(name.find(".so"), string::npos) << "Unknown BLAS backend " << name
+      << ", expected cblas, builtin or the path of a shared library";
+  return shared_ptr<BlasBackend>(new SharedLibraryBackend(name));
+}
+
+BlasBackend* GetBlasBackend() {
+  boost::call_once(g_blas_backend_once, InitBlasBackend);
+  return g_blas_backend.get();
+}
+
+void SetBlasBackend(shared_ptr<BlasBackend> backend) {
+  CHECK(backend);
+  boost::call_once(g_blas_backend_once, InitBlasBackend);
+  LOG(INFO) << "Using BLAS backend " << backend->name();
+  g_blas_backend = backend;
+}
+
+}  // namespace caffe
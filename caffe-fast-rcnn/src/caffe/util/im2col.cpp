@@ -230,5 +230,137 @@ template void col2im_nd_cpu<double>(const double* data_col,
     const int* kernel_shape, const int* pad, const int* stride,
     const int* dilation, double* data_im);
 
+template <typename Dtype>
+void im2col_tile_cpu(const Dtype* data_im, const int height, const int width,
+    const int kernel_h, const int kernel_w,
+    const int pad_h, const int pad_w,
+    const int stride_h, const int stride_w,
+    const int dilation_h, const int dilation_w,
+    const int* rows, const int num_rows,
+    const int output_row_begin, const int output_row_end, Dtype* data_col) {
+  const int output_w = (width + 2 * pad_w -
+    (dilation_w * (kernel_w - 1) + 1)) / stride_w + 1;
+  const int tile_size = (output_row_end - output_row_begin) * output_w;
+  const int channel_size = height * width;
+  const int kernel_size = kernel_h * kernel_w;
+#pragma omp parallel for
+  for (int r = 0; r < num_rows; ++r) {
+    const Dtype* channel_im = data_im + (rows[r] / kernel_size) * channel_size;
+    const int kernel_row = (rows[r] % kernel_size) / kernel_w;
+    const int kernel_col = rows[r] % kernel_w;
+    Dtype* col = data_col + r * tile_size;
+    int input_row = -pad_h + kernel_row * dilation_h +
+        output_row_begin * stride_h;
+    for (int output_rows = output_row_end - output_row_begin; output_rows;
+        output_rows--) {
+      if (!is_a_ge_zero_and_a_lt_b(input_row, height)) {
+        for (int output_cols = output_w; output_cols; output_cols--) {
+          *(col++) = 0;
+        }
+      } else {
+        int input_col = -pad_w + kernel_col * dilation_w;
+        for (int output_col = output_w; output_col; output_col--) {
+          if (is_a_ge_zero_and_a_lt_b(input_col, width)) {
+            *(col++) = channel_im[input_row * width + input_col];
+          } else {
+            *(col++) = 0;
+          }
+          input_col += stride_w;
+        }
+      }
+      input_row += stride_h;
+    }
+  }
+}
+
+// Explicit instantiation
+template void im2col_tile_cpu<float>(const float* data_im, const int height,
+    const int width, const int kernel_h, const int kernel_w,
+    const int pad_h, const int pad_w, const int stride_h,
+    const int stride_w, const int dilation_h, const int dilation_w,
+    const int* rows, const int num_rows,
+    const int output_row_begin, const int output_row_end, float* data_col);
+template void im2col_tile_cpu<double>(const double* data_im, const int height,
+    const int width, const int kernel_h, const int kernel_w,
+    const int pad_h, const int pad_w, const int stride_h,
+    const int stride_w, const int dilation_h, const int dilation_w,
+    const int* rows, const int num_rows,
+    const int output_row_begin, const int output_row_end, double* data_col);
+
+template <typename Dtype>
+void im2col_rows_cpu(const Dtype* data_im, const int height, const int width,
+    const int kernel_h, const int kernel_w,
+    const int pad_h, const int pad_w,
+    const int stride_h, const int stride_w,
+    const int dilation_h, const int dilation_w,
+    const int* rows, const int num_rows, Dtype* data_col) {
+  const int output_h = (height + 2 * pad_h -
+    (dilation_h * (kernel_h - 1) + 1)) / stride_h + 1;
+  im2col_tile_cpu(data_im, height, width, kernel_h, kernel_w, pad_h, pad_w,
+      stride_h, stride_w, dilation_h, dilation_w, rows, num_rows,
+      0, output_h, data_col);
+}
+
+// Explicit instantiation
+template void im2col_rows_cpu<float>(const float* data_im, const int height,
+    const int width, const int kernel_h, const int kernel_w,
+    const int pad_h, const int pad_w, const int stride_h,
+    const int stride_w, const int dilation_h, const int dilation_w,
+    const int* rows, const int num_rows, float* data_col);
+template void im2col_rows_cpu<double>(const double* data_im, const int height,
+    const int width, const int kernel_h, const int kernel_w,
+    const int pad_h, const int pad_w, const int stride_h,
+    const int stride_w, const int dilation_h, const int dilation_w,
+    const int* rows, const int num_rows, double* data_col);
+
+template <typename Dtype>
+void col2im_rows_cpu(const Dtype* data_col, const int channels,
+    const int height, const int width, const int kernel_h, const int kernel_w,
+    const int pad_h, const int pad_w,
+    const int stride_h, const int stride_w,
+    const int dilation_h, const int dilation_w,
+    const int* rows, const int num_rows, Dtype* data_im) {
+  caffe_set(height * width * channels, Dtype(0), data_im);
+  const int output_h = (height + 2 * pad_h -
+    (dilation_h * (kernel_h - 1) + 1)) / stride_h + 1;
+  const int output_w = (width + 2 * pad_w -
+    (dilation_w * (kernel_w - 1) + 1)) / stride_w + 1;
+  const int channel_size = height * width;
+  const int kernel_size = kernel_h * kernel_w;
+  for (int r = 0; r < num_rows; ++r) {
+    Dtype* channel_im = data_im + (rows[r] / kernel_size) * channel_size;
+    const int kernel_row = (rows[r] % kernel_size) / kernel_w;
+    const int kernel_col = rows[r] % kernel_w;
+    int input_row = -pad_h + kernel_row * dilation_h;
+    for (int output_rows = output_h; output_rows; output_rows--) {
+      if (!is_a_ge_zero_and_a_lt_b(input_row, height)) {
+        data_col += output_w;
+      } else {
+        int input_col = -pad_w + kernel_col * dilation_w;
+        for (int output_col = output_w; output_col; output_col--) {
+          if (is_a_ge_zero_and_a_lt_b(input_col, width)) {
+            channel_im[input_row * width + input_col] += *data_col;
+          }
+          data_col++;
+          input_col += stride_w;
+        }
+      }
+      input_row += stride_h;
+    }
+  }
+}
+
+// Explicit instantiation
+template void col2im_rows_cpu<float>(const float* data_col, const int channels,
+    const int height, const int width, const int kernel_h, const int kernel_w,
+    const int pad_h, const int pad_w, const int stride_h,
+    const int stride_w, const int dilation_h, const int dilation_w,
+    const int* rows, const int num_rows, float* data_im);
+template void col2im_rows_cpu<double>(const double* data_col,
+    const int channels, const int height, const int width,
+    const int kernel_h, const int kernel_w,
+    const int pad_h, const int pad_w, const int stride_h,
+    const int stride_w, const int dilation_h, const int dilation_w,
+    const int* rows, const int num_rows, double* data_im);
 
 }  // namespace caffe
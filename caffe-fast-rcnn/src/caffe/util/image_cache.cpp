@@ -0,0 +1,78 @@
+#ifdef USE_OPENCV
+#include <boost/thread.hpp>
+
+#include "caffe/util/image_cache.hpp"
+
+namespace caffe {
+
+class ImageCache::sync {
+ public:
+  mutable boost::mutex mutex_;
+};
+
+static size_t ImageBytes(const cv::Mat& image) {
+  return image.total() * image.elemSize();
+}
+
+ImageCache::ImageCache(size_t capacity)
+    : capacity_(capacity), sync_(new sync()), size_(0), hits_(0),
+      misses_(0) {
+}
+
+bool ImageCache::Get(int index, cv::Mat* image) {
+  boost::mutex::scoped_lock lock(sync_->mutex_);
+  map<int, Images::iterator>::iterator position = positions_.find(index);
+  if (position == positions_.end()) {
+    ++misses_;
+    return false;
+  }
+  ++hits_;
+  images_.splice(images_.begin(), images_, position->second);
+  *image = position->second->second;
+  return true;
+}
+
+void ImageCache::Put(int index, const cv::Mat& image) {
+  const size_t bytes = ImageBytes(image);
+  if (bytes > capacity_) {
+    return;
+  }
+  boost::mutex::scoped_lock lock(sync_->mutex_);
+  map<int, Images::iterator>::iterator position = positions_.find(index);
+  if (position != positions_.end()) {
+    // Another thread decoded it too.
+    images_.splice(images_.begin(), images_, position->second);
+    return;
+  }
+  while (size_ + bytes > capacity_) {
+    size_ -= ImageBytes(images_.back().second);
+    positions_.erase(images_.back().first);
+    images_.pop_back();
+  }
+  images_.push_front(std::make_pair(index, image));
+  positions_[index] = images_.begin();
+  size_ += bytes;
+}
+
+size_t ImageCache::size() const {
+  boost::mutex::scoped_lock lock(sync_->mutex_);
+  return size_;
+}
+
+int ImageCache::count() const {
+  boost::mutex::scoped_lock lock(sync_->mutex_);
+  return positions_.size();
+}
+
+int ImageCache::hits() const {
+  boost::mutex::scoped_lock lock(sync_->mutex_);
+  return hits_;
+}
+
+int ImageCache::misses() const {
+  boost::mutex::scoped_lock lock(sync_->mutex_);
+  return misses_;
+}
+
+}  // namespace caffe
+#endif  // USE_OPENCV
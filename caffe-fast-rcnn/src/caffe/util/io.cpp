@@ -11,6 +11,7 @@
 #include <stdint.h>
 
 #include <algorithm>
+#include <cstdio>
 #include <fstream>  // NOLINT(readability/streams)
 #include <string>
 #include <vector>
@@ -65,8 +66,16 @@ bool ReadProtoFromBinaryFile(const char* filename, Message* proto) {
 }
 
 void WriteProtoToBinaryFile(const Message& proto, const char* filename) {
-  fstream output(filename, ios::out | ios::trunc | ios::binary);
-  CHECK(proto.SerializeToOstream(&output));
+  // Write to a temporary file renamed over filename once complete, so that
+  // readers never see a partially written file.
+  const string temp_filename = string(filename) + ".tmp";
+  fstream output(temp_filename.c_str(), ios::out | ios::trunc | ios::binary);
+  CHECK(proto.SerializeToOstream(&output)) << "Failed to write "
+      << temp_filename;
+  output.close();
+  CHECK(!output.fail()) << "Failed to write " << temp_filename;
+  CHECK_EQ(std::rename(temp_filename.c_str(), filename), 0)
+      << "Failed to rename " << temp_filename << " to " << filename;
 }
 
 #ifdef USE_OPENCV
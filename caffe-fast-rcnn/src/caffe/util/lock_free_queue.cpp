@@ -0,0 +1,227 @@
+#include <boost/atomic.hpp>
+#include <boost/scoped_array.hpp>
+#include <boost/thread.hpp>
+#include <stdint.h>
+
+#include <string>
+
+#include "caffe/data_reader.hpp"
+#include "caffe/layers/base_data_layer.hpp"
+#include "caffe/util/lock_free_queue.hpp"
+
+namespace caffe {
+
+// The ring buffer of D. Vyukov's bounded MPMC queue: the sequence number of
+// each cell tells whether it is free for the enqueue position that maps to it,
+// or full for the matching dequeue position.
+template<typename T>
+class LockFreeQueue<T>::sync {
+ public:
+  explicit sync(size_t capacity)
+      : cells_(new Cell[capacity]), mask_(capacity - 1), enqueue_pos_(0),
+        dequeue_pos_(0), waiters_(0) {
+    for (size_t i = 0; i < capacity; ++i) {
+      cells_[i].sequence_.store(i, boost::memory_order_relaxed);
+    }
+  }
+
+  struct Cell {
+    boost::atomic<size_t> sequence_;
+    T data_;
+  };
+
+  boost::scoped_array<Cell> cells_;
+  const size_t mask_;
+  // Keep the producer and consumer positions on separate cache lines.
+  char pad0_[64];
+  boost::atomic<size_t> enqueue_pos_;
+  char pad1_[64];
+  boost::atomic<size_t> dequeue_pos_;
+  char pad2_[64];
+  // The threads parked on condition_, waiting for an item or a free slot.
+  boost::atomic<int> waiters_;
+  boost::mutex mutex_;
+  boost::condition_variable condition_;
+};
+
+template<typename T>
+LockFreeQueue<T>::LockFreeQueue(size_t capacity, int spin_count)
+    : capacity_(1), spin_count_(spin_count) {
+  CHECK_GT(capacity, 0);
+  while (capacity_ < capacity) {
+    capacity_ *= 2;
+  }
+  sync_.reset(new sync(capacity_));
+}
+
+template<typename T>
+bool LockFreeQueue<T>::TryPush(const T& t) {
+  typename sync::Cell* cell;
+  size_t pos = sync_->enqueue_pos_.load(boost::memory_order_relaxed);
+  for (;;) {
+    cell = &sync_->cells_[pos & sync_->mask_];
+    const size_t seq = cell->sequence_.load(boost::memory_order_acquire);
+    const intptr_t diff = static_cast<intptr_t>(seq) -
+        static_cast<intptr_t>(pos);
+    if (diff == 0) {
+      if (sync_->enqueue_pos_.compare_exchange_weak(pos, pos + 1,
+          boost::memory_order_relaxed)) {
+        break;
+      }
+    } else if (diff < 0) {
+      return false;  // full
+    } else {
+      pos = sync_->enqueue_pos_.load(boost::memory_order_relaxed);
+    }
+  }
+  cell->data_ = t;
+  cell->sequence_.store(pos + 1, boost::memory_order_release);
+  return true;
+}
+
+template<typename T>
+bool LockFreeQueue<T>::TryPop(T* t) {
+  typename sync::Cell* cell;
+  size_t pos = sync_->dequeue_pos_.load(boost::memory_order_relaxed);
+  for (;;) {
+    cell = &sync_->cells_[pos & sync_->mask_];
+    const size_t seq = cell->sequence_.load(boost::memory_order_acquire);
+    const intptr_t diff = static_cast<intptr_t>(seq) -
+        static_cast<intptr_t>(pos + 1);
+    if (diff == 0) {
+      if (sync_->dequeue_pos_.compare_exchange_weak(pos, pos + 1,
+          boost::memory_order_relaxed)) {
+        break;
+      }
+    } else if (diff < 0) {
+      return false;  // empty
+    } else {
+      pos = sync_->dequeue_pos_.load(boost::memory_order_relaxed);
+    }
+  }
+  *t = cell->data_;
+  cell->sequence_.store(pos + capacity_, boost::memory_order_release);
+  return true;
+}
+
+template<typename T>
+void LockFreeQueue<T>::Notify() {
+  // Pairs with the fence in the waiters: either they see the new state, or
+  // this sees them parked.
+  boost::atomic_thread_fence(boost::memory_order_seq_cst);
+  if (sync_->waiters_.load(boost::memory_order_relaxed) > 0) {
+    boost::mutex::scoped_lock lock(sync_->mutex_);
+    sync_->condition_.notify_all();
+  }
+}
+
+template<typename T>
+void LockFreeQueue<T>::push(const T& t) {
+  for (int i = 0; i < spin_count_; ++i) {
+    if (try_push(t)) {
+      return;
+    }
+  }
+  {
+    boost::mutex::scoped_lock lock(sync_->mutex_);
+    ++sync_->waiters_;
+    boost::atomic_thread_fence(boost::memory_order_seq_cst);
+    while (!TryPush(t)) {
+      sync_->condition_.wait(lock);
+    }
+    --sync_->waiters_;
+  }
+  Notify();
+}
+
+template<typename T>
+bool LockFreeQueue<T>::try_push(const T& t) {
+  if (!TryPush(t)) {
+    return false;
+  }
+  Notify();
+  return true;
+}
+
+template<typename T>
+bool LockFreeQueue<T>::try_pop(T* t) {
+  if (!TryPop(t)) {
+    return false;
+  }
+  Notify();
+  return true;
+}
+
+template<typename T>
+T LockFreeQueue<T>::pop(const string& log_on_wait) {
+  T t;
+  for (int i = 0; i < spin_count_; ++i) {
+    if (try_pop(&t)) {
+      return t;
+    }
+  }
+  {
+    boost::mutex::scoped_lock lock(sync_->mutex_);
+    ++sync_->waiters_;
+    boost::atomic_thread_fence(boost::memory_order_seq_cst);
+    while (!TryPop(&t)) {
+      if (!log_on_wait.empty()) {
+        LOG_EVERY_N(INFO, 1000)<< log_on_wait;
+      }
+      sync_->condition_.wait(lock);
+    }
+    --sync_->waiters_;
+  }
+  Notify();
+  return t;
+}
+
+template<typename T>
+bool LockFreeQueue<T>::try_peek(T* t) {
+  size_t pos = sync_->dequeue_pos_.load(boost::memory_order_acquire);
+  for (;;) {
+    const typename sync::Cell& cell = sync_->cells_[pos & sync_->mask_];
+    const size_t seq = cell.sequence_.load(boost::memory_order_acquire);
+    if (seq == pos + 1) {
+      *t = cell.data_;
+      return true;
+    }
+    if (static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos + 1) < 0) {
+      return false;  // empty
+    }
+    pos = sync_->dequeue_pos_.load(boost::memory_order_acquire);
+  }
+}
+
+template<typename T>
+T LockFreeQueue<T>::peek() {
+  T t;
+  for (int i = 0; i < spin_count_; ++i) {
+    if (try_peek(&t)) {
+      return t;
+    }
+  }
+  boost::mutex::scoped_lock lock(sync_->mutex_);
+  ++sync_->waiters_;
+  boost::atomic_thread_fence(boost::memory_order_seq_cst);
+  while (!try_peek(&t)) {
+    sync_->condition_.wait(lock);
+  }
+  --sync_->waiters_;
+  return t;
+}
+
+template<typename T>
+size_t LockFreeQueue<T>::size() const {
+  const size_t dequeue_pos =
+      sync_->dequeue_pos_.load(boost::memory_order_acquire);
+  const size_t enqueue_pos =
+      sync_->enqueue_pos_.load(boost::memory_order_acquire);
+  return enqueue_pos > dequeue_pos ? enqueue_pos - dequeue_pos : 0;
+}
+
+template class LockFreeQueue<Batch<float>*>;
+template class LockFreeQueue<Batch<double>*>;
+template class LockFreeQueue<Datum*>;
+
+}  // namespace caffe
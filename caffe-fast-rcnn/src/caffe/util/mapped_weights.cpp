@@ -0,0 +1,170 @@
+#include <fcntl.h>
+#include <stdint.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cstring>
+#include <fstream>  // NOLINT(readability/streams)
+#include <string>
+#include <vector>
+
+#include "caffe/util/mapped_weights.hpp"
+#include "caffe/util/math_functions.hpp"
+
+namespace caffe {
+
+static const char kMappedWeightsMagic[8] = { 'C', 'A', 'F', 'F', 'E', 'M',
+    'A', 'P' };
+static const uint32_t kMappedWeightsVersion = 1;
+static const size_t kMappedWeightsAlignment = 64;
+
+static size_t AlignMapped(size_t offset) {
+  return (offset + kMappedWeightsAlignment - 1) / kMappedWeightsAlignment *
+      kMappedWeightsAlignment;
+}
+
+// The header is the magic, the version and the index size.
+static const size_t kMappedWeightsHeaderSize = sizeof(kMappedWeightsMagic) +
+    2 * sizeof(uint32_t);
+
+MappedWeights::MappedWeights(const string& filename)
+    : addr_(MAP_FAILED), size_(0), data_start_(0) {
+  int fd = open(filename.c_str(), O_RDONLY);
+  CHECK_NE(fd, -1) << "File not found: " << filename;
+  struct stat st;
+  CHECK_EQ(fstat(fd, &st), 0) << "Cannot stat " << filename;
+  size_ = st.st_size;
+  CHECK_GE(size_, kMappedWeightsHeaderSize) << filename
+      << " is not a mapped weights file";
+  // Private and writable, so weights can still be changed in place (e.g. by
+  // fine-tuning) without touching the file or the other processes.
+  addr_ = mmap(NULL, size_, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+  close(fd);
+  CHECK(addr_ != MAP_FAILED) << "Cannot map " << filename;
+
+  const char* bytes = static_cast<const char*>(addr_);
+  CHECK_EQ(memcmp(bytes, kMappedWeightsMagic, sizeof(kMappedWeightsMagic)), 0)
+      << filename << " is not a mapped weights file";
+  uint32_t version, index_size;
+  memcpy(&version, bytes + sizeof(kMappedWeightsMagic), sizeof(version));
+  memcpy(&index_size, bytes + sizeof(kMappedWeightsMagic) + sizeof(version),
+      sizeof(index_size));
+  CHECK_EQ(version, kMappedWeightsVersion) << "Unsupported mapped weights "
+      << "version in " << filename;
+  CHECK_LE(kMappedWeightsHeaderSize + index_size, size_) << "Truncated "
+      << filename;
+  CHECK(index_.ParseFromArray(bytes + kMappedWeightsHeaderSize, index_size))
+      << "Cannot parse the index of " << filename;
+  data_start_ = AlignMapped(kMappedWeightsHeaderSize + index_size);
+  for (int i = 0; i < index_.layer_size(); ++i) {
+    for (int j = 0; j < index_.layer(i).blobs_size(); ++j) {
+      const MappedBlob& blob = index_.layer(i).blobs(j);
+      CHECK_EQ(blob.offset() % kMappedWeightsAlignment, 0);
+      CHECK_LE(data_start_ + blob.offset() + blob.count() * sizeof(float),
+          size_) << "Truncated " << filename;
+    }
+  }
+}
+
+MappedWeights::~MappedWeights() {
+  if (addr_ != MAP_FAILED) {
+    munmap(addr_, size_);
+  }
+}
+
+const float* MappedWeights::data(const MappedBlob& blob) const {
+  return reinterpret_cast<const float*>(static_cast<const char*>(addr_) +
+      data_start_ + blob.offset());
+}
+
+void MappedWeights::ShareInto(const MappedBlob& blob,
+    Blob<float>* target) const {
+  CHECK_EQ(target->count(), blob.count());
+  if (blob.count() == 0) {
+    return;
+  }
+  float* source = const_cast<float*>(data(blob));
+  // A blob with spare capacity could later be reshaped past the mapped data.
+  if (target->data()->size() == blob.count() * sizeof(float)) {
+    target->data()->set_cpu_data(source);
+  } else {
+    caffe_copy(target->count(), source, target->mutable_cpu_data());
+  }
+}
+
+void MappedWeights::ShareInto(const MappedBlob& blob,
+    Blob<double>* target) const {
+  CHECK_EQ(target->count(), blob.count());
+  const float* source = data(blob);
+  double* target_data = target->mutable_cpu_data();
+  for (int i = 0; i < target->count(); ++i) {
+    target_data[i] = source[i];
+  }
+}
+
+void WriteMappedWeights(const NetParameter& param, const string& filename) {
+  MappedWeightsIndex index;
+  size_t offset = 0;
+  for (int i = 0; i < param.layer_size(); ++i) {
+    const LayerParameter& source_layer = param.layer(i);
+    MappedLayer* layer = index.add_layer();
+    layer->set_name(source_layer.name());
+    for (int j = 0; j < source_layer.blobs_size(); ++j) {
+      const BlobProto& source = source_layer.blobs(j);
+      MappedBlob* blob = layer->add_blobs();
+      BlobProto* header = blob->mutable_header();
+      if (source.has_shape()) {
+        header->mutable_shape()->CopyFrom(source.shape());
+      }
+      if (source.has_num() || source.has_channels() ||
+          source.has_height() || source.has_width()) {
+        header->set_num(source.num());
+        header->set_channels(source.channels());
+        header->set_height(source.height());
+        header->set_width(source.width());
+      }
+      blob->set_offset(offset);
+      blob->set_count(source.double_data_size() > 0 ?
+          source.double_data_size() : source.data_size());
+      offset = AlignMapped(offset + blob->count() * sizeof(float));
+    }
+  }
+  string index_bytes;
+  CHECK(index.SerializeToString(&index_bytes));
+  const uint32_t index_size = index_bytes.size();
+
+  std::ofstream output(filename.c_str(),
+      std::ios::out | std::ios::trunc | std::ios::binary);
+  CHECK(output.is_open()) << "Cannot open " << filename;
+  output.write(kMappedWeightsMagic, sizeof(kMappedWeightsMagic));
+  output.write(reinterpret_cast<const char*>(&kMappedWeightsVersion),
+      sizeof(kMappedWeightsVersion));
+  output.write(reinterpret_cast<const char*>(&index_size), sizeof(index_size));
+  output.write(index_bytes.data(), index_size);
+  const vector<char> padding(kMappedWeightsAlignment, 0);
+  const size_t data_start = AlignMapped(kMappedWeightsHeaderSize + index_size);
+  output.write(&padding[0], data_start - kMappedWeightsHeaderSize - index_size);
+  size_t written = 0;
+  for (int i = 0; i < param.layer_size(); ++i) {
+    for (int j = 0; j < param.layer(i).blobs_size(); ++j) {
+      const BlobProto& source = param.layer(i).blobs(j);
+      const MappedBlob& blob = index.layer(i).blobs(j);
+      output.write(&padding[0], blob.offset() - written);
+      if (source.double_data_size() > 0) {
+        vector<float> data(source.double_data().begin(),
+            source.double_data().end());
+        output.write(reinterpret_cast<const char*>(&data[0]),
+            data.size() * sizeof(float));
+      } else if (source.data_size() > 0) {
+        output.write(reinterpret_cast<const char*>(source.data().data()),
+            source.data_size() * sizeof(float));
+      }
+      written = blob.offset() + blob.count() * sizeof(float);
+    }
+  }
+  output.close();
+  CHECK(!output.fail()) << "Cannot write " << filename;
+}
+
+}  // namespace caffe
@@ -0,0 +1,132 @@
+#include <stdint.h>
+
+#include <algorithm>
+#include <vector>
+
+#include "caffe/util/nms.hpp"
+
+namespace caffe {
+
+static const int kNMSBlock = sizeof(uint64_t) * 8;
+
+// Boxes as a structure of arrays, so that the overlaps of one box with a
+// block of others vectorize.
+template <typename Dtype>
+struct NMSBoxes {
+  NMSBoxes(const int num_boxes, const Dtype* boxes)
+      : x1(num_boxes), y1(num_boxes), x2(num_boxes), y2(num_boxes),
+        area(num_boxes) {
+    for (int i = 0; i < num_boxes; ++i) {
+      x1[i] = boxes[4 * i];
+      y1[i] = boxes[4 * i + 1];
+      x2[i] = boxes[4 * i + 2];
+      y2[i] = boxes[4 * i + 3];
+      area[i] = (x2[i] - x1[i] + 1) * (y2[i] - y1[i] + 1);
+    }
+  }
+
+  // Returns the mask of the boxes [col_start + start, col_start + col_size)
+  // whose IoU with box i is >= thresh.
+  uint64_t OverlapMask(const int i, const int col_start, const int col_size,
+      const int start, const Dtype thresh) const {
+    const Dtype ix1 = x1[i], iy1 = y1[i], ix2 = x2[i], iy2 = y2[i];
+    const Dtype iarea = area[i];
+    const Dtype* jx1 = &x1[col_start];
+    const Dtype* jy1 = &y1[col_start];
+    const Dtype* jx2 = &x2[col_start];
+    const Dtype* jy2 = &y2[col_start];
+    const Dtype* jarea = &area[col_start];
+    unsigned char overlaps[kNMSBlock];
+    // Branch free, so that the compiler can vectorize it.
+    for (int k = 0; k < col_size; ++k) {
+      const Dtype w = std::max(Dtype(0),
+          std::min(ix2, jx2[k]) - std::max(ix1, jx1[k]) + 1);
+      const Dtype h = std::max(Dtype(0),
+          std::min(iy2, jy2[k]) - std::max(iy1, jy1[k]) + 1);
+      const Dtype inter = w * h;
+      overlaps[k] = inter / (iarea + jarea[k] - inter) >= thresh;
+    }
+    uint64_t mask = 0;
+    for (int k = start; k < col_size; ++k) {
+      mask |= static_cast<uint64_t>(overlaps[k]) << k;
+    }
+    return mask;
+  }
+
+  std::vector<Dtype> x1, y1, x2, y2, area;
+};
+
+template <typename Dtype>
+void nms_cpu(const int num_boxes, const Dtype* boxes, const Dtype thresh,
+    std::vector<int>* keep, const int max_keep) {
+  keep->clear();
+  if (num_boxes == 0) {
+    return;
+  }
+  const NMSBoxes<Dtype> soa(num_boxes, boxes);
+  const int col_blocks = (num_boxes + kNMSBlock - 1) / kNMSBlock;
+  // remv has a bit set for every box suppressed so far; mask holds the
+  // overlaps of the rows of the current block with every column block.
+  std::vector<uint64_t> remv(col_blocks, 0);
+  std::vector<uint64_t> mask(kNMSBlock * col_blocks);
+  for (int row_block = 0; row_block < col_blocks; ++row_block) {
+    const int row_start = row_block * kNMSBlock;
+    const int row_size = std::min(num_boxes - row_start, kNMSBlock);
+    const uint64_t live = ~remv[row_block];
+    if (row_size == kNMSBlock ? live == 0 :
+        (live & ((uint64_t(1) << row_size) - 1)) == 0) {
+      continue;
+    }
+#pragma omp parallel for if (col_blocks - row_block > 1)
+    for (int col_block = row_block; col_block < col_blocks; ++col_block) {
+      const int col_start = col_block * kNMSBlock;
+      const int col_size = std::min(num_boxes - col_start, kNMSBlock);
+      for (int r = 0; r < row_size; ++r) {
+        if ((live >> r) & 1) {
+          mask[r * col_blocks + col_block] = soa.OverlapMask(row_start + r,
+              col_start, col_size, col_block == row_block ? r + 1 : 0,
+              thresh);
+        }
+      }
+    }
+    for (int r = 0; r < row_size; ++r) {
+      if ((remv[row_block] >> r) & 1) {
+        continue;
+      }
+      keep->push_back(row_start + r);
+      if (static_cast<int>(keep->size()) == max_keep) {
+        return;
+      }
+      const uint64_t* row_mask = &mask[r * col_blocks];
+      for (int col_block = row_block; col_block < col_blocks; ++col_block) {
+        remv[col_block] |= row_mask[col_block];
+      }
+    }
+  }
+}
+
+template <typename Dtype>
+void nms_cpu_batched(const std::vector<int>& offsets, const Dtype* boxes,
+    const Dtype thresh, std::vector<std::vector<int> >* keep,
+    const int max_keep) {
+  const int num_groups = offsets.empty() ? 0 : offsets.size() - 1;
+  keep->resize(num_groups);
+#pragma omp parallel for schedule(dynamic)
+  for (int g = 0; g < num_groups; ++g) {
+    nms_cpu(offsets[g + 1] - offsets[g], boxes + 4 * offsets[g], thresh,
+        &(*keep)[g], max_keep);
+  }
+}
+
+template void nms_cpu<float>(const int num_boxes, const float* boxes,
+    const float thresh, std::vector<int>* keep, const int max_keep);
+template void nms_cpu<double>(const int num_boxes, const double* boxes,
+    const double thresh, std::vector<int>* keep, const int max_keep);
+template void nms_cpu_batched<float>(const std::vector<int>& offsets,
+    const float* boxes, const float thresh,
+    std::vector<std::vector<int> >* keep, const int max_keep);
+template void nms_cpu_batched<double>(const std::vector<int>& offsets,
+    const double* boxes, const double thresh,
+    std::vector<std::vector<int> >* keep, const int max_keep);
+
+}  // namespace caffe
@@ -0,0 +1,228 @@
+#include <boost/date_time/posix_time/posix_time.hpp>
+#include <boost/thread.hpp>
+
+#include <fstream>  // NOLINT(readability/streams)
+#include <iomanip>
+#include <string>
+#include <utility>
+
+#include "caffe/util/profiler.hpp"
+
+namespace caffe {
+
+class Profiler::sync {
+ public:
+  mutable boost::mutex mutex_;
+  boost::posix_time::ptime start_;
+  // Small numbers for the threads, in the order they first record an event.
+  map<boost::thread::id, int> threads_;
+};
+
+Profiler::Profiler()
+    : sync_(new sync()), max_trace_events_(0), dropped_trace_events_(0) {
+  sync_->start_ = boost::posix_time::microsec_clock::universal_time();
+}
+
+LayerProfile* Profiler::AddLayer(const string& name, const string& type) {
+  layers_.push_back(shared_ptr<LayerProfile>(
+      new LayerProfile(this, name, type)));
+  return layers_.back().get();
+}
+
+int Profiler::num_trace_events() const {
+  boost::mutex::scoped_lock lock(sync_->mutex_);
+  return events_.size();
+}
+
+int Profiler::dropped_trace_events() const {
+  boost::mutex::scoped_lock lock(sync_->mutex_);
+  return dropped_trace_events_;
+}
+
+double Profiler::Now() const {
+  return (boost::posix_time::microsec_clock::universal_time() -
+      sync_->start_).total_microseconds();
+}
+
+void Profiler::Reset() {
+  boost::mutex::scoped_lock lock(sync_->mutex_);
+  for (int i = 0; i < layers_.size(); ++i) {
+    for (int phase = 0; phase < LayerProfile::NUM_PHASES; ++phase) {
+      layers_[i]->phases[phase] = ProfileStat();
+    }
+  }
+  for (map<string, ProfileStat>::iterator it = sections_.begin();
+       it != sections_.end(); ++it) {
+    it->second = ProfileStat();
+  }
+  events_.clear();
+  dropped_trace_events_ = 0;
+  sync_->start_ = boost::posix_time::microsec_clock::universal_time();
+}
+
+ProfileStat* Profiler::Section(const string& name, const string** key) {
+  boost::mutex::scoped_lock lock(sync_->mutex_);
+  map<string, ProfileStat>::iterator it =
+      sections_.insert(std::make_pair(name, ProfileStat())).first;
+  *key = &it->first;
+  return &it->second;
+}
+
+void Profiler::AddTraceEvent(const string* name, const char* category,
+    double start, double duration) {
+  boost::mutex::scoped_lock lock(sync_->mutex_);
+  if (events_.size() >= max_trace_events_) {
+    ++dropped_trace_events_;
+    return;
+  }
+  const boost::thread::id id = boost::this_thread::get_id();
+  map<boost::thread::id, int>::iterator thread = sync_->threads_.find(id);
+  if (thread == sync_->threads_.end()) {
+    thread = sync_->threads_.insert(
+        std::make_pair(id, static_cast<int>(sync_->threads_.size()))).first;
+  }
+  TraceEvent event = {name, category, start, duration, thread->second};
+  events_.push_back(event);
+}
+
+// Write s as a JSON string.
+static void WriteString(std::ostream* out, const string& s) {
+  *out << '"';
+  for (int i = 0; i < s.size(); ++i) {
+    const char c = s[i];
+    if (c == '"' || c == '\\') {
+      *out << '\\' << c;
+    } else if (static_cast<unsigned char>(c) < 0x20) {
+      *out << "\\u" << std::hex << std::setw(4) << std::setfill('0')
+          << static_cast<int>(c) << std::dec << std::setfill(' ');
+    } else {
+      *out << c;
+    }
+  }
+  *out << '"';
+}
+
+static void WriteStat(std::ostream* out, const ProfileStat& stat) {
+  *out << "{\"calls\": " << stat.calls
+      << ", \"total_ms\": " << stat.microseconds / 1000
+      << ", \"mean_ms\": "
+      << (stat.calls ? stat.microseconds / 1000 / stat.calls : 0)
+      << ", \"bytes_allocated\": " << stat.bytes_allocated
+      << ", \"bytes_zeroed\": " << stat.bytes_zeroed
+      << ", \"reallocations\": " << stat.reallocations << "}";
+}
+
+void Profiler::ToJSON(std::ostream* out) const {
+  const std::ios::fmtflags flags = out->flags();
+  const std::streamsize precision = out->precision();
+  *out << std::fixed << std::setprecision(3);
+  *out << "{\n  \"sections\": {";
+  for (map<string, ProfileStat>::const_iterator it = sections_.begin();
+       it != sections_.end(); ++it) {
+    *out << (it == sections_.begin() ? "\n    " : ",\n    ");
+    WriteString(out, it->first);
+    *out << ": ";
+    WriteStat(out, it->second);
+  }
+  *out << "\n  },\n  \"layers\": [";
+  for (int i = 0; i < layers_.size(); ++i) {
+    const LayerProfile& layer = *layers_[i];
+    *out << (i ? ",\n    " : "\n    ") << "{\"name\": ";
+    WriteString(out, layer.name);
+    *out << ", \"type\": ";
+    WriteString(out, layer.type);
+    for (int phase = 0; phase < LayerProfile::NUM_PHASES; ++phase) {
+      *out << ",\n     \""
+          << ProfileScope::PhaseName(static_cast<LayerProfile::Phase>(phase))
+          << "\": ";
+      WriteStat(out, layer.phases[phase]);
+    }
+    *out << ",\n     \"flops\": " << layer.flops
+        << ", \"flops_left\": " << layer.flops_left << "}";
+  }
+  *out << "\n  ]\n}\n";
+  out->flags(flags);
+  out->precision(precision);
+}
+
+void Profiler::ToTrace(std::ostream* out) const {
+  const std::ios::fmtflags flags = out->flags();
+  const std::streamsize precision = out->precision();
+  *out << std::fixed << std::setprecision(0);
+  boost::mutex::scoped_lock lock(sync_->mutex_);
+  *out << "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [";
+  for (int i = 0; i < events_.size(); ++i) {
+    const TraceEvent& event = events_[i];
+    *out << (i ? ",\n" : "\n") << "{\"name\": ";
+    WriteString(out, *event.name);
+    *out << ", \"cat\": \"" << event.category << "\", \"ph\": \"X\", \"ts\": "
+        << event.start << ", \"dur\": " << event.duration
+        << ", \"pid\": 0, \"tid\": " << event.thread << "}";
+  }
+  *out << "\n]}\n";
+  out->flags(flags);
+  out->precision(precision);
+}
+
+void Profiler::WriteJSON(const string& filename) const {
+  std::ofstream out(filename.c_str());
+  CHECK(out) << "Failed to open profile file " << filename;
+  ToJSON(&out);
+}
+
+void Profiler::WriteTrace(const string& filename) const {
+  std::ofstream out(filename.c_str());
+  CHECK(out) << "Failed to open trace file " << filename;
+  ToTrace(&out);
+  LOG_IF(WARNING, dropped_trace_events_ > 0) << "The trace in " << filename
+      << " misses its last " << dropped_trace_events_ << " events";
+}
+
+const char* ProfileScope::PhaseName(LayerProfile::Phase phase) {
+  switch (phase) {
+  case LayerProfile::FORWARD:
+    return "forward";
+  case LayerProfile::BACKWARD:
+    return "backward";
+  case LayerProfile::RESHAPE:
+    return "reshape";
+  case LayerProfile::DATA_WAIT:
+    return "data_wait";
+  default:
+    LOG(FATAL) << "Unknown profile phase: " << phase;
+  }
+  return "";
+}
+
+// Wait for the kernels already launched, so that they are not counted in
+// the time of the scope, and those of the scope, so that they are.
+static void Synchronize() {
+#ifndef CPU_ONLY
+  if (Caffe::mode() == Caffe::GPU) {
+    CUDA_CHECK(cudaDeviceSynchronize());
+  }
+#endif
+}
+
+void ProfileScope::Start() {
+  Synchronize();
+  start_bytes_ = Caffe::allocated_bytes();
+  start_zeroed_ = Caffe::zeroed_bytes();
+  start_reallocations_ = Caffe::blob_reallocations();
+  start_ = profiler_->Now();
+}
+
+void ProfileScope::Stop() {
+  Synchronize();
+  const double duration = profiler_->Now() - start_;
+  ++stat_->calls;
+  stat_->microseconds += duration;
+  stat_->bytes_allocated += Caffe::allocated_bytes() - start_bytes_;
+  stat_->bytes_zeroed += Caffe::zeroed_bytes() - start_zeroed_;
+  stat_->reallocations += Caffe::blob_reallocations() - start_reallocations_;
+  if (profiler_->max_trace_events_ > 0) {
+    profiler_->AddTraceEvent(name_, category_, start_, duration);
+  }
+}
+
+}  // namespace caffe
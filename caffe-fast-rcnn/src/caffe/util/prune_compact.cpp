@@ -0,0 +1,355 @@
+#include <map>
+#include <string>
+#include <vector>
+
+#include "caffe/blob.hpp"
+#include "caffe/common.hpp"
+#include "caffe/util/prune_compact.hpp"
+
+namespace caffe {
+
+namespace {
+
+// The weights of one Convolution / InnerProduct layer, viewed as a
+// num_output x num_input matrix regardless of the storage order.
+struct CompactLayer {
+  int weights_id;        // index into the weights NetParameter
+  vector<int> shape;     // shape of the weight blob
+  vector<float> weight;
+  vector<float> bias;    // empty when the layer has no bias term
+  bool is_conv;
+  bool transpose;        // InnerProduct with transpose: true
+  bool modified;
+
+  int num_output() const {
+    return (!is_conv && transpose) ? shape[1] : shape[0];
+  }
+  int num_input() const { return weight.size() / num_output(); }
+  float& at(const int o, const int k) {
+    return (!is_conv && transpose) ? weight[k * num_output() + o] :
+        weight[o * num_input() + k];
+  }
+
+  // Keeps only the outputs and input columns flagged in keep_out / keep_in.
+  void Shrink(const vector<bool>& keep_out, const vector<bool>& keep_in) {
+    const int N = num_output();
+    const int K = num_input();
+    int new_N = 0, new_K = 0;
+    for (int o = 0; o < N; ++o) { new_N += keep_out[o]; }
+    for (int k = 0; k < K; ++k) { new_K += keep_in[k]; }
+    vector<float> shrunk;
+    shrunk.reserve(new_N * new_K);
+    if (!is_conv && transpose) {
+      for (int k = 0; k < K; ++k) {
+        for (int o = 0; o < N; ++o) {
+          if (keep_out[o] && keep_in[k]) { shrunk.push_back(at(o, k)); }
+        }
+      }
+    } else {
+      for (int o = 0; o < N; ++o) {
+        for (int k = 0; k < K; ++k) {
+          if (keep_out[o] && keep_in[k]) { shrunk.push_back(at(o, k)); }
+        }
+      }
+    }
+    weight.swap(shrunk);
+    if (bias.size()) {
+      vector<float> shrunk_bias;
+      for (int o = 0; o < N; ++o) {
+        if (keep_out[o]) { shrunk_bias.push_back(bias[o]); }
+      }
+      bias.swap(shrunk_bias);
+    }
+    if (is_conv) {
+      const int kernel_dim = K / shape[1];
+      shape[0] = new_N;
+      shape[1] = new_K / kernel_dim;
+    } else {
+      shape[transpose ? 1 : 0] = new_N;
+      shape[transpose ? 0 : 1] = new_K;
+    }
+    modified = true;
+  }
+};
+
+// A layer reading the producer's channels, reached through channel-wise
+// layers only.
+struct ChannelConsumer {
+  int layer_id;
+  // Whether a constant channel reaches the layer as the same constant at
+  // every input position (only ReLU / Dropout on the way, no padding).
+  bool foldable;
+  // negative_slope of every ReLU on the way, in order.
+  vector<float> slopes;
+};
+
+bool HasSharedParams(const LayerParameter& layer) {
+  for (int i = 0; i < layer.param_size(); ++i) {
+    if (layer.param(i).name().size()) { return true; }
+  }
+  return false;
+}
+
+bool IsCompactable(const LayerParameter& layer) {
+  if (HasSharedParams(layer) || layer.bottom_size() != 1 ||
+      layer.top_size() != 1) {
+    return false;
+  }
+  if (layer.type() == "Convolution") {
+    return layer.convolution_param().group() == 1;
+  }
+  if (layer.type() == "InnerProduct") {
+    return layer.inner_product_param().axis() == 1;
+  }
+  return false;
+}
+
+bool HasPadding(const LayerParameter& layer) {
+  if (layer.type() != "Convolution") { return false; }
+  const ConvolutionParameter& conv_param = layer.convolution_param();
+  for (int i = 0; i < conv_param.pad_size(); ++i) {
+    if (conv_param.pad(i)) { return true; }
+  }
+  return conv_param.pad_h() || conv_param.pad_w();
+}
+
+template <typename T>
+bool Contains(const T& names, const string& name) {
+  for (int i = 0; i < names.size(); ++i) {
+    if (names.Get(i) == name) { return true; }
+  }
+  return false;
+}
+
+// Collects the layers after layer `from` that read `blob`. Returns false if
+// any reader is not channel-wise or compactable, or if the blob is a net
+// output (nothing reads it).
+bool TraceConsumers(const NetParameter& param, const int from,
+    const string& blob, bool foldable, vector<float> slopes,
+    vector<ChannelConsumer>* consumers) {
+  bool consumed = false;
+  for (int i = from + 1; i < param.layer_size(); ++i) {
+    const LayerParameter& layer = param.layer(i);
+    const bool reads = Contains(layer.bottom(), blob);
+    if (reads) {
+      const string& type = layer.type();
+      if (type == "ReLU" || type == "Dropout") {
+        if (layer.bottom_size() != 1 || layer.top_size() != 1) {
+          return false;
+        }
+        // The slope only applies to readers of the ReLU's output: the later
+        // readers of blob itself if in place, else those of its top.
+        vector<float> top_slopes(slopes);
+        if (type == "ReLU") {
+          top_slopes.push_back(layer.relu_param().negative_slope());
+        }
+        if (layer.top(0) == blob) {  // in place
+          slopes.swap(top_slopes);
+          continue;
+        }
+        if (!TraceConsumers(param, i, layer.top(0), foldable, top_slopes,
+            consumers)) {
+          return false;
+        }
+      } else if (type == "Pooling" || type == "ROIPooling") {
+        if (layer.bottom(0) != blob || layer.top_size() != 1 ||
+            layer.top(0) == blob) {
+          return false;
+        }
+        if (!TraceConsumers(param, i, layer.top(0), false, slopes,
+            consumers)) {
+          return false;
+        }
+      } else if (IsCompactable(layer)) {
+        ChannelConsumer consumer;
+        consumer.layer_id = i;
+        consumer.foldable = foldable && !HasPadding(layer);
+        consumer.slopes = slopes;
+        consumers->push_back(consumer);
+      } else {
+        return false;
+      }
+      consumed = true;
+    }
+    // Stop once another layer overwrites the blob name.
+    if (!reads && Contains(layer.top(), blob)) { break; }
+  }
+  return consumed;
+}
+
+// The value a constant channel takes after the ReLUs on a path.
+float ApplySlopes(float value, const vector<float>& slopes) {
+  for (int i = 0; i < slopes.size(); ++i) {
+    if (value < 0) { value *= slopes[i]; }
+  }
+  return value;
+}
+
+bool LoadLayer(const NetParameter& param, const NetParameter& weights,
+    const int layer_id, map<int, CompactLayer>* layers) {
+  if (layers->count(layer_id)) { return true; }
+  const LayerParameter& layer = param.layer(layer_id);
+  for (int i = 0; i < weights.layer_size(); ++i) {
+    if (weights.layer(i).name() != layer.name()) { continue; }
+    const LayerParameter& source = weights.layer(i);
+    if (source.blobs_size() < 1 || source.blobs_size() > 2) { return false; }
+    CompactLayer& compact = (*layers)[layer_id];
+    compact.weights_id = i;
+    compact.is_conv = layer.type() == "Convolution";
+    compact.transpose = !compact.is_conv &&
+        layer.inner_product_param().transpose();
+    compact.modified = false;
+    Blob<float> blob;
+    blob.FromProto(source.blobs(0));
+    compact.shape = blob.shape();
+    if (!compact.is_conv) {
+      // Legacy caffemodels store InnerProduct weights as 1 x 1 x N x K.
+      const int N = layer.inner_product_param().num_output();
+      const int K = blob.count() / N;
+      compact.shape.resize(2);
+      compact.shape[0] = compact.transpose ? K : N;
+      compact.shape[1] = compact.transpose ? N : K;
+    }
+    compact.weight.assign(blob.cpu_data(), blob.cpu_data() + blob.count());
+    if (source.blobs_size() == 2) {
+      blob.FromProto(source.blobs(1));
+      compact.bias.assign(blob.cpu_data(), blob.cpu_data() + blob.count());
+    }
+    return true;
+  }
+  return false;
+}
+
+void StoreLayer(const CompactLayer& compact, NetParameter* weights) {
+  LayerParameter* layer = weights->mutable_layer(compact.weights_id);
+  BlobProto* weight = layer->mutable_blobs(0);
+  weight->Clear();
+  for (int i = 0; i < compact.shape.size(); ++i) {
+    weight->mutable_shape()->add_dim(compact.shape[i]);
+  }
+  for (int i = 0; i < compact.weight.size(); ++i) {
+    weight->add_data(compact.weight[i]);
+  }
+  if (compact.bias.size()) {
+    BlobProto* bias = layer->mutable_blobs(1);
+    bias->Clear();
+    bias->mutable_shape()->add_dim(compact.bias.size());
+    for (int i = 0; i < compact.bias.size(); ++i) {
+      bias->add_data(compact.bias[i]);
+    }
+  }
+}
+
+}  // namespace
+
+int CompactPrunedNet(const NetParameter& net_param, const NetParameter& weights,
+    NetParameter* compact_net_param, NetParameter* compact_weights) {
+  compact_net_param->CopyFrom(net_param);
+  compact_weights->CopyFrom(weights);
+  map<int, CompactLayer> layers;
+  int total_removed = 0;
+  for (int i = 0; i < net_param.layer_size(); ++i) {
+    const LayerParameter& layer = net_param.layer(i);
+    if (!IsCompactable(layer) ||
+        !LoadLayer(net_param, weights, i, &layers)) {
+      continue;
+    }
+    vector<ChannelConsumer> consumers;
+    if (!TraceConsumers(net_param, i, layer.top(0), true, vector<float>(),
+        &consumers)) {
+      LOG(INFO) << layer.name() << ": output feeds a layer that cannot be "
+                << "shrunk, keeping all channels";
+      continue;
+    }
+    CompactLayer& producer = layers[i];
+    const int channels = producer.num_output();
+    // Columns each consumer holds per input channel.
+    vector<int> spatial(consumers.size());
+    bool loaded = true;
+    for (int c = 0; c < consumers.size() && loaded; ++c) {
+      loaded = LoadLayer(net_param, weights, consumers[c].layer_id, &layers);
+      if (!loaded) { break; }
+      const CompactLayer& consumer = layers[consumers[c].layer_id];
+      loaded = consumer.num_input() % channels == 0 &&
+          (!consumer.is_conv || consumer.shape[1] == channels);
+      spatial[c] = consumer.num_input() / channels;
+    }
+    if (!loaded) {
+      LOG(INFO) << layer.name() << ": consumer weights missing or of "
+                << "unexpected shape, keeping all channels";
+      continue;
+    }
+    vector<bool> keep(channels, true);
+    int num_removed = 0;
+    for (int k = 0; k < channels && num_removed < channels - 1; ++k) {
+      bool row_pruned = true;
+      for (int j = 0; j < producer.num_input() && row_pruned; ++j) {
+        row_pruned = producer.at(k, j) == 0;
+      }
+      bool col_pruned = true;
+      for (int c = 0; c < consumers.size() && col_pruned; ++c) {
+        CompactLayer& consumer = layers[consumers[c].layer_id];
+        for (int o = 0; o < consumer.num_output() && col_pruned; ++o) {
+          for (int s = 0; s < spatial[c] && col_pruned; ++s) {
+            col_pruned = consumer.at(o, k * spatial[c] + s) == 0;
+          }
+        }
+      }
+      if (!row_pruned && !col_pruned) { continue; }
+      vector<float> values(consumers.size(), 0);
+      if (!col_pruned) {
+        // The channel is the constant bias; it can only go if that
+        // constant is zero or absorbed exactly by every consumer's bias.
+        const float b = producer.bias.size() ? producer.bias[k] : 0;
+        bool removable = true;
+        for (int c = 0; c < consumers.size() && removable; ++c) {
+          values[c] = ApplySlopes(b, consumers[c].slopes);
+          removable = values[c] == 0 || (consumers[c].foldable &&
+              layers[consumers[c].layer_id].bias.size());
+        }
+        if (!removable) { continue; }
+      }
+      for (int c = 0; c < consumers.size(); ++c) {
+        if (values[c] == 0) { continue; }
+        CompactLayer& consumer = layers[consumers[c].layer_id];
+        for (int o = 0; o < consumer.num_output(); ++o) {
+          float sum = 0;
+          for (int s = 0; s < spatial[c]; ++s) {
+            sum += consumer.at(o, k * spatial[c] + s);
+          }
+          consumer.bias[o] += values[c] * sum;
+        }
+      }
+      keep[k] = false;
+      ++num_removed;
+    }
+    if (!num_removed) { continue; }
+    producer.Shrink(keep, vector<bool>(producer.num_input(), true));
+    for (int c = 0; c < consumers.size(); ++c) {
+      CompactLayer& consumer = layers[consumers[c].layer_id];
+      vector<bool> keep_in(consumer.num_input());
+      for (int k = 0; k < keep_in.size(); ++k) {
+        keep_in[k] = keep[k / spatial[c]];
+      }
+      consumer.Shrink(vector<bool>(consumer.num_output(), true), keep_in);
+    }
+    LayerParameter* compact_layer = compact_net_param->mutable_layer(i);
+    if (producer.is_conv) {
+      compact_layer->mutable_convolution_param()->set_num_output(
+          channels - num_removed);
+    } else {
+      compact_layer->mutable_inner_product_param()->set_num_output(
+          channels - num_removed);
+    }
+    LOG(INFO) << layer.name() << ": " << channels << " -> "
+              << channels - num_removed << " output channels";
+    total_removed += num_removed;
+  }
+  for (map<int, CompactLayer>::const_iterator it = layers.begin();
+       it != layers.end(); ++it) {
+    if (it->second.modified) { StoreLayer(it->second, compact_weights); }
+  }
+  return total_removed;
+}
+
+}  // namespace caffe
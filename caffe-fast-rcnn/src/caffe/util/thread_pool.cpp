@@ -0,0 +1,74 @@
+#include <boost/bind.hpp>
+#include <boost/thread.hpp>
+
+#include "caffe/util/thread_pool.hpp"
+
+namespace caffe {
+
+class ThreadPool::sync {
+ public:
+  boost::mutex mutex_;
+  boost::condition_variable start_;
+  boost::condition_variable done_;
+};
+
+ThreadPool::ThreadPool(int num_threads)
+    : sync_(new sync()), generation_(0), num_running_(0), stop_(false) {
+  CHECK_GT(num_threads, 0) << "ThreadPool needs at least one thread";
+  for (int i = 1; i < num_threads; ++i) {
+    threads_.push_back(shared_ptr<boost::thread>(new boost::thread(
+        boost::bind(&ThreadPool::WorkerLoop, this, i))));
+  }
+}
+
+ThreadPool::~ThreadPool() {
+  {
+    boost::mutex::scoped_lock lock(sync_->mutex_);
+    stop_ = true;
+  }
+  sync_->start_.notify_all();
+  for (int i = 0; i < threads_.size(); ++i) {
+    threads_[i]->join();
+  }
+}
+
+void ThreadPool::Run(const boost::function<void(int)>& task) {
+  {
+    boost::mutex::scoped_lock lock(sync_->mutex_);
+    task_ = task;
+    num_running_ = threads_.size();
+    ++generation_;
+  }
+  sync_->start_.notify_all();
+  task(0);
+  boost::mutex::scoped_lock lock(sync_->mutex_);
+  while (num_running_ > 0) {
+    sync_->done_.wait(lock);
+  }
+  task_.clear();
+}
+
+void ThreadPool::WorkerLoop(int thread_id) {
+  int generation = 0;
+  while (true) {
+    boost::function<void(int)> task;
+    {
+      boost::mutex::scoped_lock lock(sync_->mutex_);
+      while (!stop_ && generation_ == generation) {
+        sync_->start_.wait(lock);
+      }
+      if (stop_) {
+        return;
+      }
+      generation = generation_;
+      task = task_;
+    }
+    task(thread_id);
+    boost::mutex::scoped_lock lock(sync_->mutex_);
+    if (--num_running_ == 0) {
+      sync_->done_.notify_one();
+    }
+  }
+}
+
+}  // namespace caffe
@@ -13,6 +13,7 @@ namespace bp = boost::python;
 
 #include "boost/algorithm/string.hpp"
 #include "caffe/caffe.hpp"
+#include "caffe/util/blas_backend.hpp"
 #include "caffe/util/signal_handler.h"
 #include "caffe/adaptive_probabilistic_pruning.hpp"
 
@@ -49,6 +50,15 @@ DEFINE_string(sigint_effect, "stop",
 DEFINE_string(sighup_effect, "snapshot",
              "Optional; action to take when a SIGHUP signal is received: "
              "snapshot, stop or none.");
+DEFINE_string(blas, "",
+    "Optional; the BLAS backend of CPU mode: cblas, builtin or the path of a "
+    "shared library with the CBLAS interface. Defaults to $CAFFE_BLAS or "
+    "cblas.");
+DEFINE_string(profile, "",
+    "Optional; for time, run the iterations again through Net::Forward and "
+    "Backward with profiling, and write the JSON profile to this file.");
+DEFINE_string(profile_trace, "",
+    "Optional; like profile, but write a Chrome trace to this file.");
 
 // A simple registry for caffe commands.
 typedef int (*BrewFunction)();
@@ -385,6 +395,22 @@ int time() {
     FLAGS_iterations << " ms.";
   LOG(INFO) << "Total Time: " << total_timer.MilliSeconds() << " ms.";
   LOG(INFO) << "*** Benchmark ends ***";
+  if (FLAGS_profile.size() || FLAGS_profile_trace.size()) {
+    // Unlike the benchmark above, this goes through the net, so it covers
+    // Python layers, forward_threads and the waits of the data layers.
+    LOG(INFO) << "Profiling " << FLAGS_iterations << " iterations.";
+    caffe_net.set_profiling(true);
+    if (FLAGS_profile_trace.size()) {
+      caffe_net.profiler()->set_max_trace_events(100000);
+    }
+    for (int j = 0; j < FLAGS_iterations; ++j) {
+      float loss;
+      caffe_net.Forward(vector<Blob<float>*>(), &loss);
+      caffe_net.Backward();
+    }
+    caffe_net.set_profiling(false);
+    caffe_net.WriteProfile(FLAGS_profile, FLAGS_profile_trace);
+  }
   return 0;
 }
 RegisterBrewFunction(time);
@@ -404,6 +430,9 @@ int main(int argc, char** argv) {
       "  time            benchmark model execution time");
   // Run tool or show usage.
   caffe::GlobalInit(&argc, &argv);
+  if (FLAGS_blas.size()) {
+    caffe::SetBlasBackend(caffe::CreateBlasBackend(FLAGS_blas));
+  }
   if (argc == 2) {
 #ifdef WITH_PYTHON_LAYER
     try {
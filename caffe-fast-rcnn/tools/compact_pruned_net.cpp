@@ -0,0 +1,39 @@
+// This is a script to turn a structurally pruned net into a smaller dense
+// one: output channels zeroed by row / column pruning are removed from the
+// prototxt and the caffemodel, so the pruning speedup shows up at inference.
+// Usage:
+//    compact_pruned_net net_proto_file_in pruned_weights_in
+//        net_proto_file_out compact_weights_out
+
+#include <string>
+
+#include "caffe/caffe.hpp"
+#include "caffe/util/io.hpp"
+#include "caffe/util/prune_compact.hpp"
+#include "caffe/util/upgrade_proto.hpp"
+
+using namespace caffe;  // NOLINT(build/namespaces)
+
+int main(int argc, char** argv) {
+  ::google::InitGoogleLogging(argv[0]);
+  FLAGS_alsologtostderr = 1;
+  if (argc != 5) {
+    LOG(ERROR) << "Usage: compact_pruned_net net_proto_file_in "
+        << "pruned_weights_in net_proto_file_out compact_weights_out";
+    return 1;
+  }
+
+  NetParameter net_param, weights;
+  ReadNetParamsFromTextFileOrDie(string(argv[1]), &net_param);
+  ReadNetParamsFromBinaryFileOrDie(string(argv[2]), &weights);
+
+  NetParameter compact_net_param, compact_weights;
+  const int num_removed = CompactPrunedNet(net_param, weights,
+      &compact_net_param, &compact_weights);
+
+  WriteProtoToTextFile(compact_net_param, argv[3]);
+  WriteProtoToBinaryFile(compact_weights, argv[4]);
+  LOG(INFO) << "Removed " << num_removed << " pruned output channels; wrote "
+      << argv[3] << " and " << argv[4];
+  return 0;
+}
@@ -0,0 +1,104 @@
+// This program compares the CPU forward pass of a convolution layer that
+// builds the whole im2col buffer with the one that builds it tile by tile
+// (ConvolutionParameter.im2col_tile_bytes). For each it reports the time per
+// forward pass and the memory the first pass adds to the resident set, which
+// is mostly the column buffer.
+// Usage:
+//    conv_benchmark [--num=1] [--channels=64] [--height=600] [--width=1000]
+//        [--num_output=64] [--kernel_size=3] [--pad=1] [--stride=1]
+//        [--tile_bytes=262144] [--iterations=5]
+
+#include <unistd.h>
+
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include "gflags/gflags.h"
+#include "glog/logging.h"
+
+#include "caffe/blob.hpp"
+#include "caffe/filler.hpp"
+#include "caffe/layers/conv_layer.hpp"
+#include "caffe/util/benchmark.hpp"
+
+using namespace caffe;  // NOLINT(build/namespaces)
+
+DEFINE_int32(num, 1, "The batch size");
+DEFINE_int32(channels, 64, "The input channels");
+DEFINE_int32(height, 600, "The input height");
+DEFINE_int32(width, 1000, "The input width");
+DEFINE_int32(num_output, 64, "The output channels");
+DEFINE_int32(kernel_size, 3, "The kernel size");
+DEFINE_int32(pad, 1, "The padding");
+DEFINE_int32(stride, 1, "The stride");
+DEFINE_int32(tile_bytes, 262144,
+    "The im2col tile size of the tiled run, e.g. the L2 cache size");
+DEFINE_int32(iterations, 5, "The number of timed forward passes");
+
+// The resident set size in bytes.
+static double ResidentBytes() {
+  long pages = 0, resident = 0;  // NOLINT(runtime/int)
+  FILE* statm = fopen("/proc/self/statm", "r");
+  if (statm) {
+    CHECK_EQ(2, fscanf(statm, "%ld %ld", &pages, &resident));
+    fclose(statm);
+  }
+  return static_cast<double>(resident) * sysconf(_SC_PAGESIZE);
+}
+
+static void Run(const string& name, int tile_bytes, Blob<float>* bottom) {
+  LayerParameter layer_param;
+  layer_param.set_phase(TEST);
+  ConvolutionParameter* conv_param = layer_param.mutable_convolution_param();
+  conv_param->set_num_output(FLAGS_num_output);
+  conv_param->add_kernel_size(FLAGS_kernel_size);
+  conv_param->add_pad(FLAGS_pad);
+  conv_param->add_stride(FLAGS_stride);
+  conv_param->set_im2col_tile_bytes(tile_bytes);
+  conv_param->mutable_weight_filler()->set_type("gaussian");
+  ConvolutionLayer<float> layer(layer_param);
+  Blob<float> top;
+  vector<Blob<float>*> bottom_vec(1, bottom), top_vec(1, &top);
+  layer.SetUp(bottom_vec, top_vec);
+  top.mutable_cpu_data();
+
+  const double resident = ResidentBytes();
+  layer.Forward(bottom_vec, top_vec);
+  const double added = ResidentBytes() - resident;
+  CPUTimer timer;
+  timer.Start();
+  for (int i = 0; i < FLAGS_iterations; ++i) {
+    layer.Forward(bottom_vec, top_vec);
+  }
+  timer.Stop();
+  LOG(INFO) << name << ": " << timer.MilliSeconds() / FLAGS_iterations
+      << " ms per forward pass, first pass added " << added / (1 << 20)
+      << " MB to the resident set";
+}
+
+int main(int argc, char** argv) {
+  ::google::InitGoogleLogging(argv[0]);
+  FLAGS_alsologtostderr = 1;
+
+#ifndef GFLAGS_GFLAGS_H_
+  namespace gflags = google;
+#endif
+
+  gflags::SetUsageMessage("Compare whole and tiled im2col convolution\n"
+        "Usage:\n"
+        "    conv_benchmark [FLAGS]\n");
+  gflags::ParseCommandLineFlags(&argc, &argv, true);
+  CHECK_GT(FLAGS_tile_bytes, 0);
+  CHECK_GT(FLAGS_iterations, 0);
+
+  Blob<float> bottom(FLAGS_num, FLAGS_channels, FLAGS_height, FLAGS_width);
+  FillerParameter filler_param;
+  GaussianFiller<float> filler(filler_param);
+  filler.Fill(&bottom);
+  LOG(INFO) << "Input " << bottom.shape_string() << ", " << FLAGS_num_output
+      << " outputs, kernel " << FLAGS_kernel_size;
+  Run("Whole im2col buffer", 0, &bottom);
+  Run("Tiled im2col", FLAGS_tile_bytes, &bottom);
+  return 0;
+}
@@ -0,0 +1,29 @@
+// This is a script to convert a caffemodel into a .caffemap weights file,
+// which nets map into memory instead of parsing and copying it.
+// Usage:
+//    convert_caffemodel_to_caffemap weights_in weights_out.caffemap
+
+#include <string>
+
+#include "caffe/caffe.hpp"
+#include "caffe/util/io.hpp"
+#include "caffe/util/mapped_weights.hpp"
+#include "caffe/util/upgrade_proto.hpp"
+
+using namespace caffe;  // NOLINT(build/namespaces)
+
+int main(int argc, char** argv) {
+  ::google::InitGoogleLogging(argv[0]);
+  FLAGS_alsologtostderr = 1;
+  if (argc != 3) {
+    LOG(ERROR) << "Usage: convert_caffemodel_to_caffemap weights_in "
+        << "weights_out.caffemap";
+    return 1;
+  }
+
+  NetParameter weights;
+  ReadNetParamsFromBinaryFileOrDie(string(argv[1]), &weights);
+  WriteMappedWeights(weights, argv[2]);
+  LOG(INFO) << "Wrote " << argv[2];
+  return 0;
+}
@@ -0,0 +1,205 @@
+// This program finds the fastest BLAS backend for a model on this host. It
+// runs one forward pass of the model to record the shapes of its GEMM and GEMV
+// calls, then times each shape on each backend and reports the time per shape
+// and per forward pass, weighted by how often the model makes each call.
+// Usage:
+//    gemm_benchmark --model=deploy.prototxt [--backends=cblas,builtin]
+//        [--iterations=10]
+// A backend is cblas, builtin or the path of a shared library with the CBLAS
+// interface, e.g. /opt/intel/mkl/lib/intel64/libmkl_rt.so.
+
+#include <algorithm>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "boost/algorithm/string.hpp"
+#include "boost/thread/mutex.hpp"
+#include "gflags/gflags.h"
+#include "glog/logging.h"
+
+#include "caffe/blob.hpp"
+#include "caffe/filler.hpp"
+#include "caffe/net.hpp"
+#include "caffe/util/benchmark.hpp"
+#include "caffe/util/blas_backend.hpp"
+
+using namespace caffe;  // NOLINT(build/namespaces)
+
+DEFINE_string(model, "", "The model definition protocol buffer text file");
+DEFINE_string(backends, "cblas,builtin",
+    "The backends to compare, separated by ','");
+DEFINE_int32(iterations, 10, "The number of timed calls per shape");
+
+// A GEMM of op(A) (M x K) and op(B) (K x N), or a GEMV with N = 1 of op(A)
+// (M x K).
+struct Shape {
+  bool gemv;
+  CBLAS_TRANSPOSE trans_a;
+  CBLAS_TRANSPOSE trans_b;
+  int M, N, K;
+
+  bool operator<(const Shape& other) const {
+    if (gemv != other.gemv) return gemv < other.gemv;
+    if (trans_a != other.trans_a) return trans_a < other.trans_a;
+    if (trans_b != other.trans_b) return trans_b < other.trans_b;
+    if (M != other.M) return M < other.M;
+    if (N != other.N) return N < other.N;
+    return K < other.K;
+  }
+
+  string name() const {
+    std::ostringstream stream;
+    stream << (gemv ? "gemv " : "gemm ")
+        << (trans_a == CblasNoTrans ? "N" : "T");
+    if (!gemv) {
+      stream << (trans_b == CblasNoTrans ? "N" : "T");
+    }
+    stream << " M=" << M << " N=" << N << " K=" << K;
+    return stream.str();
+  }
+};
+
+// Counts the float calls by shape and passes every call on to the backend it
+// wraps. Layers with batch_threads > 1 call it from several threads.
+class RecordingBackend : public BlasBackend {
+ public:
+  explicit RecordingBackend(BlasBackend* backend)
+      : BlasBackend("recording"), backend_(backend) {}
+
+  const std::map<Shape, int>& calls() const { return calls_; }
+
+  virtual void sgemm(const CBLAS_TRANSPOSE TransA,
+      const CBLAS_TRANSPOSE TransB, const int M, const int N, const int K,
+      const float alpha, const float* A, const int lda, const float* B,
+      const int ldb, const float beta, float* C, const int ldc) {
+    Shape shape = {false, TransA, TransB, M, N, K};
+    Record(shape);
+    backend_->sgemm(TransA, TransB, M, N, K, alpha, A, lda, B, ldb, beta, C,
+        ldc);
+  }
+  virtual void dgemm(const CBLAS_TRANSPOSE TransA,
+      const CBLAS_TRANSPOSE TransB, const int M, const int N, const int K,
+      const double alpha, const double* A, const int lda, const double* B,
+      const int ldb, const double beta, double* C, const int ldc) {
+    backend_->dgemm(TransA, TransB, M, N, K, alpha, A, lda, B, ldb, beta, C,
+        ldc);
+  }
+  virtual void sgemv(const CBLAS_TRANSPOSE TransA, const int M, const int N,
+      const float alpha, const float* A, const float* x, const float beta,
+      float* y) {
+    // Stored as op(A) (M x K) times a vector.
+    Shape shape = {true, TransA, CblasNoTrans,
+        TransA == CblasNoTrans ? M : N, 1, TransA == CblasNoTrans ? N : M};
+    Record(shape);
+    backend_->sgemv(TransA, M, N, alpha, A, x, beta, y);
+  }
+  virtual void dgemv(const CBLAS_TRANSPOSE TransA, const int M, const int N,
+      const double alpha, const double* A, const double* x,
+      const double beta, double* y) {
+    backend_->dgemv(TransA, M, N, alpha, A, x, beta, y);
+  }
+  virtual void saxpy(const int N, const float alpha, const float* X,
+      float* Y) { backend_->saxpy(N, alpha, X, Y); }
+  virtual void daxpy(const int N, const double alpha, const double* X,
+      double* Y) { backend_->daxpy(N, alpha, X, Y); }
+
+ protected:
+  void Record(const Shape& shape) {
+    boost::mutex::scoped_lock lock(mutex_);
+    ++calls_[shape];
+  }
+
+  BlasBackend* backend_;
+  boost::mutex mutex_;
+  std::map<Shape, int> calls_;
+};
+
+// The milliseconds per call of the shape on the backend.
+static double Time(BlasBackend* backend, const Shape& shape) {
+  const int rows_a = shape.trans_a == CblasNoTrans ? shape.M : shape.K;
+  const int rows_b = shape.trans_b == CblasNoTrans ? shape.K : shape.N;
+  Blob<float> A(1, 1, shape.M, shape.K), B(1, 1, shape.K, shape.N),
+      C(1, 1, shape.M, shape.N);
+  FillerParameter filler_param;
+  GaussianFiller<float> filler(filler_param);
+  filler.Fill(&A);
+  filler.Fill(&B);
+  const float* a = A.cpu_data();
+  const float* b = B.cpu_data();
+  float* c = C.mutable_cpu_data();
+  CPUTimer timer;
+  for (int i = 0; i <= FLAGS_iterations; ++i) {
+    // The first call warms up the caches and the threads of the backend.
+    if (i == 1) {
+      timer.Start();
+    }
+    if (shape.gemv) {
+      backend->sgemv(shape.trans_a, rows_a, A.count() / rows_a, 1.f, a, b,
+          0.f, c);
+    } else {
+      backend->sgemm(shape.trans_a, shape.trans_b, shape.M, shape.N, shape.K,
+          1.f, a, A.count() / rows_a, b, B.count() / rows_b, 0.f, c,
+          shape.N);
+    }
+  }
+  timer.Stop();
+  return timer.MicroSeconds() / 1000 / FLAGS_iterations;
+}
+
+int main(int argc, char** argv) {
+  ::google::InitGoogleLogging(argv[0]);
+  FLAGS_alsologtostderr = 1;
+
+#ifndef GFLAGS_GFLAGS_H_
+  namespace gflags = google;
+#endif
+
+  gflags::SetUsageMessage("Time the GEMM shapes of a model on BLAS backends\n"
+        "Usage:\n"
+        "    gemm_benchmark --model=deploy.prototxt [FLAGS]\n");
+  gflags::ParseCommandLineFlags(&argc, &argv, true);
+  CHECK_GT(FLAGS_model.size(), 0) << "Need a model definition to benchmark.";
+  CHECK_GT(FLAGS_iterations, 0);
+  vector<string> names;
+  boost::split(names, FLAGS_backends, boost::is_any_of(","));
+  vector<shared_ptr<BlasBackend> > backends;
+  for (int i = 0; i < names.size(); ++i) {
+    backends.push_back(CreateBlasBackend(names[i]));
+  }
+
+  Caffe::set_mode(Caffe::CPU);
+  Net<float> net(FLAGS_model, TEST);
+  shared_ptr<RecordingBackend> recorder(
+      new RecordingBackend(backends[0].get()));
+  SetBlasBackend(recorder);
+  net.ForwardPrefilled();
+  SetBlasBackend(backends[0]);
+  const std::map<Shape, int>& calls = recorder->calls();
+  LOG(INFO) << "A forward pass of " << net.name() << " makes " << calls.size()
+      << " distinct GEMM and GEMV calls";
+
+  vector<double> totals(backends.size(), 0);
+  for (std::map<Shape, int>::const_iterator it = calls.begin();
+       it != calls.end(); ++it) {
+    std::ostringstream line;
+    line << it->first.name() << " x" << it->second << ":";
+    for (int i = 0; i < backends.size(); ++i) {
+      const double ms = Time(backends[i].get(), it->first);
+      totals[i] += ms * it->second;
+      line << " " << backends[i]->name() << " " << ms << " ms";
+    }
+    LOG(INFO) << line.str();
+  }
+  int fastest = 0;
+  for (int i = 0; i < backends.size(); ++i) {
+    LOG(INFO) << backends[i]->name() << ": " << totals[i]
+        << " ms of GEMM and GEMV per forward pass";
+    if (totals[i] < totals[fastest]) {
+      fastest = i;
+    }
+  }
+  LOG(INFO) << "Fastest backend: " << backends[fastest]->name();
+  return 0;
+}
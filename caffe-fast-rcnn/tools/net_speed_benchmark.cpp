@@ -1,7 +1,397 @@
-#include "caffe/caffe.hpp"
+// This program measures the latency and throughput of a net's forward pass
+// over the input sizes and ROI counts a detection service sees. For each ROI
+// count and input shape it reports:
+//  - the time of Net::Reshape when the input shape changes, and of the first
+//    forward pass at the new shape, which allocates the larger blobs, with
+//    the blobs reallocated and the bytes zeroed by both;
+//  - the p50/p95/p99 and mean latency of a forward pass after warming up, and
+//    how much of it the layers spend in Reshape;
+//  - the throughput with several threads, each forwarding its own copy of the
+//    net with shared weights;
+//  - the peak resident set size so far.
+// Usage:
+//    net_speed_benchmark --model=test.prototxt [--weights=model.caffemodel]
+//        [--shapes=600x1000,800x1333,1000x600] [--rois=300] [--threads=1,2,4]
+//        [--iterations=50] [--warmup=5] [--gpu=0] [--zero_fill=false]
+//        [--output=results.json]
+// The input blob "data", or else the first 4-D input, takes each shape as
+// height x width; "im_info" gets (height, width, 1). An ROI count sets
+// post_nms_topn of the Proposal layers, or the number of random boxes in a
+// "rois" input.
+
+#include <sys/resource.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>  // NOLINT(readability/streams)
+#include <string>
+#include <vector>
+
+#include "boost/algorithm/string.hpp"
+#include "boost/bind.hpp"
+#include "boost/thread.hpp"
+#include "gflags/gflags.h"
+#include "glog/logging.h"
+
+#include "caffe/blob.hpp"
+#include "caffe/filler.hpp"
+#include "caffe/net.hpp"
+#include "caffe/util/benchmark.hpp"
+#include "caffe/util/math_functions.hpp"
+#include "caffe/util/profiler.hpp"
+#include "caffe/util/upgrade_proto.hpp"
+
+using namespace caffe;  // NOLINT(build/namespaces)
+
+DEFINE_string(model, "", "The model definition protocol buffer text file");
+DEFINE_string(weights, "",
+    "Optional; the trained weights, instead of the fillers of the model");
+DEFINE_string(shapes, "600x1000,800x1333,1000x600",
+    "The input sizes as heightxwidth, separated by ','");
+DEFINE_string(rois, "",
+    "Optional; the ROI counts, separated by ','. Defaults to the model's own");
+DEFINE_string(threads, "1",
+    "The thread counts to measure the throughput with, separated by ','");
+DEFINE_int32(iterations, 50, "The number of timed forward passes per shape");
+DEFINE_int32(warmup, 5, "The number of untimed forward passes per shape");
+DEFINE_int32(gpu, -1, "Optional; the GPU to run on instead of the CPU");
+DEFINE_bool(zero_fill, true,
+    "Whether the net zeroes new blob memory (zero_fill_activations)");
+DEFINE_string(output, "", "Optional; write the results as JSON to this file");
+
+// What is measured for one ROI count and input shape.
+struct Result {
+  // 0 for the model's own.
+  int rois;
+  int height, width;
+  double reshape_ms;
+  double first_forward_ms;
+  // Of the reshape and the first forward pass.
+  size_t reallocations;
+  double zeroed_mb;
+  double p50_ms, p95_ms, p99_ms, mean_ms;
+  // The time per forward pass the layers spend in Reshape.
+  double layer_reshape_ms;
+  vector<int> threads;
+  vector<double> images_per_second;
+  double peak_rss_mb;
+};
+
+static vector<int> ParseInts(const string& list) {
+  vector<string> items;
+  boost::split(items, list, boost::is_any_of(","));
+  vector<int> values;
+  for (int i = 0; i < items.size(); ++i) {
+    if (!items[i].empty()) {
+      values.push_back(atoi(items[i].c_str()));
+      CHECK_GT(values.back(), 0) << "Bad number in " << list;
+    }
+  }
+  return values;
+}
+
+// The peak resident set size in megabytes.
+static double PeakResidentMegabytes() {
+  struct rusage usage;
+  CHECK_EQ(0, getrusage(RUSAGE_SELF, &usage));
+  return usage.ru_maxrss / 1024.;  // ru_maxrss is in kilobytes.
+}
+
+// The p-th percentile of the sorted times, by nearest rank.
+static double Percentile(const vector<double>& sorted, double p) {
+  const int rank = static_cast<int>(std::ceil(p / 100 * sorted.size()));
+  return sorted[std::max(rank - 1, 0)];
+}
+
+static void SetMode() {
+  if (FLAGS_gpu >= 0) {
+    Caffe::SetDevice(FLAGS_gpu);
+    Caffe::set_mode(Caffe::GPU);
+  } else {
+    Caffe::set_mode(Caffe::CPU);
+  }
+}
+
+// The input blob of the net with the name, or NULL.
+static Blob<float>* Input(Net<float>* net, const string& name) {
+  for (int i = 0; i < net->num_inputs(); ++i) {
+    if (net->blob_names()[net->input_blob_indices()[i]] == name) {
+      return net->input_blobs()[i];
+    }
+  }
+  return NULL;
+}
+
+// The image blob of the net.
+static Blob<float>* ImageInput(Net<float>* net) {
+  Blob<float>* data = Input(net, "data");
+  if (data && data->num_axes() == 4) {
+    return data;
+  }
+  for (int i = 0; i < net->num_inputs(); ++i) {
+    if (net->input_blobs()[i]->num_axes() == 4) {
+      return net->input_blobs()[i];
+    }
+  }
+  LOG(FATAL) << "The net has no 4-D input to take the image shapes";
+  return NULL;
+}
+
+// Shape the inputs for a height x width image and fill them.
+static void SetInputs(Net<float>* net, int height, int width, int rois) {
+  Blob<float>* data = ImageInput(net);
+  data->Reshape(data->num(), data->channels(), height, width);
+  FillerParameter filler_param;
+  filler_param.set_std(50);
+  GaussianFiller<float> filler(filler_param);
+  filler.Fill(data);
+  Blob<float>* im_info = Input(net, "im_info");
+  if (im_info) {
+    CHECK_GE(im_info->count(), 3) << "im_info must be (height, width, scale)";
+    float* info = im_info->mutable_cpu_data();
+    info[0] = height;
+    info[1] = width;
+    info[2] = 1;
+  }
+  Blob<float>* boxes = Input(net, "rois");
+  if (rois > 0 && boxes) {
+    boxes->Reshape(rois, 5, 1, 1);
+    float* box = boxes->mutable_cpu_data();
+    for (int i = 0; i < rois; ++i, box += 5) {
+      const float x = caffe_rng_rand() % width;
+      const float y = caffe_rng_rand() % height;
+      box[0] = 0;
+      box[1] = x;
+      box[2] = y;
+      box[3] = x + caffe_rng_rand() % (width - static_cast<int>(x));
+      box[4] = y + caffe_rng_rand() % (height - static_cast<int>(y));
+    }
+  }
+}
+
+// Copy the input blobs of one net to another.
+static void CopyInputs(const Net<float>& from, Net<float>* to) {
+  for (int i = 0; i < from.num_inputs(); ++i) {
+    to->input_blobs()[i]->CopyFrom(*from.input_blobs()[i], false, true);
+  }
+}
+
+// Forward the net warmup times, wait at the barrier, then forward it
+// iterations times.
+static void Forward(Net<float>* net, boost::barrier* barrier) {
+  SetMode();
+  for (int i = 0; i < FLAGS_warmup; ++i) {
+    net->ForwardPrefilled();
+  }
+  barrier->wait();
+  for (int i = 0; i < FLAGS_iterations; ++i) {
+    net->ForwardPrefilled();
+  }
+}
+
+// The images per second of threads nets forwarding at once.
+static double Throughput(const vector<shared_ptr<Net<float> > >& nets,
+    int threads) {
+  boost::barrier barrier(threads + 1);
+  boost::thread_group group;
+  for (int i = 0; i < threads; ++i) {
+    if (i > 0) {
+      CopyInputs(*nets[0], nets[i].get());
+    }
+    group.create_thread(boost::bind(&Forward, nets[i].get(), &barrier));
+  }
+  barrier.wait();
+  CPUTimer timer;
+  timer.Start();
+  group.join_all();
+  timer.Stop();
+  const int images =
+      threads * FLAGS_iterations * ImageInput(nets[0].get())->num();
+  return images / (timer.MicroSeconds() / 1e6);
+}
+
+static Result Measure(const vector<shared_ptr<Net<float> > >& nets,
+    int rois, int height, int width, const vector<int>& threads) {
+  Result result;
+  result.rois = rois;
+  result.height = height;
+  result.width = width;
+  Net<float>* net = nets[0].get();
+  SetInputs(net, height, width, rois);
+  const size_t reallocations = Caffe::blob_reallocations();
+  const size_t zeroed_bytes = Caffe::zeroed_bytes();
+  CPUTimer timer;
+  timer.Start();
+  net->Reshape();
+  timer.Stop();
+  result.reshape_ms = timer.MicroSeconds() / 1000;
+  timer.Start();
+  net->ForwardPrefilled();
+  timer.Stop();
+  result.first_forward_ms = timer.MicroSeconds() / 1000;
+  result.reallocations = Caffe::blob_reallocations() - reallocations;
+  result.zeroed_mb = (Caffe::zeroed_bytes() - zeroed_bytes) / 1048576.;
+  for (int i = 0; i < FLAGS_warmup; ++i) {
+    net->ForwardPrefilled();
+  }
+
+  net->set_profiling(true);
+  net->profiler()->Reset();
+  vector<double> times;
+  for (int i = 0; i < FLAGS_iterations; ++i) {
+    timer.Start();
+    net->ForwardPrefilled();
+    timer.Stop();
+    times.push_back(timer.MicroSeconds() / 1000);
+  }
+  net->set_profiling(false);
+  double layer_reshape_us = 0;
+  for (int i = 0; i < net->profiler()->num_layers(); ++i) {
+    layer_reshape_us +=
+        net->profiler()->layer(i)->phases[LayerProfile::RESHAPE].microseconds;
+  }
+  result.layer_reshape_ms = layer_reshape_us / 1000 / FLAGS_iterations;
+  std::sort(times.begin(), times.end());
+  result.p50_ms = Percentile(times, 50);
+  result.p95_ms = Percentile(times, 95);
+  result.p99_ms = Percentile(times, 99);
+  double total = 0;
+  for (int i = 0; i < times.size(); ++i) {
+    total += times[i];
+  }
+  result.mean_ms = total / times.size();
+
+  for (int i = 0; i < threads.size(); ++i) {
+    if (threads[i] <= nets.size()) {
+      result.threads.push_back(threads[i]);
+      result.images_per_second.push_back(Throughput(nets, threads[i]));
+    }
+  }
+  result.peak_rss_mb = PeakResidentMegabytes();
+  return result;
+}
+
+static void Log(const Result& result) {
+  LOG(INFO) << result.height << "x" << result.width << " rois "
+      << result.rois << ": reshape " << result.reshape_ms
+      << " ms, first forward " << result.first_forward_ms << " ms ("
+      << result.reallocations << " blobs reallocated, " << result.zeroed_mb
+      << " MB zeroed)";
+  LOG(INFO) << "    latency p50 " << result.p50_ms << " ms, p95 "
+      << result.p95_ms << " ms, p99 " << result.p99_ms << " ms, mean "
+      << result.mean_ms << " ms, of which layer reshapes "
+      << result.layer_reshape_ms << " ms";
+  for (int i = 0; i < result.threads.size(); ++i) {
+    LOG(INFO) << "    " << result.threads[i] << " threads: "
+        << result.images_per_second[i] << " images/s";
+  }
+  LOG(INFO) << "    peak RSS " << result.peak_rss_mb << " MB";
+}
+
+static void WriteJSON(const vector<Result>& results, const string& filename) {
+  std::ofstream out(filename.c_str());
+  CHECK(out) << "Failed to open " << filename;
+  out << "[";
+  for (int i = 0; i < results.size(); ++i) {
+    const Result& r = results[i];
+    out << (i ? ",\n " : "\n ") << "{\"height\": " << r.height
+        << ", \"width\": " << r.width << ", \"rois\": " << r.rois
+        << ", \"reshape_ms\": " << r.reshape_ms
+        << ", \"first_forward_ms\": " << r.first_forward_ms
+        << ", \"reallocations\": " << r.reallocations
+        << ", \"zeroed_mb\": " << r.zeroed_mb
+        << ", \"p50_ms\": " << r.p50_ms << ", \"p95_ms\": " << r.p95_ms
+        << ", \"p99_ms\": " << r.p99_ms << ", \"mean_ms\": " << r.mean_ms
+        << ", \"layer_reshape_ms\": " << r.layer_reshape_ms
+        << ", \"images_per_second\": {";
+    for (int j = 0; j < r.threads.size(); ++j) {
+      out << (j ? ", " : "") << "\"" << r.threads[j] << "\": "
+          << r.images_per_second[j];
+    }
+    out << "}, \"peak_rss_mb\": " << r.peak_rss_mb << "}";
+  }
+  out << "\n]\n";
+}
 
 int main(int argc, char** argv) {
-  LOG(FATAL) << "Deprecated. Use caffe time --model=... "
-             "[--iterations=50] [--gpu] [--device_id=0]";
+  ::google::InitGoogleLogging(argv[0]);
+  FLAGS_alsologtostderr = 1;
+
+#ifndef GFLAGS_GFLAGS_H_
+  namespace gflags = google;
+#endif
+
+  gflags::SetUsageMessage("Measure the forward latency and throughput of a "
+        "net over input sizes\n"
+        "Usage:\n"
+        "    net_speed_benchmark --model=test.prototxt [FLAGS]\n");
+  gflags::ParseCommandLineFlags(&argc, &argv, true);
+  CHECK_GT(FLAGS_model.size(), 0) << "Need a model definition to benchmark.";
+  CHECK_GT(FLAGS_iterations, 0);
+  CHECK_GE(FLAGS_warmup, 0);
+  SetMode();
+
+  vector<int> shapes;
+  vector<string> items;
+  boost::split(items, FLAGS_shapes, boost::is_any_of(","));
+  for (int i = 0; i < items.size(); ++i) {
+    int height, width;
+    CHECK_EQ(2, sscanf(items[i].c_str(), "%dx%d", &height, &width))
+        << "Bad shape " << items[i] << ", expected heightxwidth";
+    CHECK_GT(height, 0);
+    CHECK_GT(width, 0);
+    shapes.push_back(height);
+    shapes.push_back(width);
+  }
+  vector<int> rois = ParseInts(FLAGS_rois);
+  if (rois.empty()) {
+    rois.push_back(0);
+  }
+  const vector<int> threads = ParseInts(FLAGS_threads);
+  const int max_threads = *std::max_element(threads.begin(), threads.end());
+
+  NetParameter param;
+  ReadNetParamsFromTextFileOrDie(FLAGS_model, &param);
+  param.mutable_state()->set_phase(TEST);
+  if (!FLAGS_zero_fill) {
+    param.set_zero_fill_activations(false);
+  }
+  vector<Result> results;
+  for (int r = 0; r < rois.size(); ++r) {
+    if (rois[r] > 0) {
+      for (int i = 0; i < param.layer_size(); ++i) {
+        if (param.layer(i).type() == "Proposal") {
+          param.mutable_layer(i)->mutable_proposal_param()->set_post_nms_topn(
+              rois[r]);
+        }
+      }
+    }
+    // The nets of the threads share the weights of the first.
+    vector<shared_ptr<Net<float> > > nets;
+    nets.push_back(shared_ptr<Net<float> >(new Net<float>(param)));
+    if (FLAGS_weights.size()) {
+      nets[0]->CopyTrainedLayersFrom(FLAGS_weights);
+    }
+    bool python = false;
+    for (int i = 0; i < nets[0]->layers().size(); ++i) {
+      python |= string(nets[0]->layers()[i]->type()) == "Python";
+    }
+    LOG_IF(WARNING, python && max_threads > 1)
+        << "Measuring the throughput on one thread: the net has Python layers";
+    for (int i = 1; i < (python ? 1 : max_threads); ++i) {
+      nets.push_back(shared_ptr<Net<float> >(new Net<float>(param)));
+      nets.back()->ShareTrainedLayersWith(nets[0].get());
+    }
+    for (int s = 0; s < shapes.size(); s += 2) {
+      results.push_back(
+          Measure(nets, rois[r], shapes[s], shapes[s + 1], threads));
+      Log(results.back());
+    }
+  }
+  if (FLAGS_output.size()) {
+    WriteJSON(results, FLAGS_output);
+  }
   return 0;
 }
@@ -0,0 +1,146 @@
+// This program measures the batch handoff of the prefetch queues: producers
+// take slots from a free queue, stamp them and push them to a full queue, and
+// consumers pop them, record the latency and recycle them, as the data layers
+// and DataReader do. It compares BlockingQueue with LockFreeQueue.
+// Usage:
+//    queue_benchmark [--producers=1] [--consumers=8] [--slots=16]
+//        [--items=200000] [--spin_count=1000]
+
+#include <stdint.h>
+#include <time.h>
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include "boost/bind.hpp"
+#include "boost/thread.hpp"
+#include "gflags/gflags.h"
+#include "glog/logging.h"
+
+#include "caffe/proto/caffe.pb.h"
+#include "caffe/util/blocking_queue.hpp"
+#include "caffe/util/lock_free_queue.hpp"
+
+using namespace caffe;  // NOLINT(build/namespaces)
+
+DEFINE_int32(producers, 1, "The number of threads filling slots");
+DEFINE_int32(consumers, 8, "The number of threads reading slots");
+DEFINE_int32(slots, 16, "The number of slots circulating in the queues");
+DEFINE_int32(items, 200000, "The number of slots handed off in total");
+DEFINE_int32(spin_count, 1000,
+    "How often LockFreeQueue retries before it parks a waiting thread");
+
+static int64_t NowNs() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return static_cast<int64_t>(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+}
+
+// The slots are Datum pointers, as in the DataReader queues; a NULL slot
+// tells a consumer to stop.
+struct Handoff {
+  vector<Datum> slots;
+  vector<int64_t> stamps;
+  vector<vector<int64_t> > latencies;
+};
+
+template <typename Queue>
+void Produce(Queue* free_queue, Queue* full_queue, Handoff* handoff,
+    int num_items) {
+  for (int i = 0; i < num_items; ++i) {
+    Datum* slot = free_queue->pop();
+    handoff->stamps[slot - &handoff->slots[0]] = NowNs();
+    full_queue->push(slot);
+  }
+}
+
+template <typename Queue>
+void Consume(Queue* free_queue, Queue* full_queue, Handoff* handoff,
+    int consumer_id) {
+  vector<int64_t>& latencies = handoff->latencies[consumer_id];
+  for (;;) {
+    Datum* slot = full_queue->pop();
+    if (slot == NULL) {
+      return;
+    }
+    latencies.push_back(NowNs() - handoff->stamps[slot - &handoff->slots[0]]);
+    free_queue->push(slot);
+  }
+}
+
+template <typename Queue>
+void Run(const string& name, Queue* free_queue, Queue* full_queue) {
+  Handoff handoff;
+  handoff.slots.resize(FLAGS_slots);
+  handoff.stamps.resize(FLAGS_slots);
+  handoff.latencies.resize(FLAGS_consumers);
+  for (int i = 0; i < FLAGS_slots; ++i) {
+    free_queue->push(&handoff.slots[i]);
+  }
+  const int64_t start = NowNs();
+  boost::thread_group consumers, producers;
+  for (int i = 0; i < FLAGS_consumers; ++i) {
+    consumers.create_thread(boost::bind(&Consume<Queue>, free_queue,
+        full_queue, &handoff, i));
+  }
+  for (int i = 0; i < FLAGS_producers; ++i) {
+    producers.create_thread(boost::bind(&Produce<Queue>, free_queue,
+        full_queue, &handoff, FLAGS_items / FLAGS_producers));
+  }
+  producers.join_all();
+  for (int i = 0; i < FLAGS_consumers; ++i) {
+    full_queue->push(static_cast<Datum*>(NULL));
+  }
+  consumers.join_all();
+  const double seconds = (NowNs() - start) * 1e-9;
+
+  vector<int64_t> latencies;
+  for (int i = 0; i < FLAGS_consumers; ++i) {
+    latencies.insert(latencies.end(), handoff.latencies[i].begin(),
+        handoff.latencies[i].end());
+  }
+  std::sort(latencies.begin(), latencies.end());
+  double mean = 0;
+  for (int i = 0; i < latencies.size(); ++i) {
+    mean += latencies[i];
+  }
+  mean /= latencies.size();
+  LOG(INFO) << name << ": " << latencies.size() / seconds << " handoffs/s, "
+      << "latency mean " << mean / 1000 << " us, median "
+      << latencies[latencies.size() / 2] / 1000. << " us, 99% "
+      << latencies[latencies.size() * 99 / 100] / 1000. << " us";
+}
+
+int main(int argc, char** argv) {
+  ::google::InitGoogleLogging(argv[0]);
+  FLAGS_alsologtostderr = 1;
+
+#ifndef GFLAGS_GFLAGS_H_
+  namespace gflags = google;
+#endif
+
+  gflags::SetUsageMessage("Measure the batch handoff latency of the queues\n"
+        "Usage:\n"
+        "    queue_benchmark [FLAGS]\n");
+  gflags::ParseCommandLineFlags(&argc, &argv, true);
+  CHECK_GT(FLAGS_producers, 0);
+  CHECK_GT(FLAGS_consumers, 0);
+  CHECK_GT(FLAGS_slots, 0);
+  CHECK_GE(FLAGS_items, FLAGS_producers);
+
+  LOG(INFO) << FLAGS_producers << " producers, " << FLAGS_consumers
+      << " consumers, " << FLAGS_slots << " slots";
+  {
+    BlockingQueue<Datum*> free_queue, full_queue;
+    Run("BlockingQueue", &free_queue, &full_queue);
+  }
+  {
+    // The full queue also holds the stop markers.
+    LockFreeQueue<Datum*> free_queue(FLAGS_slots, FLAGS_spin_count);
+    LockFreeQueue<Datum*> full_queue(FLAGS_slots + FLAGS_consumers,
+        FLAGS_spin_count);
+    Run("LockFreeQueue", &free_queue, &full_queue);
+  }
+  return 0;
+}
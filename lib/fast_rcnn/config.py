@@ -151,6 +151,13 @@ __C.TEST.BBOX_REG = True
 # Propose boxes
 __C.TEST.HAS_RPN = False
 
+# Images per forward pass; above 1, test_net pads images of similar size
+# into one batch and runs them through caffe.BatchDetector
+__C.TEST.BATCH_SIZE = 1
+
+# Images are batched by their size rounded up to a multiple of this
+__C.TEST.BUCKET_STEP = 32
+
 # Test using these proposals
 __C.TEST.PROPOSAL_METHOD = 'selective_search'
 
@@ -7,7 +7,7 @@
 
 from fast_rcnn.config import cfg
 from nms.gpu_nms import gpu_nms
-from nms.cpu_nms import cpu_nms
+from nms.cpu_nms import cpu_nms, cpu_nms_batched
 
 def nms(dets, thresh, force_cpu=False):
     """Dispatch to either CPU or GPU NMS implementations."""
@@ -18,3 +18,12 @@ def nms(dets, thresh, force_cpu=False):
         return gpu_nms(dets, thresh, device_id=cfg.GPU_ID)
     else:
         return cpu_nms(dets, thresh)
+
+def nms_batched(dets_list, thresh, force_cpu=False):
+    """Apply NMS to each array of detections in dets_list (e.g., one per
+    class) and return the list of kept indices of each."""
+
+    if cfg.USE_GPU_NMS and not force_cpu:
+        return [nms(dets, thresh) for dets in dets_list]
+    else:
+        return cpu_nms_batched(dets_list, thresh)
@@ -14,9 +14,9 @@ from utils.timer import Timer
 import numpy as np
 import cv2
 import caffe
-from fast_rcnn.nms_wrapper import nms
+from fast_rcnn.nms_wrapper import nms_batched
 import cPickle
-from utils.blob import im_list_to_blob
+from utils.blob import im_list_to_blob, prep_im_for_blob
 import os
 
 def _get_image_blob(im):
@@ -183,6 +183,67 @@ def im_detect(net, im, boxes=None):
 
     return scores, pred_boxes
 
+def batch_detector(net):
+    """Make a caffe.BatchDetector running net as cfg.TEST asks."""
+    detector = caffe.BatchDetector(net, cfg.TEST.BATCH_SIZE,
+                                   cfg.TEST.BUCKET_STEP)
+    if cfg.TEST.SVM:
+        detector.set_score_blob('cls_score')
+    detector.set_bbox_reg(cfg.TEST.BBOX_REG)
+    return detector
+
+def im_detect_batch(detector, ims, boxes=None):
+    """Detect object classes in several images given object proposals.
+
+    The images go through the net in batches of similar size, padded to a
+    common size, so that the net is only reshaped once per batch.
+
+    Arguments:
+        detector (caffe.BatchDetector): detector running the network
+        ims (list): color images to test (in BGR order)
+        boxes (list): R x 4 arrays of object proposals of each image or None
+            (for RPN)
+
+    Returns:
+        detections (list): the (scores, boxes) arrays of each image, as
+            im_detect returns them
+    """
+    assert len(cfg.TEST.SCALES) == 1, \
+        "Only single-scale testing is implemented for batches"
+    processed_ims = []
+    im_scales = []
+    for im in ims:
+        processed_im, im_scale = prep_im_for_blob(
+            im, cfg.PIXEL_MEANS, cfg.TEST.SCALES[0], cfg.TEST.MAX_SIZE)
+        processed_ims.append(np.ascontiguousarray(processed_im))
+        im_scales.append(im_scale)
+
+    inv_indices = None
+    if boxes is not None:
+        boxes = [np.ascontiguousarray(im_boxes, dtype=np.float32)
+                 for im_boxes in boxes]
+        # Only compute features on the unique feature ROIs, as im_detect
+        if cfg.DEDUP_BOXES > 0:
+            v = np.array([1e3, 1e6, 1e9, 1e12])
+            inv_indices = []
+            for i in xrange(len(boxes)):
+                hashes = np.round(boxes[i] * im_scales[i] *
+                                  cfg.DEDUP_BOXES).dot(v).astype(np.int)
+                _, index, inv_index = np.unique(hashes, return_index=True,
+                                                return_inverse=True)
+                boxes[i] = boxes[i][index, :]
+                inv_indices.append(inv_index)
+
+    detections = detector.detect(processed_ims, im_scales,
+                                 [im.shape for im in ims], boxes)
+
+    if inv_indices is not None:
+        # Map scores and predictions back to the original set of boxes
+        detections = [(scores[inv_index, :], pred_boxes[inv_index, :])
+                      for (scores, pred_boxes), inv_index
+                      in zip(detections, inv_indices)]
+    return detections
+
 def vis_detections(im, class_name, dets, thresh=0.3):
     """Visual debugging of detections."""
     import matplotlib.pyplot as plt
@@ -211,16 +272,17 @@ def apply_nms(all_boxes, thresh):
     nms_boxes = [[[] for _ in xrange(num_images)]
                  for _ in xrange(num_classes)]
     for cls_ind in xrange(num_classes):
-        for im_ind in xrange(num_images):
-            dets = all_boxes[cls_ind][im_ind]
-            if dets == []:
-                continue
-            # CPU NMS is much faster than GPU NMS when the number of boxes
-            # is relative small (e.g., < 10k)
-            # TODO(rbg): autotune NMS dispatch
-            keep = nms(dets, thresh, force_cpu=True)
+        im_inds = [im_ind for im_ind in xrange(num_images)
+                   if all_boxes[cls_ind][im_ind] != []]
+        # CPU NMS is much faster than GPU NMS when the number of boxes
+        # is relative small (e.g., < 10k)
+        # TODO(rbg): autotune NMS dispatch
+        keeps = nms_batched([all_boxes[cls_ind][im_ind] for im_ind in im_inds],
+                            thresh, force_cpu=True)
+        for im_ind, keep in zip(im_inds, keeps):
             if len(keep) == 0:
                 continue
+            dets = all_boxes[cls_ind][im_ind]
             nms_boxes[cls_ind][im_ind] = dets[keep, :].copy()
     return nms_boxes
 
@@ -241,7 +303,13 @@ def test_net(net, imdb, max_per_image=100, thresh=0.05, vis=False):
     if not cfg.TEST.HAS_RPN:
         roidb = imdb.roidb
 
-    for i in xrange(num_images):
+    # Batched testing reads several batches worth of images at a time, so
+    # that the detector can group them by size.
+    detector = batch_detector(net) if cfg.TEST.BATCH_SIZE > 1 else None
+    group_size = 8 * cfg.TEST.BATCH_SIZE if detector else 1
+
+    for start in xrange(0, num_images, group_size):
+        im_inds = range(start, min(start + group_size, num_images))
         # filter out any ground truth boxes
         if cfg.TEST.HAS_RPN:
             box_proposals = None
@@ -251,40 +319,64 @@ def test_net(net, imdb, max_per_image=100, thresh=0.05, vis=False):
             # detection on the *non*-ground-truth rois. We select those the rois
             # that have the gt_classes field set to 0, which means there's no
             # ground truth.
-            box_proposals = roidb[i]['boxes'][roidb[i]['gt_classes'] == 0]
+            box_proposals = [roidb[i]['boxes'][roidb[i]['gt_classes'] == 0]
+                             for i in im_inds]
 
-        im = cv2.imread(imdb.image_path_at(i))
+        ims = [cv2.imread(imdb.image_path_at(i)) for i in im_inds]
         _t['im_detect'].tic()
-        scores, boxes = im_detect(net, im, box_proposals)
+        if detector:
+            detections = im_detect_batch(detector, ims, box_proposals)
+        elif cfg.TEST.HAS_RPN:
+            detections = [im_detect(net, ims[0])]
+        else:
+            detections = [im_detect(net, ims[0], box_proposals[0])]
         _t['im_detect'].toc()
 
-        _t['misc'].tic()
-        # skip j = 0, because it's the background class
-        for j in xrange(1, imdb.num_classes):
-            inds = np.where(scores[:, j] > thresh)[0]
-            cls_scores = scores[inds, j]
-            cls_boxes = boxes[inds, j*4:(j+1)*4]
-            cls_dets = np.hstack((cls_boxes, cls_scores[:, np.newaxis])) \
-                .astype(np.float32, copy=False)
-            keep = nms(cls_dets, cfg.TEST.NMS)
-            cls_dets = cls_dets[keep, :]
-            if vis:
-                vis_detections(im, imdb.classes[j], cls_dets)
-            all_boxes[j][i] = cls_dets
-
-        # Limit to max_per_image detections *over all classes*
-        if max_per_image > 0:
-            image_scores = np.hstack([all_boxes[j][i][:, -1]
-                                      for j in xrange(1, imdb.num_classes)])
-            if len(image_scores) > max_per_image:
-                image_thresh = np.sort(image_scores)[-max_per_image]
+        for i, im, (scores, boxes) in zip(im_inds, ims, detections):
+            _t['misc'].tic()
+            if detector:
+                # Threshold, NMS and max_per_image of all the classes at once
+                all_cls_dets = caffe.BatchDetector.suppress(
+                    scores, boxes, thresh, cfg.TEST.NMS, max_per_image)
                 for j in xrange(1, imdb.num_classes):
-                    keep = np.where(all_boxes[j][i][:, -1] >= image_thresh)[0]
-                    all_boxes[j][i] = all_boxes[j][i][keep, :]
-        _t['misc'].toc()
+                    all_boxes[j][i] = all_cls_dets[j - 1]
+                    if vis:
+                        vis_detections(im, imdb.classes[j], all_boxes[j][i])
+                _t['misc'].toc()
+                continue
 
+            # skip j = 0, because it's the background class
+            all_cls_dets = []
+            for j in xrange(1, imdb.num_classes):
+                inds = np.where(scores[:, j] > thresh)[0]
+                cls_scores = scores[inds, j]
+                cls_boxes = boxes[inds, j*4:(j+1)*4]
+                all_cls_dets.append(
+                    np.hstack((cls_boxes, cls_scores[:, np.newaxis]))
+                    .astype(np.float32, copy=False))
+            # NMS of all the classes at once
+            keeps = nms_batched(all_cls_dets, cfg.TEST.NMS)
+            for j in xrange(1, imdb.num_classes):
+                cls_dets = all_cls_dets[j - 1][keeps[j - 1], :]
+                if vis:
+                    vis_detections(im, imdb.classes[j], cls_dets)
+                all_boxes[j][i] = cls_dets
+
+            # Limit to max_per_image detections *over all classes*
+            if max_per_image > 0:
+                image_scores = np.hstack([all_boxes[j][i][:, -1]
+                                          for j in xrange(1, imdb.num_classes)])
+                if len(image_scores) > max_per_image:
+                    image_thresh = np.sort(image_scores)[-max_per_image]
+                    for j in xrange(1, imdb.num_classes):
+                        keep = np.where(all_boxes[j][i][:, -1] >= image_thresh)[0]
+                        all_boxes[j][i] = all_boxes[j][i][keep, :]
+            _t['misc'].toc()
+
+        # Times per image
         print 'im_detect: {:d}/{:d} {:.3f}s {:.3f}s' \
-              .format(i + 1, num_images, _t['im_detect'].average_time,
+              .format(im_inds[-1] + 1, num_images,
+                      _t['im_detect'].total_time / (im_inds[-1] + 1),
                       _t['misc'].average_time)
 
     det_file = os.path.join(output_dir, 'detections.pkl')
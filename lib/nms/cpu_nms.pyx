@@ -5,64 +5,53 @@
 # Written by Ross Girshick
 # --------------------------------------------------------
 
+from libcpp.vector cimport vector
+
 import numpy as np
 cimport numpy as np
 
-cdef inline np.float32_t max(np.float32_t a, np.float32_t b):
-    return a if a >= b else b
+cdef extern from "caffe/util/nms.hpp" namespace "caffe":
+    void nms_cpu[Dtype](int num_boxes, const Dtype* boxes, Dtype thresh,
+                        vector[int]* keep, int max_keep) nogil
+    void nms_cpu_batched[Dtype](const vector[int]& offsets,
+                                const Dtype* boxes, Dtype thresh,
+                                vector[vector[int]]* keep,
+                                int max_keep) nogil
 
-cdef inline np.float32_t min(np.float32_t a, np.float32_t b):
-    return a if a <= b else b
+def _sorted_boxes(dets, order):
+    return np.ascontiguousarray(dets[order, :4], dtype=np.float32)
 
 def cpu_nms(np.ndarray[np.float32_t, ndim=2] dets, np.float thresh):
-    cdef np.ndarray[np.float32_t, ndim=1] x1 = dets[:, 0]
-    cdef np.ndarray[np.float32_t, ndim=1] y1 = dets[:, 1]
-    cdef np.ndarray[np.float32_t, ndim=1] x2 = dets[:, 2]
-    cdef np.ndarray[np.float32_t, ndim=1] y2 = dets[:, 3]
-    cdef np.ndarray[np.float32_t, ndim=1] scores = dets[:, 4]
-
-    cdef np.ndarray[np.float32_t, ndim=1] areas = (x2 - x1 + 1) * (y2 - y1 + 1)
-    cdef np.ndarray[np.int_t, ndim=1] order = scores.argsort()[::-1]
+    """Greedy NMS of the (x1, y1, x2, y2, score) rows of dets.
 
+    Returns the indices of the kept rows by decreasing score.
+    """
+    cdef np.ndarray[np.int_t, ndim=1] order = dets[:, 4].argsort()[::-1]
+    cdef np.ndarray[np.float32_t, ndim=2] boxes = _sorted_boxes(dets, order)
     cdef int ndets = dets.shape[0]
-    cdef np.ndarray[np.int_t, ndim=1] suppressed = \
-            np.zeros((ndets), dtype=np.int)
-
-    # nominal indices
-    cdef int _i, _j
-    # sorted indices
-    cdef int i, j
-    # temp variables for box i's (the box currently under consideration)
-    cdef np.float32_t ix1, iy1, ix2, iy2, iarea
-    # variables for computing overlap with box j (lower scoring box)
-    cdef np.float32_t xx1, yy1, xx2, yy2
-    cdef np.float32_t w, h
-    cdef np.float32_t inter, ovr
-
-    keep = []
-    for _i in range(ndets):
-        i = order[_i]
-        if suppressed[i] == 1:
-            continue
-        keep.append(i)
-        ix1 = x1[i]
-        iy1 = y1[i]
-        ix2 = x2[i]
-        iy2 = y2[i]
-        iarea = areas[i]
-        for _j in range(_i + 1, ndets):
-            j = order[_j]
-            if suppressed[j] == 1:
-                continue
-            xx1 = max(ix1, x1[j])
-            yy1 = max(iy1, y1[j])
-            xx2 = min(ix2, x2[j])
-            yy2 = min(iy2, y2[j])
-            w = max(0.0, xx2 - xx1 + 1)
-            h = max(0.0, yy2 - yy1 + 1)
-            inter = w * h
-            ovr = inter / (iarea + areas[j] - inter)
-            if ovr >= thresh:
-                suppressed[j] = 1
-
-    return keep
+    cdef vector[int] keep
+    if ndets > 0:
+        with nogil:
+            nms_cpu[float](ndets, &boxes[0, 0], thresh, &keep, 0)
+    return list(order[keep])
+
+def cpu_nms_batched(dets_list, np.float thresh):
+    """Runs cpu_nms on each array of dets_list in a single call, with the
+    arrays spread over threads.
+
+    Returns the list of kept indices of each array.
+    """
+    cdef vector[int] offsets
+    offsets.push_back(0)
+    orders = []
+    for dets in dets_list:
+        orders.append(dets[:, 4].argsort()[::-1])
+        offsets.push_back(offsets.back() + dets.shape[0])
+    if offsets.back() == 0:
+        return [[] for _ in dets_list]
+    cdef np.ndarray[np.float32_t, ndim=2] boxes = np.vstack(
+        [_sorted_boxes(dets, order) for dets, order in zip(dets_list, orders)])
+    cdef vector[vector[int]] keep
+    with nogil:
+        nms_cpu_batched[float](offsets, &boxes[0, 0], thresh, &keep, 0)
+    return [list(order[group_keep]) for order, group_keep in zip(orders, keep)]
@@ -58,6 +58,10 @@ def locate_cuda():
 CUDA = locate_cuda()
 
 
+# The C++ NMS is shared with the Caffe layers.
+CAFFE_ROOT = os.path.join(os.path.dirname(os.path.abspath(__file__)),
+                          '..', 'caffe-fast-rcnn')
+
 # Obtain the numpy include directory.  This logic works across numpy versions.
 try:
     numpy_include = np.get_include()
@@ -118,9 +122,12 @@ ext_modules = [
     ),
     Extension(
         "nms.cpu_nms",
-        ["nms/cpu_nms.pyx"],
-        extra_compile_args={'gcc': ["-Wno-cpp", "-Wno-unused-function"]},
-        include_dirs = [numpy_include]
+        ["nms/cpu_nms.pyx", CAFFE_ROOT + "/src/caffe/util/nms.cpp"],
+        language='c++',
+        extra_compile_args={'gcc': ["-Wno-cpp", "-Wno-unused-function",
+                                    "-fopenmp"]},
+        extra_link_args=["-fopenmp"],
+        include_dirs = [numpy_include, CAFFE_ROOT + "/include"]
     ),
     Extension('nms.gpu_nms',
         ['nms/nms_kernel.cu', 'nms/gpu_nms.pyx'],